@@ -3,7 +3,12 @@
  */
 
 // system lib
+#ifdef __ANDROID__
 #include <asm/ptrace.h>
+#else
+// glibc的 sys/ptrace.h 和 asm/ptrace.h 不能同时包含, user_regs_struct 在 sys/user.h 里
+#include <sys/user.h>
+#endif
 #include <sys/ptrace.h>
 #include <sys/wait.h>
 #include <stdio.h>
@@ -19,6 +24,10 @@
 
 // user lib
 #include "Utils.h"
+#include "remote_memory.h"
+#include "remote_arena.h"
+#include "inject_stub.h"
+#include "remote_syscall.h"
 
 // 各构架预定义
 #if defined(__aarch64__) // 真机64位
@@ -51,6 +60,7 @@
 #define eax rax
 #define esp rsp
 #define eip rip
+#define BREAKPOINT_INSTR 0xCC // int3, 停下来的时候rip已经指向下一条指令
 #elif defined(__i386__) // 模拟器
 #define pt_regs user_regs_struct
 #endif
@@ -202,45 +212,71 @@ long ptrace_getpc(struct pt_regs *regs) {
 #endif
 }
 
+/**
+ * @brief 修改要执行代码的地址,需要 ptrace_setregs 写回远程进程
+ * @param regs regs存储远程进程当前的寄存器值
+ * @param pc 新的pc
+ */
+void ptrace_setpc(struct pt_regs *regs, uintptr_t pc) {
+#if defined(__i386__) || defined(__x86_64__)
+    regs->eip = pc;
+#elif defined(__arm__) || defined(__aarch64__)
+    regs->ARM_pc = pc;
+#else
+    LOGE("Not supported Environment %s\n", __FUNCTION__);
+#endif
+}
+
+/**
+ * @brief 获取栈顶地址
+ * @param regs regs存储远程进程当前的寄存器值
+ * @return 返回sp寄存器值
+ */
+long ptrace_getsp(struct pt_regs *regs) {
+#if defined(__i386__) || defined(__x86_64__)
+    return regs->esp;
+#elif defined(__arm__) || defined(__aarch64__)
+    return regs->ARM_sp;
+#else
+    LOGE("Not supported Environment %s\n", __FUNCTION__);
+#endif
+}
+
+/**
+ * @brief 在函数入口处获取第一个参数, x86_64是rdi, ARM是r0/x0
+ * @param regs regs存储远程进程当前的寄存器值
+ * @return 返回第一个参数
+ */
+long ptrace_getarg0(struct pt_regs *regs) {
+#if defined(__x86_64__)
+    return regs->rdi;
+#elif defined(__arm__) || defined(__aarch64__)
+    return regs->ARM_r0;
+#else
+    LOGE("Not supported Environment %s\n", __FUNCTION__);
+#endif
+}
+
 
 
 /**
- * @brief 使用ptrace从远程进程内存中读取数据
- * 这里的*_t类型是typedef定义一些基本类型的别名，用于跨平台。例如uint8_t表示无符号8位也就是无符号的char类型
+ * @brief 从远程进程内存中读取数据
+ * 走 RemoteMemory, 一般是一次 process_vm_readv, 失败的部分用 /proc/pid/mem, 最后才用 PTRACE_PEEKDATA
  * @param pid pid表示远程进程的ID
  * @param pSrcBuf pSrcBuf表示从远程进程读取数据的内存地址
  * @param pDestBuf pDestBuf表示用于存储读取出数据的地址
  * @param size size表示读取数据的大小
- * @return 返回0表示读取数据成功
+ * @return 返回0表示读取数据成功，返回-1表示读取数据失败
  */
 int ptrace_readdata(pid_t pid, uint8_t *pSrcBuf, uint8_t *pDestBuf, size_t size) {
-    long nReadCount = 0;
-    long nRemainCount = 0;
-    uint8_t *pCurSrcBuf = pSrcBuf;
-    uint8_t *pCurDestBuf = pDestBuf;
-    long lTmpBuf = 0;
-    long i = 0;
-
-    nReadCount = size / sizeof(long);
-    nRemainCount = size % sizeof(long);
-
-    for (i = 0; i < nReadCount; i++) {
-        lTmpBuf = ptrace(PTRACE_PEEKTEXT, pid, pCurSrcBuf, 0);
-        memcpy(pCurDestBuf, (char *) (&lTmpBuf), sizeof(long));
-        pCurSrcBuf += sizeof(long);
-        pCurDestBuf += sizeof(long);
-    }
-
-    if (nRemainCount > 0) {
-        lTmpBuf = ptrace(PTRACE_PEEKTEXT, pid, pCurSrcBuf, 0);
-        memcpy(pCurDestBuf, (char *) (&lTmpBuf), nRemainCount);
-    }
-
-    return 0;
+    RemoteMemory mem(pid);
+    return mem.read((uintptr_t) pSrcBuf, pDestBuf, size) ? 0 : -1;
 }
 
 /**
- * @brief 使用ptrace将数据写入到远程进程空间中
+ * @brief 将数据写入到远程进程空间中
+ * 一个100字节的路径用 POKETEXT 要13次系统调用, 这里一般是一次 process_vm_writev,
+ * 只读页(比如往r-x代码段下断点)用 /proc/pid/mem, 最后才用 PTRACE_POKEDATA
  *
  * @param pid pid表示远程进程的ID
  * @param pWriteAddr pWriteAddr表示写入数据到远程进程的内存地址
@@ -249,35 +285,10 @@ int ptrace_readdata(pid_t pid, uint8_t *pSrcBuf, uint8_t *pDestBuf, size_t size)
  * @return int 返回0表示写入数据成功，返回-1表示写入数据失败
  */
 int ptrace_writedata(pid_t pid, uint8_t *pWriteAddr, uint8_t *pWriteData, size_t size){
-
-    long nWriteCount = 0;
-    long nRemainCount = 0;
-    uint8_t *pCurSrcBuf = pWriteData;
-    uint8_t *pCurDestBuf = pWriteAddr;
-    long lTmpBuf = 0;
-    long i = 0;
-
-    nWriteCount = size / sizeof(long);
-    nRemainCount = size % sizeof(long);
-
-    // 先讲数据以sizeof(long)字节大小为单位写入到远程进程内存空间中
-    for (i = 0; i < nWriteCount; i++){
-        memcpy((void *)(&lTmpBuf), pCurSrcBuf, sizeof(long));
-        if (ptrace(PTRACE_POKETEXT, pid, (void *)pCurDestBuf, (void *)lTmpBuf) < 0){ // PTRACE_POKETEXT表示从远程内存空间写入一个sizeof(long)大小的数据
-            LOGE("[-] Write Remote Memory error, MemoryAddr:0x%lx, err:%s\n", (uintptr_t)pCurDestBuf, strerror(errno));
-            return -1;
-        }
-        pCurSrcBuf += sizeof(long);
-        pCurDestBuf += sizeof(long);
-    }
-    // 将剩下的数据写入到远程进程内存空间中
-    if (nRemainCount > 0){
-        lTmpBuf = ptrace(PTRACE_PEEKTEXT, pid, pCurDestBuf, NULL); //先取出原内存中的数据，然后将要写入的数据以单字节形式填充到低字节处
-        memcpy((void *)(&lTmpBuf), pCurSrcBuf, nRemainCount);
-        if (ptrace(PTRACE_POKETEXT, pid, pCurDestBuf, lTmpBuf) < 0){
-            LOGE("[-] Write Remote Memory error, MemoryAddr:0x%lx, err:%s\n", (uintptr_t)pCurDestBuf, strerror(errno));
-            return -1;
-        }
+    RemoteMemory mem(pid);
+    if (!mem.write((uintptr_t) pWriteAddr, pWriteData, size)) {
+        LOGE("[-] Write Remote Memory error, MemoryAddr:0x%lx, err:%s\n", (uintptr_t)pWriteAddr, strerror(errno));
+        return -1;
     }
     return 0;
 }
@@ -353,6 +364,11 @@ int ptrace_call(pid_t pid, uintptr_t ExecuteAddr, long *parameters, long num_par
     if (num_params > 5)
         regs->r9 = parameters[5];
 
+    // 跳过128字节的red zone, 压入返回地址之前rsp要16字节对齐, 不然libc里的SSE指令会崩
+    regs->esp = (regs->esp - 128) & ~0xfUL;
+    if (num_param_registers < num_params && (num_params - num_param_registers) % 2 != 0){
+        regs->esp -= sizeof(long);
+    }
     if (num_param_registers < num_params){
         regs->esp -= (num_params - num_param_registers) * sizeof(long); // 分配栈空间，栈的方向是从高地址到低地址
         if (0 != ptrace_writedata(pid, (uint8_t *)regs->esp, (uint8_t *)&parameters[num_param_registers], (num_params - num_param_registers) * sizeof(long))){
@@ -368,6 +384,8 @@ int ptrace_call(pid_t pid, uintptr_t ExecuteAddr, long *parameters, long num_par
 
     //设置eip寄存器为需要调用的函数地址
     regs->eip = ExecuteAddr;
+    // 进程停在系统调用里(比如pause)的时候, 继续运行时内核会按系统调用重启把rip往回退2个字节
+    regs->orig_rax = -1;
 
     // 开始执行
     if (-1 == ptrace_setregs(pid, regs) || -1 == ptrace_continue(pid)){
@@ -390,6 +408,12 @@ int ptrace_call(pid_t pid, uintptr_t ExecuteAddr, long *parameters, long num_par
         waitpid(pid, &stat, WUNTRACED);
     }
 
+    // 获取远程进程的寄存器值，方便获取返回值
+    if (ptrace_getregs(pid, regs) == -1){
+        LOGE("[-] After call getregs error");
+        return -1;
+    }
+
 #elif defined(__arm__) || defined(__aarch64__) // 真机
 #if defined(__arm__) // 32位真机
     int num_param_registers = 4;
@@ -488,78 +512,426 @@ int ptrace_call(pid_t pid, uintptr_t ExecuteAddr, long *parameters, long num_par
 }
 
 
-bool stop_int_app_process_entry(pid_t pid){
+/**
+ * @brief 在远程进程里执行一次系统调用, 不需要解析libc的符号, libc还没有映射的时候也能用
+ * 系统调用指令按顺序找: 进程停在系统调用里的时候pc前面那一条, vdso里的, 都没有就临时写到程序入口(AT_ENTRY)
+ * 单步执行这一条指令, 执行完恢复寄存器和写过的指令, 进程只运行一条指令
+ *
+ * @param mem 远程进程的内存
+ * @param regs 远程进程当前的寄存器, 执行完以后恢复成这个
+ * @param ret 系统调用的返回值, 失败的时候是 -errno
+ * @param nr 系统调用号, 目标进程构架的 __NR_xxx
+ * @param args 最多6个参数
+ * @return 返回true表示执行了系统调用, 当前构架不支持(32位)或者ptrace失败返回false
+ */
+bool remote_syscall_v(RemoteMemory &mem, const struct pt_regs *regs, long *ret, long nr, const long *args, size_t num_args){
+#if defined(__aarch64__) || defined(__x86_64__)
+    pid_t pid = mem.get_pid();
+    const uint8_t *insn;
+    size_t insn_size;
+    if (!syscall_insn(&insn, &insn_size) || num_args > 6) {
+        return false;
+    }
+    struct pt_regs SyscallRegs;
+    memcpy(&SyscallRegs, regs, sizeof(SyscallRegs));
+
+    uintptr_t site = 0;
+    uint8_t saved[4];
+    bool planted = false;
+    // 停在系统调用里的时候 x86_64 的pc在 syscall 后面, arm64 内核已经为了重启把pc退回到 svc 上
+    auto pc = (uintptr_t) ptrace_getpc(&SyscallRegs);
+    uint8_t around[8];
+    if (pc >= insn_size && mem.read(pc - insn_size, around, insn_size * 2)) {
+        if (memcmp(around, insn, insn_size) == 0) {
+            site = pc - insn_size;
+        } else if (memcmp(around + insn_size, insn, insn_size) == 0) {
+            site = pc;
+        }
+    }
+    if (site == 0 && vdso_syscall_offset() != 0) {
+        uintptr_t vdso = read_remote_auxv(pid, AT_SYSINFO_EHDR);
+        if (vdso != 0) {
+            site = vdso + vdso_syscall_offset();
+        }
+    }
+    if (site == 0) {
+        site = read_remote_auxv(pid, AT_ENTRY);
+        if (site == 0 || !mem.read(site, saved, insn_size) || !mem.write(site, insn, insn_size)) {
+            LOGE("[-][function:%s] no syscall instruction for %d", __func__, pid);
+            return false;
+        }
+        planted = true;
+    }
+
+    long a[6] = {};
+    memcpy(a, args, num_args * sizeof(long));
+#if defined(__x86_64__)
+    SyscallRegs.rax = nr;
+    SyscallRegs.rdi = a[0];
+    SyscallRegs.rsi = a[1];
+    SyscallRegs.rdx = a[2];
+    SyscallRegs.r10 = a[3];
+    SyscallRegs.r8 = a[4];
+    SyscallRegs.r9 = a[5];
+    // 跟 ptrace_call 一样, 不让内核按系统调用重启去改rip
+    SyscallRegs.orig_rax = -1;
+#elif defined(__aarch64__)
+    SyscallRegs.regs[8] = nr;
+    for (int i = 0; i < 6; i++) {
+        SyscallRegs.regs[i] = a[i];
+    }
+#endif
+    ptrace_setpc(&SyscallRegs, site);
+
+    bool ok = false;
+    int stat = 0;
+    if (ptrace_setregs(pid, &SyscallRegs) == 0 && ptrace(PTRACE_SINGLESTEP, pid, 0, 0) != -1) {
+        while (waitpid(pid, &stat, __WALL) != -1 && WIFSTOPPED(stat)) {
+            if (WSTOPSIG(stat) == SIGTRAP && (stat >> 16) == 0) {
+                ok = true;
+                break;
+            }
+            // 单步之前来了别的信号或者ptrace事件, 丢掉以后重新单步
+            LOGW("[-][function:%s] %d stopped by %x before syscall", __func__, pid, stat);
+            if (ptrace(PTRACE_SINGLESTEP, pid, 0, 0) == -1) {
+                break;
+            }
+        }
+    }
+    if (ok && ptrace_getregs(pid, &SyscallRegs) == 0 && (uintptr_t) ptrace_getpc(&SyscallRegs) == site + insn_size) {
+        *ret = ptrace_getret(&SyscallRegs);
+    } else {
+        LOGE("[-][function:%s] syscall %ld in %d did not complete", __func__, nr, pid);
+        ok = false;
+    }
+    if (planted) {
+        mem.write(site, saved, insn_size);
+    }
+    if (ptrace_setregs(pid, const_cast<struct pt_regs *>(regs)) != 0) {
+        return false;
+    }
+    return ok;
+#else
+    LOGE("[-] Not supported Environment %s\n", __FUNCTION__);
+    return false;
+#endif
+}
+
+template<typename... Args>
+bool remote_syscall(RemoteMemory &mem, const struct pt_regs *regs, long *ret, long nr, Args... args){
+    static_assert(sizeof...(Args) <= 6, "too many syscall args");
+    const long a[] = {(long) args..., 0};
+    return remote_syscall_v(mem, regs, ret, nr, a, sizeof...(Args));
+}
+
+
+/**
+ * @brief 在远程进程中mmap一块可读写的匿名内存给arena使用
+ * 64位直接用 remote_syscall, 32位没有单步, 还是调用libc的mmap
+ *
+ * @param mem 远程进程的内存
+ * @param arena 成功以后arena指向这块内存
+ * @param regs 远程进程call函数前的寄存器环境
+ * @param return_addr ptrace_call 使用的返回地址
+ * @param size 映射的大小
+ * @return 返回true表示映射成功
+ */
+bool remote_arena_map(RemoteMemory &mem, RemoteArena &arena, struct pt_regs *regs, uintptr_t return_addr,
+                      size_t size = RemoteArena::kDefaultSize){
+    long addr = 0;
+#if defined(__aarch64__) || defined(__x86_64__)
+    // void *mmap(void *start, size_t length, int prot, int flags, int fd, off_t offsize);
+    if (!remote_syscall(mem, regs, &addr, __NR_mmap, 0, size, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0)) {
+        return false;
+    }
+    if (addr < 0 && addr > -4096) {
+        LOGE("[-][function:%s] Remote mmap failed: %s\n", __func__, strerror(-addr));
+        return false;
+    }
+#else
+    pid_t pid = mem.get_pid();
+    void *mmap_addr = find_func_addr(pid, "libc.so", "mmap");
+    long parameters[6];
+    parameters[0] = 0; // 设置为NULL表示让系统自动选择分配内存的地址
+    parameters[1] = (long) size; // 映射内存的大小
+    parameters[2] = PROT_READ | PROT_WRITE; // 表示映射内存区域 可读|可写
+    parameters[3] = MAP_ANONYMOUS | MAP_PRIVATE; // 建立匿名映射
+    parameters[4] = -1; //  若需要映射文件到内存中，则为文件的fd
+    parameters[5] = 0; //文件映射偏移量
+    if (ptrace_call(pid, (uintptr_t) mmap_addr, parameters, 6, regs, return_addr) == -1) {
+        LOGE("[-][function:%s] Call Remote mmap Func Failed, err:%s\n", __func__, strerror(errno));
+        return false;
+    }
+    addr = ptrace_getret(regs);
+    if (addr == 0 || addr == (long) MAP_FAILED) {
+        LOGE("[-][function:%s] Remote mmap failed, return value=%lX\n", __func__, addr);
+        return false;
+    }
+#endif
+    LOGD("[+][function:%s] Remote Process Map Memory Addr:0x%lx\n", __func__, addr);
+    arena.attach(addr, size);
+    return true;
+}
+
+/**
+ * @brief 会话结束时munmap arena的映射,不再在目标进程里留下匿名映射
+ *
+ * @param mem 远程进程的内存
+ * @param arena 没有映射的时候什么都不做
+ * @param regs 远程进程call函数前的寄存器环境
+ * @param return_addr ptrace_call 使用的返回地址
+ * @return 返回true表示释放成功
+ */
+bool remote_arena_unmap(RemoteMemory &mem, RemoteArena &arena, struct pt_regs *regs, uintptr_t return_addr){
+    if (!arena.is_mapped()) {
+        return true;
+    }
+    size_t size = arena.get_size();
+    uintptr_t base = arena.detach();
+    long ret = -1;
+#if defined(__aarch64__) || defined(__x86_64__)
+    if (!remote_syscall(mem, regs, &ret, __NR_munmap, base, size)) {
+        return false;
+    }
+#else
+    pid_t pid = mem.get_pid();
+    void *munmap_addr = find_func_addr(pid, "libc.so", "munmap");
+    long parameters[2] = {(long) base, (long) size};
+    if (ptrace_call(pid, (uintptr_t) munmap_addr, parameters, 2, regs, return_addr) == -1) {
+        LOGE("[-][function:%s] Call Remote munmap Func Failed\n", __func__);
+        return false;
+    }
+    ret = ptrace_getret(regs);
+#endif
+    if (ret != 0) {
+        LOGE("[-][function:%s] Remote munmap %lx failed\n", __func__, base);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief 按要写入的数据算arena的大小,至少 RemoteArena::kDefaultSize,按页对齐
+ */
+size_t remote_arena_size_for(size_t payload){
+    size_t size = (payload + 256 + 0xfff) & ~(size_t) 0xfff;
+    return size < RemoteArena::kDefaultSize ? RemoteArena::kDefaultSize : size;
+}
+
+/**
+ * @brief 用 inject_stub 让目标进程只运行一次就完成 dlopen -> dlsym -> 调用用户函数
+ * 邮箱和字符串放在当前栈指针下面(arena 直接挂在这段栈上, 不需要mmap),
+ * stub 临时写到程序入口(AT_ENTRY)处, 入口代码只在启动时执行一次, 其他线程不会执行到,
+ * 停在 stub 结尾以后恢复原来的代码, 寄存器由调用方恢复
+ *
+ * @param mem 远程进程的内存
+ * @param box dlopen/dlsym/dlerror 的地址由调用方填好, 返回1的时候是 stub 写回的结果
+ * @param regs 远程进程当前的寄存器, 不会修改
+ * @return 1 执行到了 stub 结尾, 0 进程运行了但是没有停在 stub 结尾,
+ *         -1 没有运行进程(当前构架没有stub,入口或者栈写不进去), 调用方可以改用 ptrace_call
+ */
+int ptrace_call_inject_stub(RemoteMemory &mem, InjectMailbox &box,
+                            const char *LibPath, const char *FunctionName, const char *FunctionArgs,
+                            const struct pt_regs *regs){
+    pid_t pid = mem.get_pid();
+    const uint8_t *code;
+    size_t code_size;
+    if (!inject_stub_code(&code, &code_size)) {
+        return -1;
+    }
+    uintptr_t site = read_remote_auxv(pid, AT_ENTRY);
+    // 检查入口所在的映射
+    ProcMapQuery query(pid);
+    auto site_map = query.find(site);
+    if (site_map == nullptr || site + code_size > site_map->end || (site_map->perms & PROT_EXEC) == 0) {
+        LOGW("[-][function:%s] no room for inject stub at entry %lx", __func__, site);
+        return -1;
+    }
+
+    struct pt_regs StubRegs;
+    memcpy(&StubRegs, regs, sizeof(StubRegs));
+    // 栈指针下面留出256字节(x86_64的red zone是128字节), 再往下是arena, stub 的栈从arena下面开始
+    // 邮箱按8字节对齐, 多留16字节
+    size_t payload = sizeof(InjectMailbox) + strlen(LibPath) + strlen(FunctionName) + strlen(FunctionArgs) + 3 + 16;
+    uintptr_t top = ((uintptr_t) ptrace_getsp(&StubRegs) - 256) & ~(uintptr_t) 15;
+    uintptr_t base = (top - payload) & ~(uintptr_t) 15;
+    RemoteArena arena;
+    arena.attach(base, top - base);
+    box.lib_path = arena.push_string(LibPath);
+    box.function_name = arena.push_string(FunctionName);
+    box.function_args = arena.push_string(FunctionArgs);
+    box.handle = box.symbol = box.ret = 0;
+    box.error[0] = '\0';
+    uintptr_t box_addr = arena.push(&box, sizeof(box), 8);
+    std::vector<uint8_t> saved(code_size);
+    if (box_addr == 0 || !arena.flush(mem) || !mem.read(site, saved.data(), code_size)) {
+        LOGW("[-][function:%s] write inject mailbox failed", __func__);
+        return -1;
+    }
+    if (!mem.write(site, code, code_size)) {
+        LOGW("[-][function:%s] write inject stub at %lx failed", __func__, site);
+        // 可能写了一部分
+        mem.write(site, saved.data(), code_size);
+        return -1;
+    }
+
+#if defined(__x86_64__)
+    StubRegs.rdi = box_addr;
+    StubRegs.rsp = base;
+    // 跟 ptrace_call 一样, 不让内核按系统调用重启去改rip
+    StubRegs.orig_rax = -1;
+#elif defined(__aarch64__)
+    StubRegs.regs[0] = box_addr;
+    StubRegs.sp = base;
+#endif
+    ptrace_setpc(&StubRegs, site);
+
+    int result = 0;
+    if (ptrace_setregs(pid, &StubRegs) == -1 || ptrace_continue(pid) == -1) {
+        LOGE("[-][function:%s] ptrace set regs or continue error, pid:%d", __func__, pid);
+        mem.write(site, saved.data(), code_size);
+        return -1;
+    }
+    int stat = 0;
+    while (true) {
+        if (waitpid(pid, &stat, __WALL) == -1 || !WIFSTOPPED(stat)) {
+            LOGE("[-][function:%s] process %d gone while running inject stub", __func__, pid);
+            return 0;
+        }
+        int sig = WSTOPSIG(stat);
+        if (sig == SIGTRAP && (stat >> 16) == 0) {
+            break;
+        }
+        if (sig == SIGSEGV || sig == SIGBUS || sig == SIGILL) {
+            // dlopen 或者用户函数崩了, 不把信号交给进程, 由调用方恢复寄存器
+            LOGE("[-][function:%s] inject stub stopped by signal %d", __func__, sig);
+            break;
+        }
+        // ptrace事件和group-stop直接继续, 其他信号交还给进程
+        int deliver = ((stat >> 16) != 0 || sig == SIGSTOP) ? 0 : sig;
+        if (ptrace(PTRACE_CONT, pid, 0, deliver) == -1) {
+            PLOGE("continue %d", pid);
+            return 0;
+        }
+    }
+    struct pt_regs AfterRegs;
+    if (WSTOPSIG(stat) == SIGTRAP && ptrace_getregs(pid, &AfterRegs) == 0 &&
+        (uintptr_t) ptrace_getpc(&AfterRegs) == site + inject_stub_trap_offset() &&
+        mem.read(box_addr, &box)) {
+        result = 1;
+    } else if (WSTOPSIG(stat) == SIGTRAP) {
+        LOGE("[-][function:%s] inject stub stopped at unknown addr", __func__);
+    }
+    if (!mem.write(site, saved.data(), code_size)) {
+        LOGE("[-][function:%s] restore entry code at %lx failed", __func__, site);
+    }
+    return result;
+}
+
+
+/**
+ * @brief 修改auxv中的AT_ENTRY,让进程在执行到入口的时候触发SIGSEGV停下来
+ * 只做布置,不会让进程运行,进程运行以后由 on_app_process_entry_stop 处理停止事件
+ * argc/envp/auxv 一项一项的读取都在栈顶的一两页里, mem 开了缓存的话只需要一次系统调用
+ *
+ * 只有停在exec之后, 还没有执行用户态指令时sp才指向argc, 进程跑起来以后从sp往上找到的是栈上的其他数据,
+ * 所以找到的AT_ENTRY还要跟 /proc/pid/auxv 里内核保存的值一样才会改
+ *
+ * @param mem 远程进程的内存,进程需要停在exec之后
+ * @param entry 保存原始入口地址和AT_ENTRY所在的地址,恢复的时候使用
+ * @return 返回true表示布置成功
+ */
+bool arm_app_process_entry(RemoteMemory &mem, EntryStop &entry){
     struct pt_regs CurrentRegs;
-    if (ptrace_getregs(pid, &CurrentRegs) != 0){
+    if (ptrace_getregs(mem.get_pid(), &CurrentRegs) != 0){
         return false;
     }
-    auto arg = static_cast<uintptr_t>(CurrentRegs.sp);
-    int argc;
+    uintptr_t expected_entry = read_remote_auxv(mem.get_pid(), AT_ENTRY);
+    if (expected_entry == 0) {
+        LOGE("failed to read AT_ENTRY of %d", mem.get_pid());
+        return false;
+    }
+    auto arg = static_cast<uintptr_t>(ptrace_getsp(&CurrentRegs));
+    int argc = 0;
     auto argv = reinterpret_cast<char **>(reinterpret_cast<uintptr_t *>(arg) + 1);
-    read_proc(pid, arg,  (uintptr_t)&argc, sizeof(argc));
+    mem.read(arg, &argc);
     LOGV("argc %d", argc);
     auto envp = argv + argc + 1;
     LOGV("envp %p", envp);
     auto p = envp;
     while (true) {
-        uintptr_t *buf;
-        read_proc(pid, (uintptr_t) p,  (uintptr_t)&buf, sizeof(buf));
-        if (buf != nullptr) ++p;
+        uintptr_t buf = 0;
+        if (!mem.read((uintptr_t) p, &buf)) {
+            return false;
+        }
+        if (buf != 0) ++p;
         else break;
     }
     ++p;
     auto auxv = reinterpret_cast<ElfW(auxv_t) *>(p);
     auto v = auxv;
-    uintptr_t entry_addr = 0;
-    uintptr_t addr_of_entry_addr = 0;
+    entry.entry_addr = 0;
+    entry.addr_of_entry_addr = 0;
     while (true) {
         ElfW(auxv_t) buf;
-        read_proc(pid, (uintptr_t) v, (uintptr_t)&buf, sizeof(buf));
+        if (!mem.read((uintptr_t) v, &buf)) {
+            break;
+        }
         if (buf.a_type == AT_ENTRY) {
-            entry_addr = (uintptr_t) buf.a_un.a_val;
-            addr_of_entry_addr = (uintptr_t) v + offsetof(ElfW(auxv_t), a_un);
+            entry.entry_addr = (uintptr_t) buf.a_un.a_val;
+            entry.addr_of_entry_addr = (uintptr_t) v + offsetof(ElfW(auxv_t), a_un);
             break;
         }
         if (buf.a_type == AT_NULL) break;
         v++;
     }
-    if (entry_addr == 0) {
-        LOGE("failed to get entry");
+    if (entry.entry_addr != expected_entry) {
+        LOGE("failed to get entry, found %lx on stack, auxv says %lx", entry.entry_addr, expected_entry);
+        entry.entry_addr = 0;
+        entry.addr_of_entry_addr = 0;
         return false;
     }
 
-    uintptr_t break_addr = (-0x05ec1cff & ~1) | ((uintptr_t) entry_addr & 1);
+    entry.break_addr = (-0x05ec1cff & ~1) | ((uintptr_t) entry.entry_addr & 1);
 
-    if (!write_proc(pid, (uintptr_t) addr_of_entry_addr,  (uintptr_t)&break_addr, sizeof(break_addr))) return false;
-    ptrace(PTRACE_CONT, pid, 0, 0);
-    int status;
-    wait_for_trace(pid, &status, __WALL);
-    if (WIFSTOPPED(status) && WSTOPSIG(status) == SIGSEGV) {
-        if (ptrace_getregs(pid, &CurrentRegs) != 0) {
-            return false;
-        }
-        if (static_cast<uintptr_t>(CurrentRegs.pc & ~1) != (break_addr & ~1)) {
-            LOGE("stopped at unknown addr %p", (void *) CurrentRegs.pc);
-            return false;
-        }
-        // The linker has been initialized now, we can do dlopen
-        LOGD("stopped at entry");
+    return mem.write(entry.addr_of_entry_addr, entry.break_addr);
+}
 
-        // restore entry address
-        if (!write_proc(pid, (uintptr_t) addr_of_entry_addr, (uintptr_t)&entry_addr,
-                        sizeof(entry_addr)))
-            return false;
-        // reset pc to entry
-        CurrentRegs.pc = (long) entry_addr;
+/**
+ * @brief 处理 arm_app_process_entry 布置以后的停止事件
+ *
+ * @param mem 远程进程的内存
+ * @param status waitpid返回的状态
+ * @param entry arm_app_process_entry 保存的入口信息
+ * @return 返回true表示进程停在了入口,AT_ENTRY和pc都已经恢复,这时候linker已经初始化完成,可以dlopen
+ */
+bool on_app_process_entry_stop(RemoteMemory &mem, int status, const EntryStop &entry){
+    struct pt_regs CurrentRegs;
+    pid_t pid = mem.get_pid();
+    if (!WIFSTOPPED(status) || WSTOPSIG(status) != SIGSEGV) {
+        return false;
+    }
+    if (ptrace_getregs(pid, &CurrentRegs) != 0) {
+        return false;
+    }
+    if (static_cast<uintptr_t>(ptrace_getpc(&CurrentRegs) & ~1) != (entry.break_addr & ~1)) {
+        LOGE("stopped at unknown addr %p", (void *) ptrace_getpc(&CurrentRegs));
+        return false;
+    }
+    // The linker has been initialized now, we can do dlopen
+    LOGD("stopped at entry");
 
-        LOGD("restore registers invoke entry");
-        // restore registers
-        ptrace_setregs(pid, &CurrentRegs);
+    // restore entry address
+    if (!mem.write(entry.addr_of_entry_addr, entry.entry_addr))
+        return false;
+    // reset pc to entry
+    ptrace_setpc(&CurrentRegs, entry.entry_addr);
 
-        return true;
-    }
-    return false;
+    LOGD("restore registers invoke entry");
+    // restore registers
+    ptrace_setregs(pid, &CurrentRegs);
 
+    return true;
 }
 
 
@@ -569,61 +941,49 @@ bool remote_ptrace_dlopen(pid_t pid,char*LibPath){
     if (ptrace_getregs(pid, &CurrentRegs) != 0){
         return false;
     }
-    auto remote_map = MapScan(std::to_string(pid));
-    auto local_map = MapScan(std::to_string(getpid()));
-    uintptr_t libc_return_addr = reinterpret_cast<uintptr_t>(find_module_return_addr(remote_map, "libc.so"));
+    uintptr_t libc_return_addr = reinterpret_cast<uintptr_t>(find_module_return_addr(pid, "libc.so"));
 
     memcpy(&OriginalRegs, &CurrentRegs, sizeof(CurrentRegs));
 
+    RemoteMemory mem(pid);
+    RemoteArena arena;
+    bool ok = false;
     do{
-        void *mmap_addr = find_func_addr(local_map, remote_map, "libc.so", "mmap");
-        long parameters[6];
-        // mmap映射 <-- 设置mmap的参数
-        // void *mmap(void *start, size_t length, int prot, int flags, int fd, off_t offsize);
-        parameters[0] = NULL; // 设置为NULL表示让系统自动选择分配内存的地址
-        parameters[1] = 0x3000; // 映射内存的大小
-        parameters[2] = PROT_READ | PROT_WRITE; // 表示映射内存区域 可读|可写|可执行
-        parameters[3] = MAP_ANONYMOUS | MAP_PRIVATE; // 建立匿名映射
-        parameters[4] = -1; //  若需要映射文件到内存中，则为文件的fd
-        parameters[5] = 0; //文件映射偏移量
-
-        // 调用远程进程的mmap函数 建立远程进程的内存映射 在目标进程中为libxxx.so分配内存
-        if (ptrace_call(pid, (uintptr_t)mmap_addr, parameters, 6, &CurrentRegs,libc_return_addr) == -1){
-            LOGE("[-][function:%s] Call Remote mmap Func Failed, err:%s\n",__func__ , strerror(errno));
+        // 在目标进程中为libxxx.so的路径分配内存
+        if (!remote_arena_map(mem, arena, &CurrentRegs, libc_return_addr, remote_arena_size_for(strlen(LibPath) + 1))) {
             break;
         }
-        // 打印一下
-        LOGD("[+][function:%s] ptrace_call mmap success, return value=%lX, pc=%lX\n",__func__ , ptrace_getret(&CurrentRegs), ptrace_getpc(&CurrentRegs));
-
-        // 获取mmap函数执行后的返回值，也就是内存映射的起始地址
-        // 从寄存器中获取mmap函数的返回值 即申请的内存首地址
-        auto RemoteMapMemoryAddr = (uintptr_t)ptrace_getret(&CurrentRegs);
-        LOGD("[+][function:%s] Remote Process Map Memory Addr:0x%lx\n",__func__ , RemoteMapMemoryAddr);
 
-//    // 分别获取dlopen、dlsym、dlclose等函数的地址
-        auto dlopen_addr = find_func_addr(local_map, remote_map, "libdl.so", "dlopen");
-        auto dlsym_addr = find_func_addr(local_map, remote_map, "libdl.so", "dlsym");
-        auto dlclose_addr = find_func_addr(local_map, remote_map, "libdl.so", "dlclose");
-        auto dlerror_addr = find_func_addr(local_map, remote_map, "libdl.so", "dlerror");
-
-        //    // 打印一下
-//    LOGD("[+][function:%s] Get imports: dlopen: %lx, dlsym: %lx, dlclose: %lx, dlerror: %lx\n",__func__ , dlopen_addr, dlsym_addr, dlclose_addr, dlerror_addr);
+        // 这里只调用 dlopen, 失败时再调用 dlerror 取错误信息; dlerror 找不到也能注入, 只是没有错误信息
+        static const char *const kDlNames[] = {"dlopen", "dlerror"};
+        uintptr_t dl_addrs[2];
+        RemoteElf libdl(mem);
+        if (!libdl.open(reinterpret_cast<uintptr_t>(find_module_base(pid, "libdl.so")))) {
+            LOGE("[-][function:%s] libdl.so not found\n", __func__);
+            break;
+        }
+        libdl.find(kDlNames, dl_addrs, 2);
+        if (dl_addrs[0] == 0) {
+            LOGE("[-][function:%s] dlopen not found in libdl.so\n", __func__);
+            break;
+        }
+        auto dlopen_addr = reinterpret_cast<void *>(dl_addrs[0]);
+        auto dlerror_addr = reinterpret_cast<void *>(dl_addrs[1]);
 
         // 打印注入so的路径
         LOGD("[+][function:%s] LibPath = %s\n",__func__ , LibPath);
 
         // 将要加载的so库路径写入到远程进程内存空间中
-        /**
-         * pid  开始写入数据的地址   写入内容    写入数据大小
-         */
-        if (write_proc(pid,  RemoteMapMemoryAddr, (uintptr_t) LibPath,strlen(LibPath) + 1) == -1) {
+        uintptr_t RemoteLibPath = arena.push_string(LibPath);
+        if (RemoteLibPath == 0 || !arena.flush(mem)) {
             LOGE("[-][function:%s] Write LibPath:%s to RemoteProcess error\n",__func__ , LibPath);
             break;
         }
 
+        long parameters[2];
         // 设置dlopen的参数,返回值为模块加载的地址
         // void *dlopen(const char *filename, int flag);
-        parameters[0] = (uintptr_t) RemoteMapMemoryAddr; // 写入的libPath
+        parameters[0] = (long) RemoteLibPath; // 写入的libPath
         parameters[1] = RTLD_NOW ; // dlopen的标识                            不能使用RTLD_GLOBAL ,会导致无法dlclose 无法关闭so库
 
         // 执行dlopen 载入so
@@ -638,31 +998,37 @@ bool remote_ptrace_dlopen(pid_t pid,char*LibPath){
 
         // dlopen 错误
         if ((long) RemoteModuleAddr == 0x0){
+            if (dlerror_addr == nullptr) {
+                LOGE("[-][function:%s] dlopen failed, no dlerror in libdl.so\n",__func__);
+                break;
+            }
             if (ptrace_call(pid, (uintptr_t) dlerror_addr, parameters, 0, &CurrentRegs,libc_return_addr) == -1) {
                 LOGE("[-][function:%s] Call Remote dlerror Func Failed\n",__func__ );
                 break;
             }
             uintptr_t Error =  ptrace_getret(&CurrentRegs);
             char LocalErrorInfo[1024] = {0};
-            read_proc(pid,  Error, ( uintptr_t) LocalErrorInfo, 1024);
+            mem.read_string(Error, LocalErrorInfo, sizeof(LocalErrorInfo));
             LOGE("[-][function:%s] dlopen error:%s\n",__func__, LocalErrorInfo );
             break;
         }
-        if (ptrace_setregs(pid, &OriginalRegs) == -1) {
-            LOGE("[-][function:%s] Recover reges failed\n",__func__);
-            break;
-        }
+        ok = true;
+    } while (false);
 
-        LOGD("[+][function:%s] Recover Regs Success\n",__func__);
+    // 路径只在dlopen的时候用到,不在目标进程里留下映射
+    remote_arena_unmap(mem, arena, &CurrentRegs, libc_return_addr);
 
-        ptrace_getregs(pid, &CurrentRegs);
-        if (memcmp(&OriginalRegs, &CurrentRegs, sizeof(CurrentRegs)) != 0) {
-            LOGE("[-][function:%s] Set Regs Error\n",__func__);
-            break;
-        }
-        return true;
-    } while (false);
+    if (ptrace_setregs(pid, &OriginalRegs) == -1) {
+        LOGE("[-][function:%s] Recover reges failed\n",__func__);
+        return false;
+    }
 
-    return false;
-}
+    LOGD("[+][function:%s] Recover Regs Success\n",__func__);
 
+    ptrace_getregs(pid, &CurrentRegs);
+    if (memcmp(&OriginalRegs, &CurrentRegs, sizeof(CurrentRegs)) != 0) {
+        LOGE("[-][function:%s] Set Regs Error\n",__func__);
+        return false;
+    }
+    return ok;
+}
@@ -1,5 +1,10 @@
 // system lib
+#ifdef __ANDROID__
 #include <asm/ptrace.h>
+#else
+// glibc的 sys/ptrace.h 和 asm/ptrace.h 不能同时包含, user_regs_struct 在 sys/user.h 里
+#include <sys/user.h>
+#endif
 #include <cstdio>
 #include <cstdlib>
 #include <sys/ptrace.h>
@@ -16,8 +21,13 @@
 #include <asm/unistd.h>
 #include <sys/stat.h>
 #include <sys/vfs.h>
+#ifdef __ANDROID__
 #include <sys/system_properties.h>
+#endif
 #include "logging.h"
+#include "remote_memory.h"
+#include "proc_maps.h"
+#include "remote_elf.h"
 //// 系统lib路径
 //struct process_libs{
 //    const char *libc_path;
@@ -26,32 +36,6 @@
 //} process_libs = {"","",""};
 
 
-struct MapInfo {
-    /// \brief The start address of the memory region.
-    uintptr_t start;
-    /// \brief The end address of the memory region.
-    uintptr_t end;
-    /// \brief The permissions of the memory region. This is a bit mask of the following values:
-    /// - PROT_READ
-    /// - PROT_WRITE
-    /// - PROT_EXEC
-    uint8_t perms;
-    /// \brief Whether the memory region is private.
-    bool is_private;
-    /// \brief The offset of the memory region.
-    uintptr_t offset;
-    /// \brief The device number of the memory region.
-    /// Major can be obtained by #major()
-    /// Minor can be obtained by #minor()
-    dev_t dev;
-    /// \brief The inode number of the memory region.
-    ino_t inode;
-    /// \brief The path of the memory region.
-    std::string path;
-};
-
-
-
 ///**
 // * @brief 处理各架构预定义的库文件
 // */
@@ -154,41 +138,25 @@ void *get_remote_func_addr(pid_t pid, const char *ModuleName, void *LocalFuncAdd
     return RemoteFuncAddr;
 }
 
+// 单段读写, 跟以前一样返回传输的字节数, 失败返回-1
+// 多段或者同一个进程反复读写的地方直接用 RemoteMemory, 可以合并系统调用并复用 /proc/pid/mem
 ssize_t read_proc(int pid, uintptr_t remote_addr, uintptr_t buf, size_t len) {
-    struct iovec local{
-            .iov_base = (void *) buf,
-            .iov_len = len
-    };
-    struct iovec remote{
-            .iov_base = (void *) remote_addr,
-            .iov_len = len
-    };
-    auto l = process_vm_readv(pid, &local, 1, &remote, 1, 0);
-    if (l == -1) {
-        PLOGE("process_vm_readv");
-    } else if (static_cast<size_t>(l) != len) {
-        LOGW("not fully read: %zu, excepted %zu", l, len);
+    RemoteMemory mem(pid);
+    if (!mem.read(remote_addr, (void *) buf, len)) {
+        LOGW("read remote addr %" PRIxPTR " size %zu failed", remote_addr, len);
+        return -1;
     }
-    return l;
+    return len;
 }
 
 ssize_t write_proc(int pid, uintptr_t remote_addr, uintptr_t buf, size_t len) {
     LOGV("write to remote addr %" PRIxPTR " size %zu", remote_addr, len);
-    struct iovec local{
-            .iov_base = (void *) buf,
-            .iov_len = len
-    };
-    struct iovec remote{
-            .iov_base = (void *) remote_addr,
-            .iov_len = len
-    };
-    auto l = process_vm_writev(pid, &local, 1, &remote, 1, 0);
-    if (l == -1) {
-        PLOGE("process_vm_writev");
-    } else if (static_cast<size_t>(l) != len) {
-        LOGW("not fully written: %zu, excepted %zu", l, len);
+    RemoteMemory mem(pid);
+    if (!mem.write(remote_addr, (const void *) buf, len)) {
+        LOGW("write remote addr %" PRIxPTR " size %zu failed", remote_addr, len);
+        return -1;
     }
-    return l;
+    return len;
 }
 
 
@@ -217,84 +185,17 @@ bool ends_with(std::string_view str, std::string_view suffix) {
 }
 
 uintptr_t get_remote_module_base(const std::string& pid,const std::string& libName){
-
-    constexpr static auto kPermLength = 5;
-    constexpr static auto kMapEntry = 7;
-    std::vector<MapInfo> info;
-    std::string file_name = std::string("/proc/") + pid + "/maps";
-    auto maps = std::unique_ptr<FILE, decltype(&fclose)>{fopen(file_name.c_str(), "r"), &fclose};
-    uintptr_t ret_addr=0;
-    if (maps) {
-        char *line = nullptr;
-        size_t len = 0;
-        ssize_t read;
-        while ((read = getline(&line, &len, maps.get())) > 0) {
-            line[read - 1] = '\0';
-            uintptr_t start = 0;
-            uintptr_t end = 0;
-            uintptr_t off = 0;
-            ino_t inode = 0;
-            unsigned int dev_major = 0;
-            unsigned int dev_minor = 0;
-            std::array<char, kPermLength> perm{'\0'};
-            int path_off;
-            if (sscanf(line, "%" PRIxPTR "-%" PRIxPTR " %4s %" PRIxPTR " %x:%x %lu %n%*s", &start,
-                       &end, perm.data(), &off, &dev_major, &dev_minor, &inode,
-                       &path_off) != kMapEntry) {
-                continue;
-            }
-
-            while (path_off < read && isspace(line[path_off])) path_off++;
-
-            if(ends_with(libName,line + path_off)){
-                ret_addr = start;
-                break;
-            }
-        }
-        free(line);
-        return ret_addr;
-    }
+    ProcMapQuery query(atoi(pid.c_str()));
+    auto map = query.find_module(libName, [](const MapInfo &) { return true; });
+    return map != nullptr ? map->start : 0;
 }
 
 
-std::vector<MapInfo> MapScan(const std::string& pid) {
-    constexpr static auto kPermLength = 5;
-    constexpr static auto kMapEntry = 7;
-    std::vector<MapInfo> info;
-    std::string file_name = std::string("/proc/") + pid + "/maps";
-    auto maps = std::unique_ptr<FILE, decltype(&fclose)>{fopen(file_name.c_str(), "r"), &fclose};
-    if (maps) {
-        char *line = nullptr;
-        size_t len = 0;
-        ssize_t read;
-        while ((read = getline(&line, &len, maps.get())) > 0) {
-            line[read - 1] = '\0';
-            uintptr_t start = 0;
-            uintptr_t end = 0;
-            uintptr_t off = 0;
-            ino_t inode = 0;
-            unsigned int dev_major = 0;
-            unsigned int dev_minor = 0;
-            std::array<char, kPermLength> perm{'\0'};
-            int path_off;
-            if (sscanf(line, "%" PRIxPTR "-%" PRIxPTR " %4s %" PRIxPTR " %x:%x %lu %n%*s", &start,
-                       &end, perm.data(), &off, &dev_major, &dev_minor, &inode,
-                       &path_off) != kMapEntry) {
-                continue;
-            }
-            while (path_off < read && isspace(line[path_off])) path_off++;
-            auto ref = MapInfo{start, end, 0, perm[3] == 'p', off,
-                               static_cast<dev_t>(makedev(dev_major, dev_minor)),
-                               inode, line + path_off};
-            if (perm[0] == 'r') ref.perms |= PROT_READ;
-            if (perm[1] == 'w') ref.perms |= PROT_WRITE;
-            if (perm[2] == 'x') ref.perms |= PROT_EXEC;
-            info.emplace_back(ref);
-
-        }
-        free(line);
-    }
-    return info;
+// 每行不再分配 std::string, 返回的 MapInfo::path 指向 ProcMaps 里的缓冲区
+ProcMaps MapScan(const std::string& pid) {
+    ProcMaps maps;
+    maps.scan(atoi(pid.c_str()));
+    return maps;
 }
 
 
@@ -316,56 +217,38 @@ std::string get_program(int pid) {
 }
 
 
-void *find_module_return_addr(std::vector<MapInfo> &info, std::string_view suffix) {
-    for (auto &map: info) {
-        if ((map.perms & PROT_EXEC) == 0 && ends_with(map.path,suffix)) {
-            return (void *) map.start;
-        }
-    }
-    return nullptr;
+// 下面几个只要一个答案, 内核支持 PROCMAP_QUERY 的时候不用读整个maps, 但按模块名找还是要把文件映射走一遍
+void *find_module_return_addr(pid_t pid, std::string_view suffix) {
+    ProcMapQuery query(pid);
+    auto map = query.find_module(suffix, [](const MapInfo &m) { return (m.perms & PROT_EXEC) == 0; });
+    return map != nullptr ? (void *) map->start : nullptr;
 }
 
-void *find_module_base(std::vector<MapInfo> &info, std::string_view suffix) {
-    for (auto &map: info) {
-        if (map.offset == 0 && ends_with(map.path,suffix)) {
-            return (void *) map.start;
-        }
-    }
-    return nullptr;
+void *find_module_base(pid_t pid, std::string_view suffix) {
+    ProcMapQuery query(pid);
+    auto map = query.find_module(suffix, [](const MapInfo &m) { return m.offset == 0; });
+    return map != nullptr ? (void *) map->start : nullptr;
 }
 
-void *find_func_addr(
-        std::vector<MapInfo> &local_info,
-        std::vector<MapInfo> &remote_info,
-        std::string_view module,
-        std::string_view func) {
-    auto lib = dlopen(module.data(), RTLD_NOW);
-    if (lib == nullptr) {
-        LOGE("failed to open lib %s: %s", module.data(), dlerror());
-        return nullptr;
-    }
-    auto sym = reinterpret_cast<uint8_t *>(dlsym(lib, func.data()));
-    if (sym == nullptr) {
-        LOGE("failed to find sym %s in %s: %s", func.data(), module.data(), dlerror());
-        dlclose(lib);
+// 直接解析目标进程里这个模块的动态符号表, 不在 adi 里加载同一个so
+// 同一个模块要找多个函数的时候用 RemoteElf 的批量查找
+void *find_func_addr(pid_t pid, std::string_view module, std::string_view func) {
+    auto base = reinterpret_cast<uintptr_t>(find_module_base(pid, module));
+    if (base == 0) {
+        LOGE("failed to find remote base for module %s", module.data());
         return nullptr;
     }
-    LOGD("sym %s: %p", func.data(), sym);
-    dlclose(lib);
-    auto local_base = reinterpret_cast<uint8_t *>(find_module_base(local_info, module));
-    if (local_base == nullptr) {
-        LOGE("failed to find local base for module %s", module.data());
+    RemoteMemory mem(pid);
+    RemoteElf elf(mem);
+    if (!elf.open(base)) {
+        LOGE("failed to parse remote module %s at %lx", module.data(), (unsigned long) base);
         return nullptr;
     }
-    auto remote_base = reinterpret_cast<uint8_t *>(find_module_base(remote_info, module));
-    if (remote_base == nullptr) {
-        LOGE("failed to find remote base for module %s", module.data());
-        return nullptr;
+    auto addr = elf.find(func);
+    if (addr == 0) {
+        LOGE("failed to find sym %s in %s", func.data(), module.data());
     }
-    LOGD("found local base %p remote base %p", local_base, remote_base);
-    auto addr = (sym - local_base) + remote_base;
-    LOGD("addr %p", addr);
-    return addr;
+    return reinterpret_cast<void *>(addr);
 }
 
 
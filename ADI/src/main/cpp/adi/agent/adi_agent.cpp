@@ -0,0 +1,191 @@
+//
+// Created by chic on 2025/7/2.
+//
+// 注入到长时间运行的目标进程里的agent, 第一次注入以后 adi 通过共享内存里的邮箱
+// 让它加载so, 调用函数, 读写内存, 卸载so, 这些操作都不需要ptrace, 目标进程不会停下来
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/futex.h>
+#include <dlfcn.h>
+#include <pthread.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <atomic>
+#include "agent_protocol.h"
+
+static AgentMailbox *mailbox = nullptr;
+
+static void futex_wait(uint32_t *addr, uint32_t value){
+    syscall(__NR_futex, addr, FUTEX_WAIT, value, nullptr, nullptr, 0);
+}
+
+static void futex_wake(uint32_t *addr){
+    syscall(__NR_futex, addr, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+static void set_error(AgentMailbox *box, const char *error){
+    box->ok = 0;
+    box->ret = -1;
+    if (error == nullptr) {
+        error = "unknown error";
+    }
+    size_t n = strnlen(error, kAgentMaxData - 1);
+    memcpy(box->data, error, n);
+    box->data[n] = '\0';
+    box->len = n;
+}
+
+// 读写内存用 process_vm_* 访问自己, 地址不对的时候返回EFAULT而不是让目标进程崩掉
+static bool copy_self(AgentMailbox *box, bool is_write){
+    size_t len = box->len;
+    if (len > kAgentMaxData) {
+        set_error(box, "length too large");
+        return false;
+    }
+    struct iovec local{box->data, len};
+    struct iovec remote{reinterpret_cast<void *>(box->addr), len};
+    ssize_t n = is_write ? process_vm_writev(getpid(), &local, 1, &remote, 1, 0)
+                         : process_vm_readv(getpid(), &local, 1, &remote, 1, 0);
+    if (n < 0) {
+        set_error(box, strerror(errno));
+        return false;
+    }
+    box->ret = n;
+    box->len = is_write ? 0 : n;
+    return true;
+}
+
+static void handle_request(AgentMailbox *box){
+    box->ok = 1;
+    switch (static_cast<AgentOp>(box->op)) {
+        case AgentOp::PING:
+            box->ret = gettid();
+            box->len = 0;
+            return;
+        case AgentOp::LOAD: {
+            box->data[kAgentMaxData - 1] = '\0';
+            void *handle = dlopen(box->data, RTLD_NOW);
+            if (handle == nullptr) {
+                set_error(box, dlerror());
+                return;
+            }
+            box->ret = reinterpret_cast<intptr_t>(handle);
+            box->len = 0;
+            return;
+        }
+        case AgentOp::CALL: {
+            box->data[kAgentMaxData - 1] = '\0';
+            const char *name = box->data;
+            size_t name_len = strlen(name);
+            const char *arg = name_len + 1 < box->len ? name + name_len + 1 : "";
+            auto handle = reinterpret_cast<void *>(box->handle);
+            auto fn = reinterpret_cast<long (*)(void *, const char *)>(dlsym(handle, name));
+            if (fn == nullptr) {
+                set_error(box, dlerror());
+                return;
+            }
+            box->ret = fn(handle, arg);
+            box->len = 0;
+            return;
+        }
+        case AgentOp::READ:
+            copy_self(box, false);
+            return;
+        case AgentOp::WRITE:
+            copy_self(box, true);
+            return;
+        case AgentOp::UNLOAD:
+            box->ret = dlclose(reinterpret_cast<void *>(box->handle));
+            if (box->ret != 0) {
+                set_error(box, dlerror());
+                return;
+            }
+            box->len = 0;
+            return;
+    }
+    set_error(box, "unknown op");
+}
+
+static void *agent_main(void *){
+    // 进程的信号交给别的线程处理
+    sigset_t all;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, nullptr);
+
+    AgentMailbox *box = mailbox;
+    __atomic_store_n(&box->agent_tid, gettid(), __ATOMIC_RELEASE);
+    uint32_t done = __atomic_load_n(&box->done_seq, __ATOMIC_ACQUIRE);
+    while (true) {
+        uint32_t req = __atomic_load_n(&box->req_seq, __ATOMIC_ACQUIRE);
+        if (req == done) {
+            futex_wait(&box->req_seq, req);
+            continue;
+        }
+        handle_request(box);
+        done = req;
+        __atomic_store_n(&box->done_seq, done, __ATOMIC_RELEASE);
+        futex_wake(&box->done_seq);
+    }
+    return nullptr;
+}
+
+// zygote 每次 fork 之前 ZygoteHooks 要等到 /proc/self/task 里只剩一个线程, 多了agent线程就会一直等下去
+static bool in_zygote(){
+    char name[64] = {};
+    int fd = open("/proc/self/cmdline", O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return false;
+    }
+    ssize_t n = read(fd, name, sizeof(name) - 1);
+    close(fd);
+    return n > 0 && (strcmp(name, "zygote") == 0 || strcmp(name, "zygote64") == 0);
+}
+
+/**
+ * 用 inject_process 注入时调用的函数
+ * zygote 里不启动agent线程, 返回0
+ * @return 成功返回邮箱的地址, 失败返回0, 已经启动过的直接返回原来的邮箱
+ */
+extern "C" __attribute__((visibility("default")))
+long adi_agent_start(void *handle, const char *arg){
+    (void) handle;
+    (void) arg;
+    static std::atomic<bool> started{false};
+    if (in_zygote()) {
+        return 0;
+    }
+    if (started.exchange(true)) {
+        return reinterpret_cast<long>(mailbox);
+    }
+    void *mem = mmap(nullptr, kAgentMailboxSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+        started = false;
+        return 0;
+    }
+    // fork 出来的子进程没有agent线程, 不要把邮箱带过去
+    madvise(mem, kAgentMailboxSize, MADV_DONTFORK);
+    mailbox = static_cast<AgentMailbox *>(mem);
+    mailbox->version = kAgentVersion;
+
+    pthread_t thread;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    int err = pthread_create(&thread, &attr, agent_main, nullptr);
+    pthread_attr_destroy(&attr);
+    if (err != 0) {
+        munmap(mem, kAgentMailboxSize);
+        mailbox = nullptr;
+        started = false;
+        return 0;
+    }
+    // 不等线程开始运行, 注入时新线程可能要等注入结束才能运行, 在这之前发来的请求线程起来以后再处理
+    __atomic_store_n(&mailbox->magic, kAgentMagic, __ATOMIC_RELEASE);
+    return reinterpret_cast<long>(mailbox);
+}
@@ -0,0 +1,218 @@
+//
+// Created by chic on 2025/7/2.
+//
+
+#include "agent_client.h"
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <csignal>
+#include <cerrno>
+#include <cinttypes>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <algorithm>
+#include "logging.h"
+#include "proc_maps.h"
+
+static int futex_wait(uint32_t *addr, uint32_t value, int timeout_ms){
+    struct timespec ts{timeout_ms / 1000, (timeout_ms % 1000) * 1000000L};
+    return syscall(__NR_futex, addr, FUTEX_WAIT, value, &ts, nullptr, 0);
+}
+
+static void futex_wake(uint32_t *addr){
+    syscall(__NR_futex, addr, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+AgentClient::~AgentClient(){
+    close();
+}
+
+void AgentClient::close(){
+    if (box != nullptr) {
+        munmap(box, kAgentMailboxSize);
+        box = nullptr;
+    }
+}
+
+bool AgentClient::open(pid_t target){
+    close();
+    pid = target;
+    ProcMaps maps;
+    if (!maps.scan(pid)) {
+        return false;
+    }
+    // agent 的邮箱是 kAgentMailboxSize 大小的共享匿名映射, 内容里有 kAgentMagic
+    char path[64];
+    for (auto &map: maps) {
+        if (map.end - map.start != kAgentMailboxSize || map.is_private || map.path.substr(0, 9) != "/dev/zero") {
+            continue;
+        }
+        snprintf(path, sizeof(path), "/proc/%d/map_files/%" PRIxPTR "-%" PRIxPTR, pid, map.start, map.end);
+        int fd = ::open(path, O_RDWR | O_CLOEXEC);
+        if (fd == -1) {
+            LOGV("open %s failed: %s", path, strerror(errno));
+            continue;
+        }
+        void *mem = mmap(nullptr, kAgentMailboxSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (mem == MAP_FAILED) {
+            continue;
+        }
+        auto candidate = static_cast<AgentMailbox *>(mem);
+        if (__atomic_load_n(&candidate->magic, __ATOMIC_ACQUIRE) == kAgentMagic && candidate->version == kAgentVersion) {
+            box = candidate;
+            break;
+        }
+        munmap(mem, kAgentMailboxSize);
+    }
+    return box != nullptr;
+}
+
+bool AgentClient::lock(){
+    auto self = (uint32_t) getpid();
+    for (int waited = 0; waited < kTimeoutMs; waited += 10) {
+        uint32_t owner = 0;
+        if (__atomic_compare_exchange_n(&box->lock, &owner, self, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            return true;
+        }
+        // 持有的 adi 已经退出了
+        if (kill((pid_t) owner, 0) == -1 && errno == ESRCH &&
+            __atomic_compare_exchange_n(&box->lock, &owner, self, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            return true;
+        }
+        futex_wait(&box->lock, owner, 10);
+    }
+    error = "agent mailbox busy";
+    return false;
+}
+
+void AgentClient::unlock(){
+    __atomic_store_n(&box->lock, 0, __ATOMIC_RELEASE);
+    futex_wake(&box->lock);
+}
+
+bool AgentClient::request(){
+    uint32_t req = __atomic_load_n(&box->req_seq, __ATOMIC_RELAXED) + 1;
+    __atomic_store_n(&box->req_seq, req, __ATOMIC_RELEASE);
+    futex_wake(&box->req_seq);
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while (true) {
+        uint32_t done = __atomic_load_n(&box->done_seq, __ATOMIC_ACQUIRE);
+        if (done == req) {
+            break;
+        }
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        long elapsed = (now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000;
+        if (elapsed >= kTimeoutMs) {
+            error = "agent did not respond";
+            return false;
+        }
+        futex_wait(&box->done_seq, done, kTimeoutMs - (int) elapsed);
+    }
+    if (!box->ok) {
+        error.assign(box->data, std::min<size_t>(box->len, kAgentMaxData));
+        return false;
+    }
+    return true;
+}
+
+bool AgentClient::ping(pid_t *tid){
+    if (box == nullptr || !lock()) return false;
+    box->op = (uint32_t) AgentOp::PING;
+    box->len = 0;
+    bool ok = request();
+    if (ok && tid != nullptr) {
+        *tid = (pid_t) box->ret;
+    }
+    unlock();
+    return ok;
+}
+
+bool AgentClient::load(const char *path, uint64_t *handle){
+    size_t len = strlen(path) + 1;
+    if (box == nullptr || len > kAgentMaxData || !lock()) return false;
+    box->op = (uint32_t) AgentOp::LOAD;
+    memcpy(box->data, path, len);
+    box->len = len;
+    bool ok = request();
+    if (ok) {
+        *handle = (uint64_t) box->ret;
+    }
+    unlock();
+    return ok;
+}
+
+bool AgentClient::call(uint64_t handle, const char *name, const char *arg, long *ret){
+    size_t name_len = strlen(name) + 1;
+    size_t arg_len = strlen(arg) + 1;
+    if (box == nullptr || name_len + arg_len > kAgentMaxData || !lock()) return false;
+    box->op = (uint32_t) AgentOp::CALL;
+    box->handle = handle;
+    memcpy(box->data, name, name_len);
+    memcpy(box->data + name_len, arg, arg_len);
+    box->len = name_len + arg_len;
+    bool ok = request();
+    if (ok) {
+        *ret = (long) box->ret;
+    }
+    unlock();
+    return ok;
+}
+
+bool AgentClient::read(uintptr_t addr, void *buf, size_t len){
+    if (box == nullptr || !lock()) return false;
+    auto out = static_cast<uint8_t *>(buf);
+    bool ok = true;
+    // 一次最多 kAgentMaxData 字节
+    while (ok && len > 0) {
+        size_t chunk = std::min(len, kAgentMaxData);
+        box->op = (uint32_t) AgentOp::READ;
+        box->addr = addr;
+        box->len = chunk;
+        ok = request() && box->len == chunk;
+        if (ok) {
+            memcpy(out, box->data, chunk);
+            out += chunk;
+            addr += chunk;
+            len -= chunk;
+        }
+    }
+    unlock();
+    return ok;
+}
+
+bool AgentClient::write(uintptr_t addr, const void *buf, size_t len){
+    if (box == nullptr || !lock()) return false;
+    auto in = static_cast<const uint8_t *>(buf);
+    bool ok = true;
+    while (ok && len > 0) {
+        size_t chunk = std::min(len, kAgentMaxData);
+        box->op = (uint32_t) AgentOp::WRITE;
+        box->addr = addr;
+        memcpy(box->data, in, chunk);
+        box->len = chunk;
+        ok = request() && box->ret == (int64_t) chunk;
+        in += chunk;
+        addr += chunk;
+        len -= chunk;
+    }
+    unlock();
+    return ok;
+}
+
+bool AgentClient::unload(uint64_t handle){
+    if (box == nullptr || !lock()) return false;
+    box->op = (uint32_t) AgentOp::UNLOAD;
+    box->handle = handle;
+    box->len = 0;
+    bool ok = request();
+    unlock();
+    return ok;
+}
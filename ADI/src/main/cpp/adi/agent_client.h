@@ -0,0 +1,56 @@
+//
+// Created by chic on 2025/7/2.
+//
+
+#pragma once
+#include <sys/types.h>
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include "agent_protocol.h"
+
+/**
+ * adi 这一边的 agent 客户端
+ * open 在目标进程的maps里找 agent 的邮箱, 通过 /proc/pid/map_files 映射到自己的进程里,
+ * 之后每个请求只是写共享内存加两次futex, 不需要ptrace, 目标进程不会停下来
+ * map_files 需要root(CAP_SYS_ADMIN 或者 CAP_CHECKPOINT_RESTORE)
+ * 失败的时候 get_error 返回 agent 给的错误信息
+ */
+class AgentClient {
+public:
+    AgentClient() = default;
+    ~AgentClient();
+    AgentClient(const AgentClient &) = delete;
+    AgentClient &operator=(const AgentClient &) = delete;
+
+    // 目标进程里没有agent返回false
+    bool open(pid_t pid);
+    void close();
+    bool is_open() const {
+        return box != nullptr;
+    }
+
+    bool ping(pid_t *tid = nullptr);
+    bool load(const char *path, uint64_t *handle);
+    bool call(uint64_t handle, const char *name, const char *arg, long *ret);
+    bool read(uintptr_t addr, void *buf, size_t len);
+    bool write(uintptr_t addr, const void *buf, size_t len);
+    bool unload(uint64_t handle);
+
+    const std::string &get_error() const {
+        return error;
+    }
+
+    // 等待agent处理一个请求的最长时间, 超过以后认为agent已经不在了
+    static constexpr int kTimeoutMs = 5000;
+
+private:
+    pid_t pid = -1;
+    AgentMailbox *box = nullptr;
+    std::string error;
+
+    // 调用前 op/len/handle/addr/data 已经填好, 成功返回true
+    bool request();
+    bool lock();
+    void unlock();
+};
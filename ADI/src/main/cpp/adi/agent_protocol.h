@@ -0,0 +1,58 @@
+//
+// Created by chic on 2025/7/2.
+//
+
+#pragma once
+#include <sys/types.h>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * libadi_agent.so 和 adi 之间的邮箱
+ * agent 在目标进程里 mmap 一块 MAP_SHARED|MAP_ANONYMOUS 的内存, maps 里显示为 /dev/zero (deleted),
+ * adi 通过 /proc/pid/map_files 映射同一块内存, 两边在上面用 futex 等待和唤醒, 不需要让目标进程停下来
+ * 目标进程里不留下任何fd, zygote fork 的时候检查fd不会出问题
+ *
+ * 一次请求: adi 拿到 lock, 填好 op/参数/data, req_seq 加一并唤醒, 等到 done_seq == req_seq 以后读结果
+ */
+
+#define ADI_AGENT_START "adi_agent_start"
+
+static constexpr uint32_t kAgentMagic = 0x41494441;     // "ADIA"
+static constexpr uint32_t kAgentVersion = 1;
+static constexpr size_t kAgentMailboxSize = 64 * 1024;
+
+enum class AgentOp : uint32_t {
+    PING,       // ret 是 agent 线程的tid
+    LOAD,       // dlopen(data, RTLD_NOW), ret 是 handle
+    CALL,       // data 是 "函数名\0参数\0", dlsym(handle, 函数名) 以后调用 fn(handle, 参数), ret 是返回值
+    READ,       // 读 addr 开始的 len 字节到 data, ret 是读到的字节数
+    WRITE,      // data 的 len 字节写到 addr, ret 是写入的字节数
+    UNLOAD,     // dlclose(handle), ret 是 dlclose 的返回值
+};
+
+struct AgentMailbox {
+    uint32_t magic;
+    uint32_t version;
+    pid_t agent_tid;
+    // 持有请求的 adi 的pid, 0表示空闲, 持有的进程不在了可以抢过来
+    uint32_t lock;
+    // futex
+    uint32_t req_seq;
+    uint32_t done_seq;
+
+    uint32_t op;
+    // 请求的时候是 data 的长度(READ 是要读的长度), 返回的时候是结果的长度, 失败时是错误信息的长度
+    uint32_t len;
+    uint64_t handle;
+    uint64_t addr;
+    // 失败的时候是 -1, data 里是错误信息
+    int64_t ret;
+    uint32_t ok;
+    uint32_t reserved;
+
+    char data[kAgentMailboxSize - 64];
+};
+
+static_assert(sizeof(AgentMailbox) == kAgentMailboxSize);
+static constexpr size_t kAgentMaxData = sizeof(AgentMailbox::data);
@@ -0,0 +1,206 @@
+//
+// Created by chic on 2025/7/12.
+//
+// 主机上比较等 waitSoPath 加载时每次命中断点的开销
+// fork一个子进程反复调用同一个函数, 像 __dl_notify_gdb_of_load 每加载一个so调用一次那样,
+// 软件断点每次命中要恢复原指令, 单步, 再写回断点; 硬件断点只改调试寄存器, x86_64 上直接继续
+// 输出命中次数(必须跟调用次数一样), 每次命中的耗时, 停止次数和写代码段的次数
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/ptrace.h>
+#include <sys/uio.h>
+#include <sys/user.h>
+#include <elf.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include "hw_breakpoint.h"
+#include "remote_memory.h"
+#include "logging.h"
+
+#if defined(__aarch64__)
+static constexpr uint32_t kBreakInstr = 0xD4200000;
+#else
+static constexpr uint32_t kBreakInstr = 0xCC;
+#endif
+
+__attribute__((noinline))
+void bp_target(int i){
+    asm volatile("" : : "r"(i) : "memory");
+}
+
+static uint64_t now_ns(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static bool get_pc(pid_t pid, uintptr_t *pc){
+#if defined(__aarch64__)
+    struct user_pt_regs regs;
+#else
+    struct user_regs_struct regs;
+#endif
+    struct iovec iov = {&regs, sizeof(regs)};
+    if (ptrace(PTRACE_GETREGSET, pid, NT_PRSTATUS, &iov) == -1) {
+        return false;
+    }
+#if defined(__aarch64__)
+    *pc = regs.pc;
+#else
+    *pc = regs.rip;
+#endif
+    return true;
+}
+
+#if defined(__x86_64__)
+// int3 执行完以后pc在下一个字节, 退回到断点位置
+static bool rewind_pc(pid_t pid){
+    struct user_regs_struct regs;
+    struct iovec iov = {&regs, sizeof(regs)};
+    if (ptrace(PTRACE_GETREGSET, pid, NT_PRSTATUS, &iov) == -1) {
+        return false;
+    }
+    regs.rip -= 1;
+    return ptrace(PTRACE_SETREGSET, pid, NT_PRSTATUS, &iov) != -1;
+}
+#endif
+
+struct Result {
+    bool ok = false;
+    long hits = 0;
+    long stops = 0;
+    long text_writes = 0;
+    uint64_t ns = 0;
+};
+
+// 子进程停在 SIGSTOP 上以后下断点, 一直运行到退出
+static Result run(int calls, bool hardware){
+    Result r;
+    pid_t pid = fork();
+    if (pid == 0) {
+        ptrace(PTRACE_TRACEME, 0, 0, 0);
+        raise(SIGSTOP);
+        for (int i = 0; i < calls; i++) {
+            bp_target(i);
+        }
+        _exit(0);
+    }
+    int status;
+    if (waitpid(pid, &status, 0) == -1 || !WIFSTOPPED(status)) {
+        PLOGE("wait %d", pid);
+        return r;
+    }
+    uintptr_t addr = (uintptr_t) &bp_target;
+    RemoteMemory mem(pid);
+    HwBreakpoint hw;
+    uint32_t orig = 0;
+    if (hardware) {
+        if (!hw_breakpoint_set(hw, pid, addr)) {
+            kill(pid, SIGKILL);
+            waitpid(pid, &status, 0);
+            return r;
+        }
+    } else {
+        if (!mem.read(addr, &orig) ||
+            !mem.write(addr, kBreakInstr == 0xCC ? (orig & ~0xffu) | 0xCC : kBreakInstr)) {
+            kill(pid, SIGKILL);
+            waitpid(pid, &status, 0);
+            return r;
+        }
+        r.text_writes++;
+    }
+    uint64_t start = now_ns();
+    ptrace(PTRACE_CONT, pid, 0, 0);
+    while (waitpid(pid, &status, 0) != -1) {
+        if (WIFEXITED(status) || WIFSIGNALED(status)) {
+            r.ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+            break;
+        }
+        r.stops++;
+        if (WSTOPSIG(status) != SIGTRAP) {
+            ptrace(PTRACE_CONT, pid, 0, WSTOPSIG(status));
+            continue;
+        }
+        r.hits++;
+        if (hardware) {
+            uintptr_t pc = 0;
+            if (!hw_breakpoint_hit(hw, status) || !get_pc(pid, &pc) || pc != addr) {
+                LOGE("unexpected stop at %lx", (unsigned long) pc);
+                break;
+            }
+            if (!kHwBreakpointNeedsStep) {
+                ptrace(PTRACE_CONT, pid, 0, 0);
+                continue;
+            }
+            hw_breakpoint_enable(hw, false);
+        } else {
+#if defined(__x86_64__)
+            rewind_pc(pid);
+#endif
+            mem.write(addr, orig);
+            r.text_writes++;
+        }
+        // 单步越过断点以后重新下
+        ptrace(PTRACE_SINGLESTEP, pid, 0, 0);
+        if (waitpid(pid, &status, 0) == -1 || !WIFSTOPPED(status)) {
+            break;
+        }
+        r.stops++;
+        if (hardware) {
+            hw_breakpoint_enable(hw, true);
+        } else {
+            mem.write(addr, kBreakInstr == 0xCC ? (orig & ~0xffu) | 0xCC : kBreakInstr);
+            r.text_writes++;
+        }
+        ptrace(PTRACE_CONT, pid, 0, 0);
+    }
+    r.ns = now_ns() - start;
+    if (!r.ok) {
+        kill(pid, SIGKILL);
+        waitpid(pid, &status, 0);
+    }
+    return r;
+}
+
+static void print(const char *name, const Result &r, int calls){
+    if (!r.ok) {
+        printf("%-10s %s\n", name, "failed");
+        return;
+    }
+    double n = r.hits > 0 ? r.hits : 1;
+    printf("%-10s %8ld %s %10.0f %10.2f %12.2f\n", name, r.hits, r.hits == calls ? "ok " : "BAD",
+           r.ns / n, r.stops / n, r.text_writes / n);
+}
+
+static void usage(const char *prog){
+    fprintf(stderr, "usage: %s [-n calls]\n", prog);
+}
+
+int main(int argc, char *argv[]){
+    int calls = 2000;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:h")) != -1) {
+        switch (opt) {
+            case 'n':
+                calls = atoi(optarg);
+                break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+    printf("%-10s %8s %3s %10s %10s %12s\n", "mode", "hits", "", "ns/hit", "stops/hit", "writes/hit");
+    print("software", run(calls, false), calls);
+    Result hw = run(calls, true);
+    if (!hw.ok && hw.hits == 0) {
+        printf("%-10s %s\n", "hardware", "unsupported, adi falls back to software breakpoints");
+        return 0;
+    }
+    print("hardware", hw, calls);
+    return 0;
+}
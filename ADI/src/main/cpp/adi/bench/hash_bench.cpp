@@ -0,0 +1,145 @@
+//
+// Created by chic on 2025/7/9.
+//
+// 比较 symbol_hash 里各个 GNU hash 实现: 名字取自 -l 指定的so(默认 libc 所在的文件)的 .dynsym/.symtab
+// 先对每个名字的每个后缀(覆盖所有对齐和长度)检查各实现和逐字节的结果一样,
+// 再输出每个实现 每个名字/每字节 的耗时, 以及 gnu_hash_batch 一次算完所有名字的耗时
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <dlfcn.h>
+#include <elf.h>
+#include <link.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <vector>
+#include "symbol_hash.h"
+
+static uint64_t now_ns(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// .symtab 和 .dynsym 里所有非空的符号名
+static bool load_names(const char *path, std::vector<std::string> *names){
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat s;
+    fstat(fd, &s);
+    auto data = (uint8_t *) mmap(nullptr, s.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+    auto ehdr = (ElfW(Ehdr) *) data;
+    auto shdr = (ElfW(Shdr) *) (data + ehdr->e_shoff);
+    for (size_t i = 0; i < ehdr->e_shnum; i++) {
+        if (shdr[i].sh_type != SHT_SYMTAB && shdr[i].sh_type != SHT_DYNSYM) {
+            continue;
+        }
+        auto syms = (ElfW(Sym) *) (data + shdr[i].sh_offset);
+        auto strtab = (const char *) data + shdr[shdr[i].sh_link].sh_offset;
+        for (size_t j = 1; j < shdr[i].sh_size / sizeof(ElfW(Sym)); j++) {
+            if (strtab[syms[j].st_name] != '\0') {
+                names->emplace_back(strtab + syms[j].st_name);
+            }
+        }
+    }
+    munmap(data, s.st_size);
+    return true;
+}
+
+static void usage(const char *prog){
+    fprintf(stderr, "usage: %s [-l library] [-r rounds]\n", prog);
+}
+
+int main(int argc, char *argv[]){
+    std::string library;
+    unsigned int rounds = 200;
+    int opt;
+    while ((opt = getopt(argc, argv, "l:r:h")) != -1) {
+        switch (opt) {
+            case 'l':
+                library = optarg;
+                break;
+            case 'r':
+                rounds = strtoul(optarg, nullptr, 10);
+                break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (rounds == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (library.empty()) {
+        Dl_info info;
+        if (dladdr((void *) &malloc, &info) == 0 || info.dli_fname == nullptr) {
+            fprintf(stderr, "dladdr malloc failed\n");
+            return 1;
+        }
+        library = info.dli_fname;
+    }
+    std::vector<std::string> names;
+    if (!load_names(library.c_str(), &names) || names.empty()) {
+        fprintf(stderr, "no symbol names in %s\n", library.c_str());
+        return 1;
+    }
+    std::vector<const char *> ptrs;
+    size_t bytes = 0;
+    for (auto &name: names) {
+        ptrs.push_back(name.c_str());
+        bytes += name.size();
+    }
+
+    const GnuHashBackend *backends;
+    size_t count = gnu_hash_backends(&backends);
+    for (size_t b = 1; b < count; b++) {
+        for (auto &name: names) {
+            for (size_t k = 0; k <= name.size(); k++) {
+                uint32_t len = 0, expected_len = 0;
+                uint32_t h = backends[b].hash(name.c_str() + k, &len);
+                uint32_t expected = backends[0].hash(name.c_str() + k, &expected_len);
+                if (h != expected || len != expected_len) {
+                    fprintf(stderr, "%s mismatch for %s\n", backends[b].name, name.c_str() + k);
+                    return 1;
+                }
+            }
+        }
+    }
+    printf("%s: %zu names, %.1f bytes avg, backends checked against scalar: %zu\n", library.c_str(), names.size(),
+           (double) bytes / names.size(), count - 1);
+
+    printf("%-12s %10s %10s\n", "backend", "ns/name", "ns/byte");
+    uint32_t sink = 0;
+    for (size_t b = 0; b < count; b++) {
+        uint64_t start = now_ns();
+        for (unsigned int r = 0; r < rounds; r++) {
+            for (auto name: ptrs) {
+                sink += backends[b].hash(name, nullptr);
+            }
+        }
+        double total = (double) (now_ns() - start);
+        printf("%-12s %10.2f %10.3f\n", backends[b].name, total / rounds / names.size(), total / rounds / bytes);
+    }
+    std::vector<uint32_t> hashes(ptrs.size());
+    uint64_t start = now_ns();
+    for (unsigned int r = 0; r < rounds; r++) {
+        gnu_hash_batch(ptrs.data(), hashes.data(), ptrs.size());
+        sink += hashes[r % hashes.size()];
+    }
+    double total = (double) (now_ns() - start);
+    printf("%-12s %10.2f %10.3f\n", "batch", total / rounds / names.size(), total / rounds / bytes);
+    return sink != 0 ? 0 : 1;
+}
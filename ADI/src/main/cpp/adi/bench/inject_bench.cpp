@@ -0,0 +1,303 @@
+//
+// Created by chic on 2025/6/28.
+//
+// 主机上(x86_64 Linux)比较两种注入方式让目标进程停下来的次数和耗时
+// chain: 跟 inject_process 原来的做法一样, mmap -> dlopen -> dlsym -> 用户函数 -> munmap 每一步让进程运行一次,
+//        mmap/munmap 用 remote_syscall, 其他的用 ptrace_call
+// stub:  ptrace_call_inject_stub, 进程只运行一次
+// fork一个一直 pause 的子进程, SEIZE以后对它反复注入 libadi_bench_payload.so,
+// 输出每次注入的耗时, 系统调用次数, 并检查用户函数的返回值
+// getpid/vdso 两行是 remote_syscall(getpid) 一次的开销, 分别用pc前面的syscall指令和vdso里的指令
+// agent: 用stub注入一次 libadi_agent.so 以后, 通过 AgentClient 加载和调用, 不用ptrace, 需要root才能打开 map_files
+// glibc 2.34 以后 dlopen/dlsym 都在 libc.so.6 里
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/sysmacros.h>
+#include <link.h>
+#include <cinttypes>
+#include <array>
+#include <unistd.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+// PtraceUtils.h 要用到 contorlProcess.h 里的 EntryStop
+#include "contorlProcess.h"
+#include "PtraceUtils.h"
+#include "agent_client.h"
+#include "inject_metrics.h"
+#include "logging.h"
+
+static constexpr const char *kPayloadFunc = "adi_bench_payload";
+static constexpr const char *kPayloadArg = "hello from adi_inject_bench";
+
+struct LibcFuncs {
+    void *dlopen_addr;
+    void *dlsym_addr;
+    void *dlerror_addr;
+};
+
+static uint64_t now_ns(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// 返回用户函数的返回值, 失败返回-1
+static long inject_chain(pid_t pid, LibcFuncs &f, const char *lib){
+    RemoteMemory mem(pid);
+    RemoteArena arena;
+    struct pt_regs CurrentRegs, OriginalRegs;
+    if (ptrace_getregs(pid, &CurrentRegs) != 0) {
+        return -1;
+    }
+    memcpy(&OriginalRegs, &CurrentRegs, sizeof(CurrentRegs));
+    long ret = -1;
+    do {
+        size_t payload = strlen(lib) + strlen(kPayloadFunc) + strlen(kPayloadArg) + 3;
+        if (!remote_arena_map(mem, arena, &CurrentRegs, 0, remote_arena_size_for(payload))) {
+            break;
+        }
+        uintptr_t RemoteLibPath = arena.push_string(lib);
+        uintptr_t RemoteFunctionName = arena.push_string(kPayloadFunc);
+        uintptr_t RemoteFunctionArgs = arena.push_string(kPayloadArg);
+        if (!arena.flush(mem)) {
+            break;
+        }
+        long parameters[2] = {(long) RemoteLibPath, RTLD_NOW};
+        if (ptrace_call(pid, (uintptr_t) f.dlopen_addr, parameters, 2, &CurrentRegs, 0) == -1) {
+            break;
+        }
+        long handle = ptrace_getret(&CurrentRegs);
+        if (handle == 0) {
+            break;
+        }
+        parameters[0] = handle;
+        parameters[1] = (long) RemoteFunctionName;
+        if (ptrace_call(pid, (uintptr_t) f.dlsym_addr, parameters, 2, &CurrentRegs, 0) == -1) {
+            break;
+        }
+        long symbol = ptrace_getret(&CurrentRegs);
+        if (symbol == 0) {
+            break;
+        }
+        parameters[1] = (long) RemoteFunctionArgs;
+        if (ptrace_call(pid, (uintptr_t) symbol, parameters, 2, &CurrentRegs, 0) == -1) {
+            break;
+        }
+        ret = ptrace_getret(&CurrentRegs);
+    } while (false);
+    remote_arena_unmap(mem, arena, &CurrentRegs, 0);
+    ptrace_setregs(pid, &OriginalRegs);
+    return ret;
+}
+
+static long inject_stub(pid_t pid, LibcFuncs &f, const char *lib){
+    RemoteMemory mem(pid);
+    struct pt_regs OriginalRegs;
+    if (ptrace_getregs(pid, &OriginalRegs) != 0) {
+        return -1;
+    }
+    InjectMailbox box{};
+    box.dlopen = (uintptr_t) f.dlopen_addr;
+    box.dlsym = (uintptr_t) f.dlsym_addr;
+    box.dlerror = (uintptr_t) f.dlerror_addr;
+    int result = ptrace_call_inject_stub(mem, box, lib, kPayloadFunc, kPayloadArg, &OriginalRegs);
+    ptrace_setregs(pid, &OriginalRegs);
+    if (result != 1 || box.symbol == 0) {
+        fprintf(stderr, "stub inject failed: %d %s\n", result, box.error);
+        return -1;
+    }
+    return (long) box.ret;
+}
+
+// 停在pause里的时候用pc前面的syscall指令, via_vdso 假装pc不在系统调用上, 用vdso里的指令
+static bool syscall_getpid(pid_t pid, bool via_vdso){
+    RemoteMemory mem(pid);
+    struct pt_regs OriginalRegs, Regs;
+    if (ptrace_getregs(pid, &OriginalRegs) != 0) {
+        return false;
+    }
+    memcpy(&Regs, &OriginalRegs, sizeof(Regs));
+    if (via_vdso) {
+        ptrace_setpc(&Regs, 0x1000);
+    }
+    long ret = -1;
+    bool ok = remote_syscall(mem, &Regs, &ret, __NR_getpid);
+    if (via_vdso) {
+        ptrace_setregs(pid, &OriginalRegs);
+    }
+    return ok && ret == pid;
+}
+
+static bool run_syscall(const char *name, pid_t pid, unsigned int count, bool via_vdso){
+    InjectTimeline timeline;
+    InjectMetrics::current() = &timeline;
+    uint64_t start = now_ns();
+    bool ok = true;
+    for (unsigned int i = 0; i < count && ok; i++) {
+        ok = syscall_getpid(pid, via_vdso);
+    }
+    uint64_t elapsed = now_ns() - start;
+    InjectMetrics::current() = nullptr;
+    if (!ok) {
+        printf("%-6s failed\n", name);
+        return false;
+    }
+    auto per = [&](SyscallKind k) { return (double) timeline.syscalls[(int) k] / count; };
+    printf("%-6s %10.0f %8.1f %8.1f %10.1f %8.1f\n", name, (double) elapsed / count, per(SyscallKind::PTRACE),
+           per(SyscallKind::WAITPID), per(SyscallKind::PROCESS_VM), per(SyscallKind::PROC_MEM));
+    return true;
+}
+
+static bool run(const char *name, pid_t pid, LibcFuncs &f, const char *lib, unsigned int count,
+                long (*inject)(pid_t, LibcFuncs &, const char *)){
+    InjectTimeline timeline;
+    InjectMetrics::current() = &timeline;
+    uint64_t start = now_ns();
+    bool ok = true;
+    for (unsigned int i = 0; i < count && ok; i++) {
+        ok = inject(pid, f, lib) == (long) strlen(kPayloadArg);
+    }
+    uint64_t elapsed = now_ns() - start;
+    InjectMetrics::current() = nullptr;
+    if (!ok) {
+        printf("%-6s failed\n", name);
+        return false;
+    }
+    auto per = [&](SyscallKind k) { return (double) timeline.syscalls[(int) k] / count; };
+    printf("%-6s %10.0f %8.1f %8.1f %10.1f %8.1f\n", name, (double) elapsed / count, per(SyscallKind::PTRACE),
+           per(SyscallKind::WAITPID), per(SyscallKind::PROCESS_VM), per(SyscallKind::PROC_MEM));
+    return true;
+}
+
+// 注入一次agent, 之后的注入都通过邮箱完成
+static bool run_agent(pid_t pid, LibcFuncs &f, const std::string &agent_lib, const char *lib, unsigned int count){
+    RemoteMemory mem(pid);
+    struct pt_regs OriginalRegs;
+    if (ptrace_getregs(pid, &OriginalRegs) != 0) {
+        return false;
+    }
+    InjectMailbox box{};
+    box.dlopen = (uintptr_t) f.dlopen_addr;
+    box.dlsym = (uintptr_t) f.dlsym_addr;
+    box.dlerror = (uintptr_t) f.dlerror_addr;
+    int result = ptrace_call_inject_stub(mem, box, agent_lib.c_str(), ADI_AGENT_START, "", &OriginalRegs);
+    ptrace_setregs(pid, &OriginalRegs);
+    AgentClient agent;
+    if (result != 1 || box.ret == 0 || !agent.open(pid)) {
+        printf("%-6s failed: %d %s\n", "agent", result, box.error);
+        return false;
+    }
+
+    InjectTimeline timeline;
+    InjectMetrics::current() = &timeline;
+    uint64_t start = now_ns();
+    bool ok = true;
+    for (unsigned int i = 0; i < count && ok; i++) {
+        uint64_t handle = 0;
+        long ret = -1;
+        ok = agent.load(lib, &handle) && agent.call(handle, kPayloadFunc, kPayloadArg, &ret) &&
+             ret == (long) strlen(kPayloadArg);
+    }
+    uint64_t elapsed = now_ns() - start;
+    InjectMetrics::current() = nullptr;
+    if (!ok) {
+        printf("%-6s failed: %s\n", "agent", agent.get_error().c_str());
+        return false;
+    }
+    auto per = [&](SyscallKind k) { return (double) timeline.syscalls[(int) k] / count; };
+    printf("%-6s %10.0f %8.1f %8.1f %10.1f %8.1f\n", "agent", (double) elapsed / count, per(SyscallKind::PTRACE),
+           per(SyscallKind::WAITPID), per(SyscallKind::PROCESS_VM), per(SyscallKind::PROC_MEM));
+    return true;
+}
+
+static void usage(const char *prog){
+    fprintf(stderr, "usage: %s [-n injections] [-l payload.so] [-v]\n", prog);
+}
+
+int main(int argc, char *argv[]){
+    unsigned int count = 200;
+    std::string lib;
+    bool verbose = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:l:vh")) != -1) {
+        switch (opt) {
+            case 'n':
+                count = strtoul(optarg, nullptr, 10);
+                break;
+            case 'l':
+                lib = optarg;
+                break;
+            case 'v':
+                verbose = true;
+                break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+    std::string dir = get_program(getpid());
+    dir = dir.substr(0, dir.rfind('/') + 1);
+    if (lib.empty()) {
+        // 默认用跟benchmark放在一起的 libadi_bench_payload.so
+        lib = dir + "libadi_bench_payload.so";
+    }
+    if (count == 0 || access(lib.c_str(), R_OK) != 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (!verbose) {
+        // ptrace_call 每次调用都会输出日志
+        logging::setfd(open("/dev/null", O_WRONLY | O_CLOEXEC));
+    }
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        while (true) {
+            pause();
+        }
+    }
+    int status;
+    if (ptrace(PTRACE_SEIZE, pid, 0, 0) == -1 || ptrace(PTRACE_INTERRUPT, pid, 0, 0) == -1 ||
+        waitpid(pid, &status, __WALL) == -1) {
+        PLOGE("seize %d", pid);
+        kill(pid, SIGKILL);
+        return 1;
+    }
+
+    LibcFuncs f{};
+    {
+        static const char *const kNames[] = {"dlopen", "dlsym", "dlerror"};
+        uintptr_t addrs[3] = {0, 0, 0};
+        RemoteMemory mem(pid);
+        RemoteElf libc(mem);
+        if (libc.open(reinterpret_cast<uintptr_t>(find_module_base(pid, "libc.so.6")))) {
+            libc.find(kNames, addrs, 3);
+        }
+        f.dlopen_addr = (void *) addrs[0];
+        f.dlsym_addr = (void *) addrs[1];
+        f.dlerror_addr = (void *) addrs[2];
+    }
+    if (!f.dlopen_addr || !f.dlsym_addr || !f.dlerror_addr) {
+        fprintf(stderr, "libc functions not found in target\n");
+        kill(pid, SIGKILL);
+        return 1;
+    }
+
+    printf("%-6s %10s %8s %8s %10s %8s\n", "mode", "ns/inject", "ptrace", "waitpid", "process_vm", "proc_mem");
+    bool ok = run("chain", pid, f, lib.c_str(), count, inject_chain) &&
+              run("stub", pid, f, lib.c_str(), count, inject_stub) &&
+              run_syscall("getpid", pid, count, false) &&
+              run_syscall("vdso", pid, count, true) &&
+              run_agent(pid, f, dir + "libadi_agent.so", lib.c_str(), count);
+
+    kill(pid, SIGKILL);
+    waitpid(pid, &status, __WALL);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,12 @@
+//
+// Created by chic on 2025/6/28.
+//
+// adi_inject_bench 注入到目标进程里的so, 返回参数的长度, 用来检查参数和返回值有没有传对
+
+#include <cstring>
+
+extern "C" __attribute__((visibility("default")))
+long adi_bench_payload(void *handle, const char *arg){
+    (void) handle;
+    return (long) strlen(arg);
+}
@@ -0,0 +1,281 @@
+//
+// Created by chic on 2025/7/4.
+//
+// 比较原来 getline+sscanf 逐行解析 /proc/pid/maps 和 ProcMaps 的耗时
+// 不指定 -p 时fork一个子进程, 在里面把可执行文件映射 -m 次, 做出跟 system_server 差不多数量的映射
+// 手机上可以用 -p 指定 system_server 的pid
+// 输出每次扫描的耗时, 以及按地址找映射和按文件名找模块基址的耗时(逐个比较 / 索引)
+// 最后一列是 PROCMAP_QUERY(linux 6.11+) 不扫描直接查一次的耗时, 要跟 扫描+查找 比较
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <csignal>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <array>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "proc_maps.h"
+
+struct OldMapInfo {
+    uintptr_t start;
+    uintptr_t end;
+    uint8_t perms;
+    bool is_private;
+    uintptr_t offset;
+    dev_t dev;
+    ino_t inode;
+    std::string path;
+};
+
+static uint64_t now_ns(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static bool ends_with(std::string_view str, std::string_view suffix){
+    return str.size() >= suffix.size() && str.substr(str.size() - suffix.size()) == suffix;
+}
+
+// 原来 Utils.h 里的 MapScan
+static std::vector<OldMapInfo> old_scan(pid_t pid){
+    constexpr static auto kPermLength = 5;
+    constexpr static auto kMapEntry = 7;
+    std::vector<OldMapInfo> info;
+    std::string file_name = std::string("/proc/") + std::to_string(pid) + "/maps";
+    auto maps = std::unique_ptr<FILE, decltype(&fclose)>{fopen(file_name.c_str(), "r"), &fclose};
+    if (maps) {
+        char *line = nullptr;
+        size_t len = 0;
+        ssize_t read;
+        while ((read = getline(&line, &len, maps.get())) > 0) {
+            line[read - 1] = '\0';
+            uintptr_t start = 0;
+            uintptr_t end = 0;
+            uintptr_t off = 0;
+            ino_t inode = 0;
+            unsigned int dev_major = 0;
+            unsigned int dev_minor = 0;
+            std::array<char, kPermLength> perm{'\0'};
+            int path_off;
+            if (sscanf(line, "%" PRIxPTR "-%" PRIxPTR " %4s %" PRIxPTR " %x:%x %lu %n%*s", &start,
+                       &end, perm.data(), &off, &dev_major, &dev_minor, &inode,
+                       &path_off) != kMapEntry) {
+                continue;
+            }
+            while (path_off < read && isspace(line[path_off])) path_off++;
+            auto ref = OldMapInfo{start, end, 0, perm[3] == 'p', off,
+                                  static_cast<dev_t>(makedev(dev_major, dev_minor)),
+                                  inode, line + path_off};
+            if (perm[0] == 'r') ref.perms |= PROT_READ;
+            if (perm[1] == 'w') ref.perms |= PROT_WRITE;
+            if (perm[2] == 'x') ref.perms |= PROT_EXEC;
+            info.emplace_back(ref);
+        }
+        free(line);
+    }
+    return info;
+}
+
+static void usage(const char *prog){
+    fprintf(stderr, "usage: %s [-p pid] [-m mappings] [-n scans] [-s module]\n", prog);
+}
+
+int main(int argc, char *argv[]){
+    pid_t pid = -1;
+    unsigned int mappings = 4000;
+    unsigned int count = 200;
+    std::string module = "libc.so.6";
+    int opt;
+    while ((opt = getopt(argc, argv, "p:m:n:s:h")) != -1) {
+        switch (opt) {
+            case 'p':
+                pid = atoi(optarg);
+                break;
+            case 'm':
+                mappings = strtoul(optarg, nullptr, 10);
+                break;
+            case 'n':
+                count = strtoul(optarg, nullptr, 10);
+                break;
+            case 's':
+                module = optarg;
+                break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (count == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    pid_t child = -1;
+    if (pid == -1) {
+        // 自己的maps在扫描的时候会变, 用一个停着的子进程, 两种方式读到的内容才一样
+        int ready[2];
+        if (pipe(ready) == -1) {
+            perror("pipe");
+            return 1;
+        }
+        child = fork();
+        if (child == 0) {
+            // 每次都映射文件的第一页, offset 不连续, 内核不会把相邻的映射合并
+            int fd = open("/proc/self/exe", O_RDONLY | O_CLOEXEC);
+            for (unsigned int i = 0; fd != -1 && i < mappings; i++) {
+                mmap(nullptr, 4096, PROT_READ, MAP_PRIVATE, fd, 0);
+            }
+            char c = 0;
+            write(ready[1], &c, 1);
+            while (true) {
+                pause();
+            }
+        }
+        close(ready[1]);
+        char c;
+        read(ready[0], &c, 1);
+        close(ready[0]);
+        pid = child;
+    }
+
+    ProcMaps maps;
+    if (!maps.scan(pid)) {
+        fprintf(stderr, "scan %d failed\n", pid);
+        if (child != -1) kill(child, SIGKILL);
+        return 1;
+    }
+    auto old = old_scan(pid);
+    if (old.size() != maps.size()) {
+        fprintf(stderr, "mismatch: sscanf %zu entries, ProcMaps %zu entries\n", old.size(), maps.size());
+        if (child != -1) kill(child, SIGKILL);
+        return 1;
+    }
+    for (size_t i = 0; i < old.size(); i++) {
+        auto &a = old[i];
+        auto &b = maps.entries()[i];
+        if (a.start != b.start || a.end != b.end || a.perms != b.perms || a.is_private != b.is_private ||
+            a.offset != b.offset || a.dev != b.dev || a.inode != b.inode || a.path != b.path) {
+            fprintf(stderr, "mismatch at %zu: %s\n", i, a.path.c_str());
+            if (child != -1) kill(child, SIGKILL);
+            return 1;
+        }
+    }
+    bool has_query = ProcMapQuery::ioctl_supported();
+    printf("pid %d, %zu mappings, PROCMAP_QUERY %s\n", pid, maps.size(), has_query ? "supported" : "not supported");
+    printf("%-16s %12s %12s %14s\n", "case", "sscanf", "ProcMaps", "PROCMAP_QUERY");
+
+    uint64_t start = now_ns();
+    size_t sink = 0;
+    for (unsigned int i = 0; i < count; i++) {
+        sink += old_scan(pid).size();
+    }
+    double old_ns = (double) (now_ns() - start) / count;
+    start = now_ns();
+    for (unsigned int i = 0; i < count; i++) {
+        ProcMaps m;
+        m.scan(pid);
+        sink += m.size();
+    }
+    double new_ns = (double) (now_ns() - start) / count;
+    printf("%-16s %12.0f %12.0f %14s\n", "scan ns", old_ns, new_ns, "-");
+
+    // 每个映射中间的地址各找一次
+    constexpr unsigned int kLookups = 100;
+    start = now_ns();
+    for (unsigned int r = 0; r < kLookups; r++) {
+        for (auto &target: old) {
+            uintptr_t addr = target.start + (target.end - target.start) / 2;
+            for (auto &map: old) {
+                if (addr >= map.start && addr < map.end) {
+                    sink += map.start;
+                    break;
+                }
+            }
+        }
+    }
+    old_ns = (double) (now_ns() - start) / (kLookups * old.size());
+    start = now_ns();
+    for (unsigned int r = 0; r < kLookups; r++) {
+        for (auto &target: old) {
+            auto map = maps.find(target.start + (target.end - target.start) / 2);
+            sink += map != nullptr ? map->start : 0;
+        }
+    }
+    new_ns = (double) (now_ns() - start) / (kLookups * old.size());
+    bool ok = true;
+    double query_ns = 0;
+    if (has_query) {
+        ProcMapQuery query(pid);
+        start = now_ns();
+        for (auto &target: old) {
+            // [vsyscall] 不是vma, PROCMAP_QUERY 找不到
+            if (target.path == "[vsyscall]") {
+                continue;
+            }
+            auto map = query.find(target.start + (target.end - target.start) / 2);
+            if (map == nullptr || map->start != target.start || map->path != target.path) {
+                fprintf(stderr, "PROCMAP_QUERY mismatch at %" PRIxPTR "\n", target.start);
+                ok = false;
+                break;
+            }
+        }
+        query_ns = (double) (now_ns() - start) / old.size();
+    }
+    printf("%-16s %12.1f %12.1f %14.1f\n", "addr ns", old_ns, new_ns, query_ns);
+
+    // find_module_base 的查找方式
+    constexpr unsigned int kModuleLookups = 10000;
+    uintptr_t old_base = 0;
+    start = now_ns();
+    for (unsigned int r = 0; r < kModuleLookups; r++) {
+        for (auto &map: old) {
+            if (map.offset == 0 && ends_with(map.path, module)) {
+                old_base = map.start;
+                break;
+            }
+        }
+    }
+    old_ns = (double) (now_ns() - start) / kModuleLookups;
+    uintptr_t new_base = 0;
+    start = now_ns();
+    for (unsigned int r = 0; r < kModuleLookups; r++) {
+        auto map = maps.find_module(module, [](const MapInfo &m) { return m.offset == 0; });
+        new_base = map != nullptr ? map->start : 0;
+    }
+    new_ns = (double) (now_ns() - start) / kModuleLookups;
+    uintptr_t query_base = old_base;
+    query_ns = 0;
+    if (has_query) {
+        // 跟 find_module_base 一样每次新建一个 ProcMapQuery, 按名字找会读一次文本
+        constexpr unsigned int kQueryLookups = 20;
+        start = now_ns();
+        for (unsigned int r = 0; r < kQueryLookups; r++) {
+            ProcMapQuery query(pid);
+            auto map = query.find_module(module, [](const MapInfo &m) { return m.offset == 0; });
+            query_base = map != nullptr ? map->start : 0;
+        }
+        query_ns = (double) (now_ns() - start) / kQueryLookups;
+    }
+    printf("%-16s %12.1f %12.1f %14.1f\n", "module ns", old_ns, new_ns, query_ns);
+    if (old_base != new_base || old_base != query_base) {
+        fprintf(stderr, "module base mismatch for %s: %" PRIxPTR " %" PRIxPTR " %" PRIxPTR "\n", module.c_str(),
+                old_base, new_base, query_base);
+        ok = false;
+    }
+    if (child != -1) {
+        kill(child, SIGKILL);
+        waitpid(child, nullptr, 0);
+    }
+    return ok && sink != 0 ? 0 : 1;
+}
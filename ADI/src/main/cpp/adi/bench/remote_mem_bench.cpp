@@ -0,0 +1,216 @@
+//
+// Created by chic on 2025/6/24.
+//
+// 主机上(x86_64 Linux)比较访问远程进程内存的几种方式
+// fork一个子进程, 在里面映射一块rw内存和一块r-x内存, SEIZE以后停下来,
+// 按不同的传输大小分别用 PEEK/POKE, /proc/pid/mem, process_vm_* 和 RemoteMemory 自动选择读写,
+// 输出每次的耗时, 吞吐和系统调用次数, 另外比较64段分散的小读取合并成一次readv的效果,
+// 以及一个long一个long遍历(像读auxv那样)时开启按页缓存的效果
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#include <sys/ptrace.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <vector>
+#include "remote_memory.h"
+#include "inject_metrics.h"
+#include "logging.h"
+
+static constexpr size_t kMaxSize = 1 << 20;
+static constexpr size_t kScatterCount = 64;
+static constexpr size_t kScatterLen = 16;
+
+struct TargetAddrs {
+    uintptr_t rw;
+    uintptr_t rx;
+};
+
+static uint64_t now_ns(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+[[noreturn]]
+static void target_main(int addr_fd){
+    // rw 后面多留出分散读取用的页
+    auto rw = mmap(nullptr, kMaxSize + kScatterCount * 4096, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    auto rx = mmap(nullptr, 4096, PROT_READ | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (rw == MAP_FAILED || rx == MAP_FAILED) {
+        _exit(1);
+    }
+    TargetAddrs addrs{(uintptr_t) rw, (uintptr_t) rx};
+    if (write(addr_fd, &addrs, sizeof(addrs)) != sizeof(addrs)) {
+        _exit(1);
+    }
+    close(addr_fd);
+    while (true) {
+        pause();
+    }
+}
+
+static const char *path_name(RemoteMemPath path){
+    switch (path) {
+        case RemoteMemPath::AUTO: return "auto";
+        case RemoteMemPath::VM: return "process_vm";
+        case RemoteMemPath::PROC_MEM: return "proc_mem";
+        case RemoteMemPath::PTRACE: return "ptrace";
+    }
+    return "?";
+}
+
+static uint32_t total_syscalls(const InjectTimeline &t){
+    return t.syscalls[(int) SyscallKind::PTRACE] + t.syscalls[(int) SyscallKind::PROCESS_VM] +
+           t.syscalls[(int) SyscallKind::PROC_MEM];
+}
+
+// 在 budget_ns 内反复执行 op, 至少3次, 输出每次的平均耗时和系统调用次数
+template<typename Op>
+static void measure(const char *what, RemoteMemPath path, size_t bytes, uint64_t budget_ns, Op op){
+    InjectTimeline timeline;
+    InjectMetrics::current() = &timeline;
+    uint64_t iters = 0;
+    bool ok = true;
+    uint64_t start = now_ns();
+    uint64_t elapsed = 0;
+    while (ok && (iters < 3 || elapsed < budget_ns)) {
+        ok = op();
+        iters++;
+        elapsed = now_ns() - start;
+    }
+    InjectMetrics::current() = nullptr;
+    if (!ok) {
+        printf("%-14s %-10s %8zu  %12s\n", what, path_name(path), bytes, "failed");
+        return;
+    }
+    double ns = (double) elapsed / iters;
+    printf("%-14s %-10s %8zu  %12.0f %10.1f %10.1f\n", what, path_name(path), bytes, ns,
+           bytes * 1e3 / ns, (double) total_syscalls(timeline) / iters);
+}
+
+static void usage(const char *prog){
+    fprintf(stderr, "usage: %s [-t ms_per_case]\n", prog);
+}
+
+int main(int argc, char *argv[]){
+    unsigned int budget_ms = 100;
+    int opt;
+    while ((opt = getopt(argc, argv, "t:h")) != -1) {
+        switch (opt) {
+            case 't':
+                budget_ms = strtoul(optarg, nullptr, 10);
+                break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+    uint64_t budget_ns = (uint64_t) budget_ms * 1000000ull;
+
+    int fds[2];
+    if (pipe(fds) == -1) {
+        PLOGE("pipe");
+        return 1;
+    }
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(fds[0]);
+        target_main(fds[1]);
+    }
+    close(fds[1]);
+    TargetAddrs addrs{};
+    if (read(fds[0], &addrs, sizeof(addrs)) != sizeof(addrs)) {
+        LOGE("target did not start");
+        return 1;
+    }
+    close(fds[0]);
+    int status;
+    if (ptrace(PTRACE_SEIZE, pid, 0, 0) == -1 || ptrace(PTRACE_INTERRUPT, pid, 0, 0) == -1 ||
+        waitpid(pid, &status, __WALL) == -1) {
+        PLOGE("seize %d", pid);
+        kill(pid, SIGKILL);
+        return 1;
+    }
+
+    std::vector<uint8_t> buf(kMaxSize);
+    for (size_t i = 0; i < buf.size(); i++) {
+        buf[i] = (uint8_t) i;
+    }
+    const size_t sizes[] = {8, 100, 256, 1024, 4096, 65536, kMaxSize};
+    const RemoteMemPath paths[] = {RemoteMemPath::PTRACE, RemoteMemPath::PROC_MEM, RemoteMemPath::VM,
+                                   RemoteMemPath::AUTO};
+
+    printf("%-14s %-10s %8s  %12s %10s %10s\n", "case", "path", "bytes", "ns/op", "MB/s", "syscalls");
+    for (size_t size : sizes) {
+        for (RemoteMemPath path : paths) {
+            RemoteMemory mem(pid);
+            mem.set_path(path);
+            measure("write rw", path, size, budget_ns, [&] { return mem.write(addrs.rw, buf.data(), size); });
+            measure("read rw", path, size, budget_ns, [&] { return mem.read(addrs.rw, buf.data(), size); });
+        }
+    }
+
+    // 下断点: 往r-x代码段写4字节, process_vm_writev 会失败
+    uint32_t instr = 0xD4200000;
+    for (RemoteMemPath path : paths) {
+        RemoteMemory mem(pid);
+        mem.set_path(path);
+        measure("write r-x", path, sizeof(instr), budget_ns, [&] { return mem.write(addrs.rx, instr); });
+    }
+
+    // 64段分散在不同页上的16字节读取, 逐个读和合并成一次readv
+    std::vector<RemoteIo> ios(kScatterCount);
+    for (size_t i = 0; i < kScatterCount; i++) {
+        ios[i] = {addrs.rw + kMaxSize + i * 4096, buf.data() + i * kScatterLen, kScatterLen};
+    }
+    for (RemoteMemPath path : paths) {
+        RemoteMemory mem(pid);
+        mem.set_path(path);
+        measure("scatter 1by1", path, kScatterCount * kScatterLen, budget_ns, [&] {
+            for (auto &io : ios) {
+                if (!mem.read(io.remote, io.local, io.len)) return false;
+            }
+            return true;
+        });
+        measure("scatter readv", path, kScatterCount * kScatterLen, budget_ns, [&] {
+            return mem.readv(ios.data(), ios.size());
+        });
+    }
+
+    // 像读auxv一样一次读一个long, 连续读512个, 每轮开始前进程算作运行过一次
+    for (size_t cache_pages : {(size_t) 0, RemoteMemory::kDefaultCachePages}) {
+        RemoteMemory mem(pid);
+        mem.enable_cache(cache_pages);
+        measure(cache_pages == 0 ? "walk uncached" : "walk cached", RemoteMemPath::AUTO, 512 * sizeof(long),
+                budget_ns, [&] {
+            RemoteMemory::invalidate_all();
+            for (size_t i = 0; i < 512; i++) {
+                long word;
+                if (!mem.read(addrs.rw + i * sizeof(long), &word)) return false;
+            }
+            return true;
+        });
+    }
+    // 写入以后缓存必须失效
+    {
+        RemoteMemory mem(pid);
+        mem.enable_cache();
+        uint64_t before = 0, after = 0, value = 0x1122334455667788ull;
+        mem.read(addrs.rw, &before);
+        mem.write(addrs.rw, value);
+        mem.read(addrs.rw, &after);
+        printf("cache invalidated on write: %s\n", after == value ? "yes" : "NO");
+    }
+
+    kill(pid, SIGKILL);
+    waitpid(pid, &status, __WALL);
+    return 0;
+}
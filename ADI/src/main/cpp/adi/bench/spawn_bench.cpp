@@ -0,0 +1,415 @@
+//
+// Created by chic on 2025/6/20.
+//
+// 主机上(x86_64 Linux)测试监控init带来的进程创建延迟
+// 合成一个"init"进程按固定速率 fork+exec N 个马上退出的子进程, 一部分子进程的exec文件符合规则,
+// 分别在没有监控和有监控的情况下运行一次, 比较每次 fork 到 waitpid 返回的延迟和吞吐
+// 符合规则的子进程会走完 exec停止 -> 匹配 -> 入口停止 -> 等待waitSoPath, 主机上没有android的linker,
+// 在这里会detach, 所以不包括真正dlopen的耗时
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <fstream>
+#include "json.hpp"
+#include "contorlProcess.h"
+#include "ptrace_monitor.h"
+#include "proc_connector.h"
+#include "fanotify_gate.h"
+#include "inject_metrics.h"
+#include "logging.h"
+
+struct BenchArgs {
+    unsigned int count = 1000;
+    unsigned int rate = 0;              // 每秒创建的进程数, 0表示不限速
+    unsigned int match_percent = 10;
+    const char *true_path = "/bin/true";
+    bool shard = false;
+    MonitorBackend backend = MonitorBackend::PTRACE;
+    const char *stats = nullptr;
+    // 监控进程写统计的文件, 没有 --stats 时用临时目录里的文件, 用来检查符合规则的子进程有没有走完流程
+    std::string stats_path;
+    bool verbose = false;
+};
+
+struct SpawnSample {
+    uint64_t ns;
+    uint32_t matched;
+};
+
+struct RoundResult {
+    uint64_t wall_ns = 0;
+    std::vector<SpawnSample> samples;
+};
+
+static uint64_t now_ns(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static bool copy_file(const char *from, const std::string &to){
+    int in = open(from, O_RDONLY | O_CLOEXEC);
+    if (in == -1) {
+        PLOGE("open %s", from);
+        return false;
+    }
+    int out = open(to.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0755);
+    if (out == -1) {
+        PLOGE("open %s", to.c_str());
+        close(in);
+        return false;
+    }
+    char buf[65536];
+    ssize_t n;
+    bool ok = true;
+    while ((n = read(in, buf, sizeof(buf))) > 0) {
+        if (write(out, buf, n) != n) {
+            ok = false;
+            break;
+        }
+    }
+    close(in);
+    close(out);
+    return ok && n == 0;
+}
+
+static bool read_full(int fd, void *buf, size_t len){
+    auto p = static_cast<char *>(buf);
+    while (len > 0) {
+        ssize_t n = read(fd, p, len);
+        if (n <= 0) {
+            if (n == -1 && errno == EINTR) continue;
+            return false;
+        }
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+// 合成的init: 等待go以后按速率创建子进程,把每次的延迟写回results
+[[noreturn]]
+static void synthetic_init(const BenchArgs &args, const std::string &match_path,
+                           const std::string &nomatch_path, int go_fd, int result_fd){
+    char c;
+    if (!read_full(go_fd, &c, 1)) {
+        _exit(1);
+    }
+    std::vector<SpawnSample> samples(args.count);
+    uint64_t start = now_ns();
+    for (unsigned int i = 0; i < args.count; i++) {
+        if (args.rate != 0) {
+            uint64_t due = start + (uint64_t) i * 1000000000ull / args.rate;
+            uint64_t now = now_ns();
+            if (due > now) {
+                struct timespec ts = {(time_t) ((due - now) / 1000000000ull), (long) ((due - now) % 1000000000ull)};
+                nanosleep(&ts, nullptr);
+            }
+        }
+        // 匹配的子进程均匀分布在整个过程中
+        bool matched = (uint64_t) i * args.match_percent / 100 != (uint64_t) (i + 1) * args.match_percent / 100;
+        const char *path = matched ? match_path.c_str() : nomatch_path.c_str();
+        uint64_t t0 = now_ns();
+        pid_t pid = fork();
+        if (pid == 0) {
+            execl(path, path, (char *) nullptr);
+            _exit(127);
+        }
+        int status;
+        while (waitpid(pid, &status, 0) == -1 && errno == EINTR);
+        samples[i] = {now_ns() - t0, matched};
+    }
+    uint64_t wall = now_ns() - start;
+    write(result_fd, &wall, sizeof(wall));
+    write(result_fd, samples.data(), samples.size() * sizeof(SpawnSample));
+    _exit(0);
+}
+
+static void stats_exit(int){
+    InjectMetrics::getInstance().dump();
+    InjectMetrics::getInstance().write_json();
+    _exit(0);
+}
+
+// 监控进程: 跟adi --monitor一样的流程, 规则只有match_path一条
+[[noreturn]]
+static void monitor_main(const BenchArgs &args, pid_t init_pid, const std::string &match_path){
+    if (!args.verbose) {
+        int null_fd = open("/dev/null", O_WRONLY);
+        dup2(null_fd, STDERR_FILENO);
+    }
+    InjectMetrics::getInstance().setEnabled(true);
+    InjectMetrics::getInstance().setJsonPath(args.stats_path);
+    signal(SIGTERM, stats_exit);
+    InjectProc &injectProc = InjectProc::getInstance();
+    injectProc.setTracePid(init_pid);
+    injectProc.setShard(args.shard);
+    injectProc.setBackend(args.backend);
+    // waitSoPath永远不会加载, 进程在入口停止以后就会detach
+    injectProc.add_childProces(std::unique_ptr<ContorlProcess>(new ContorlProcess {
+            match_path, "libadi_bench_never_loaded.so", "", "", "", "", args.count}));
+    if (!injectProc.compile_rules()) {
+        _exit(1);
+    }
+    if (args.backend == MonitorBackend::NETLINK) {
+        ProcConnectorTask();
+    } else if (args.backend == MonitorBackend::FANOTIFY) {
+        FanotifyGateTask();
+    }
+    PtraceTask();
+}
+
+// ptrace后端SEIZE成功以后 /proc/pid/status 里的TracerPid不为0
+static bool wait_traced(pid_t pid){
+    std::string path = "/proc/" + std::to_string(pid) + "/status";
+    for (int i = 0; i < 5000; i++) {
+        FILE *fp = fopen(path.c_str(), "r");
+        if (fp == nullptr) {
+            return false;
+        }
+        char line[256];
+        int tracer = 0;
+        while (fgets(line, sizeof(line), fp)) {
+            if (sscanf(line, "TracerPid: %d", &tracer) == 1) break;
+        }
+        fclose(fp);
+        if (tracer != 0) {
+            return true;
+        }
+        usleep(1000);
+    }
+    return false;
+}
+
+static bool run_round(const BenchArgs &args, bool traced, const std::string &match_path,
+                      const std::string &nomatch_path, RoundResult &result){
+    int go[2], res[2];
+    if (pipe2(go, O_CLOEXEC) == -1 || pipe2(res, O_CLOEXEC) == -1) {
+        PLOGE("pipe");
+        return false;
+    }
+    pid_t init_pid = fork();
+    if (init_pid == 0) {
+        close(go[1]);
+        close(res[0]);
+        synthetic_init(args, match_path, nomatch_path, go[0], res[1]);
+    }
+    close(go[0]);
+    close(res[1]);
+    pid_t monitor_pid = -1;
+    if (traced) {
+        monitor_pid = fork();
+        if (monitor_pid == 0) {
+            monitor_main(args, init_pid, match_path);
+        }
+        bool ready;
+        if (args.backend == MonitorBackend::PTRACE) {
+            ready = wait_traced(init_pid);
+        } else {
+            // netlink/fanotify 没有办法从外面看出是否准备好了
+            usleep(200 * 1000);
+            ready = true;
+        }
+        if (!ready) {
+            LOGE("monitor did not attach to %d", init_pid);
+            kill(init_pid, SIGKILL);
+            kill(monitor_pid, SIGKILL);
+            waitpid(init_pid, nullptr, 0);
+            waitpid(monitor_pid, nullptr, 0);
+            return false;
+        }
+    }
+    write(go[1], "g", 1);
+    close(go[1]);
+    result.samples.resize(args.count);
+    bool ok = read_full(res[0], &result.wall_ns, sizeof(result.wall_ns)) &&
+              read_full(res[0], result.samples.data(), result.samples.size() * sizeof(SpawnSample));
+    close(res[0]);
+    waitpid(init_pid, nullptr, 0);
+    if (monitor_pid > 0) {
+        kill(monitor_pid, SIGTERM);
+        waitpid(monitor_pid, nullptr, 0);
+    }
+    return ok;
+}
+
+/**
+ * 符合规则的子进程都要走到入口停止(或者已经在等waitSoPath), 没走到说明交接或者SEIZE出了问题,
+ * 进程直接跑完了, 这时延迟反而更低, 只看延迟发现不了
+ * netlink 是进程跑起来以后才SEIZE, 没有入口停止, 主机上也没有android的linker可以等, 不检查
+ */
+static bool check_matched(const BenchArgs &args, const std::string &match_path){
+    std::ifstream f(args.stats_path);
+    auto root = nlohmann::json::parse(f, nullptr, false);
+    if (root.is_discarded() || !root.contains("rules")) {
+        LOGE("read stats %s failed", args.stats_path.c_str());
+        return false;
+    }
+    uint64_t processes = 0, entry_stop = 0, wait_lib = 0;
+    if (root["rules"].contains(match_path)) {
+        auto &rule = root["rules"][match_path];
+        processes = rule.value("processes", (uint64_t) 0);
+        if (rule.contains("timeline_ns")) {
+            auto &marks = rule["timeline_ns"];
+            if (marks.contains("entry_stop")) entry_stop = marks["entry_stop"].value("count", (uint64_t) 0);
+            if (marks.contains("wait_lib")) wait_lib = marks["wait_lib"].value("count", (uint64_t) 0);
+        }
+    }
+    printf("matched traced %lu, entry_stop %lu, wait_lib %lu\n", (unsigned long) processes,
+           (unsigned long) entry_stop, (unsigned long) wait_lib);
+    if (args.backend == MonitorBackend::NETLINK) {
+        return true;
+    }
+    if (args.match_percent != 0 && processes == 0) {
+        fprintf(stderr, "no matched child was traced\n");
+        return false;
+    }
+    if (std::max(entry_stop, wait_lib) < processes) {
+        fprintf(stderr, "%lu matched children never reached entry_stop\n",
+                (unsigned long) (processes - std::max(entry_stop, wait_lib)));
+        return false;
+    }
+    return true;
+}
+
+struct Summary {
+    size_t n = 0;
+    uint64_t mean = 0, p50 = 0, p99 = 0, max = 0;
+};
+
+static Summary summarize(const RoundResult &r, int matched){
+    std::vector<uint64_t> v;
+    for (auto &s : r.samples) {
+        if (matched == -1 || (int) s.matched == matched) v.push_back(s.ns);
+    }
+    Summary sum;
+    if (v.empty()) {
+        return sum;
+    }
+    std::sort(v.begin(), v.end());
+    uint64_t total = 0;
+    for (auto ns : v) total += ns;
+    sum.n = v.size();
+    sum.mean = total / v.size();
+    sum.p50 = v[(v.size() - 1) * 50 / 100];
+    sum.p99 = v[((v.size() - 1) * 99 + 50) / 100];
+    sum.max = v.back();
+    return sum;
+}
+
+static void print_summary(const char *name, const Summary &s, const Summary *base){
+    if (s.n == 0) {
+        return;
+    }
+    printf("%-18s n=%-6zu mean %8.1fus  p50 %8.1fus  p99 %8.1fus  max %8.1fus", name, s.n,
+           s.mean / 1e3, s.p50 / 1e3, s.p99 / 1e3, s.max / 1e3);
+    if (base != nullptr && base->n != 0) {
+        printf("  (%+.1fus p50, %+.1fus p99)", ((double) s.p50 - base->p50) / 1e3, ((double) s.p99 - base->p99) / 1e3);
+    }
+    printf("\n");
+}
+
+static void usage(const char *prog){
+    fprintf(stderr,
+            "usage: %s [-n count] [-r spawns_per_sec] [-m match_percent] [-t true_path]\n"
+            "          [--shard] [--backend ptrace|netlink|fanotify] [--stats json] [-v]\n", prog);
+}
+
+int main(int argc, char *argv[]){
+    BenchArgs args;
+    static struct option long_options[] = {
+            {"count",   required_argument, 0, 'n'},
+            {"rate",    required_argument, 0, 'r'},
+            {"match",   required_argument, 0, 'm'},
+            {"true",    required_argument, 0, 't'},
+            {"shard",   no_argument,       0, 's'},
+            {"backend", required_argument, 0, 'b'},
+            {"stats",   required_argument, 0, 'S'},
+            {"verbose", no_argument,       0, 'v'},
+            {"help",    no_argument,       0, 'h'},
+            {0, 0, 0, 0}
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "n:r:m:t:vh", long_options, nullptr)) != -1) {
+        switch (opt) {
+            case 'n': args.count = strtoul(optarg, nullptr, 0); break;
+            case 'r': args.rate = strtoul(optarg, nullptr, 0); break;
+            case 'm': args.match_percent = std::min(100ul, strtoul(optarg, nullptr, 0)); break;
+            case 't': args.true_path = optarg; break;
+            case 's': args.shard = true; break;
+            case 'b':
+                if (!parse_backend(optarg, &args.backend)) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'S': args.stats = optarg; break;
+            case 'v': args.verbose = true; break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (args.count == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    // 匹配和不匹配的子进程用两份不同inode的拷贝, 规则按inode匹配
+    char dir_template[] = "/tmp/adi_bench.XXXXXX";
+    char *dir = mkdtemp(dir_template);
+    if (dir == nullptr) {
+        PLOGE("mkdtemp");
+        return 1;
+    }
+    std::string match_path = std::string(dir) + "/match";
+    std::string nomatch_path = std::string(dir) + "/nomatch";
+    args.stats_path = args.stats != nullptr ? args.stats : std::string(dir) + "/stats.json";
+    if (!copy_file(args.true_path, match_path) || !copy_file(args.true_path, nomatch_path)) {
+        return 1;
+    }
+
+    RoundResult base, traced;
+    bool ok = run_round(args, false, match_path, nomatch_path, base) &&
+              run_round(args, true, match_path, nomatch_path, traced);
+    bool matched_ok = ok && check_matched(args, match_path);
+    unlink(match_path.c_str());
+    unlink(nomatch_path.c_str());
+    if (args.stats == nullptr) {
+        unlink(args.stats_path.c_str());
+    }
+    rmdir(dir);
+    if (!ok) {
+        fprintf(stderr, "benchmark failed\n");
+        return 1;
+    }
+
+    const char *backend_name = args.backend == MonitorBackend::NETLINK ? "netlink"
+                             : args.backend == MonitorBackend::FANOTIFY ? "fanotify" : "ptrace";
+    printf("spawns %u, rate %s, match %u%%, backend %s%s\n", args.count,
+           args.rate ? std::to_string(args.rate).c_str() : "unlimited", args.match_percent,
+           backend_name, args.shard ? " (shard)" : "");
+    printf("throughput: baseline %.0f spawns/s, traced %.0f spawns/s\n",
+           args.count * 1e9 / base.wall_ns, args.count * 1e9 / traced.wall_ns);
+    Summary base_all = summarize(base, -1);
+    Summary base_nomatch = summarize(base, 0);
+    Summary base_match = summarize(base, 1);
+    Summary traced_nomatch = summarize(traced, 0);
+    Summary traced_match = summarize(traced, 1);
+    print_summary("baseline", base_all, nullptr);
+    print_summary("traced unmatched", traced_nomatch, &base_nomatch);
+    print_summary("traced matched", traced_match, &base_match);
+    return matched_ok ? 0 : 1;
+}
@@ -0,0 +1,287 @@
+//
+// Created by chic on 2025/7/6.
+//
+// 比较原来 get_libFile_Symbol_off 的做法(每次读写映射整个文件, 逐个 strncmp 前缀比较)和 ElfSymbolIndex
+// 不指定 -l 时用 libc 所在的文件, 手机上可以 -l /apex/com.android.runtime/bin/linker64
+// 先对 .symtab/.dynsym 里每个符号名检查索引的结果和逐个 strcmp 完全比较的结果一样,
+// 再输出原来的前缀比较找错了多少个, 以及 每次查找 / 冷启动建索引 / LRU 命中 的耗时
+// 然后两行是 SymbolCache: 缓存里没有(解析+写文件) 和 新进程第一次查(打开缓存+校验+读build-id) 的耗时
+// 文件有 .gnu_debugdata 时最后输出第一次解压+建索引, 以及同一个 build-id 第二次打开直接命中的耗时
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <dlfcn.h>
+#include <elf.h>
+#include <link.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <vector>
+#include "elf_symbol_index.h"
+#include "symbol_cache.h"
+
+static uint64_t now_ns(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+struct FileTables {
+    uint8_t *data = nullptr;
+    size_t size = 0;
+    // .symtab 和 .dynsym, 跟原来的顺序一样
+    const ElfW(Sym) *tables[2] = {nullptr, nullptr};
+    const char *strtabs[2] = {nullptr, nullptr};
+    size_t counts[2] = {0, 0};
+};
+
+// 原来的 linkerElfCtxInit, 按 sh_type 和 section 名字找表
+static bool map_tables(const char *path, int prot, FileTables *f){
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat s;
+    fstat(fd, &s);
+    f->size = s.st_size;
+    f->data = (uint8_t *) mmap(nullptr, f->size, prot, MAP_FILE | MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (f->data == MAP_FAILED) {
+        return false;
+    }
+    auto ehdr = (ElfW(Ehdr) *) f->data;
+    auto shdr = (ElfW(Shdr) *) (f->data + ehdr->e_shoff);
+    const char *shstrtab = (const char *) f->data + shdr[ehdr->e_shstrndx].sh_offset;
+    for (size_t i = 0; i < ehdr->e_shnum; i++) {
+        const char *name = shstrtab + shdr[i].sh_name;
+        if (shdr[i].sh_type == SHT_SYMTAB) {
+            f->tables[0] = (ElfW(Sym) *) (f->data + shdr[i].sh_offset);
+            f->counts[0] = shdr[i].sh_size / sizeof(ElfW(Sym));
+        } else if (shdr[i].sh_type == SHT_STRTAB && strcmp(name, ".strtab") == 0) {
+            f->strtabs[0] = (const char *) f->data + shdr[i].sh_offset;
+        } else if (shdr[i].sh_type == SHT_DYNSYM) {
+            f->tables[1] = (ElfW(Sym) *) (f->data + shdr[i].sh_offset);
+            f->counts[1] = shdr[i].sh_size / sizeof(ElfW(Sym));
+        } else if (shdr[i].sh_type == SHT_STRTAB && strcmp(name, ".dynstr") == 0) {
+            f->strtabs[1] = (const char *) f->data + shdr[i].sh_offset;
+        }
+    }
+    return true;
+}
+
+// 原来的 iterateSymbolTableImpl: 表里的名字是要找的名字的前缀就算找到
+static uintptr_t old_find(const FileTables &f, const char *symbol_name){
+    for (int t = 0; t < 2; t++) {
+        if (f.tables[t] == nullptr || f.strtabs[t] == nullptr) {
+            continue;
+        }
+        for (size_t i = 0; i < f.counts[t]; i++) {
+            const ElfW(Sym) *sym = f.tables[t] + i;
+            const char *name = f.strtabs[t] + sym->st_name;
+            if (sym->st_size == 0) {
+                continue;
+            }
+            if (strncmp(name, symbol_name, strlen(name)) == 0) {
+                return sym->st_value;
+            }
+        }
+    }
+    return 0;
+}
+
+// 原来的 get_libFile_Symbol_off, 每次都重新映射(原来还不 munmap)
+static uintptr_t old_lookup(const char *path, const char *symbol_name){
+    FileTables f;
+    if (!map_tables(path, PROT_READ | PROT_WRITE, &f)) {
+        return 0;
+    }
+    uintptr_t value = old_find(f, symbol_name);
+    munmap(f.data, f.size);
+    return value;
+}
+
+// 完全比较名字, 规则跟 ElfSymbolIndex 一样: 跳过未定义/section/file, GLOBAL/WEAK 优先
+static uintptr_t exact_find(const FileTables &f, const char *symbol_name){
+    const ElfW(Sym) *best = nullptr;
+    for (int t = 0; t < 2; t++) {
+        if (f.tables[t] == nullptr || f.strtabs[t] == nullptr) {
+            continue;
+        }
+        for (size_t i = 1; i < f.counts[t]; i++) {
+            const ElfW(Sym) *sym = f.tables[t] + i;
+            int type = sym->st_info & 0xf;
+            if (sym->st_shndx == SHN_UNDEF || type == STT_SECTION || type == STT_FILE) {
+                continue;
+            }
+            if (strcmp(f.strtabs[t] + sym->st_name, symbol_name) != 0) {
+                continue;
+            }
+            if (best == nullptr) {
+                best = sym;
+            } else if ((best->st_info >> 4) == STB_LOCAL && (sym->st_info >> 4) != STB_LOCAL) {
+                best = sym;
+            }
+        }
+    }
+    return best != nullptr ? best->st_value : 0;
+}
+
+static void usage(const char *prog){
+    fprintf(stderr, "usage: %s [-l library] [-n lookups] [-c cache_file]\n", prog);
+}
+
+int main(int argc, char *argv[]){
+    std::string library;
+    unsigned int count = 20;
+    std::string cache_path = "/tmp/adi_symbol_bench.cache";
+    int opt;
+    while ((opt = getopt(argc, argv, "l:n:c:h")) != -1) {
+        switch (opt) {
+            case 'c':
+                cache_path = optarg;
+                break;
+            case 'l':
+                library = optarg;
+                break;
+            case 'n':
+                count = strtoul(optarg, nullptr, 10);
+                break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (count == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (library.empty()) {
+        Dl_info info;
+        if (dladdr((void *) &malloc, &info) == 0 || info.dli_fname == nullptr) {
+            fprintf(stderr, "dladdr malloc failed\n");
+            return 1;
+        }
+        library = info.dli_fname;
+    }
+    FileTables f;
+    if (!map_tables(library.c_str(), PROT_READ, &f)) {
+        fprintf(stderr, "open %s failed\n", library.c_str());
+        return 1;
+    }
+    ElfSymbolIndex index;
+    if (!index.open(library.c_str())) {
+        fprintf(stderr, "index %s failed\n", library.c_str());
+        return 1;
+    }
+
+    // 所有定义了的符号名
+    std::vector<const char *> names;
+    for (int t = 0; t < 2; t++) {
+        for (size_t i = 1; f.tables[t] != nullptr && f.strtabs[t] != nullptr && i < f.counts[t]; i++) {
+            const ElfW(Sym) *sym = f.tables[t] + i;
+            if (sym->st_shndx != SHN_UNDEF && f.strtabs[t][sym->st_name] != '\0') {
+                names.push_back(f.strtabs[t] + sym->st_name);
+            }
+        }
+    }
+    size_t wrong_old = 0;
+    for (auto name: names) {
+        uintptr_t expected = exact_find(f, name);
+        if (index.find(name) != expected) {
+            fprintf(stderr, "index mismatch for %s\n", name);
+            return 1;
+        }
+        if (old_find(f, name) != expected) {
+            wrong_old++;
+        }
+    }
+    printf("%s: %zu symbols, %zu indexed, prefix match wrong for %zu\n", library.c_str(), names.size(), index.size(),
+           wrong_old);
+
+    // 每次 spawn 查的就是这样几个名字, 取表的最后几个(线性扫描最慢的情况)
+    std::vector<const char *> sample(names.end() - std::min<size_t>(names.size(), count), names.end());
+    uintptr_t sink = 0;
+    uint64_t start = now_ns();
+    for (auto name: sample) {
+        sink += old_lookup(library.c_str(), name);
+    }
+    double old_ns = (double) (now_ns() - start) / sample.size();
+
+    start = now_ns();
+    for (unsigned int r = 0; r < 100; r++) {
+        ElfSymbolIndex cold;
+        cold.open(library.c_str());
+        sink += cold.size();
+    }
+    double cold_ns = (double) (now_ns() - start) / 100;
+
+    ElfSymbolIndex::get(library.c_str());
+    start = now_ns();
+    for (auto name: sample) {
+        auto cached = ElfSymbolIndex::get(library.c_str());
+        sink += cached->find(name);
+    }
+    double cached_ns = (double) (now_ns() - start) / sample.size();
+
+    std::vector<uintptr_t> values(sample.size());
+    start = now_ns();
+    for (unsigned int r = 0; r < 1000; r++) {
+        sink += index.find(sample.data(), values.data(), sample.size());
+    }
+    double batch_ns = (double) (now_ns() - start) / (1000 * sample.size());
+
+    // 缓存文件不存在的时候第一次查要解析并写文件, 之后每个新进程只打开缓存和读 build-id
+    std::string build_id;
+    bool has_build_id = SymbolCache::read_build_id(library.c_str(), &build_id);
+    unlink(cache_path.c_str());
+    std::vector<uintptr_t> cached_values(sample.size());
+    start = now_ns();
+    {
+        SymbolCache cache(cache_path.c_str());
+        cache.lookup(library.c_str(), sample.data(), cached_values.data(), sample.size());
+    }
+    double miss_ns = (double) (now_ns() - start);
+    start = now_ns();
+    for (unsigned int r = 0; r < 100; r++) {
+        SymbolCache cache(cache_path.c_str());
+        cache.lookup(library.c_str(), sample.data(), cached_values.data(), sample.size());
+    }
+    double hit_ns = (double) (now_ns() - start) / 100;
+    for (size_t i = 0; i < sample.size(); i++) {
+        if (cached_values[i] != index.find(sample[i])) {
+            fprintf(stderr, "cache mismatch for %s\n", sample[i]);
+            return 1;
+        }
+    }
+
+    printf("%-24s %12.0f\n", "old mmap+scan ns", old_ns);
+    printf("%-24s %12.0f\n", "index build ns", cold_ns);
+    printf("%-24s %12.0f\n", "LRU hit+find ns", cached_ns);
+    printf("%-24s %12.1f\n", "batch find ns/name", batch_ns);
+    printf("%-24s %12.0f %s\n", "cache miss ns", miss_ns, has_build_id ? "" : "(no build-id, not cached)");
+    printf("%-24s %12.0f\n", "cache startup+hit ns", hit_ns);
+
+    if (index.has_debugdata()) {
+        start = now_ns();
+        auto mini = index.debugdata();
+        double decompress_ns = (double) (now_ns() - start);
+        if (mini == nullptr) {
+            fprintf(stderr, "load .gnu_debugdata failed\n");
+            return 1;
+        }
+        ElfSymbolIndex again;
+        again.open(library.c_str());
+        start = now_ns();
+        sink += again.debugdata()->size();
+        double shared_ns = (double) (now_ns() - start);
+        printf("%-24s %12.0f (%zu symbols)\n", "debugdata decompress ns", decompress_ns, mini->size());
+        printf("%-24s %12.0f\n", "debugdata build-id hit ns", shared_ns);
+    }
+    munmap(f.data, f.size);
+    return sink != 0 ? 0 : 1;
+}
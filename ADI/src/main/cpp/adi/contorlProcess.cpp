@@ -2,7 +2,12 @@
 // Created by chic on 2024/11/19.
 //
 // system lib
+#ifdef __ANDROID__
 #include <asm/ptrace.h>
+#else
+// glibc的 sys/ptrace.h 和 asm/ptrace.h 不能同时包含, user_regs_struct 在 sys/user.h 里
+#include <sys/user.h>
+#endif
 #include <sys/ptrace.h>
 #include <sys/wait.h>
 #include <cerrno>
@@ -13,8 +18,10 @@
 #include <elf.h>
 #include <sys/uio.h>
 #include <unistd.h>
+#include <sys/syscall.h>
 #include <fcntl.h>
 #include <sys/sysmacros.h>
+#include <sys/stat.h>
 #include <cinttypes>
 #include "contorlProcess.h"
 #include <string>
@@ -24,234 +31,249 @@
 #include "logging.h"
 #include "PtraceUtils.h"
 #include <link.h>
+#include <thread>
 #include "elf_symbol_resolver.h"
+#include "fanotify_gate.h"
+#include "inject_metrics.h"
+#include "remote_link_map.h"
 using namespace std;
 
-bool wait_FunSym(pid_t pid, uintptr_t remote_monitor_sym_addr){
-
-    int status;
-    struct pt_regs CurrentRegs;
-    if (ptrace_getregs(pid, &CurrentRegs) != 0){
+static const char *linker_path = "/apex/com.android.runtime/bin/linker64";
+// start_wait_lib 在 linker 里要用的两个符号
+static const char *const kLinkerSyms[] = {"__dl__r_debug", "__dl_notify_gdb_of_load"};
+
+// 在addr处下断点, 调试寄存器有空闲槽位时用硬件断点, 不用改代码段
+// 否则写入断点指令,保存原指令; 代码段是r-x的, process_vm_writev 写不进去, RemoteMemory 会改用 /proc/pid/mem
+static bool set_breakpoint(Tracee &t, uintptr_t addr){
+    t.bp_addr = addr;
+    if (hw_breakpoint_set(t.hw_bp, t.pid, addr)) {
+        LOGD("hw breakpoint %d at %lx", t.hw_bp.slot, addr);
+        return true;
+    }
+    uint32_t break_addr_instr =  BREAKPOINT_INSTR;
+    if (!t.mem.read(addr, &t.bp_orig_instr)) {
         return false;
     }
+    return t.mem.write(addr, break_addr_instr);
+}
 
-
-    uint32_t orig_instr;
-
-    read_proc(pid, remote_monitor_sym_addr, (uintptr_t)&orig_instr, sizeof(orig_instr));
+// 单步越过断点以后重新下断点, 软件断点的原指令已经保存过
+static bool rearm_breakpoint(Tracee &t){
+    if (t.hw_bp.armed()) {
+        return hw_breakpoint_enable(t.hw_bp, true);
+    }
     uint32_t break_addr_instr =  BREAKPOINT_INSTR;
-    uint32_t source_addr_instr;
-    ptrace_writedata(pid, (uint8_t*) remote_monitor_sym_addr, (uint8_t*)&break_addr_instr, sizeof(break_addr_instr));
-    ptrace(PTRACE_CONT, pid, 0, 0);
-    int sginal ;
-    do{
-        wait_for_trace(pid, &status, __WALL);
-        if (WIFSTOPPED(status) ) {
-            sginal = WSTOPSIG(status);
-            if(sginal == SIGTRAP){
-                if (ptrace_getregs(pid, &CurrentRegs) != 0) {
-                    LOGE("ptrace_getregs failed");
-                    return false;
-                }
-                LOGD("[+][function:%s] cmp pc ",__func__);
-                if (static_cast<uintptr_t>(CurrentRegs.pc & ~1) != (remote_monitor_sym_addr & ~1)) {
-                    LOGE("stopped at unknown addr %llx", CurrentRegs.pc);
-                    ptrace(PTRACE_CONT, pid, NULL, WSTOPSIG(status));
-                    continue;
-                }
-                LOGD("[+][function:%s] reset instr ",__func__);
-                ptrace_writedata(pid, (uint8_t*) remote_monitor_sym_addr, (uint8_t*)&orig_instr, sizeof(orig_instr));
-                read_proc(pid, remote_monitor_sym_addr, (uintptr_t)&source_addr_instr, sizeof(source_addr_instr));
-                if(source_addr_instr != orig_instr){
-                    LOGE("bkr reset failed");
-                }
+    return t.mem.write(t.bp_addr, break_addr_instr);
+}
 
-                break;
-            }
-            if (ptrace_getregs(pid, &CurrentRegs) != 0) {
-                LOGE("ptrace_getregs failed");
-                return false;
-            }
-            LOGD("[+][function:%s] wait_for_trace sig: %d addr %llx",__func__,sginal,CurrentRegs.pc);
-            ptrace(PTRACE_CONT, pid, 0, sginal); // 传递信号
-        }
-    } while (true);
+// 为了单步越过断点临时去掉它: 软件断点恢复原指令, 硬件断点只关掉槽位
+static void disarm_breakpoint(Tracee &t){
+    if (t.hw_bp.armed()) {
+        hw_breakpoint_enable(t.hw_bp, false);
+        return;
+    }
+    uint32_t source_addr_instr = 0;
+    t.mem.write(t.bp_addr, t.bp_orig_instr);
+    t.mem.read(t.bp_addr, &source_addr_instr);
+    if(source_addr_instr != t.bp_orig_instr){
+        LOGE("bkr reset failed");
+    }
+}
 
+// 不再需要这个断点, 硬件断点把槽位还回去
+static void clear_breakpoint(Tracee &t){
+    if (t.hw_bp.armed()) {
+        hw_breakpoint_clear(t.hw_bp);
+    } else {
+        disarm_breakpoint(t);
+    }
+    t.bp_addr = 0;
+}
+
+// 判断是否停在了当前断点上
+static bool stopped_at_breakpoint(Tracee &t, int status, struct pt_regs &CurrentRegs){
+    if (!WIFSTOPPED(status) || WSTOPSIG(status) != SIGTRAP || (status >> 16) != 0) {
+        return false;
+    }
+    if (t.hw_bp.armed() && !hw_breakpoint_hit(t.hw_bp, status)) {
+        return false;
+    }
+    if (ptrace_getregs(t.pid, &CurrentRegs) != 0) {
+        LOGE("ptrace_getregs failed");
+        return false;
+    }
+#if defined(__i386__) || defined(__x86_64__)
+    // int3 执行完以后pc在断点的下一个字节,退回到断点位置,恢复原指令以后从这里继续执行
+    // 硬件断点在执行之前就停下了, pc 就是断点位置
+    bool software = !t.hw_bp.armed();
+    if (software) {
+        ptrace_setpc(&CurrentRegs, ptrace_getpc(&CurrentRegs) - 1);
+    }
+#endif
+    if (static_cast<uintptr_t>(ptrace_getpc(&CurrentRegs) & ~1) != (t.bp_addr & ~1)) {
+        LOGE("stopped at unknown addr %lx", ptrace_getpc(&CurrentRegs));
+        return false;
+    }
+#if defined(__i386__) || defined(__x86_64__)
+    if (software) {
+        ptrace_setregs(t.pid, &CurrentRegs);
+    }
+#endif
     return true;
 }
 
+// 不是我们等待的事件,让进程继续运行,信号停止需要把信号传递回去
+static void resume_tracee(pid_t pid, int status){
+    int sig = (status >> 16) == 0 ? WSTOPSIG(status) : 0;
+    if (sig != 0) {
+        LOGD("[+] pass signal %d to %d", sig, pid);
+    }
+    ptrace(PTRACE_CONT, pid, 0, sig);
+}
 
-uintptr_t wait_lib_load_get_base(pid_t pid, const char *LibPath, vector<MapInfo>& local_maps) {
+// 进程需要是停止的状态; 还有断点的话先去掉, 内核detach时不会清调试寄存器
+static void detach_tracee(Tracee &t, int sig){
+    if (t.bp_addr != 0) {
+        clear_breakpoint(t);
+    }
+    ptrace(PTRACE_DETACH, t.pid, 0, sig);
+    InjectMetrics::mark(t.timeline, InjectMark::DETACH);
+    t.state = TraceeState::DETACHED;
+}
 
+// Tracee detach或者退出以后把时间线按规则汇总
+static void record_tracee(const Tracee &t){
+    std::string rule;
+    if (t.cp != nullptr) {
+        rule = t.cp->exec.empty() ? t.cp->execRegex : t.cp->exec;
+    }
+    InjectMetrics::getInstance().record(rule, t.pid, t.timeline);
+}
 
-    uintptr_t ret_libart_load_bias = -1;
+// 处理一次停止事件,这段时间里 ptrace/waitpid/process_vm_* 都算在这个Tracee上
+void InjectProc::dispatch_timed(Tracee &t, int status){
+    uint64_t begin = InjectMetrics::now_ns();
+    t.timeline.stops++;
+    InjectMetrics::current() = &t.timeline;
+    dispatch_tracee_event(t, status);
+    InjectMetrics::current() = nullptr;
+    t.timeline.stopped_ns += InjectMetrics::now_ns() - begin;
+}
 
-    auto remote_map = MapScan(std::to_string(pid));
-    auto remote_linker_handle = find_module_return_addr(remote_map, "/apex/com.android.runtime/bin/linker64");
 
-    if(remote_linker_handle == nullptr){
-        LOGE("remote_linker_handle is not found \n");
+bool InjectProc::filter_proce_exec_file(pid_t pid, ContorlProcess *&cp)
+{
+    ContorlProcess *match = rules.match(pid);
+    if (match == nullptr) {
         return false;
     }
-    struct pt_regs CurrentRegs;
-    // linker nof load self it ,linker 使用符号解析的时候一定要注意,我发现通过hash表和动态段的快速解析方式不好是,只能使用原始读取文件遍历函数的方法算偏移
-    auto dl_notify_gdb_of_load_off = reinterpret_cast<uintptr_t>(get_libFile_Symbol_off("/apex/com.android.runtime/bin/linker64", "__dl_notify_gdb_of_load"));
-    auto linker64_base_addr =  find_module_base(remote_map,"/apex/com.android.runtime/bin/linker64");
-    auto wait_LibPath_base_addr =  find_module_base(remote_map,LibPath);
-    if(wait_LibPath_base_addr != nullptr){
-        LOGD("wait_LibPath_base_addr : %s is alrealy load",LibPath);
-        return reinterpret_cast<uintptr_t>(wait_LibPath_base_addr);
-    }
-    auto remote_dl_notify_gdb_of_load_addr = dl_notify_gdb_of_load_off + (uintptr_t )linker64_base_addr;
-    LOGD("local_dl_notify_gdb_of_load %lx", remote_dl_notify_gdb_of_load_addr);
-
-    uint32_t orig_instr;
-    read_proc(pid, remote_dl_notify_gdb_of_load_addr, (uintptr_t)&orig_instr, sizeof(uint32_t));
-    link_map linkMap{};
-    char libname[100];
-    uint32_t break_addr_instr =  BREAKPOINT_INSTR;
-    uint32_t source_addr_instr;
-
-
-    int status;
-    do{
-        LOGD("Write break");
-        ptrace_writedata(pid, (uint8_t*) remote_dl_notify_gdb_of_load_addr, (uint8_t*)&break_addr_instr, sizeof(break_addr_instr));
-        ptrace(PTRACE_CONT, pid, 0, 0);
-        wait_for_trace(pid, &status, __WALL);
-        LOGD("wait_for_trace");
-        //出发断点
-        if (WIFSTOPPED(status) && WSTOPSIG(status) == SIGTRAP) {
-            if (ptrace_getregs(pid, &CurrentRegs) != 0) {
-                LOGE("ptrace_getregs failed");
-                return -1;
-            }
-            //判断是否在断点位置
-            if (static_cast<uintptr_t>(CurrentRegs.pc & ~1) != (remote_dl_notify_gdb_of_load_addr & ~1)) {
-                LOGE("stopped at unknown addr %llx", CurrentRegs.pc);
-//                auto remote_linker_handle = find_module_return_addr(local_map,"/apex/com.android.runtime/bin/linker64");
-//                LOGD("remote_linker_handle addr %llx", remote_linker_handle);
-                ptrace(PTRACE_CONT, pid, NULL, WSTOPSIG(status));
-                continue;
-            }
-            LOGD("reset break");
-            //恢复断点位置的指令
-            ptrace_writedata(pid, (uint8_t*) remote_dl_notify_gdb_of_load_addr, (uint8_t*)&orig_instr, sizeof(orig_instr));
-            //读取恢复的断点位置的指令
-            read_proc(pid, remote_dl_notify_gdb_of_load_addr, (uintptr_t)&source_addr_instr, sizeof(source_addr_instr));
-            //判断写入的是否和原来的指令相同
-            if(source_addr_instr != orig_instr){
-                LOGD("bkr reset failed");
-            }
-            //获取第一个参数
-            uintptr_t link_map_ptr = CurrentRegs.regs[0];
-            read_proc(pid,link_map_ptr,(uintptr_t)&linkMap, sizeof(link_map));
-            read_proc(pid,(uintptr_t)linkMap.l_name,(uintptr_t)&libname, 100);
-            LOGD("[+]__dl_notify_gdb_of_load:%s",libname);
-            if(ends_with(libname,LibPath)){
-                ret_libart_load_bias = linkMap.l_addr;
-                break;
-            }
-            ptrace(PTRACE_SINGLESTEP, pid, NULL, NULL);
-            LOGD("ptrace singlestep");
-            wait_for_trace(pid, &status, __WALL);
-            LOGD("wait_for_trace coutine");
-
-
-        }
-    } while (true);
-
-    return ret_libart_load_bias;
+    LOGD("filter_proce_exec_file: %s ,pid:%d ", match->exec.c_str(),pid);
+    if (!RuleTable::take(match)) {
+        return false;
+    }
+    cp = match;
+    return true;
 }
-bool InjectProc::filter_proce_exec_file(pid_t pid, ContorlProcess &cp)
-{
-    auto program = get_program(pid);
-    LOGD("filter_proce_exec_file: %s ,pid:%d ", program.c_str(),pid);
-    for (auto &map: cps) {
-        if(program == map.exec){
-            if(map.monitorCount == 0){
-                return false;
-            }
-            map.monitorCount -=1;
-            cp = map;
-            return true;
-        }
+
+// /proc/pid/stat 第四个字段是ppid, comm里可能有空格,从最后一个')'开始解析
+pid_t get_ppid(pid_t pid){
+    char path[64];
+    char buf[512];
+    snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+    FILE *fp = fopen(path, "r");
+    if (fp == nullptr) {
+        return -1;
+    }
+    size_t n = fread(buf, 1, sizeof(buf) - 1, fp);
+    fclose(fp);
+    buf[n] = '\0';
+    char *p = strrchr(buf, ')');
+    pid_t ppid = -1;
+    if (p == nullptr || sscanf(p + 1, " %*c %d", &ppid) != 1) {
+        return -1;
     }
-    return false;
+    return ppid;
 }
 
 
 
 bool inject_process(pid_t pid,const char *LibPath,const char *FunctionName,const char*FunctionArgs){
 
+    RemoteMemory mem(pid);
+    // 用不了 stub 的时候, LibPath, FunctionName, FunctionArgs 在这里各自占一块, 一次写入, 注入结束时释放
+    RemoteArena arena;
+    struct pt_regs CurrentRegs, OriginalRegs;
+    uintptr_t libc_return_addr = 0;
+    // CurrentRegs 当前寄存器
+    // OriginalRegs 保存注入前寄存器
+    if (ptrace_getregs(pid, &CurrentRegs) != 0){
+        return false;
+    }
+    // 保存原始寄存器
+    memcpy(&OriginalRegs, &CurrentRegs, sizeof(CurrentRegs));
 
     do{
-        auto remote_map = MapScan(std::to_string(pid));
-        auto local_map = MapScan(std::to_string(getpid()));
-        uintptr_t libc_return_addr = reinterpret_cast<uintptr_t>(find_module_return_addr(remote_map,"libc.so"));
+        libc_return_addr = reinterpret_cast<uintptr_t>(find_module_return_addr(pid,"libc.so"));
         LOGD("[+][function:%s] libc_return_addr:0x%lx\n",__func__ ,(uintptr_t)libc_return_addr);
 
-        long parameters[6];
-        // CurrentRegs 当前寄存器
-        // OriginalRegs 保存注入前寄存器
-        struct pt_regs CurrentRegs, OriginalRegs;
-        if (ptrace_getregs(pid, &CurrentRegs) != 0){
+        // 分别获取dlopen、dlsym、dlerror函数的地址, 注入时只调用这三个
+        // 直接读目标进程里 libdl.so 的动态符号表, 三个函数一起查
+        static const char *const kDlNames[] = {"dlopen", "dlsym", "dlerror"};
+        uintptr_t dl_addrs[3] = {0, 0, 0};
+        RemoteElf libdl(mem);
+        if (libdl.open(reinterpret_cast<uintptr_t>(find_module_base(pid,"libdl.so")))) {
+            libdl.find(kDlNames, dl_addrs, 3);
+        }
+        void *dlopen_addr = (void *) dl_addrs[0];
+        void *dlsym_addr = (void *) dl_addrs[1];
+        void *dlerror_addr = (void *) dl_addrs[2];
+        // 打印一下
+        LOGD("[+][function:%s] Get imports: dlopen: %lx, dlsym: %lx, dlerror: %lx",__func__ , dlopen_addr, dlsym_addr, dlerror_addr);
+
+        // 先用 stub 在目标进程里一次做完 dlopen/dlsym/调用, 只需要让进程运行一次
+        InjectMailbox box{};
+        box.dlopen = (uintptr_t) dlopen_addr;
+        box.dlsym = (uintptr_t) dlsym_addr;
+        box.dlerror = (uintptr_t) dlerror_addr;
+        int stub_result = ptrace_call_inject_stub(mem, box, LibPath, FunctionName, FunctionArgs, &CurrentRegs);
+        if (stub_result != -1) {
+            if (stub_result == 0) {
+                LOGD("[-][function:%s] inject stub failed",__func__);
+            } else if (box.handle == 0) {
+                LOGD("[-][function:%s] dlopen error:%s",__func__, box.error);
+            } else if (box.symbol == 0) {
+                LOGD("[-][function:%s] dlsym %s failed:%s",__func__, FunctionName, box.error);
+            } else {
+                InjectMetrics::mark_current(InjectMark::CALL_USER);
+                LOGD("[+][function:%s] Call Function %s at 0x%lx returned 0x%lx",__func__, FunctionName, (uintptr_t) box.symbol, (uintptr_t) box.ret);
+            }
             break;
         }
-        // 保存原始寄存器
-        memcpy(&OriginalRegs, &CurrentRegs, sizeof(CurrentRegs));
-
-        // 获取mmap函数在远程进程中的地址 以便为libxxx.so分配内存
-        // 由于mmap函数在libc.so库中 为了将libxxx.so加载到目标进程中 就需要使用目标进程的mmap函数 所以需要查找到libc.so库在目标进程的起始地址
-        void *mmap_addr = find_func_addr(local_map,remote_map,"libc.so","mmap");
-        LOGD("[+][function:%s] mmap RemoteFuncAddr:0x%lx\n",__func__ ,(uintptr_t)mmap_addr);
-
-        // mmap映射 <-- 设置mmap的参数
-        // void *mmap(void *start, size_t length, int prot, int flags, int fd, off_t offsize);
-        parameters[0] = NULL; // 设置为NULL表示让系统自动选择分配内存的地址
-        parameters[1] = 0x3000; // 映射内存的大小
-        parameters[2] = PROT_READ | PROT_WRITE; // 表示映射内存区域 可读|可写|可执行
-        parameters[3] = MAP_ANONYMOUS | MAP_PRIVATE; // 建立匿名映射
-        parameters[4] = -1; //  若需要映射文件到内存中，则为文件的fd
-        parameters[5] = 0; //文件映射偏移量
-
-        // 调用远程进程的mmap函数 建立远程进程的内存映射 在目标进程中为libxxx.so分配内存
-        if (ptrace_call(pid, (uintptr_t)mmap_addr, parameters, 6, &CurrentRegs,libc_return_addr) == -1){
-            LOGD("[-][function:%s] Call Remote mmap Func Failed, err:%s\n",__func__ , strerror(errno));
+
+        long parameters[6];
+
+        size_t payload = strlen(LibPath) + strlen(FunctionName) + strlen(FunctionArgs) + 3;
+        // 在目标进程中直接用mmap系统调用为libxxx.so分配内存, 不需要解析libc的mmap
+        if (!remote_arena_map(mem, arena, &CurrentRegs, libc_return_addr, remote_arena_size_for(payload))) {
             break;
         }
-        // 打印一下
-        LOGD("[+][function:%s] ptrace_call mmap success, return value=%lX, pc=%lX\n",__func__ , ptrace_getret(&CurrentRegs), ptrace_getpc(&CurrentRegs));
-
-        // 获取mmap函数执行后的返回值，也就是内存映射的起始地址
-        // 从寄存器中获取mmap函数的返回值 即申请的内存首地址
-        void *RemoteMapMemoryAddr = (void *)ptrace_getret(&CurrentRegs);
-        LOGD("[+][function:%s] Remote Process Map Memory Addr:0x%lx\n",__func__ , (uintptr_t)RemoteMapMemoryAddr);
-
-        // 分别获取dlopen、dlsym、dlclose等函数的地址
-        void *dlopen_addr, *dlsym_addr, *dlclose_addr, *dlerror_addr;
-        dlopen_addr =  find_func_addr(local_map,remote_map,"libdl.so","dlopen");
-        dlsym_addr =  find_func_addr(local_map,remote_map,"libdl.so","dlsym");
-        dlclose_addr =  find_func_addr(local_map,remote_map,"libdl.so","dlclose");
-        dlerror_addr =  find_func_addr(local_map,remote_map,"libdl.so","dlerror");
-        // 打印一下
-        LOGD("[+][function:%s] Get imports: dlopen: %lx, dlsym: %lx, dlclose: %lx, dlerror: %lx",__func__ , dlopen_addr, dlsym_addr, dlclose_addr, dlerror_addr);
+        InjectMetrics::mark_current(InjectMark::CALL_MMAP);
 
         // 打印注入so的路径
         LOGD("[+][function:%s] LibPath = %s",__func__ , LibPath);
 
-        // 将要加载的so库路径写入到远程进程内存空间中
-        /**
-         * pid  开始写入数据的地址   写入内容    写入数据大小
-         */
-        if (ptrace_writedata(pid, (uint8_t *) RemoteMapMemoryAddr, (uint8_t *) LibPath,strlen(LibPath) + 1) == -1) {
+        // 将so库路径,dlsym用的函数名和函数参数放到各自的位置,一次写入到远程进程内存空间中
+        uintptr_t RemoteLibPath = arena.push_string(LibPath);
+        uintptr_t RemoteFunctionName = arena.push_string(FunctionName);
+        uintptr_t RemoteFunctionArgs = arena.push_string(FunctionArgs);
+        if (RemoteLibPath == 0 || RemoteFunctionName == 0 || RemoteFunctionArgs == 0 || !arena.flush(mem)) {
             LOGD("[-][function:%s] Write LibPath:%s to RemoteProcess error",__func__ , LibPath);
             break;
         }
 
         // 设置dlopen的参数,返回值为模块加载的地址
         // void *dlopen(const char *filename, int flag);
-        parameters[0] = (uintptr_t) RemoteMapMemoryAddr; // 写入的libPath
+        parameters[0] = (long) RemoteLibPath; // 写入的libPath
         parameters[1] = RTLD_NOW ; // dlopen的标识                            不能使用RTLD_GLOBAL ,会导致无法dlclose 无法关闭so库
 
         // 执行dlopen 载入so
@@ -259,6 +281,7 @@ bool inject_process(pid_t pid,const char *LibPath,const char *FunctionName,const
             LOGD("[+][function:%s] Call Remote dlopen Func Failed",__func__ );
             break;
         }
+        InjectMetrics::mark_current(InjectMark::CALL_DLOPEN);
 
         // RemoteModuleAddr为远程进程加载注入模块的地址
         void *RemoteModuleAddr = (void *) ptrace_getret(&CurrentRegs);
@@ -271,106 +294,526 @@ bool inject_process(pid_t pid,const char *LibPath,const char *FunctionName,const
                 LOGD("[-][function:%s] Call Remote dlerror Func Failed",__func__ );
                 break;
             }
-            char *Error = (char *) ptrace_getret(&CurrentRegs);
+            auto Error = (uintptr_t) ptrace_getret(&CurrentRegs);
             char LocalErrorInfo[1024] = {0};
-            ptrace_readdata(pid, (uint8_t *) Error, (uint8_t *) LocalErrorInfo, 1024);
+            mem.read_string(Error, LocalErrorInfo, sizeof(LocalErrorInfo));
             LOGD("[-][function:%s] dlopen error:%s",__func__, LocalErrorInfo );
             break;
         }
 
         LOGD("[+][function:%s] Have func symbols is %s",__func__, FunctionName);
-        // 传入了函数的symbols
-        // 将so库中需要调用的函数名称写入到远程进程内存空间中
-        if (ptrace_writedata(pid, (uint8_t *) RemoteMapMemoryAddr + strlen(LibPath) + 2,(uint8_t *) FunctionName, strlen(FunctionName) + 1) == -1) {
-            LOGD("[-][function:%s] Write FunctionName:%s to RemoteProcess error",__func__, FunctionName);
-            break;
-        }
 
         // 设置dlsym的参数，返回值为远程进程内函数的地址 调用XXX功能
         // void *dlsym(void *handle, const char *symbol);
         parameters[0] = (uintptr_t) RemoteModuleAddr;
-        parameters[1] = (uintptr_t) ((uint8_t *) RemoteMapMemoryAddr + strlen(LibPath) + 2);
+        parameters[1] = (long) RemoteFunctionName;
         //调用dlsym
         if (ptrace_call(pid, (uintptr_t) dlsym_addr, parameters, 2, &CurrentRegs,libc_return_addr) == -1) {
             LOGD("[-][function:%s] Call Remote dlsym Func Failed",__func__);
             break;
         }
+        InjectMetrics::mark_current(InjectMark::CALL_DLSYM);
         // RemoteModuleFuncAddr为远程进程空间内获取的函数地址
         void *RemoteModuleFuncAddr = (void *) ptrace_getret(&CurrentRegs);
         if(RemoteModuleFuncAddr == 0){
             LOGD("[-][function:%s] ptrace_call dlsym failed, Remote Process ModuleFunc Addr:0x%lx",__func__,(uintptr_t) RemoteModuleFuncAddr);
+            break;
         } else{
             LOGD("[+][function:%s] ptrace_call dlsym success, Remote Process ModuleFunc Addr:0x%lx",__func__,(uintptr_t) RemoteModuleFuncAddr);
         }
 
         int num_arg = 2;
 
-        if (ptrace_writedata(pid, (uint8_t *) RemoteMapMemoryAddr,(uint8_t *) FunctionArgs, strlen(FunctionArgs) + 1) == -1) {
-            LOGD("[-][function:%s] Write FunctionArgs:%s to RemoteProcess error",__func__, FunctionName);
-            break;
-        }
-        parameters[1] = (uintptr_t) ((uint8_t *) RemoteMapMemoryAddr);
+        parameters[1] = (long) RemoteFunctionArgs;
 
         LOGD("[+][function:%s] Call Function %s ArgAddr1:0x%lx",__func__,FunctionName,(uintptr_t)parameters[1]);
         if (ptrace_call(pid, (uintptr_t) RemoteModuleFuncAddr, parameters,num_arg ,&CurrentRegs,libc_return_addr) == -1) {
             LOGD("[-][function:%s] Call Remote injected Func Failed",__func__);
             break;
         }
+        InjectMetrics::mark_current(InjectMark::CALL_USER);
 
-        if (ptrace_setregs(pid, &OriginalRegs) == -1) {
-            LOGD("[-][function:%s] Recover reges failed",__func__);
-            break;
-        }
+    }while(false);
 
-        LOGD("[+][function:%s] Recover Regs Success",__func__);
+    // 会话结束,参数已经用完,释放映射,不在目标进程里留下匿名内存
+    remote_arena_unmap(mem, arena, &CurrentRegs, libc_return_addr);
 
-        ptrace_getregs(pid, &CurrentRegs);
-        if (memcmp(&OriginalRegs, &CurrentRegs, sizeof(CurrentRegs)) != 0) {
-            LOGD("[-][function:%s] Set Regs Error",__func__);
-        }
+    if (ptrace_setregs(pid, &OriginalRegs) == -1) {
+        LOGD("[-][function:%s] Recover reges failed",__func__);
+        return false;
+    }
 
-    }while(false);
+    LOGD("[+][function:%s] Recover Regs Success",__func__);
+
+    ptrace_getregs(pid, &CurrentRegs);
+    if (memcmp(&OriginalRegs, &CurrentRegs, sizeof(CurrentRegs)) != 0) {
+        LOGD("[-][function:%s] Set Regs Error",__func__);
+    }
+
+    return true;
 
+}
+
+bool parse_backend(const char *name, MonitorBackend *backend){
+    if (strcmp(name, "ptrace") == 0) {
+        *backend = MonitorBackend::PTRACE;
+    } else if (strcmp(name, "netlink") == 0) {
+        *backend = MonitorBackend::NETLINK;
+    } else if (strcmp(name, "fanotify") == 0) {
+        *backend = MonitorBackend::FANOTIFY;
+    } else {
+        return false;
+    }
     return true;
+}
+
+void InjectProc::handle_tracee_event(pid_t pid, int status){
+    if (pid <= 0) {
+        return;
+    }
+    auto it = tracees.find(pid);
+    if (it == tracees.end()) {  //运行到这里说明是新创建的子进程,加入到监控队列
+        LOGD("new process attached %d",pid);
+        Tracee &t = tracees.emplace(pid, Tracee(pid)).first->second;
+        InjectMetrics::mark(t.timeline, InjectMark::FORK);
+        t.timeline.syscalls[(int) SyscallKind::WAITPID]++;
+        t.timeline.stops++;
+        InjectMetrics::current() = &t.timeline;
+        //前面ptrace的时候,使用的是PTRACE_O_TRACEFORK,所以子进程会在调用fork以后停止,并被追踪到
+        ptrace(PTRACE_SETOPTIONS, pid, 0, PTRACE_O_TRACEEXEC); //这段代码 进程会停止在exec加载完,但是还没没有执行的时候
+        ptrace(PTRACE_CONT, pid, 0, 0);
+        InjectMetrics::current() = nullptr;
+        return;
+    }
+    Tracee &t = it->second;
+    if (WIFEXITED(status) || WIFSIGNALED(status)) {
+        LOGD("tracee %d exited", pid);
+        InjectMetrics::mark(t.timeline, InjectMark::DETACH);
+        record_tracee(t);
+        tracees.erase(it);
+        return;
+    }
+    if (!WIFSTOPPED(status)) {
+        return;
+    }
+    // 这次停止是 PtraceTask 里的 waitpid(-1) 拿到的,那时还不知道是哪个进程
+    t.timeline.syscalls[(int) SyscallKind::WAITPID]++;
+    dispatch_timed(t, status);
+    if (t.state == TraceeState::DETACHED) {
+        record_tracee(t);
+        tracees.erase(pid);
+    } else if (t.state == TraceeState::HANDED_OFF) {
+        // 时间线已经交给worker线程,由worker汇总
+        tracees.erase(pid);
+    }
+}
+
+void InjectProc::detach_all(){
+    for (auto &[pid, t] : tracees) {
+        if (t.bp_addr == 0) {
+            ptrace(PTRACE_DETACH, pid, nullptr, nullptr);
+            continue;
+        }
+        // 进程在运行, 先用SIGSTOP停下来; 停下来的原因不是这个SIGSTOP的话, 原来的信号交回去, detach以后再SIGCONT
+        syscall(SYS_tgkill, pid, pid, SIGSTOP);
+        int status;
+        while (waitpid(pid, &status, __WALL) == -1 && errno == EINTR);
+        if (!WIFSTOPPED(status)) {
+            continue;
+        }
+        bool own_stop = (status >> 16) == 0 && WSTOPSIG(status) == SIGSTOP;
+        int sig = (status >> 16) == 0 && !own_stop ? WSTOPSIG(status) : 0;
+        // 刚好停在断点或者单步上, SIGTRAP 是我们自己的, 不能交给进程; 软件断点在 x86_64 上还要把pc退回去
+        struct pt_regs CurrentRegs;
+        if (sig == SIGTRAP && (stopped_at_breakpoint(t, status, CurrentRegs) || t.state == TraceeState::WAITING_LIB_STEP)) {
+            sig = 0;
+        }
+        LOGD("detach_all: clear breakpoint at %lx in %d", t.bp_addr, pid);
+        detach_tracee(t, sig);
+        if (!own_stop) {
+            kill(pid, SIGCONT);
+        }
+    }
+}
+
+void InjectProc::dispatch_tracee_event(Tracee &t, int status){
+    switch (t.state) {
+        case TraceeState::FORKED:
+            on_forked_stop(t, status);
+            break;
+        case TraceeState::HANDOFF:
+            on_handoff_stop(t, status);
+            break;
+        case TraceeState::ENTRY_STOPPED:
+            on_entry_stop(t, status);
+            break;
+        case TraceeState::WAITING_LIB:
+            on_lib_break(t, status);
+            break;
+        case TraceeState::WAITING_LIB_STEP:
+            on_lib_step(t, status);
+            break;
+        case TraceeState::WAITING_FUN_SYM:
+            on_fun_sym_break(t, status);
+            break;
+        case TraceeState::INJECTING:
+        case TraceeState::HANDED_OFF:
+        case TraceeState::DETACHED:
+            break;
+    }
+}
+
+void InjectProc::on_forked_stop(Tracee &t, int status){
+    //旧的子继承,等待他执行完exec,这个时候只是加载了可执行文件,我们可以判断是那个进程了.
+    //所以在这里停止,如果在前面停止,我们很难知道要运行的进程是那个.
+    if (!STOPPED_WITH(status,SIGTRAP, PTRACE_EVENT_EXEC)){
+        LOGE("old process handle: STOPPED_WITH is not");
+        detach_tracee(t, (status >> 16) == 0 ? WSTOPSIG(status) : 0);
+        return;
+    }
+    InjectMetrics::mark(t.timeline, InjectMark::EXEC);
+    // exec已经完成, /proc/pid/exe 已经是新的文件,直接在这次停止里判断,不需要再发SIGSTOP停一次
+    if (!filter_proce_exec_file(t.pid, t.cp)) {
+        detach_tracee(t, 0);
+        return;
+    }
+    if (shard) {
+        handoff_tracee(t);
+        return;
+    }
+    start_entry_stop(t);
+}
 
+void InjectProc::start_entry_stop(Tracee &t){
+    if (!arm_app_process_entry(t.mem, t.entry)) {
+        LOGE("arm_app_process_entry failed");
+        detach_tracee(t, 0);
+        return;
+    }
+    ptrace(PTRACE_CONT, t.pid, 0, 0);
+    t.state = TraceeState::ENTRY_STOPPED;
 }
 
-void InjectProc::monitor_process(pid_t pid){
-    ContorlProcess cp;
-    if(filter_proce_exec_file(pid,cp)){
-        bool stop = stop_int_app_process_entry(pid);
-        if(stop){
-            auto local_map = MapScan(std::to_string(getpid()));
-            if(!cp.waitSoPath.empty()) {
-                uintptr_t  remote_waitSoPath_addr = wait_lib_load_get_base(pid, cp.waitSoPath.c_str(),local_map);
-                if(remote_waitSoPath_addr != -1){
-                    if(!cp.waitFunSym.empty()){
-                        uintptr_t remote_waitFunSym_addr = get_libFile_Symbol_off((char*)cp.waitSoPath.c_str(),(char*)cp.waitFunSym.c_str())+remote_waitSoPath_addr;
-                        LOGD("waitFunSym is %s, wait Fun exec,waitFunSymAddr : %lx",cp.waitFunSym.c_str(),remote_waitFunSym_addr);
-                        wait_FunSym(pid, (uintptr_t) remote_waitFunSym_addr);
-                    }
-                    LOGD("start, inject so to process");
-                    inject_process(pid,cp.InjectSO.c_str(), cp.InjectFunSym.c_str(),cp.InjectFunArg.c_str());
-                    LOGD("end,   inject so to process");
-                } else{
-                    LOGE("wait_lib_load_get_base:%s failed",cp.waitSoPath.c_str());
-
-                }
-            }else{
-                LOGD("waitSoPath is null , start inject so to process");
-                inject_process(pid,cp.InjectSO.c_str(), cp.InjectFunSym.c_str(),cp.InjectFunArg.c_str());
-                LOGD("end,   inject so to process");
+// LIVE模式SEIZE的时候进程已经在跑了, sp 不再指向auxv, 不能改栈上的AT_ENTRY
+// 改为在 /proc/pid/auxv 给出的入口下断点, 命中时linker已经初始化完成
+void InjectProc::start_entry_break(Tracee &t){
+    t.entry = EntryStop{};
+    uintptr_t entry = read_remote_auxv(t.pid, AT_ENTRY);
+    if (entry == 0 || !set_breakpoint(t, entry)) {
+        LOGE("set break at entry of %d failed", t.pid);
+        detach_tracee(t, 0);
+        return;
+    }
+    ptrace(PTRACE_CONT, t.pid, 0, 0);
+    t.state = TraceeState::ENTRY_STOPPED;
+}
+
+void InjectProc::handoff_tracee(Tracee &t){
+    // 在 PTRACE_EVENT_EXEC 停止时 PTRACE_DETACH 的信号参数会被内核忽略, 所以先给进程挂一个SIGSTOP再detach,
+    // 进程回到用户态之前就会停在group-stop, 等worker线程重新SEIZE
+    LOGD("handoff %d to shard worker", t.pid);
+    syscall(SYS_tgkill, t.pid, t.pid, SIGSTOP);
+    ptrace(PTRACE_DETACH, t.pid, 0, 0);
+    t.state = TraceeState::HANDED_OFF;
+    std::thread(&InjectProc::shard_worker, this, t.pid, t.cp, AttachMode::HANDOFF, t.timeline, -1, -1).detach();
+}
+
+void InjectProc::shard_worker(pid_t pid, ContorlProcess *cp, AttachMode mode, InjectTimeline timeline, int fan_fd, int event_fd){
+    Tracee t(pid);
+    t.cp = cp;
+    t.state = TraceeState::HANDOFF;
+    t.attach = mode;
+    t.timeline = timeline;
+    // 整个线程只处理这一个进程, SEIZE之前就开始计数
+    InjectMetrics::current() = &t.timeline;
+    // ptrace只认SEIZE的线程,所以后面所有的ptrace和waitpid都在这个线程里做
+    // EXEC_GATE: 进程还阻塞在exec里,带上TRACEEXEC, exec完成以后会停在 PTRACE_EVENT_EXEC
+    long options = mode == AttachMode::EXEC_GATE ? PTRACE_O_TRACEEXEC : 0;
+    bool seized = ptrace(PTRACE_SEIZE, pid, 0, options) != -1;
+    if (!seized) {
+        PLOGE("shard worker seize %d", pid);
+    }
+    if (mode == AttachMode::EXEC_GATE) {
+        // 放行之前记下被拦住的文件, exec事件到来时用来确认完成的是这一次exec
+        struct stat st;
+        if (fstat(event_fd, &st) == 0) {
+            t.exec_dev = st.st_dev;
+            t.exec_ino = st.st_ino;
+        }
+        exec_gate_allow(fan_fd, event_fd);
+    }
+    if (!seized) {
+        if (mode == AttachMode::HANDOFF) kill(pid, SIGCONT);
+        RuleTable::give_back(cp);
+        InjectMetrics::current() = nullptr;
+        return;
+    }
+    if (mode == AttachMode::LIVE) {
+        InjectMetrics::mark(t.timeline, InjectMark::EXEC);
+        if (ptrace(PTRACE_INTERRUPT, pid, 0, 0) == -1) {
+            PLOGE("shard worker interrupt %d", pid);
+            detach_tracee(t, 0);
+        }
+    }
+    int status;
+    while (t.state != TraceeState::DETACHED) {
+        if (waitpid(pid, &status, __WALL) == -1) {
+            if (errno == EINTR) continue;
+            PLOGE("shard worker wait %d", pid);
+            break;
+        }
+        if (WIFEXITED(status) || WIFSIGNALED(status)) {
+            LOGD("tracee %d exited", pid);
+            // exec失败以后进程直接退出了, 没有走到exec事件
+            if (mode == AttachMode::EXEC_GATE && t.state == TraceeState::HANDOFF) {
+                RuleTable::give_back(cp);
+                t.cp = nullptr;
             }
+            InjectMetrics::mark(t.timeline, InjectMark::DETACH);
+            break;
+        }
+        dispatch_timed(t, status);
+        // dispatch_timed 会清掉 current
+        InjectMetrics::current() = &t.timeline;
+    }
+    InjectMetrics::current() = nullptr;
+    record_tracee(t);
+    LOGD("shard worker %d done", pid);
+}
 
-        } else{
-            LOGE("stop_int_app_process_entry failed");
+// pc还在linker里,说明还没有执行到入口
+static bool stopped_in_linker(pid_t pid){
+    struct pt_regs CurrentRegs;
+    if (ptrace_getregs(pid, &CurrentRegs) != 0) {
+        return false;
+    }
+    auto pc = static_cast<uintptr_t>(ptrace_getpc(&CurrentRegs));
+    ProcMapQuery query(pid);
+    auto map = query.find(pc);
+    return map != nullptr && (ends_with(map->path, "/linker64") || ends_with(map->path, "/linker"));
+}
 
+// /proc/pid/exe 是不是 (dev, ino) 这个文件
+static bool exe_is(pid_t pid, dev_t dev, ino_t ino){
+    char exe[64];
+    snprintf(exe, sizeof(exe), "/proc/%d/exe", pid);
+    struct stat st;
+    return stat(exe, &st) == 0 && st.st_dev == dev && st.st_ino == ino;
+}
+
+void InjectProc::on_handoff_stop(Tracee &t, int status){
+    if (t.attach == AttachMode::EXEC_GATE) {
+        // exec完成,跟ptrace后端在exec停止时的处理一样
+        if (STOPPED_WITH(status, SIGTRAP, PTRACE_EVENT_EXEC) && exe_is(t.pid, t.exec_dev, t.exec_ino)) {
+            InjectMetrics::mark(t.timeline, InjectMark::EXEC);
+            start_entry_stop(t);
+            return;
         }
+        // FAN_ALLOW 以后exec还可能失败, 那样不会有这次exec的事件: 第一次停止不是exec事件,
+        // 或者是之后exec了别的文件, 都不是这个规则的进程, 次数还回去, 不再继续跟着它
+        LOGD("exec gate %d: exec of %s did not complete", t.pid, t.cp->exec.c_str());
+        RuleTable::give_back(t.cp);
+        t.cp = nullptr;
+        detach_tracee(t, (status >> 16) == 0 ? WSTOPSIG(status) : 0);
+        return;
+    }
+    if (!WIFSTOPPED(status) || (status >> 16) != PTRACE_EVENT_STOP) {
+        resume_tracee(t.pid, status);
+        return;
+    }
+    if (t.attach == AttachMode::HANDOFF) {
+        // 清掉group-stop的状态,SIGCONT后面会以信号停止的形式出现,直接传递回去
+        kill(t.pid, SIGCONT);
+        start_entry_stop(t);
+        return;
+    }
+    // netlink的exec事件是异步的,SEIZE的时候进程已经在跑了, 不一定停在exec之后, 不能改栈上的AT_ENTRY
+    // 有waitSoPath就直接等待so加载; 没有的话还在linker里就在入口下断点等linker初始化完成
+    if (!t.cp->waitSoPath.empty()) {
+        start_wait_lib(t);
+    } else if (stopped_in_linker(t.pid)) {
+        start_entry_break(t);
+    } else {
+        inject_and_detach(t);
+    }
+}
 
-        ptrace(PTRACE_SYSCALL, pid, 0, 0);
-        ptrace(PTRACE_CONT, pid, 0, 0);
+void InjectProc::warm_symbols(){
+    uintptr_t offs[2];
+    get_libFile_Symbol_offs(linker_path, kLinkerSyms, offs, 2);
+    for (auto &rule: rules.rules()) {
+        if (rule->waitSoPath.empty() || rule->waitFunSym.empty()) {
+            continue;
+        }
+        const char *name = rule->waitFunSym.c_str();
+        get_libFile_Symbol_offs(rule->waitSoPath.c_str(), &name, offs, 1);
+    }
+}
+
+void InjectProc::on_entry_stop(Tracee &t, int status){
+    if (t.entry.addr_of_entry_addr == 0) {
+        // start_entry_break 在入口下的断点
+        struct pt_regs CurrentRegs;
+        if (!stopped_at_breakpoint(t, status, CurrentRegs)) {
+            resume_tracee(t.pid, status);
+            return;
+        }
+        clear_breakpoint(t);
+    } else if (!WIFSTOPPED(status) || WSTOPSIG(status) != SIGSEGV) {
+        resume_tracee(t.pid, status);
+        return;
+    } else if (!on_app_process_entry_stop(t.mem, status, t.entry)) {
+        LOGE("stop_int_app_process_entry failed");
+        detach_tracee(t, WSTOPSIG(status));
+        return;
+    }
+    InjectMetrics::mark(t.timeline, InjectMark::ENTRY_STOP);
+    if(!t.cp->waitSoPath.empty()) {
+        start_wait_lib(t);
+    }else{
+        LOGD("waitSoPath is null , start inject so to process");
+        inject_and_detach(t);
+    }
+}
+
+void InjectProc::start_wait_lib(Tracee &t){
+    // linker 的基址在auxv里, 取不到再查maps
+    auto linker64_base_addr = reinterpret_cast<void *>(read_remote_auxv(t.pid, AT_BASE));
+    if (linker64_base_addr == nullptr) {
+        linker64_base_addr = find_module_base(t.pid,linker_path);
+    }
+    // linker 里要用的两个符号一次查出来, 一般直接从符号缓存里拿到
+    uintptr_t linker_offs[2] = {0, 0};
+    if (linker64_base_addr != nullptr) {
+        get_libFile_Symbol_offs(linker_path, kLinkerSyms, linker_offs, 2);
+    }
+    // 先看 r_debug 链表上有没有, 找不到 r_debug 的时候才查maps
+    RemoteLinkMap link_map(t.mem);
+    bool located = link_map.locate();
+    if (!located && linker_offs[0] != 0) {
+        located = link_map.set_r_debug(linker_offs[0] + (uintptr_t)linker64_base_addr);
+    }
+    uintptr_t wait_LibPath_base_addr = 0;
+    RemoteModule module;
+    if (located) {
+        if (link_map.find(t.cp->waitSoPath, &module)) {
+            wait_LibPath_base_addr = module.bias;
+        }
+    } else {
+        wait_LibPath_base_addr = reinterpret_cast<uintptr_t>(find_module_base(t.pid,t.cp->waitSoPath));
+    }
+    if(wait_LibPath_base_addr != 0){
+        LOGD("wait_LibPath_base_addr : %s is alrealy load",t.cp->waitSoPath.c_str());
+        InjectMetrics::mark(t.timeline, InjectMark::WAIT_LIB);
+        t.wait_lib_base = wait_LibPath_base_addr;
+        start_wait_fun_sym(t);
+        return;
+    }
+    if(linker64_base_addr == nullptr){
+        LOGE("remote_linker_handle is not found \n");
+        detach_tracee(t, 0);
+        return;
+    }
+    // linker nof load self it ,linker 使用符号解析的时候一定要注意,我发现通过hash表和动态段的快速解析方式不好是,只能使用原始读取文件遍历函数的方法算偏移
+    if (linker_offs[1] == 0) {
+        LOGE("__dl_notify_gdb_of_load is not found in %s", linker_path);
+        detach_tracee(t, 0);
+        return;
+    }
+    t.dl_notify_addr = linker_offs[1] + (uintptr_t )linker64_base_addr;
+    LOGD("local_dl_notify_gdb_of_load %lx", t.dl_notify_addr);
+    if (!set_breakpoint(t, t.dl_notify_addr)) {
+        LOGE("set break at __dl_notify_gdb_of_load failed");
+        detach_tracee(t, 0);
+        return;
+    }
+    ptrace(PTRACE_CONT, t.pid, 0, 0);
+    t.state = TraceeState::WAITING_LIB;
+}
 
+void InjectProc::on_lib_break(Tracee &t, int status){
+    struct pt_regs CurrentRegs;
+    if (!stopped_at_breakpoint(t, status, CurrentRegs)) {
+        resume_tracee(t.pid, status);
+        return;
+    }
+    //获取第一个参数, 刚加载的so的 link_map, 名字完整读出来
+    RemoteLinkMap link_map(t.mem);
+    RemoteModule module;
+    uintptr_t link_map_ptr = ptrace_getarg0(&CurrentRegs);
+    if (link_map.read_node(link_map_ptr, &module)) {
+        LOGD("[+]__dl_notify_gdb_of_load:%s",module.name.c_str());
+        if(ends_with(module.name,t.cp->waitSoPath)){
+            clear_breakpoint(t);
+            InjectMetrics::mark(t.timeline, InjectMark::WAIT_LIB);
+            t.wait_lib_base = module.bias;
+            start_wait_fun_sym(t);
+            return;
+        }
     }
+    // x86_64 的硬件断点命中时内核设了 RF, 直接继续不会再停在这里, 断点也一直有效
+    if (t.hw_bp.armed() && !kHwBreakpointNeedsStep) {
+        ptrace(PTRACE_CONT, t.pid, 0, 0);
+        return;
+    }
+    LOGD("reset break");
+    // 去掉断点执行完原指令以后重新下断点
+    disarm_breakpoint(t);
+    ptrace(PTRACE_SINGLESTEP, t.pid, NULL, NULL);
+    t.state = TraceeState::WAITING_LIB_STEP;
+}
+
+void InjectProc::on_lib_step(Tracee &t, int status){
+    if (!WIFSTOPPED(status) || WSTOPSIG(status) != SIGTRAP) {
+        // 单步还没有完成就收到了信号,带着信号继续单步
+        ptrace(PTRACE_SINGLESTEP, t.pid, NULL, (status >> 16) == 0 ? WSTOPSIG(status) : 0);
+        return;
+    }
+    rearm_breakpoint(t);
+    ptrace(PTRACE_CONT, t.pid, 0, 0);
+    t.state = TraceeState::WAITING_LIB;
+}
+
+void InjectProc::start_wait_fun_sym(Tracee &t){
+    if(t.cp->waitFunSym.empty()){
+        inject_and_detach(t);
+        return;
+    }
+    uintptr_t waitFunSym_off = get_libFile_Symbol_off(t.cp->waitSoPath.c_str(), t.cp->waitFunSym.c_str());
+    if (waitFunSym_off == 0) {
+        LOGE("%s is not found in %s", t.cp->waitFunSym.c_str(), t.cp->waitSoPath.c_str());
+        detach_tracee(t, 0);
+        return;
+    }
+    uintptr_t remote_waitFunSym_addr = waitFunSym_off + t.wait_lib_base;
+    LOGD("waitFunSym is %s, wait Fun exec,waitFunSymAddr : %lx",t.cp->waitFunSym.c_str(),remote_waitFunSym_addr);
+    if (!set_breakpoint(t, remote_waitFunSym_addr)) {
+        LOGE("set break at %s failed", t.cp->waitFunSym.c_str());
+        detach_tracee(t, 0);
+        return;
+    }
+    ptrace(PTRACE_CONT, t.pid, 0, 0);
+    t.state = TraceeState::WAITING_FUN_SYM;
+}
+
+void InjectProc::on_fun_sym_break(Tracee &t, int status){
+    struct pt_regs CurrentRegs;
+    if (!stopped_at_breakpoint(t, status, CurrentRegs)) {
+        resume_tracee(t.pid, status);
+        return;
+    }
+    LOGD("[+][function:%s] reset instr ",__func__);
+    InjectMetrics::mark(t.timeline, InjectMark::WAIT_FUN_SYM);
+    clear_breakpoint(t);
+    inject_and_detach(t);
+}
+
+void InjectProc::inject_and_detach(Tracee &t){
+    t.state = TraceeState::INJECTING;
+    LOGD("start, inject so to process");
+    inject_process(t.pid,t.cp->InjectSO.c_str(), t.cp->InjectFunSym.c_str(),t.cp->InjectFunArg.c_str());
+    LOGD("end,   inject so to process");
+    detach_tracee(t, 0);
 }
 
 
@@ -4,13 +4,24 @@
 
 #pragma once
 #include <sys/types.h>
+#include <cstdint>
 #include <string>
-#include <set>
+#include <map>
 #include <vector>
+#include <atomic>
+#include <memory>
+#include "rule_table.h"
+#include "inject_metrics.h"
+#include "remote_memory.h"
+#include "hw_breakpoint.h"
 #define STOPPED_WITH(status,sig, event) WIFSTOPPED(status) && (status >> 8 == ((sig) | (event << 8)))
 void func_test(int argc, char *argv[]);
 
 bool inject_process(pid_t pid,const char *LibPath,const char *FunctionName,const char*FunctionArgs);
+
+pid_t get_ppid(pid_t pid);
+
+std::string get_program(int pid);
 class ContorlProcess {
 public:
 
@@ -20,8 +31,81 @@ public:
     std::string InjectSO;
     std::string InjectFunSym;
     std::string InjectFunArg;
-    unsigned int monitorCount;
+    // 剩余注入次数,多个监控线程同时匹配,用 RuleTable::take 原子的减一
+    std::atomic<unsigned int> monitorCount;
+    // 可选,按正则匹配exec路径
+    std::string execRegex{};
+
+};
+
+/**
+ * 每个被追踪子进程的状态,PtraceTask 里的 waitpid(-1) 收到事件以后按状态分发
+ * FORKED -> ENTRY_STOPPED -> WAITING_LIB -> WAITING_FUN_SYM -> INJECTING -> DETACHED
+ * 每个状态表示进程下一次停止时等待的事件,不同的子进程可以同时处于不同的状态
+ */
+enum class TraceeState {
+    FORKED,             // 刚fork出来,等待 PTRACE_EVENT_EXEC
+    HANDOFF,            // 分片模式下worker线程刚SEIZE,等待 PTRACE_EVENT_STOP
+    ENTRY_STOPPED,      // 修改了AT_ENTRY,等待进程执行到入口触发SIGSEGV; LIVE模式是在入口下了断点
+    WAITING_LIB,        // __dl_notify_gdb_of_load 下了断点,等待 waitSoPath 加载
+    WAITING_LIB_STEP,   // 恢复了原指令(硬件断点是关掉了槽位)单步执行,等待单步完成重新下断点
+    WAITING_FUN_SYM,    // waitFunSym 下了断点,等待函数执行
+    INJECTING,          // 正在注入
+    HANDED_OFF,         // 分片模式下已经交给worker线程,从init线程的列表中删除
+    DETACHED            // 已经detach,从列表中删除
+};
+
+// 发现新进程exec的方式
+enum class MonitorBackend {
+    PTRACE,     // PTRACE_O_TRACEFORK 追踪init的每一个子进程
+    NETLINK,    // NETLINK_CONNECTOR 监听 PROC_EVENT_EXEC,只SEIZE符合规则的进程
+    FANOTIFY    // FAN_OPEN_EXEC_PERM 拦住规则里的exec文件,只SEIZE执行这些文件的进程
+};
+
+// worker线程拿到进程时进程所处的状态
+enum class AttachMode {
+    HANDOFF,    // init线程带着SIGSTOP detach,进程停在group-stop
+    LIVE,       // 进程正在运行,需要PTRACE_INTERRUPT
+    EXEC_GATE   // 进程阻塞在fanotify权限事件里,exec还没有完成
+};
+
+bool parse_backend(const char *name, MonitorBackend *backend);
+
+// arm_app_process_entry 保存的入口信息,恢复入口时使用
+struct EntryStop {
+    uintptr_t entry_addr = 0;
+    uintptr_t addr_of_entry_addr = 0;
+    uintptr_t break_addr = 0;
+};
+
+class Tracee {
+public:
+    explicit Tracee(pid_t pid) : pid(pid), mem(pid) {
+        mem.enable_cache();
+    }
 
+    pid_t pid;
+    // 断点读写和链表读取都用这个对象, /proc/pid/mem 只打开一次, 一次停止期间的读取按页缓存
+    RemoteMemory mem;
+    TraceeState state = TraceeState::FORKED;
+    // 匹配到的规则, 规则在 RuleTable 里一直存在
+    ContorlProcess *cp = nullptr;
+    EntryStop entry;
+    // 当前断点的位置, 软件断点还要存原指令
+    uintptr_t bp_addr = 0;
+    uint32_t bp_orig_instr = 0;
+    // 调试寄存器有空闲槽位时用硬件断点, armed() 为false时是软件断点
+    HwBreakpoint hw_bp;
+    // __dl_notify_gdb_of_load 在远程进程中的地址
+    uintptr_t dl_notify_addr = 0;
+    // waitSoPath 在远程进程中的load bias
+    uintptr_t wait_lib_base = 0;
+    AttachMode attach = AttachMode::HANDOFF;
+    // EXEC_GATE: 被拦住的exec文件, exec完成以后 /proc/pid/exe 必须还是它
+    dev_t exec_dev = 0;
+    ino_t exec_ino = 0;
+    // 耗时统计,分片模式下跟着进程一起交给worker线程
+    InjectTimeline timeline;
 };
 
 
@@ -34,21 +118,64 @@ public:
         traced_pid = pid;
     }
 
-    std::set<pid_t>& get_Tracee_Process(){
-        return monitor_pid;
+    // 分片模式: 匹配到的子进程交给独立的worker线程注入,不同进程的注入可以并行
+    void setShard(bool enable){
+        shard = enable;
+    }
+
+    void setBackend(MonitorBackend b){
+        backend = b;
+    }
+    MonitorBackend getBackend(){
+        return backend;
+    }
+
+    std::map<pid_t, Tracee>& get_Tracee_Process(){
+        return tracees;
     }
     pid_t getTracePid(){
         return traced_pid;
     }
 
-    void monitor_process(pid_t pid);
+    // PtraceTask 所在的线程, 子进程的ptrace请求只能由这个线程发出
+    void setTracerTid(pid_t tid){
+        tracer_tid = tid;
+    }
+    pid_t getTracerTid(){
+        return tracer_tid;
+    }
+
+    // 退出之前detach所有子进程, 必须在 tracer_tid 线程里调用
+    // 下了断点的子进程先停下来去掉断点, 调试寄存器和BRK/int3在detach以后都还在, 留着进程下次执行到就会被SIGTRAP杀掉
+    void detach_all();
 
-    bool filter_proce_exec_file(pid_t pid, ContorlProcess &cp);
+    // 子进程(非init)的waitpid事件,按照Tracee的状态处理,不会阻塞等待
+    void handle_tracee_event(pid_t pid, int status);
 
-    void add_childProces(ContorlProcess cp){
-        cps.emplace_back(cp);
+    // worker线程入口: SEIZE init线程交过来的进程,独立完成整个注入流程
+    // EXEC_GATE模式下SEIZE以后向fan_fd回复FAN_ALLOW放行exec,并关闭event_fd
+    // timeline 是交过来之前的耗时统计
+    void shard_worker(pid_t pid, ContorlProcess *cp, AttachMode mode, InjectTimeline timeline,
+                      int fan_fd = -1, int event_fd = -1);
+
+    bool filter_proce_exec_file(pid_t pid, ContorlProcess *&cp);
+
+    RuleTable& get_rules(){
+        return rules;
+    }
+
+    void add_childProces(std::unique_ptr<ContorlProcess> cp){
+        rules.add(std::move(cp));
     }
 
+    // 所有规则添加完以后编译索引
+    bool compile_rules(){
+        return rules.compile();
+    }
+
+    // 监控开始前把 linker 和各规则 waitSoPath 要用的符号查一遍, 检查磁盘上的符号缓存, 过期的这时候重建
+    void warm_symbols();
+
     // 获取单例实例的静态方法
     static InjectProc& getInstance() {
         static InjectProc instance; // 使用static保证只创建一次
@@ -59,11 +186,29 @@ private:
     InjectProc(){
 
     }
-    std::vector<ContorlProcess> cps;
+    RuleTable rules;
     std::string requestoSocket;
     pid_t traced_pid;
+    pid_t tracer_tid = 0;
     std::string zygote64_Inject_So;
     std::string zygote32_Inject_So;
-    std::set<pid_t> monitor_pid;
+    std::map<pid_t, Tracee> tracees;
+    bool shard = false;
+    MonitorBackend backend = MonitorBackend::PTRACE;
+
+    void dispatch_tracee_event(Tracee &t, int status);
+    void handoff_tracee(Tracee &t);
+    void start_entry_stop(Tracee &t);
+    void start_entry_break(Tracee &t);
+    void on_handoff_stop(Tracee &t, int status);
+    void on_forked_stop(Tracee &t, int status);
+    void dispatch_timed(Tracee &t, int status);
+    void on_entry_stop(Tracee &t, int status);
+    void on_lib_break(Tracee &t, int status);
+    void on_lib_step(Tracee &t, int status);
+    void on_fun_sym_break(Tracee &t, int status);
+    void start_wait_lib(Tracee &t);
+    void start_wait_fun_sym(Tracee &t);
+    void inject_and_detach(Tracee &t);
 
 };
\ No newline at end of file
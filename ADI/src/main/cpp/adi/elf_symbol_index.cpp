@@ -0,0 +1,247 @@
+//
+// Created by chic on 2025/7/6.
+//
+
+#include "elf_symbol_index.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstring>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include "xz_decoder.h"
+#include "logging.h"
+
+ElfSymbolIndex::~ElfSymbolIndex(){
+    if (base != nullptr && owned.empty()) {
+        munmap(base, length);
+    }
+}
+
+// fd 是已经打开的文件, 长度是 size
+static void *map_elf(int fd, size_t size){
+    if (size < sizeof(Elf64_Ehdr)) {
+        return nullptr;
+    }
+    void *data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        PLOGE("mmap elf");
+        return nullptr;
+    }
+    auto ident = static_cast<const unsigned char *>(data);
+    if (memcmp(ident, ELFMAG, SELFMAG) != 0 || (ident[EI_CLASS] != ELFCLASS32 && ident[EI_CLASS] != ELFCLASS64)) {
+        munmap(data, size);
+        return nullptr;
+    }
+    return data;
+}
+
+static bool open_elf(const char *path, int *fd, struct stat *st){
+    *fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (*fd == -1) {
+        PLOGE("open %s", path);
+        return false;
+    }
+    if (fstat(*fd, st) == -1) {
+        PLOGE("fstat %s", path);
+        close(*fd);
+        return false;
+    }
+    return true;
+}
+
+bool ElfSymbolIndex::open(const char *path){
+    int fd;
+    struct stat st;
+    if (!open_elf(path, &fd, &st)) {
+        return false;
+    }
+    void *data = map_elf(fd, st.st_size);
+    close(fd);
+    if (data == nullptr) {
+        LOGE("%s is not a valid elf", path);
+        return false;
+    }
+    if (base != nullptr && owned.empty()) {
+        munmap(base, length);
+    }
+    base = data;
+    length = st.st_size;
+    return build(path);
+}
+
+bool ElfSymbolIndex::build(const char *path){
+    symbols.clear();
+    debugdata_offset = debugdata_size = 0;
+    build_id.clear();
+    return elf_dispatch(static_cast<const uint8_t *>(base)[EI_CLASS],
+                        [&](auto e) { return build_image<decltype(e)>(path); });
+}
+
+template<typename E>
+bool ElfSymbolIndex::build_image(const char *path){
+    ElfFileImage<E> elf;
+    if (!elf.open(static_cast<const uint8_t *>(base), length)) {
+        LOGE("%s has no section headers", path);
+        return false;
+    }
+    size_t symbol_count = 0;
+    for (size_t i = 0; i < elf.section_count(); i++) {
+        if (elf.section(i).sh_type == SHT_SYMTAB || elf.section(i).sh_type == SHT_DYNSYM) {
+            symbol_count += elf.section(i).sh_size / sizeof(typename E::Sym);
+        }
+    }
+    symbols.reserve(symbol_count);
+    auto add = [&](std::string_view name, const typename E::Sym &sym) {
+        // 导入的符号和 section/file 符号都不要
+        int type = sym.st_info & 0xf;
+        uint8_t bind = sym.st_info >> 4;
+        if (sym.st_shndx == SHN_UNDEF || type == STT_SECTION || type == STT_FILE) {
+            return;
+        }
+        auto [it, inserted] = symbols.try_emplace(name, Symbol{sym.st_value, bind});
+        if (!inserted && it->second.bind == STB_LOCAL && bind != STB_LOCAL) {
+            it->second = Symbol{sym.st_value, bind};
+        }
+    };
+    // 跟原来一样 .symtab 在前, .dynsym 里的全局符号一般 .symtab 里也有
+    for (auto type: {SHT_SYMTAB, SHT_DYNSYM}) {
+        for (size_t i = 0; i < elf.section_count(); i++) {
+            if (elf.section(i).sh_type == (uint32_t) type) {
+                elf.for_each_symbol(elf.section(i), add);
+            }
+        }
+    }
+
+    // .gnu_debugdata 先只记下位置, 用到的时候才解压
+    if (auto debugdata = elf.find_section(".gnu_debugdata", SHT_PROGBITS); debugdata != nullptr) {
+        debugdata_offset = debugdata->sh_offset;
+        debugdata_size = debugdata->sh_size;
+        elf.build_id(&build_id);
+    }
+    return !symbols.empty() || debugdata_size != 0;
+}
+
+std::shared_ptr<const ElfSymbolIndex> ElfSymbolIndex::debugdata() const {
+    if (debugdata_size == 0) {
+        return nullptr;
+    }
+    std::lock_guard<std::mutex> guard(debugdata_lock);
+    if (!debugdata_loaded) {
+        debugdata_index = load_debugdata();
+        debugdata_loaded = true;
+    }
+    return debugdata_index;
+}
+
+std::shared_ptr<const ElfSymbolIndex> ElfSymbolIndex::load_debugdata() const {
+    static std::mutex lock;
+    // build-id -> 解压出来的索引, 最近用过的在最后
+    static std::vector<std::pair<std::string, std::shared_ptr<const ElfSymbolIndex>>> lru;
+    if (!build_id.empty()) {
+        std::lock_guard<std::mutex> guard(lock);
+        for (size_t i = 0; i < lru.size(); i++) {
+            if (lru[i].first == build_id) {
+                auto hit = lru[i];
+                lru.erase(lru.begin() + i);
+                lru.push_back(hit);
+                return hit.second;
+            }
+        }
+    }
+    auto index = std::make_shared<ElfSymbolIndex>();
+    auto data = static_cast<const uint8_t *>(base) + debugdata_offset;
+    if (!xz_decompress(data, debugdata_size, &index->owned, kMaxDebugdataSize)) {
+        LOGE("decompress .gnu_debugdata failed");
+        return nullptr;
+    }
+    if (index->owned.size() < SELFMAG || memcmp(index->owned.data(), ELFMAG, SELFMAG) != 0) {
+        LOGE(".gnu_debugdata is not a valid elf");
+        return nullptr;
+    }
+    index->base = index->owned.data();
+    index->length = index->owned.size();
+    if (!index->build(".gnu_debugdata")) {
+        return nullptr;
+    }
+    if (!build_id.empty()) {
+        std::lock_guard<std::mutex> guard(lock);
+        if (lru.size() >= kDebugdataCacheSize) {
+            lru.erase(lru.begin());
+        }
+        lru.emplace_back(build_id, index);
+    }
+    return index;
+}
+
+uintptr_t ElfSymbolIndex::find(std::string_view name) const {
+    auto it = symbols.find(name);
+    if (it != symbols.end()) {
+        return it->second.value;
+    }
+    auto mini = debugdata();
+    return mini != nullptr ? mini->find(name) : 0;
+}
+
+size_t ElfSymbolIndex::find(const char *const *names, uintptr_t *values, size_t count) const {
+    size_t found = 0;
+    for (size_t i = 0; i < count; i++) {
+        values[i] = find(names[i]);
+        if (values[i] != 0) {
+            found++;
+        }
+    }
+    return found;
+}
+
+std::shared_ptr<const ElfSymbolIndex> ElfSymbolIndex::get(const char *path){
+    static std::mutex lock;
+    // 最近用过的在最后
+    static std::vector<std::pair<ElfFileKey, std::shared_ptr<const ElfSymbolIndex>>> lru;
+
+    int fd;
+    struct stat st;
+    if (!open_elf(path, &fd, &st)) {
+        return nullptr;
+    }
+    ElfFileKey key{st.st_dev, st.st_ino, st.st_mtim, st.st_size};
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        for (size_t i = 0; i < lru.size(); i++) {
+            if (lru[i].first == key) {
+                auto hit = lru[i];
+                lru.erase(lru.begin() + i);
+                lru.push_back(hit);
+                close(fd);
+                return hit.second;
+            }
+        }
+    }
+    // 建索引的时候不拿锁, 两个线程同时打开同一个文件最多多建一次
+    void *data = map_elf(fd, st.st_size);
+    close(fd);
+    if (data == nullptr) {
+        LOGE("%s is not a valid elf", path);
+        return nullptr;
+    }
+    auto index = std::make_shared<ElfSymbolIndex>();
+    index->base = data;
+    index->length = st.st_size;
+    if (!index->build(path)) {
+        return nullptr;
+    }
+    std::lock_guard<std::mutex> guard(lock);
+    for (size_t i = 0; i < lru.size(); i++) {
+        if (lru[i].first == key) {
+            lru.erase(lru.begin() + i);
+            break;
+        }
+    }
+    if (lru.size() >= kCacheSize) {
+        lru.erase(lru.begin());
+    }
+    lru.emplace_back(key, index);
+    return index;
+}
@@ -0,0 +1,106 @@
+//
+// Created by chic on 2025/7/6.
+//
+
+#pragma once
+#include <sys/types.h>
+#include <elf.h>
+#include <cstdint>
+#include <cstddef>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "elf_engine.h"
+
+/**
+ * 磁盘上一个so的符号表索引, 查的是符号在文件里的偏移(st_value), 加上 load bias 才是运行时地址
+ * 文件只读 mmap 一次, .symtab 和 .dynsym 里所有定义了的符号按名字放进哈希表, 名字直接指向映射的字符串表
+ * 32位和64位的文件都能打开, 用 elf_engine.h 按文件的类别解析, 跟 adi 自己是多少位无关
+ * 名字必须完全相同才算找到; 同名的符号 GLOBAL/WEAK 优先, 都是 LOCAL 的时候 .symtab 里第一个优先
+ * 被 strip 过只剩 .gnu_debugdata(MiniDebugInfo) 的文件, 这两个表里找不到时才解压它, 里面的 .symtab 另建一个索引
+ * 对象析构时 munmap
+ */
+class ElfSymbolIndex {
+public:
+    ElfSymbolIndex() = default;
+    ~ElfSymbolIndex();
+    ElfSymbolIndex(const ElfSymbolIndex &) = delete;
+    ElfSymbolIndex &operator=(const ElfSymbolIndex &) = delete;
+
+    // 映射文件并建立索引, 不是ELF或者一个符号都没有返回false
+    bool open(const char *path);
+
+    // 符号的 st_value, 找不到返回0
+    uintptr_t find(std::string_view name) const;
+    // 一次查多个, values[i] 是 names[i] 的 st_value, 找不到的是0, 返回找到了几个
+    size_t find(const char *const *names, uintptr_t *values, size_t count) const;
+
+    size_t size() const {
+        return symbols.size();
+    }
+
+    bool has_debugdata() const {
+        return debugdata_size != 0;
+    }
+    /**
+     * .gnu_debugdata 解压出来的ELF的索引, 第一次调用时才解压, 没有或者解压失败返回nullptr, 失败了不会再试
+     * 解压结果按 build-id 放在一个LRU里, 同一个 build-id 的文件(比如 apex 里和 bind mount 出来的同一个 linker)只解压一次
+     */
+    std::shared_ptr<const ElfSymbolIndex> debugdata() const;
+    // 按 build-id 缓存最多几个解压出来的 MiniDebugInfo
+    static constexpr size_t kDebugdataCacheSize = 4;
+    // 解压以后比这还大当作坏数据
+    static constexpr size_t kMaxDebugdataSize = 64 << 20;
+
+    /**
+     * 打开过的文件按 (dev, inode, mtime, size) 放在一个LRU里, 同一个文件不会重复映射和建索引
+     * 每次只 stat 一次判断文件有没有变, 变了或者被挤出去的索引在最后一个引用释放时 munmap
+     * 文件打不开或者不是ELF返回nullptr
+     */
+    static std::shared_ptr<const ElfSymbolIndex> get(const char *path);
+    // LRU 里最多几个文件, 每次 spawn 用到的只有 linker 和 waitSoPath
+    static constexpr size_t kCacheSize = 8;
+
+private:
+    // base 和 length 已经是映射好的文件, 按 e_ident 的类别调用 build_image
+    bool build(const char *path);
+    template<typename E>
+    bool build_image(const char *path);
+
+    std::shared_ptr<const ElfSymbolIndex> load_debugdata() const;
+
+    void *base = nullptr;
+    size_t length = 0;
+    // MiniDebugInfo 的索引指向自己解压出来的数据, 不是映射的文件
+    std::vector<uint8_t> owned;
+    struct Symbol {
+        uint64_t value;
+        uint8_t bind;
+    };
+    std::unordered_map<std::string_view, Symbol> symbols;
+
+    // .gnu_debugdata 在文件里的位置, 没有的时候 size 是0
+    uint64_t debugdata_offset = 0;
+    uint64_t debugdata_size = 0;
+    std::string build_id;
+    mutable std::mutex debugdata_lock;
+    mutable bool debugdata_loaded = false;
+    mutable std::shared_ptr<const ElfSymbolIndex> debugdata_index;
+};
+
+// LRU 的键, stat 里能看出文件有没有被替换或者改写的字段
+struct ElfFileKey {
+    dev_t dev;
+    ino_t inode;
+    struct timespec mtime;
+    off_t size;
+
+    bool operator==(const ElfFileKey &other) const {
+        return dev == other.dev && inode == other.inode && mtime.tv_sec == other.mtime.tv_sec &&
+               mtime.tv_nsec == other.mtime.tv_nsec && size == other.size;
+    }
+};
@@ -3,35 +3,16 @@
 //
 
 #pragma once
+#include <sys/types.h>
+#include <cstddef>
+#include <cstdint>
 
-
-
-class SymbolName {
-public:
-    explicit SymbolName(const char* name)
-            : name_(name), has_elf_hash_(false), has_gnu_hash_(false),
-              elf_hash_(0), gnu_hash_(0) { }
-
-    const char* get_name() {
-        return name_;
-    }
-
-
-    uint32_t elf_hash();
-    uint32_t gnu_hash();
-
-
-private:
-    const char* name_;
-    bool has_elf_hash_;
-    bool has_gnu_hash_;
-    uint32_t elf_hash_;
-    uint32_t gnu_hash_;
-
-};
-
+// so_addr 是目标进程里so偏移为0的映射, 返回符号在目标进程里的地址, 用的是 RemoteElf
 void *get_remote_load_Sym_Addr(void *so_addr, pid_t pid, const char *symbol_name) ;
 
 void *get_self_load_Sym_Addr(const char *library_name, const char *symbol_name) ;
 
-uintptr_t get_libFile_Symbol_off(char *lib_path,char *fun_name);
\ No newline at end of file
+// 符号在磁盘上so文件里的偏移, 名字完全相同才算, 找不到返回0; 先查 SymbolCache, 缓存里没有才解析文件
+uintptr_t get_libFile_Symbol_off(const char *lib_path, const char *fun_name);
+// 同一个文件一次查多个符号, offs[i] 对应 fun_names[i], 返回找到了几个
+size_t get_libFile_Symbol_offs(const char *lib_path, const char *const *fun_names, uintptr_t *offs, size_t count);
\ No newline at end of file
@@ -0,0 +1,97 @@
+//
+// Created by chic on 2025/6/4.
+//
+
+#include <sys/fanotify.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <thread>
+#include "fanotify_gate.h"
+#include "contorlProcess.h"
+#include "logging.h"
+
+void exec_gate_allow(int fan_fd, int event_fd){
+    struct fanotify_response response{};
+    response.fd = event_fd;
+    response.response = FAN_ALLOW;
+    if (write(fan_fd, &response, sizeof(response)) != sizeof(response)) {
+        PLOGE("fanotify response");
+    }
+    close(event_fd);
+}
+
+// 给每个规则的exec文件设置标记,事件到来时按fd的 (dev, inode) 在 RuleTable 里查找规则
+static size_t gate_mark_rules(int fan_fd){
+    size_t marked = 0;
+    for (auto &rule: InjectProc::getInstance().get_rules().rules()) {
+        const char *path = rule->exec.c_str();
+        if (!rule->execRegex.empty() || rule->exec.find_first_of("*?[") != std::string::npos) {
+            LOGW("exec gate can not mark pattern rule %s", path);
+            continue;
+        }
+        if (fanotify_mark(fan_fd, FAN_MARK_ADD, FAN_OPEN_EXEC_PERM, AT_FDCWD, path) != 0) {
+            PLOGE("fanotify_mark %s", path);
+            continue;
+        }
+        LOGD("exec gate on %s", path);
+        marked++;
+    }
+    return marked;
+}
+
+static void on_exec_gate(int fan_fd, const struct fanotify_event_metadata *md){
+    InjectTimeline timeline;
+    InjectMetrics::mark(timeline, InjectMark::FORK);
+    InjectProc & injectProc = InjectProc::getInstance();
+    pid_t traced_pid = injectProc.getTracePid();
+    struct stat st;
+    ContorlProcess *cp = nullptr;
+    if (fstat(md->fd, &st) == 0) {
+        cp = injectProc.get_rules().match_file(st.st_dev, st.st_ino, "");
+    }
+    // 跟ptrace后端一样,只处理traced_pid的子进程
+    if (cp == nullptr || (traced_pid > 0 && get_ppid(md->pid) != traced_pid) || !RuleTable::take(cp)) {
+        exec_gate_allow(fan_fd, md->fd);
+        return;
+    }
+    LOGD("exec gate matched %d %s", md->pid, cp->exec.c_str());
+    // worker SEIZE以后才回复FAN_ALLOW, 在这之前exec一直阻塞在内核里
+    std::thread(&InjectProc::shard_worker, &injectProc, (pid_t) md->pid, cp, AttachMode::EXEC_GATE, timeline, fan_fd, md->fd).detach();
+}
+
+[[noreturn]]
+void FanotifyGateTask(){
+    int fan_fd = fanotify_init(FAN_CLASS_CONTENT | FAN_CLOEXEC, O_RDONLY | O_LARGEFILE | O_CLOEXEC);
+    if (fan_fd == -1) {
+        PLOGE("fanotify_init");
+        exit(1);
+    }
+    if (gate_mark_rules(fan_fd) == 0) {
+        LOGE("no exec gate installed");
+        exit(1);
+    }
+    char buf[4096] __attribute__((aligned(__alignof__(struct fanotify_event_metadata))));
+    while (true) {
+        ssize_t len = read(fan_fd, buf, sizeof(buf));
+        if (len == -1) {
+            if (errno == EINTR || errno == EAGAIN) continue;
+            PLOGE("read fanotify");
+            exit(1);
+        }
+        for (auto md = (struct fanotify_event_metadata *) buf; FAN_EVENT_OK(md, len); md = FAN_EVENT_NEXT(md, len)) {
+            if (md->vers != FANOTIFY_METADATA_VERSION) {
+                LOGE("fanotify metadata version mismatch");
+                exit(1);
+            }
+            if (md->fd < 0) continue;
+            if (md->mask & FAN_OPEN_EXEC_PERM) {
+                on_exec_gate(fan_fd, md);
+            } else {
+                close(md->fd);
+            }
+        }
+    }
+}
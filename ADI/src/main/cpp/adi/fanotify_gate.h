@@ -0,0 +1,17 @@
+//
+// Created by chic on 2025/6/4.
+//
+
+#pragma once
+#include <sys/types.h>
+
+/**
+ * @brief 在childProcess的exec文件上设置 FAN_OPEN_EXEC_PERM
+ * 内核只会拦住执行这些文件的exec,等adi SEIZE以后再放行,系统里其他进程启动完全不经过adi
+ * 需要CAP_SYS_ADMIN和5.0以上内核
+ */
+[[noreturn]]
+void FanotifyGateTask();
+
+// 回复FAN_ALLOW放行阻塞在权限事件里的exec,并关闭事件fd
+void exec_gate_allow(int fan_fd, int event_fd);
@@ -0,0 +1,202 @@
+//
+// Created by chic on 2025/7/12.
+//
+
+#include "hw_breakpoint.h"
+#include <sys/ptrace.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <elf.h>
+#include <signal.h>
+#include <cstddef>
+#include <cstring>
+#include <cerrno>
+#if defined(__x86_64__)
+#include <sys/user.h>
+#endif
+#include "logging.h"
+
+#ifndef TRAP_HWBKPT
+#define TRAP_HWBKPT 4
+#endif
+
+#if defined(__aarch64__)
+#ifndef NT_ARM_HW_BREAK
+#define NT_ARM_HW_BREAK 0x402
+#endif
+
+// 跟内核 uapi 的 user_hwdebug_state 一样, 有的 NDK 头文件里没有
+struct HwDebugState {
+    uint32_t dbg_info;
+    uint32_t pad;
+    struct {
+        uint64_t addr;
+        uint32_t ctrl;
+        uint32_t pad;
+    } dbg_regs[16];
+};
+
+// 执行断点, 长度4字节(BAS=0b1111), 只在EL0触发, 打开
+static constexpr uint32_t kCtrlExec = (0xf << 5) | (2 << 1) | 1;
+
+static bool read_state(pid_t tid, HwDebugState *state){
+    struct iovec iov = {state, sizeof(*state)};
+    return ptrace(PTRACE_GETREGSET, tid, NT_ARM_HW_BREAK, &iov) != -1;
+}
+
+// 只写到 slot 为止, 后面的槽位不动
+static bool write_slot(pid_t tid, const HwDebugState &state, int slot){
+    struct iovec iov = {const_cast<HwDebugState *>(&state),
+                        offsetof(HwDebugState, dbg_regs) + (slot + 1) * sizeof(state.dbg_regs[0])};
+    return ptrace(PTRACE_SETREGSET, tid, NT_ARM_HW_BREAK, &iov) != -1;
+}
+
+bool hw_breakpoint_set(HwBreakpoint &bp, pid_t tid, uintptr_t addr){
+    HwDebugState state;
+    if (!read_state(tid, &state)) {
+        PLOGE("read NT_ARM_HW_BREAK of %d", tid);
+        return false;
+    }
+    int slots = state.dbg_info & 0xff;
+    for (int i = 0; i < slots && i < 16; i++) {
+        if (state.dbg_regs[i].ctrl & 1) {
+            continue;
+        }
+        state.dbg_regs[i].addr = addr;
+        state.dbg_regs[i].ctrl = kCtrlExec;
+        if (!write_slot(tid, state, i)) {
+            PLOGE("set hw breakpoint %d at %lx", i, (unsigned long) addr);
+            return false;
+        }
+        bp = HwBreakpoint{tid, i, addr};
+        return true;
+    }
+    LOGD("no free hw breakpoint slot in %d (%d slots)", tid, slots);
+    return false;
+}
+
+bool hw_breakpoint_enable(HwBreakpoint &bp, bool enable){
+    if (!bp.armed()) {
+        return false;
+    }
+    HwDebugState state;
+    if (!read_state(bp.tid, &state)) {
+        return false;
+    }
+    state.dbg_regs[bp.slot].addr = bp.addr;
+    state.dbg_regs[bp.slot].ctrl = enable ? kCtrlExec : (kCtrlExec & ~1u);
+    return write_slot(bp.tid, state, bp.slot);
+}
+
+void hw_breakpoint_clear(HwBreakpoint &bp){
+    if (!bp.armed()) {
+        return;
+    }
+    HwDebugState state;
+    if (read_state(bp.tid, &state)) {
+        state.dbg_regs[bp.slot].addr = 0;
+        state.dbg_regs[bp.slot].ctrl = 0;
+        write_slot(bp.tid, state, bp.slot);
+    }
+    bp = HwBreakpoint{};
+}
+
+#elif defined(__x86_64__)
+
+static constexpr int kSlots = 4;
+
+static long dr_offset(int i){
+    return offsetof(struct user, u_debugreg) + i * sizeof(((struct user *) nullptr)->u_debugreg[0]);
+}
+
+static bool read_dr(pid_t tid, int i, unsigned long *value){
+    errno = 0;
+    long v = ptrace(PTRACE_PEEKUSER, tid, dr_offset(i), nullptr);
+    if (v == -1 && errno != 0) {
+        return false;
+    }
+    *value = v;
+    return true;
+}
+
+static bool write_dr(pid_t tid, int i, unsigned long value){
+    return ptrace(PTRACE_POKEUSER, tid, dr_offset(i), value) != -1;
+}
+
+bool hw_breakpoint_set(HwBreakpoint &bp, pid_t tid, uintptr_t addr){
+    unsigned long dr7;
+    if (!read_dr(tid, 7, &dr7)) {
+        PLOGE("read dr7 of %d", tid);
+        return false;
+    }
+    for (int i = 0; i < kSlots; i++) {
+        // Li/Gi 都没开的是空闲的
+        if ((dr7 >> (i * 2)) & 3) {
+            continue;
+        }
+        // 先写地址再打开; RWi=00 LENi=00 是执行断点
+        dr7 &= ~(0xful << (16 + i * 4));
+        if (!write_dr(tid, i, addr) || !write_dr(tid, 7, dr7 | (1ul << (i * 2)))) {
+            PLOGE("set hw breakpoint %d at %lx", i, (unsigned long) addr);
+            write_dr(tid, i, 0);
+            return false;
+        }
+        bp = HwBreakpoint{tid, i, addr};
+        return true;
+    }
+    LOGD("no free hw breakpoint slot in %d", tid);
+    return false;
+}
+
+bool hw_breakpoint_enable(HwBreakpoint &bp, bool enable){
+    unsigned long dr7;
+    if (!bp.armed() || !read_dr(bp.tid, 7, &dr7)) {
+        return false;
+    }
+    dr7 = enable ? dr7 | (1ul << (bp.slot * 2)) : dr7 & ~(1ul << (bp.slot * 2));
+    return write_dr(bp.tid, 7, dr7);
+}
+
+void hw_breakpoint_clear(HwBreakpoint &bp){
+    if (!bp.armed()) {
+        return;
+    }
+    hw_breakpoint_enable(bp, false);
+    write_dr(bp.tid, bp.slot, 0);
+    bp = HwBreakpoint{};
+}
+
+#else
+
+bool hw_breakpoint_set(HwBreakpoint &bp, pid_t tid, uintptr_t addr){
+    return false;
+}
+
+bool hw_breakpoint_enable(HwBreakpoint &bp, bool enable){
+    return false;
+}
+
+void hw_breakpoint_clear(HwBreakpoint &bp){
+    bp = HwBreakpoint{};
+}
+
+#endif
+
+bool hw_breakpoint_hit(HwBreakpoint &bp, int status){
+    if (!bp.armed() || !WIFSTOPPED(status) || WSTOPSIG(status) != SIGTRAP || (status >> 16) != 0) {
+        return false;
+    }
+    siginfo_t info;
+    if (ptrace(PTRACE_GETSIGINFO, bp.tid, nullptr, &info) == -1 || info.si_code != TRAP_HWBKPT) {
+        return false;
+    }
+#if defined(__x86_64__)
+    // DR6 里对应槽位的位, 内核不会清, 留着下次会看错
+    unsigned long dr6;
+    if (!read_dr(bp.tid, 6, &dr6) || ((dr6 >> bp.slot) & 1) == 0) {
+        return false;
+    }
+    write_dr(bp.tid, 6, 0);
+#endif
+    return true;
+}
@@ -0,0 +1,44 @@
+//
+// Created by chic on 2025/7/12.
+//
+
+#pragma once
+#include <sys/types.h>
+#include <cstdint>
+
+/**
+ * 用调试寄存器下的执行断点, 不改目标的代码段: 命中时不用恢复原指令, 继续等下一次也不用重新写断点
+ * arm64 用 NT_ARM_HW_BREAK regset, 槽位数从 dbg_info 里读; x86_64 用 PTRACE_POKEUSER 写 DR0-DR3 和 DR7
+ * 调试寄存器是每个线程自己的, 只对下断点的那个线程有效, 新建的线程不会继承
+ * detach 时内核不会清掉, 留着的话进程下次执行到就会被SIGTRAP杀掉, detach 之前一定要 hw_breakpoint_clear
+ * 其他构架, 内核不支持或者槽位用完都返回false, 调用方退回写 BRK/int3 的软件断点
+ */
+struct HwBreakpoint {
+    pid_t tid = 0;
+    int slot = -1;
+    uintptr_t addr = 0;
+
+    bool armed() const {
+        return slot >= 0;
+    }
+};
+
+/**
+ * 命中以后直接 PTRACE_CONT 会不会再停在同一个地方
+ * x86_64 的内核在 eflags 里设了 RF, 这一条指令不会再触发; arm64 上 ptrace 下的断点内核不会自己跳过,
+ * 要先 hw_breakpoint_enable(false), 单步一次, 再 hw_breakpoint_enable(true)
+ */
+#if defined(__aarch64__)
+static constexpr bool kHwBreakpointNeedsStep = true;
+#else
+static constexpr bool kHwBreakpointNeedsStep = false;
+#endif
+
+// 在停着的线程 tid 的 addr 处下执行断点, 成功以后 bp.armed()
+bool hw_breakpoint_set(HwBreakpoint &bp, pid_t tid, uintptr_t addr);
+// 暂时关掉或者重新打开, 槽位不还
+bool hw_breakpoint_enable(HwBreakpoint &bp, bool enable);
+// 关掉并还回槽位
+void hw_breakpoint_clear(HwBreakpoint &bp);
+// status 是 waitpid 拿到的 SIGTRAP 停止, 是不是这个断点触发的; x86_64 上顺便清掉 DR6
+bool hw_breakpoint_hit(HwBreakpoint &bp, int status);
@@ -0,0 +1,220 @@
+//
+// Created by chic on 2025/6/12.
+//
+
+#include "inject_metrics.h"
+#include <ctime>
+#include <cstdarg>
+#include <cstdio>
+#include <algorithm>
+#include <fstream>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include "json.hpp"
+#include "logging.h"
+#include "remote_memory.h"
+
+using json = nlohmann::json;
+
+static const char *mark_names[(int) InjectMark::COUNT] = {
+        "fork", "exec", "entry_stop", "wait_lib", "wait_fun_sym",
+        "call_mmap", "call_dlopen", "call_dlsym", "call_user", "detach"
+};
+
+static const char *syscall_names[(int) SyscallKind::COUNT] = {
+        "ptrace", "waitpid", "process_vm", "proc_mem"
+};
+
+uint64_t InjectMetrics::now_ns(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+InjectTimeline *&InjectMetrics::current(){
+    static thread_local InjectTimeline *timeline = nullptr;
+    return timeline;
+}
+
+void InjectMetrics::mark(InjectTimeline &t, InjectMark m){
+    t.marks[(int) m] = now_ns();
+}
+
+void InjectMetrics::mark_current(InjectMark m){
+    InjectTimeline *t = current();
+    if (t != nullptr) {
+        mark(*t, m);
+    }
+}
+
+void InjectMetrics::count(SyscallKind kind){
+    InjectTimeline *t = current();
+    if (t != nullptr) {
+        t->syscalls[(int) kind]++;
+    }
+}
+
+void InjectMetrics::Histogram::add(uint64_t v){
+    if (samples.size() < kMaxSamples) {
+        samples.push_back(v);
+    } else {
+        samples[next] = v;
+        next = (next + 1) % kMaxSamples;
+    }
+    count++;
+    max = std::max(max, v);
+}
+
+uint64_t InjectMetrics::Histogram::percentile(unsigned int p) const{
+    if (samples.empty()) {
+        return 0;
+    }
+    std::vector<uint64_t> sorted(samples);
+    size_t idx = ((sorted.size() - 1) * p + 50) / 100;
+    std::nth_element(sorted.begin(), sorted.begin() + idx, sorted.end());
+    return sorted[idx];
+}
+
+void InjectMetrics::record(const std::string &rule, pid_t pid, const InjectTimeline &t){
+    stop_count.fetch_add(t.stops, std::memory_order_relaxed);
+    spawn_count.fetch_add(1, std::memory_order_relaxed);
+    // Release 下 LOGD 是空的, 计数不能放在参数里
+    LOGD("tracee %d: %u stops, total %lu stops / %lu processes", pid, t.stops,
+         (unsigned long) stop_count.load(std::memory_order_relaxed),
+         (unsigned long) spawn_count.load(std::memory_order_relaxed));
+    if (!enabled) {
+        return;
+    }
+    uint64_t start = 0;
+    for (uint64_t m : t.marks) {
+        if (m != 0 && (start == 0 || m < start)) start = m;
+    }
+    std::lock_guard<std::mutex> guard(lock);
+    RuleStats &rs = rules[rule.empty() ? "<unmatched>" : rule];
+    rs.processes++;
+    if (t.marks[(int) InjectMark::DETACH] != 0) {
+        rs.total_ns.add(t.marks[(int) InjectMark::DETACH] - start);
+    }
+    rs.stopped_ns.add(t.stopped_ns);
+    rs.stops.add(t.stops);
+    for (int i = 0; i < (int) SyscallKind::COUNT; i++) {
+        rs.syscalls[i].add(t.syscalls[i]);
+    }
+    for (int i = 0; i < (int) InjectMark::COUNT; i++) {
+        if (t.marks[i] != 0) {
+            rs.marks_ns[i].add(t.marks[i] - start);
+        }
+    }
+}
+
+void InjectMetrics::dump(){
+    std::lock_guard<std::mutex> guard(lock);
+    LOGI("inject stats: %lu processes, %lu stops", (unsigned long) spawn_count.load(),
+         (unsigned long) stop_count.load());
+    auto line = [](const char *name, const Histogram &h, const char *unit) {
+        if (h.count == 0) return;
+        LOGI("  %-14s p50 %lu%s p99 %lu%s max %lu%s", name, (unsigned long) h.percentile(50), unit,
+             (unsigned long) h.percentile(99), unit, (unsigned long) h.max, unit);
+    };
+    for (auto &[rule, rs] : rules) {
+        LOGI("rule %s: %lu processes", rule.c_str(), (unsigned long) rs.processes);
+        line("total", rs.total_ns, "ns");
+        line("stopped", rs.stopped_ns, "ns");
+        line("stops", rs.stops, "");
+        for (int i = 0; i < (int) SyscallKind::COUNT; i++) {
+            line(syscall_names[i], rs.syscalls[i], "");
+        }
+        for (int i = 0; i < (int) InjectMark::COUNT; i++) {
+            line(mark_names[i], rs.marks_ns[i], "ns");
+        }
+    }
+}
+
+bool InjectMetrics::write_json(){
+    if (json_path.empty()) {
+        return false;
+    }
+    auto histogram = [](const Histogram &h) {
+        return json{{"count", h.count}, {"p50", h.percentile(50)}, {"p99", h.percentile(99)}, {"max", h.max}};
+    };
+    json root;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        root["processes"] = spawn_count.load();
+        root["stops"] = stop_count.load();
+        json &out = root["rules"];
+        out = json::object();
+        for (auto &[rule, rs] : rules) {
+            json r;
+            r["processes"] = rs.processes;
+            r["total_ns"] = histogram(rs.total_ns);
+            r["stopped_ns"] = histogram(rs.stopped_ns);
+            r["stops"] = histogram(rs.stops);
+            for (int i = 0; i < (int) SyscallKind::COUNT; i++) {
+                r["syscalls"][syscall_names[i]] = histogram(rs.syscalls[i]);
+            }
+            for (int i = 0; i < (int) InjectMark::COUNT; i++) {
+                if (rs.marks_ns[i].count != 0) {
+                    r["timeline_ns"][mark_names[i]] = histogram(rs.marks_ns[i]);
+                }
+            }
+            out[rule] = r;
+        }
+    }
+    // 先写临时文件再rename,读的一方不会看到写了一半的文件
+    std::string tmp = json_path + ".tmp";
+    {
+        std::ofstream f(tmp);
+        if (!f) {
+            PLOGE("open %s", tmp.c_str());
+            return false;
+        }
+        f << root.dump(2);
+    }
+    if (rename(tmp.c_str(), json_path.c_str()) != 0) {
+        PLOGE("rename %s", json_path.c_str());
+        return false;
+    }
+    LOGD("inject stats written to %s", json_path.c_str());
+    return true;
+}
+
+// CMakeLists 里用 -Wl,--wrap 把这几个调用转到这里计数, ptrace 同时让 RemoteMemory 的读缓存失效
+// bionic的ptrace是变参函数, 实现里固定按 pid, addr, data 取参数
+extern "C" {
+long __real_ptrace(int request, ...);
+pid_t __real_waitpid(pid_t pid, int *status, int options);
+ssize_t __real_process_vm_readv(pid_t pid, const struct iovec *local_iov, unsigned long liovcnt,
+                                const struct iovec *remote_iov, unsigned long riovcnt, unsigned long flags);
+ssize_t __real_process_vm_writev(pid_t pid, const struct iovec *local_iov, unsigned long liovcnt,
+                                 const struct iovec *remote_iov, unsigned long riovcnt, unsigned long flags);
+
+long __wrap_ptrace(int request, ...){
+    va_list ap;
+    va_start(ap, request);
+    pid_t pid = va_arg(ap, pid_t);
+    void *addr = va_arg(ap, void *);
+    void *data = va_arg(ap, void *);
+    va_end(ap);
+    InjectMetrics::count(SyscallKind::PTRACE);
+    RemoteMemory::on_ptrace(request);
+    return __real_ptrace(request, pid, addr, data);
+}
+
+pid_t __wrap_waitpid(pid_t pid, int *status, int options){
+    InjectMetrics::count(SyscallKind::WAITPID);
+    return __real_waitpid(pid, status, options);
+}
+
+ssize_t __wrap_process_vm_readv(pid_t pid, const struct iovec *local_iov, unsigned long liovcnt,
+                                const struct iovec *remote_iov, unsigned long riovcnt, unsigned long flags){
+    InjectMetrics::count(SyscallKind::PROCESS_VM);
+    return __real_process_vm_readv(pid, local_iov, liovcnt, remote_iov, riovcnt, flags);
+}
+
+ssize_t __wrap_process_vm_writev(pid_t pid, const struct iovec *local_iov, unsigned long liovcnt,
+                                 const struct iovec *remote_iov, unsigned long riovcnt, unsigned long flags){
+    InjectMetrics::count(SyscallKind::PROCESS_VM);
+    return __real_process_vm_writev(pid, local_iov, liovcnt, remote_iov, riovcnt, flags);
+}
+}
@@ -0,0 +1,118 @@
+//
+// Created by chic on 2025/6/12.
+//
+
+#pragma once
+#include <sys/types.h>
+#include <cstdint>
+#include <string>
+#include <map>
+#include <vector>
+#include <mutex>
+#include <atomic>
+
+// 一次注入过程中记录时间的位置
+enum class InjectMark {
+    FORK,           // ptrace后端看到fork出的子进程, netlink/fanotify后端是收到exec事件
+    EXEC,           // PTRACE_EVENT_EXEC 或者 worker SEIZE 成功
+    ENTRY_STOP,     // 执行到程序入口
+    WAIT_LIB,       // waitSoPath 加载完成
+    WAIT_FUN_SYM,   // waitFunSym 断点命中
+    CALL_MMAP,      // 每个 ptrace_call 返回的时间
+    CALL_DLOPEN,
+    CALL_DLSYM,
+    CALL_USER,      // InjectFunSym 返回
+    DETACH,
+    COUNT
+};
+
+// 会让目标进程停下来或者访问目标进程内存的系统调用
+enum class SyscallKind {
+    PTRACE,
+    WAITPID,
+    PROCESS_VM,     // process_vm_readv / process_vm_writev
+    PROC_MEM,       // pread/pwrite /proc/pid/mem, RemoteMemory 自己计数
+    COUNT
+};
+
+// 每个Tracee一份, 记录时间点(CLOCK_MONOTONIC纳秒, 0表示没有经过)和syscall次数
+struct InjectTimeline {
+    uint64_t marks[(int) InjectMark::COUNT] = {};
+    uint32_t syscalls[(int) SyscallKind::COUNT] = {};
+    // 追踪线程从拿到停止事件到让进程继续运行花的时间,这段时间目标进程一直停着
+    // 不包括内核停止进程到waitpid返回的调度延迟
+    uint64_t stopped_ns = 0;
+    // 停止次数,每次停止都是两次上下文切换
+    uint32_t stops = 0;
+};
+
+/**
+ * 注入耗时统计
+ * 追踪线程处理某个Tracee的事件时把它的时间线设为 current, ptrace/waitpid/process_vm_* 通过
+ * 链接参数 --wrap 包装, 计数记到 current 里; Tracee结束时 record 按规则汇总成直方图
+ * --stats 打开以后 SIGUSR1 输出到日志并写到json文件
+ */
+class InjectMetrics {
+public:
+    static InjectMetrics& getInstance() {
+        static InjectMetrics instance;
+        return instance;
+    }
+
+    void setEnabled(bool enable){
+        enabled = enable;
+    }
+    bool isEnabled(){
+        return enabled;
+    }
+    void setJsonPath(const std::string &path){
+        json_path = path;
+    }
+
+    static uint64_t now_ns();
+
+    // 当前线程正在处理的Tracee的时间线,没有的时候是nullptr
+    static InjectTimeline *&current();
+    static void mark(InjectTimeline &t, InjectMark m);
+    // 给 current 记录时间点, inject_process 这种拿不到Tracee的地方用
+    static void mark_current(InjectMark m);
+    static void count(SyscallKind kind);
+
+    // Tracee detach或者退出的时候调用, rule为空表示没有匹配到规则
+    void record(const std::string &rule, pid_t pid, const InjectTimeline &t);
+
+    // 按规则输出 p50/p99/max 到日志
+    void dump();
+    bool write_json();
+
+private:
+    InjectMetrics() = default;
+
+    // 只保留最近 kMaxSamples 个样本计算分位数, max和次数是全部样本的
+    struct Histogram {
+        static constexpr size_t kMaxSamples = 1024;
+        std::vector<uint64_t> samples;
+        size_t next = 0;
+        uint64_t count = 0;
+        uint64_t max = 0;
+
+        void add(uint64_t v);
+        uint64_t percentile(unsigned int p) const;
+    };
+
+    struct RuleStats {
+        uint64_t processes = 0;
+        Histogram total_ns;     // 第一个时间点到detach
+        Histogram stopped_ns;
+        Histogram stops;
+        Histogram syscalls[(int) SyscallKind::COUNT];
+        Histogram marks_ns[(int) InjectMark::COUNT];    // 第一个时间点到每个时间点
+    };
+
+    bool enabled = false;
+    std::string json_path;
+    std::mutex lock;
+    std::map<std::string, RuleStats> rules;
+    std::atomic<uint64_t> spawn_count{0};
+    std::atomic<uint64_t> stop_count{0};
+};
@@ -0,0 +1,142 @@
+//
+// Created by chic on 2025/6/28.
+//
+
+#include "inject_stub.h"
+#include <cstddef>
+
+static_assert(offsetof(InjectMailbox, dlopen) == 0);
+static_assert(offsetof(InjectMailbox, dlsym) == 8);
+static_assert(offsetof(InjectMailbox, dlerror) == 16);
+static_assert(offsetof(InjectMailbox, lib_path) == 24);
+static_assert(offsetof(InjectMailbox, function_name) == 32);
+static_assert(offsetof(InjectMailbox, function_args) == 40);
+static_assert(offsetof(InjectMailbox, handle) == 48);
+static_assert(offsetof(InjectMailbox, symbol) == 56);
+static_assert(offsetof(InjectMailbox, ret) == 64);
+static_assert(offsetof(InjectMailbox, error) == 72);
+
+// stub 只是拷贝到目标进程里的数据, 放在 .rodata 里, 注入器自己不会执行
+// 失败的时候把 dlerror() 拷贝到邮箱里, 最多255个字节
+#if defined(__aarch64__)
+asm(R"(
+    .pushsection .rodata
+    .balign 4
+    .hidden adi_inject_stub_begin
+    .hidden adi_inject_stub_end
+adi_inject_stub_begin:
+    hint #38                // bti jc, 停下来时 PSTATE.BTYPE 可能不是0
+    mov x19, x0
+    ldr x0, [x19, #24]
+    mov x1, #2              // RTLD_NOW
+    ldr x16, [x19, #0]
+    blr x16
+    str x0, [x19, #48]
+    cbz x0, 1f
+    ldr x1, [x19, #32]
+    ldr x16, [x19, #8]
+    blr x16
+    str x0, [x19, #56]
+    cbz x0, 1f
+    mov x16, x0
+    ldr x0, [x19, #48]
+    ldr x1, [x19, #40]
+    blr x16
+    str x0, [x19, #64]
+    b 3f
+1:
+    ldr x16, [x19, #16]
+    blr x16
+    cbz x0, 3f
+    add x1, x19, #72
+    mov x2, #255
+2:
+    ldrb w3, [x0], #1
+    strb w3, [x1], #1
+    cbz w3, 3f
+    subs x2, x2, #1
+    b.ne 2b
+    strb wzr, [x1]
+3:
+    brk #0
+adi_inject_stub_end:
+    .popsection
+)");
+#define HAS_INJECT_STUB 1
+// brk 停下来的时候 pc 还指向 brk
+static constexpr size_t kTrapBack = 4;
+#elif defined(__x86_64__)
+asm(R"(
+    .pushsection .rodata
+    .hidden adi_inject_stub_begin
+    .hidden adi_inject_stub_end
+adi_inject_stub_begin:
+    movq %rdi, %rbx
+    movq 24(%rbx), %rdi
+    movl $2, %esi           # RTLD_NOW
+    call *0(%rbx)
+    movq %rax, 48(%rbx)
+    testq %rax, %rax
+    jz 1f
+    movq %rax, %rdi
+    movq 32(%rbx), %rsi
+    call *8(%rbx)
+    movq %rax, 56(%rbx)
+    testq %rax, %rax
+    jz 1f
+    movq 48(%rbx), %rdi
+    movq 40(%rbx), %rsi
+    call *%rax
+    movq %rax, 64(%rbx)
+    jmp 3f
+1:
+    call *16(%rbx)
+    testq %rax, %rax
+    jz 3f
+    leaq 72(%rbx), %rdi
+    movl $255, %ecx
+2:
+    movb (%rax), %dl
+    movb %dl, (%rdi)
+    testb %dl, %dl
+    jz 3f
+    incq %rax
+    incq %rdi
+    decl %ecx
+    jnz 2b
+    movb $0, (%rdi)
+3:
+    int3
+adi_inject_stub_end:
+    .popsection
+)");
+#define HAS_INJECT_STUB 1
+// int3 停下来的时候 rip 已经指向下一条指令
+static constexpr size_t kTrapBack = 0;
+#endif
+
+#ifdef HAS_INJECT_STUB
+extern "C" const uint8_t adi_inject_stub_begin[];
+extern "C" const uint8_t adi_inject_stub_end[];
+
+bool inject_stub_code(const uint8_t **code, size_t *size){
+    *code = adi_inject_stub_begin;
+    *size = adi_inject_stub_end - adi_inject_stub_begin;
+    return true;
+}
+
+size_t inject_stub_trap_offset(){
+    return (adi_inject_stub_end - adi_inject_stub_begin) - kTrapBack;
+}
+#else
+// 32位(arm/x86)还是用 ptrace_call
+bool inject_stub_code(const uint8_t **code, size_t *size){
+    *code = nullptr;
+    *size = 0;
+    return false;
+}
+
+size_t inject_stub_trap_offset(){
+    return 0;
+}
+#endif
@@ -0,0 +1,37 @@
+//
+// Created by chic on 2025/6/28.
+//
+
+#pragma once
+#include <sys/types.h>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * stub 和注入器之间的邮箱, 放在目标进程里, stub 开始执行时 x0/rdi 指向它
+ * 前半部分注入器写, 后半部分 stub 写, 偏移写死在 inject_stub.cpp 的汇编里
+ */
+struct InjectMailbox {
+    uint64_t dlopen;
+    uint64_t dlsym;
+    uint64_t dlerror;
+    uint64_t lib_path;
+    uint64_t function_name;
+    uint64_t function_args;
+    // stub 写回: dlopen的返回值, dlsym的返回值, 用户函数的返回值
+    uint64_t handle;
+    uint64_t symbol;
+    uint64_t ret;
+    // dlopen 或者 dlsym 失败时 dlerror() 的内容
+    char error[256];
+};
+
+/**
+ * 在目标进程里按顺序执行 dlopen(lib_path, RTLD_NOW) -> dlsym(handle, function_name)
+ * -> symbol(handle, function_args) 的位置无关代码, 结果写回邮箱以后 brk/int3 停下来
+ * 当前构架没有 stub 的时候返回false, 调用方用 ptrace_call 一个一个调用
+ */
+bool inject_stub_code(const uint8_t **code, size_t *size);
+
+// stub 结尾的 brk/int3 执行以后 pc 相对 stub 开头的偏移
+size_t inject_stub_trap_offset();
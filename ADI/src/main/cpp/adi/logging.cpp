@@ -1,5 +1,6 @@
 #include <unistd.h>
 #include <stdio.h>
+#include <stdarg.h>
 #include "logging.h"
 
 namespace logging {
@@ -18,7 +19,14 @@ namespace logging {
         if (logfd == -1) {
             va_list ap;
             va_start(ap, fmt);
+#ifdef __ANDROID__
             __android_log_vprint(prio, tag, fmt, ap);
+#else
+            static const char prio_char[] = "??VDIWEF";
+            fprintf(stderr, "%c/%s: ", prio_char[prio & 7], tag);
+            vfprintf(stderr, fmt, ap);
+            fputc('\n', stderr);
+#endif
             va_end(ap);
         } else {
             char buf[4096];
@@ -1,6 +1,18 @@
 #pragma once
 
+#ifdef __ANDROID__
 #include <android/log.h>
+#else
+// 主机上编译benchmark的时候没有liblog,日志输出到stderr
+enum {
+    ANDROID_LOG_VERBOSE = 2,
+    ANDROID_LOG_DEBUG,
+    ANDROID_LOG_INFO,
+    ANDROID_LOG_WARN,
+    ANDROID_LOG_ERROR,
+    ANDROID_LOG_FATAL,
+};
+#endif
 #include <errno.h>
 #include <string.h>
 
@@ -6,136 +6,94 @@
 #include <csignal>
 #include <sys/user.h>
 #include <cstring>
+#include <cinttypes>
 #include <set>
 #include <fstream>
 #include <sys/signalfd.h>
 #include <sys/syscall.h>
-#include <bits/glibc-syscalls.h>
 #include <elf.h>
 #include <thread>
 #include "json.hpp"
 #include "contorlProcess.h"
 #include "logging.h"
 #include "parse_args.h"
+#include "symbol_cache.h"
+#include "proc_connector.h"
+#include "fanotify_gate.h"
+#include "ptrace_monitor.h"
+#include "inject_metrics.h"
+#include "agent_client.h"
 using namespace std;
 using json = nlohmann::json;
 
-#define WPTEVENT(x) (x >> 16)
-
-
-inline const char* sigabbrev_np(int sig) {
-    if (sig > 0 && sig < NSIG) return sys_signame[sig];
-    return "(unknown)";
-}
-
-
-
-
+// 收到SIGUSR1输出一次注入耗时统计, SIGUSR1在 start_monitor 里对所有线程屏蔽了,只在这里同步等待
 [[noreturn]]
-void PtraceTask(){
-    InjectProc & injectProc = InjectProc::getInstance();
-    pid_t tracd_pid = injectProc.getTracePid();
-    ptrace(PTRACE_SEIZE, tracd_pid, 0, PTRACE_O_TRACEFORK);
-    int status;
-    while(true){
-        int pid = waitpid(-1, &status, __WALL);
-        if (tracd_pid == -1) {
-            continue;
-        } else if(tracd_pid == 0){
+void StatsTask(){
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGUSR1);
+    int sig;
+    while (true) {
+        if (sigwait(&set, &sig) != 0) {
             continue;
         }
-        if(tracd_pid == pid){
-
-            if (WIFEXITED(status) || WIFSIGNALED(status)) {
-                LOGE("ptrace process exited\n");
-//                kill(getpid(),SIGINT);
-                continue;
-            }
-            if (STOPPED_WITH(status,SIGTRAP, PTRACE_EVENT_FORK)) {
-                long child_pid;
-                ptrace(PTRACE_GETEVENTMSG, pid, 0, &child_pid);
-                LOGD("int fork monitor : %ld\n",child_pid);
-
-            } else if (STOPPED_WITH(status,SIGTRAP, PTRACE_EVENT_STOP) ) {
-                if (ptrace(PTRACE_DETACH, pid, 0, 0) == -1)
-                    LOGE("failed to detach init\n");
-                LOGE("stop tracing init\n");
-                continue;
-            }
-
-            if (WIFSTOPPED(status)) {
-
-                if (WPTEVENT(status) == 0) {
-                    if (WSTOPSIG(status) != SIGSTOP && WSTOPSIG(status) != SIGTSTP && WSTOPSIG(status) != SIGTTIN && WSTOPSIG(status) != SIGTTOU) {
-                        LOGD("recv signal : %s %d\n",sigabbrev_np(WSTOPSIG(status)),WSTOPSIG(status));
-                        ptrace(PTRACE_CONT, pid, 0, WSTOPSIG(status));
-                        continue;
-                    } else {
-                        LOGD("suppress stopping signal sent to init: %s %d\n",sigabbrev_np(WSTOPSIG(status)), WSTOPSIG(status));
-                    }
-                }
-                ptrace(PTRACE_CONT, pid, 0, 0);
-            }
-
-        } else{
-
-            std::set<pid_t> &process = injectProc.get_Tracee_Process();
-            auto state = process.find(pid);
-            if (state == process.end()) {  //运行到这里说明都是子进程信号,所以要么是新创建的子进程,要么是符合条件的子进程
-                // 新创建的子进程会会加入到监控队列,如果是旧的子进程,会走else的分支
-                LOGD("new process attached %d",pid);
-                process.emplace(pid);
-                //前面ptrace的时候,使用的是PTRACE_O_TRACEFORK,所以子进程会在调用fork以后停止,并被追踪到
-                ptrace(PTRACE_SETOPTIONS, pid, 0, PTRACE_O_TRACEEXEC); //这段代码 进程会停止在exec加载完,但是还没没有执行的时候
-                ptrace(PTRACE_CONT, pid, 0, 0);
-                continue;
-            }else{
-                //旧的子继承,等待他执行完exec,这个时候只是加载了可执行文件,我们可以判断是那个进程了.
-                //所以在这里停止,如果在前面停止,我们很难知道要运行的进程是那个.
-
-                //然后通过文件判断是否符合过滤的进程要求,
-                LOGD("old process attached %d",pid);
-                if (STOPPED_WITH(status,SIGTRAP, PTRACE_EVENT_EXEC)){
-                    kill(pid, SIGSTOP);             // 信号会在进程运行起来以后接受到
-                    ptrace(PTRACE_CONT, pid, 0, 0); //由于进程当前已经停止,所以先运行起来
-                    waitpid(pid, &status, __WALL);
-                    if (STOPPED_WITH(status,SIGSTOP, 0)) {   //这个就是接受到的信号,前面 kill(pid, SIGSTOP);  发送的
-                        injectProc.monitor_process(pid);
-                        ptrace(PTRACE_DETACH, pid, 0, 0);
-
-                    }
-                } else {
-                    LOGE("old process handle: STOPPED_WITH is not");
-                }
-
-                process.erase(state);
-                if (WIFSTOPPED(status)) {
-                    LOGE("detach process");
-                    ptrace(PTRACE_DETACH, pid, 0, 0);
-                }
-            }
-        }
+        InjectMetrics::getInstance().dump();
+        InjectMetrics::getInstance().write_json();
     }
 }
 
 
 void clean_trace(int arg) {
-    LOGE("clean_trace ");
     InjectProc & injectProc = InjectProc::getInstance();
-    std::set<pid_t> &process = injectProc.get_Tracee_Process();
-    for (auto pid:process){
-        LOGD("clean_trace detach pid: %d",pid);
-        ptrace(PTRACE_DETACH, pid, nullptr, nullptr);
+    // 子进程只能由 PtraceTask 的线程detach, 信号落在别的线程上就转过去
+    pid_t tracer = injectProc.getTracerTid();
+    if (tracer > 0 && gettid() != tracer) {
+        syscall(SYS_tgkill, getpid(), tracer, arg);
+        return;
     }
+    LOGE("clean_trace ");
+    if (InjectMetrics::getInstance().isEnabled()) {
+        InjectMetrics::getInstance().dump();
+        InjectMetrics::getInstance().write_json();
+    }
+    injectProc.detach_all();
     LOGD("clean_trace trace pid: %d",injectProc.getTracePid());
     ptrace(PTRACE_DETACH, injectProc.getTracePid(), nullptr, nullptr);
     exit(0);
 }
+// 按照后端选择监控线程, ptrace后端追踪init的所有子进程, netlink和fanotify后端只处理符合规则的exec
+// 规则编译失败返回false, 否则一直监控不会返回
+bool start_monitor(){
+    InjectProc & injectProc = InjectProc::getInstance();
+    if (!injectProc.compile_rules()) {
+        LOGE("compile childProcess rules failed");
+        return false;
+    }
+    injectProc.warm_symbols();
+    if (InjectMetrics::getInstance().isEnabled()) {
+        // 在创建监控线程之前屏蔽,后面创建的线程都会继承
+        sigset_t set;
+        sigemptyset(&set);
+        sigaddset(&set, SIGUSR1);
+        pthread_sigmask(SIG_BLOCK, &set, nullptr);
+        std::thread(StatsTask).detach();
+    }
+    void (*task)() = PtraceTask;
+    if (injectProc.getBackend() == MonitorBackend::NETLINK) {
+        task = ProcConnectorTask;
+    } else if (injectProc.getBackend() == MonitorBackend::FANOTIFY) {
+        task = FanotifyGateTask;
+    }
+    std::thread monitorThread(task);
+    monitorThread.join();
+    return true;
+}
+
 int inject_main(pid_t inject_pid,char*InjectSO,char* InjectFunSym,char*InjectFunArg){
 
 }
 
-int tracee_main_cmd(pid_t tracee_pid,ContorlProcess &cp){
+int tracee_main_cmd(pid_t tracee_pid,std::unique_ptr<ContorlProcess> cp){
     InjectProc & injectProc = InjectProc::getInstance();
     injectProc.setTracePid(tracee_pid);
     if(tracee_pid <0){
@@ -143,9 +101,8 @@ int tracee_main_cmd(pid_t tracee_pid,ContorlProcess &cp){
         return 0;
     }
 
-    injectProc.add_childProces(cp);
-    std::thread ptraceThread(PtraceTask);
-    ptraceThread.join();
+    injectProc.add_childProces(std::move(cp));
+    return start_monitor() ? 0 : 1;
 }
 int tracee_main_config(char * file){
     std::ifstream f(file);
@@ -170,35 +127,100 @@ int tracee_main_config(char * file){
         std::string InjectFunSym = e.value("InjectFunSym", "");
         std::string InjectFunArg = e.value("InjectFunArg", "");
         unsigned int monitorCount = e.value("monitorCount", 0);
-        auto cp = ContorlProcess {exec, waitSoPath, waitFunSym, InjectSO, InjectFunSym,InjectFunArg,monitorCount};
-        injectProc.add_childProces(cp);
+        std::string execRegex = e.value("execRegex", "");
+        injectProc.add_childProces(std::unique_ptr<ContorlProcess>(new ContorlProcess {exec, waitSoPath, waitFunSym, InjectSO, InjectFunSym,InjectFunArg,monitorCount,execRegex}));
     }
 
+    std::string stats = jsonData.value("stats", "");
+    if (!stats.empty()) {
+        InjectMetrics::getInstance().setEnabled(true);
+        InjectMetrics::getInstance().setJsonPath(stats);
+    }
+    std::string symbol_cache = jsonData.value("symbolCache", "");
+    if (!symbol_cache.empty()) {
+        SymbolCache::getInstance().setPath(symbol_cache.c_str());
+    }
+    if (jsonData.value("shard", false)) {
+        injectProc.setShard(true);
+    }
+    MonitorBackend backend;
+    std::string backend_name = jsonData.value("backend", "");
+    if (!backend_name.empty()) {
+        if (!parse_backend(backend_name.c_str(), &backend)) {
+            LOGE("unknown backend %s", backend_name.c_str());
+            return 0;
+        }
+        injectProc.setBackend(backend);
+    }
     injectProc.setTracePid(traced_pid);
-    std::thread ptraceThread(PtraceTask);
-    ptraceThread.join();
+    return start_monitor() ? 0 : 1;
 }
 
 
+// /proc/pid/cmdline 的第一项是 zygote 或 zygote64
+static bool is_zygote(pid_t pid){
+    char path[64];
+    char name[64] = {};
+    snprintf(path, sizeof(path), "/proc/%d/cmdline", pid);
+    FILE *fp = fopen(path, "r");
+    if (fp == nullptr) {
+        return false;
+    }
+    fread(name, 1, sizeof(name) - 1, fp);
+    fclose(fp);
+    return strcmp(name, "zygote") == 0 || strcmp(name, "zygote64") == 0;
+}
+
 int main(int argc, char *argv[]) {
     LOGD("buile time: %s",__TIMESTAMP__);
     signal(SIGINT, clean_trace);
 
     ProgramArgs args;
     parse_args(argc, argv, &args);
+    if (args.stats != nullptr) {
+        InjectMetrics::getInstance().setEnabled(true);
+        InjectMetrics::getInstance().setJsonPath(args.stats);
+    }
+    if (args.symbolCache != nullptr) {
+        SymbolCache::getInstance().setPath(args.symbolCache);
+    }
 
     if(args.monitor){
         if(args.config != NULL){
             LOGD("args.config: %s",args.config);
-            tracee_main_config(args.config);
+            InjectProc::getInstance().setShard(args.shard);
+            InjectProc::getInstance().setBackend(args.backend);
+            if (tracee_main_config(args.config) != 0) {
+                return 1;
+            }
         } else{
             LOGD("ContorlProcess: %s %s %s %s %s %s %d",args.exec,args.waitSoPath,args.waitFunSym, args.injectSoPath, args.injectFunSym,args.injectFunArg,args.monitorCount);
-            auto cp = ContorlProcess {args.exec, args.waitSoPath, args.waitFunSym, args.injectSoPath, args.injectFunSym,args.injectFunArg,args.monitorCount};
-            tracee_main_cmd(args.pid,cp);
+            auto cp = std::unique_ptr<ContorlProcess>(new ContorlProcess {args.exec, args.waitSoPath, args.waitFunSym, args.injectSoPath, args.injectFunSym,args.injectFunArg,args.monitorCount});
+            InjectProc::getInstance().setShard(args.shard);
+            InjectProc::getInstance().setBackend(args.backend);
+            if (tracee_main_cmd(args.pid,std::move(cp)) != 0) {
+                return 1;
+            }
         }
     }
     if(args.inject){
         LOGD("start inject process");
+        // 目标进程里已经有agent了, 不用ptrace
+        AgentClient agent;
+        if (agent.open(args.pid)) {
+            uint64_t handle = 0;
+            long ret = 0;
+            if (!agent.load(args.injectSoPath, &handle)) {
+                LOGE("[-] agent dlopen %s failed: %s", args.injectSoPath, agent.get_error().c_str());
+                return -1;
+            }
+            if (!agent.call(handle, args.injectFunSym, args.injectFunArg, &ret)) {
+                LOGE("[-] agent call %s failed: %s", args.injectFunSym, agent.get_error().c_str());
+                return -1;
+            }
+            LOGD("[+] agent inject success, handle: 0x%" PRIx64 " ret: %ld", handle, ret);
+            return 0;
+        }
         int status = 0;
         if (ptrace(PTRACE_ATTACH, args.pid, NULL, NULL) < 0){
             LOGE("[-] ptrace attach process error, pid:%d, err:%s\n", args.pid, strerror(errno));
@@ -206,6 +228,12 @@ int main(int argc, char *argv[]) {
         }
         LOGD("[+] attach porcess success, pid:%d\n", args.pid);
         waitpid(args.pid, &status, WUNTRACED);
+        // zygote 里多一个线程以后就不能 fork 了, agent 自己也会拒绝启动
+        if (args.agent != nullptr && is_zygote(args.pid)) {
+            LOGE("[-] agent is not supported in zygote, inject without agent");
+        } else if (args.agent != nullptr) {
+            inject_process(args.pid, args.agent, ADI_AGENT_START, "");
+        }
         inject_process(args.pid,args.injectSoPath, args.injectFunSym,args.injectFunArg);
         ptrace(PTRACE_CONT, args.pid, 0, 0);
     }
@@ -87,6 +87,11 @@ bool parse_args(int argc, char **argv, ProgramArgs *args) {
             {"monitorCount",   required_argument, 0,OPT_MONITORCOUNT},
             {"hidemaps",   required_argument, 0,OPT_HIDEMAPS},
             {"unload",   required_argument, 0,OPT_UNLOAD},
+            {"shard",   no_argument, 0,OPT_SHARD},
+            {"backend",   required_argument, 0,OPT_BACKEND},
+            {"stats",   required_argument, 0,OPT_STATS},
+            {"agent",   required_argument, 0,OPT_AGENT},
+            {"symbol-cache",   required_argument, 0,OPT_SYMBOL_CACHE},
             {0, 0, 0, 0}  // 结束标记
     };
 
@@ -155,6 +160,24 @@ bool parse_args(int argc, char **argv, ProgramArgs *args) {
             case OPT_UNLOAD:
                 args->unload = true;
                 break;
+            case OPT_SHARD:
+                args->shard = true;
+                break;
+            case OPT_BACKEND:
+                if (!parse_backend(optarg, &args->backend)) {
+                    LOGE("unknown backend %s", optarg);
+                    return false;
+                }
+                break;
+            case OPT_STATS:
+                args->stats = strdup(optarg);
+                break;
+            case OPT_AGENT:
+                args->agent = strdup(optarg);
+                break;
+            case OPT_SYMBOL_CACHE:
+                args->symbolCache = strdup(optarg);
+                break;
 
         }
     }
@@ -15,10 +15,16 @@ enum {
     OPT_INJECT_FUNARG ,
     OPT_MONITORCOUNT,
     OPT_HIDEMAPS,
-    OPT_UNLOAD
+    OPT_UNLOAD,
+    OPT_SHARD,
+    OPT_BACKEND,
+    OPT_STATS,
+    OPT_AGENT,
+    OPT_SYMBOL_CACHE
 };
 
 #include <sys/types.h>
+#include "contorlProcess.h"
 
  struct ProgramArgs{
     bool help;          // --help 或 -h
@@ -28,6 +34,8 @@ enum {
     pid_t pid;
     bool hidemaps;
     bool unload;
+    bool shard;
+    MonitorBackend backend;
     char* injectSoPath;
     char* injectFunSym;
     char* injectFunArg;
@@ -35,6 +43,9 @@ enum {
     char* waitFunSym;
     char* exec;
     char *config;
+    char *stats;        // --stats <json文件>, 打开注入耗时统计
+    char *agent;        // --agent <libadi_agent.so>, 注入时顺便把agent放进目标进程, 之后的注入不再需要ptrace
+    char *symbolCache;  // --symbol-cache <文件>, 符号偏移缓存的位置, 默认 ADI_SYMBOL_CACHE_PATH
     unsigned int monitorCount;
      ProgramArgs(){
          help = false;
@@ -53,6 +64,11 @@ enum {
          monitorCount = 0;
          hidemaps = false;
          unload = false;
+         shard = false;
+         backend = MonitorBackend::PTRACE;
+         stats = nullptr;
+         agent = nullptr;
+         symbolCache = nullptr;
      }
 } ;
 
@@ -0,0 +1,100 @@
+//
+// Created by chic on 2025/6/2.
+//
+
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/connector.h>
+#include <linux/cn_proc.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <cstdio>
+#include <thread>
+#include "proc_connector.h"
+#include "contorlProcess.h"
+#include "logging.h"
+
+static int proc_connector_open(){
+    int sock = socket(PF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_CONNECTOR);
+    if (sock == -1) {
+        PLOGE("socket NETLINK_CONNECTOR");
+        return -1;
+    }
+    struct sockaddr_nl addr{};
+    addr.nl_family = AF_NETLINK;
+    addr.nl_groups = CN_IDX_PROC;
+    addr.nl_pid = 0;
+    if (bind(sock, (struct sockaddr *) &addr, sizeof(addr)) == -1) {
+        PLOGE("bind NETLINK_CONNECTOR");
+        close(sock);
+        return -1;
+    }
+
+    char msg[NLMSG_SPACE(sizeof(struct cn_msg) + sizeof(enum proc_cn_mcast_op))] __attribute__((aligned(NLMSG_ALIGNTO))) = {};
+    auto nlh = (struct nlmsghdr *) msg;
+    auto cn = (struct cn_msg *) NLMSG_DATA(nlh);
+    nlh->nlmsg_len = NLMSG_LENGTH(sizeof(struct cn_msg) + sizeof(enum proc_cn_mcast_op));
+    nlh->nlmsg_pid = getpid();
+    nlh->nlmsg_type = NLMSG_DONE;
+    cn->id.idx = CN_IDX_PROC;
+    cn->id.val = CN_VAL_PROC;
+    cn->len = sizeof(enum proc_cn_mcast_op);
+    *(enum proc_cn_mcast_op *) cn->data = PROC_CN_MCAST_LISTEN;
+    if (send(sock, msg, nlh->nlmsg_len, 0) == -1) {
+        PLOGE("send PROC_CN_MCAST_LISTEN");
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+static void on_proc_exec(pid_t pid){
+    InjectTimeline timeline;
+    InjectMetrics::mark(timeline, InjectMark::FORK);
+    InjectProc & injectProc = InjectProc::getInstance();
+    pid_t traced_pid = injectProc.getTracePid();
+    // 跟ptrace后端一样,只处理traced_pid的子进程; 先比较ppid, 只有真正要SEIZE的进程才占用规则的 monitorCount
+    if (traced_pid > 0 && get_ppid(pid) != traced_pid) {
+        return;
+    }
+    ContorlProcess *cp;
+    if (!injectProc.filter_proce_exec_file(pid, cp)) {
+        return;
+    }
+    LOGD("netlink exec matched %d", pid);
+    std::thread(&InjectProc::shard_worker, &injectProc, pid, cp, AttachMode::LIVE, timeline, -1, -1).detach();
+}
+
+[[noreturn]]
+void ProcConnectorTask(){
+    int sock = proc_connector_open();
+    if (sock == -1) {
+        LOGE("proc connector unavailable");
+        exit(1);
+    }
+    char buf[4096] __attribute__((aligned(NLMSG_ALIGNTO)));
+    while (true) {
+        ssize_t len = recv(sock, buf, sizeof(buf), 0);
+        if (len == -1) {
+            if (errno == EINTR) continue;
+            if (errno == ENOBUFS) {
+                // 事件太多socket溢出,丢了事件也只能继续
+                LOGW("proc connector overrun, exec events lost");
+                continue;
+            }
+            PLOGE("recv proc connector");
+            exit(1);
+        }
+        for (auto nlh = (struct nlmsghdr *) buf; NLMSG_OK(nlh, (size_t) len); nlh = NLMSG_NEXT(nlh, len)) {
+            if (nlh->nlmsg_type == NLMSG_NOOP) continue;
+            if (nlh->nlmsg_type == NLMSG_ERROR || nlh->nlmsg_type == NLMSG_OVERRUN) break;
+            auto cn = (struct cn_msg *) NLMSG_DATA(nlh);
+            if (cn->id.idx != CN_IDX_PROC || cn->id.val != CN_VAL_PROC) continue;
+            auto ev = (struct proc_event *) cn->data;
+            if (ev->what == proc_event::PROC_EVENT_EXEC) {
+                on_proc_exec(ev->event_data.exec.process_tgid);
+            }
+        }
+    }
+}
@@ -0,0 +1,14 @@
+//
+// Created by chic on 2025/6/2.
+//
+
+#pragma once
+#include <sys/types.h>
+
+/**
+ * @brief 通过 NETLINK_CONNECTOR 的 proc connector 监听 PROC_EVENT_EXEC
+ * 只有exe符合规则的进程才会被 PTRACE_SEIZE, 其他进程完全不经过ptrace
+ * 需要root和CONFIG_PROC_EVENTS
+ */
+[[noreturn]]
+void ProcConnectorTask();
@@ -0,0 +1,92 @@
+//
+// Created by chic on 2025/6/20.
+//
+
+#include <sys/ptrace.h>
+#include <sys/wait.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <csignal>
+#include <cstring>
+#include <cerrno>
+#include "ptrace_monitor.h"
+#include "contorlProcess.h"
+#include "logging.h"
+
+#define WPTEVENT(x) (x >> 16)
+
+
+#ifdef __ANDROID__
+inline const char* sigabbrev_np(int sig) {
+    if (sig > 0 && sig < NSIG) return sys_signame[sig];
+    return "(unknown)";
+}
+#endif
+
+
+
+
+[[noreturn]]
+void PtraceTask(){
+    InjectProc & injectProc = InjectProc::getInstance();
+    pid_t tracd_pid = injectProc.getTracePid();
+    injectProc.setTracerTid(gettid());
+    if (ptrace(PTRACE_SEIZE, tracd_pid, 0, PTRACE_O_TRACEFORK) == -1) {
+        PLOGE("seize %d", tracd_pid);
+    }
+    int status;
+    while(true){
+        // __WNOTHREAD: 分片模式下worker线程追踪的进程由worker自己wait
+        int pid = waitpid(-1, &status, __WALL | __WNOTHREAD);
+        if (pid == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            // ECHILD: init 已经detach或者退出, 这个线程再也不会有新的子进程, 分片模式下worker还在处理已经交出去的进程
+            PLOGE("waitpid");
+            while (true) {
+                pause();
+            }
+        }
+        if (pid == 0) {
+            continue;
+        }
+        if(tracd_pid == pid){
+
+            if (WIFEXITED(status) || WIFSIGNALED(status)) {
+                LOGE("ptrace process exited\n");
+//                kill(getpid(),SIGINT);
+                continue;
+            }
+            if (STOPPED_WITH(status,SIGTRAP, PTRACE_EVENT_FORK)) {
+                long child_pid;
+                ptrace(PTRACE_GETEVENTMSG, pid, 0, &child_pid);
+                LOGD("int fork monitor : %ld\n",child_pid);
+
+            } else if (STOPPED_WITH(status,SIGTRAP, PTRACE_EVENT_STOP) ) {
+                if (ptrace(PTRACE_DETACH, pid, 0, 0) == -1)
+                    LOGE("failed to detach init\n");
+                LOGE("stop tracing init\n");
+                continue;
+            }
+
+            if (WIFSTOPPED(status)) {
+
+                if (WPTEVENT(status) == 0) {
+                    if (WSTOPSIG(status) != SIGSTOP && WSTOPSIG(status) != SIGTSTP && WSTOPSIG(status) != SIGTTIN && WSTOPSIG(status) != SIGTTOU) {
+                        LOGD("recv signal : %s %d\n",sigabbrev_np(WSTOPSIG(status)),WSTOPSIG(status));
+                        ptrace(PTRACE_CONT, pid, 0, WSTOPSIG(status));
+                        continue;
+                    } else {
+                        LOGD("suppress stopping signal sent to init: %s %d\n",sigabbrev_np(WSTOPSIG(status)), WSTOPSIG(status));
+                    }
+                }
+                ptrace(PTRACE_CONT, pid, 0, 0);
+            }
+
+        } else{
+            //运行到这里说明都是子进程信号,每个子进程按照自己的状态处理,不会互相等待
+            injectProc.handle_tracee_event(pid, status);
+        }
+    }
+}
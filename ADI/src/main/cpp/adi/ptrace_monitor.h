@@ -0,0 +1,13 @@
+//
+// Created by chic on 2025/6/20.
+//
+
+#pragma once
+#include <sys/types.h>
+
+/**
+ * @brief ptrace后端, PTRACE_O_TRACEFORK 追踪 traced_pid 的每一个子进程
+ * 子进程在 PTRACE_EVENT_EXEC 时判断是否符合规则, 不符合的直接detach
+ */
+[[noreturn]]
+void PtraceTask();
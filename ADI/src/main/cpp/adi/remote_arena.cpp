@@ -0,0 +1,71 @@
+//
+// Created by chic on 2025/6/26.
+//
+
+#include "remote_arena.h"
+#include <cstring>
+#include "logging.h"
+
+void RemoteArena::attach(uintptr_t remote_base, size_t len){
+    base = remote_base;
+    size = len;
+    shadow.assign(len, 0);
+    reset();
+}
+
+uintptr_t RemoteArena::detach(){
+    uintptr_t old = base;
+    base = 0;
+    size = 0;
+    shadow.clear();
+    shadow.shrink_to_fit();
+    reset();
+    return old;
+}
+
+uintptr_t RemoteArena::alloc(size_t len, size_t align){
+    if (base == 0) {
+        LOGE("remote arena is not mapped");
+        return 0;
+    }
+    size_t off = (used + align - 1) & ~(align - 1);
+    if (off > size || len > size - off) {
+        LOGE("remote arena full: %zu + %zu > %zu", off, len, size);
+        return 0;
+    }
+    used = off + len;
+    return base + off;
+}
+
+uintptr_t RemoteArena::push(const void *data, size_t len, size_t align){
+    uintptr_t addr = alloc(len, align);
+    if (addr == 0) {
+        return 0;
+    }
+    size_t off = addr - base;
+    memcpy(shadow.data() + off, data, len);
+    if (!dirty.empty() && dirty.back().second == off) {
+        dirty.back().second = off + len;
+    } else {
+        dirty.emplace_back(off, off + len);
+    }
+    return addr;
+}
+
+bool RemoteArena::flush(RemoteMemory &mem){
+    if (dirty.empty()) {
+        return true;
+    }
+    std::vector<RemoteIo> ios;
+    ios.reserve(dirty.size());
+    for (auto &[begin, end] : dirty) {
+        ios.push_back({base + begin, shadow.data() + begin, end - begin});
+    }
+    dirty.clear();
+    return mem.writev(ios.data(), ios.size());
+}
+
+void RemoteArena::reset(){
+    used = 0;
+    dirty.clear();
+}
@@ -0,0 +1,62 @@
+//
+// Created by chic on 2025/6/26.
+//
+
+#pragma once
+#include <sys/types.h>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+#include "remote_memory.h"
+
+/**
+ * 远程进程里的一块匿名映射, 注入时需要的字符串,结构体和参数块都从这里按顺序分配
+ * 只管分配和写入, 远程mmap/munmap由 PtraceUtils.h 里的 remote_arena_map/remote_arena_unmap 调用
+ * push 的数据先放在本地的影子缓冲区里, flush 把所有没写的数据合并成一次 writev
+ * 同一次会话里的多次注入可以 reset 以后重复使用同一块映射, 会话结束时 munmap
+ */
+class RemoteArena {
+public:
+    static constexpr size_t kDefaultSize = 0x3000;
+
+    RemoteArena() = default;
+
+    bool is_mapped() const {
+        return base != 0;
+    }
+    uintptr_t get_base() const {
+        return base;
+    }
+    size_t get_size() const {
+        return size;
+    }
+
+    // 远程mmap成功以后调用
+    void attach(uintptr_t remote_base, size_t len);
+    // munmap之前调用, 返回映射的地址, 之后arena回到没有映射的状态
+    uintptr_t detach();
+
+    // 分配 len 字节, 空间不够返回0
+    uintptr_t alloc(size_t len, size_t align = 16);
+    // 分配并把 data 放进待写入的数据里, flush 以后才真正写到远程进程
+    uintptr_t push(const void *data, size_t len, size_t align = 16);
+    uintptr_t push_string(const char *str){
+        return push(str, strlen(str) + 1, 1);
+    }
+
+    // 把 push 以后还没有写入的数据一次写到远程进程
+    bool flush(RemoteMemory &mem);
+
+    // 丢掉已经分配的空间, 映射保留给下一次注入
+    void reset();
+
+private:
+    uintptr_t base = 0;
+    size_t size = 0;
+    size_t used = 0;
+    // 远程映射在本地的副本, push 写到这里
+    std::vector<uint8_t> shadow;
+    // 待写入的 [begin, end) 偏移, 相邻的合并成一段
+    std::vector<std::pair<size_t, size_t>> dirty;
+};
@@ -0,0 +1,397 @@
+//
+// Created by chic on 2025/7/8.
+//
+
+#include "remote_elf.h"
+#include <sys/stat.h>
+#include <elf.h>
+#include <cinttypes>
+#include <cstdio>
+#include <algorithm>
+#include <cstring>
+#include <utility>
+#include "elf_engine.h"
+#include "elf_symbol_index.h"
+#include "proc_maps.h"
+#include "symbol_hash.h"
+#include "logging.h"
+
+static constexpr size_t kPageSize = 4096;
+static constexpr size_t kMaxPhnum = 64;
+static constexpr size_t kMaxDyn = 512;
+// 比这还大的 hash 表当作读错了
+static constexpr uint32_t kMaxHashWords = 1u << 20;
+// 不知道 GNU hash 一共有多少个符号时, chain 每次多读这么多项
+static constexpr size_t kChainChunk = 256;
+
+static std::mutex cache_lock;
+// (dev, inode, mtime, size) -> 表, 最近用过的在最后
+static std::vector<std::pair<ElfFileKey, std::shared_ptr<RemoteElfTables>>> cache;
+
+/**
+ * 映射的文件的 (dev, inode, mtime, size), 只有 (dev, inode) 的话app重装或者so被替换以后inode复用, 会拿到旧文件的表
+ * stat /proc/pid/map_files 得到的是映射着的那个文件本身, 文件已经被删掉也一样; 要root, 拿不到的时候不缓存
+ */
+static bool mapped_file_key(pid_t pid, const MapInfo &map, ElfFileKey *key){
+    if (map.inode == 0) {
+        return false;
+    }
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/map_files/%" PRIxPTR "-%" PRIxPTR, pid, map.start, map.end);
+    struct stat st;
+    if (stat(path, &st) != 0 || st.st_ino != map.inode) {
+        return false;
+    }
+    *key = ElfFileKey{st.st_dev, st.st_ino, st.st_mtim, st.st_size};
+    return true;
+}
+
+template<typename E>
+static bool parse_tables(RemoteMemory &mem, uintptr_t base, const uint8_t *head, RemoteElfTables *t, uintptr_t *bias_out){
+    using Phdr = typename E::Phdr;
+    using Dyn = typename E::Dyn;
+    typename E::Ehdr ehdr;
+    memcpy(&ehdr, head, sizeof(ehdr));
+    if (ehdr.e_phentsize != sizeof(Phdr) || ehdr.e_phnum == 0 || ehdr.e_phnum > kMaxPhnum ||
+        ehdr.e_phoff + ehdr.e_phnum * sizeof(Phdr) > kPageSize) {
+        return false;
+    }
+    Phdr phdrs[kMaxPhnum];
+    memcpy(phdrs, head + ehdr.e_phoff, ehdr.e_phnum * sizeof(Phdr));
+    ElfLoadInfo load = elf_load_info<E>(phdrs, ehdr.e_phnum, kPageSize);
+    if (!load.has_dynamic()) {
+        return false;
+    }
+    uint64_t min_vaddr = load.min_vaddr;
+    uintptr_t bias = base - min_vaddr;
+    // 文件里 p_filesz 范围内 addr 所在段的结束位置, 后面的读取不能越过它
+    auto segment_end = [&](uint64_t vaddr) -> uint64_t {
+        for (size_t i = 0; i < ehdr.e_phnum; i++) {
+            if (phdrs[i].p_type == PT_LOAD && vaddr >= phdrs[i].p_vaddr && vaddr < phdrs[i].p_vaddr + phdrs[i].p_filesz) {
+                return phdrs[i].p_vaddr + phdrs[i].p_filesz;
+            }
+        }
+        return 0;
+    };
+
+    size_t dyn_count = std::min<size_t>(load.dyn_size / sizeof(Dyn), kMaxDyn);
+    std::vector<Dyn> dyns(dyn_count);
+    if (!mem.read(bias + load.dyn_vaddr, dyns.data(), dyn_count * sizeof(Dyn))) {
+        return false;
+    }
+    ElfDynamicInfo dynamic = elf_parse_dynamic<E>(dyns.data(), dyn_count,
+                                                  [&](uint64_t ptr) { return load.to_vaddr(ptr, bias); });
+    uint64_t gnu = dynamic.gnu_hash, sysv = dynamic.sysv_hash;
+    t->symtab = dynamic.symtab;
+    t->strtab = dynamic.strtab;
+    t->strsz = dynamic.strsz;
+    t->versym = dynamic.versym;
+    if (t->symtab == 0 || t->strtab == 0 || t->strsz == 0 || (gnu == 0 && sysv == 0) ||
+        (dynamic.syment != 0 && dynamic.syment != sizeof(typename E::Sym))) {
+        LOGE("remote elf at %lx has no usable dynamic symbol table", (unsigned long) base);
+        return false;
+    }
+
+    // hash 表的头一次读
+    uint32_t gnu_header[4] = {0, 0, 0, 0};
+    uint32_t sysv_header[2] = {0, 0};
+    RemoteIo ios[4];
+    size_t n = 0;
+    if (gnu != 0) ios[n++] = RemoteIo{bias + gnu, gnu_header, sizeof(gnu_header)};
+    if (sysv != 0) ios[n++] = RemoteIo{bias + sysv, sysv_header, sizeof(sysv_header)};
+    if (!mem.readv(ios, n)) {
+        return false;
+    }
+    t->has_gnu = gnu != 0;
+    // bloom/bucket/chain 一次readv, GNU hash 在符号数已知(同时有 DT_HASH)时连 chain 一起读
+    using BloomWord = typename E::Addr;
+    n = 0;
+    size_t gnu_chain_count = 0;
+    if (t->has_gnu) {
+        uint32_t nbucket = gnu_header[0], maskwords = gnu_header[2];
+        if (nbucket == 0 || nbucket > kMaxHashWords || maskwords == 0 || maskwords > kMaxHashWords ||
+            (maskwords & (maskwords - 1)) != 0) {
+            LOGE("invalid gnu hash header nbucket %u maskwords %u", nbucket, maskwords);
+            return false;
+        }
+        t->gnu_symoffset = gnu_header[1];
+        t->gnu_shift2 = gnu_header[3];
+        t->gnu_bloom.resize(maskwords * sizeof(BloomWord));
+        t->gnu_buckets.resize(nbucket);
+        uint64_t bloom_addr = gnu + 16;
+        uint64_t buckets_addr = bloom_addr + t->gnu_bloom.size();
+        ios[n++] = RemoteIo{bias + bloom_addr, t->gnu_bloom.data(), t->gnu_bloom.size()};
+        ios[n++] = RemoteIo{bias + buckets_addr, t->gnu_buckets.data(), nbucket * sizeof(uint32_t)};
+        if (sysv != 0 && sysv_header[1] > t->gnu_symoffset && sysv_header[1] <= kMaxHashWords) {
+            gnu_chain_count = sysv_header[1] - t->gnu_symoffset;
+            t->gnu_chains.resize(gnu_chain_count);
+            ios[n++] = RemoteIo{bias + buckets_addr + nbucket * sizeof(uint32_t), t->gnu_chains.data(),
+                                gnu_chain_count * sizeof(uint32_t)};
+        }
+    } else {
+        uint32_t nbucket = sysv_header[0], nchain = sysv_header[1];
+        if (nbucket == 0 || nbucket > kMaxHashWords || nchain > kMaxHashWords) {
+            LOGE("invalid sysv hash header nbucket %u nchain %u", nbucket, nchain);
+            return false;
+        }
+        t->sysv_buckets.resize(nbucket);
+        t->sysv_chains.resize(nchain);
+        ios[n++] = RemoteIo{bias + sysv + 8, t->sysv_buckets.data(), nbucket * sizeof(uint32_t)};
+        ios[n++] = RemoteIo{bias + sysv + 8 + nbucket * sizeof(uint32_t), t->sysv_chains.data(), nchain * sizeof(uint32_t)};
+    }
+    if (!mem.readv(ios, n)) {
+        return false;
+    }
+
+    if (t->has_gnu && gnu_chain_count == 0) {
+        // 符号数不知道: 最大的 bucket 开始的那条链结束的地方就是最后一个符号
+        uint32_t max_bucket = 0;
+        for (auto b: t->gnu_buckets) {
+            max_bucket = std::max(max_bucket, b);
+        }
+        if (max_bucket >= t->gnu_symoffset) {
+            uint64_t chains_addr = gnu + 16 + t->gnu_bloom.size() + t->gnu_buckets.size() * sizeof(uint32_t);
+            uint64_t end = segment_end(chains_addr);
+            size_t have = 0;
+            size_t need = max_bucket - t->gnu_symoffset + 1;
+            while (true) {
+                size_t want = need + kChainChunk;
+                if (end != 0) {
+                    want = std::min<size_t>(want, (end - chains_addr) / sizeof(uint32_t));
+                }
+                if (want <= have || want > kMaxHashWords) {
+                    LOGE("gnu hash chain of remote elf at %lx is broken", (unsigned long) base);
+                    return false;
+                }
+                t->gnu_chains.resize(want);
+                if (!mem.read(bias + chains_addr + have * sizeof(uint32_t), t->gnu_chains.data() + have,
+                              (want - have) * sizeof(uint32_t))) {
+                    return false;
+                }
+                have = want;
+                size_t i = need - 1;
+                while (i < have && (t->gnu_chains[i] & 1) == 0) {
+                    i++;
+                }
+                if (i < have) {
+                    t->gnu_chains.resize(i + 1);
+                    break;
+                }
+                need = have + 1;
+            }
+        }
+    }
+    t->min_vaddr = min_vaddr;
+    *bias_out = bias;
+    return true;
+}
+
+bool RemoteElf::parse(uintptr_t base){
+    alignas(8) uint8_t head[kPageSize];
+    if (!mem.read(base, head, sizeof(head))) {
+        return false;
+    }
+    if (memcmp(head, ELFMAG, SELFMAG) != 0) {
+        LOGE("no elf header at %lx", (unsigned long) base);
+        return false;
+    }
+    auto t = std::make_shared<RemoteElfTables>();
+    uintptr_t new_bias = 0;
+    bool ok = false;
+    if (head[EI_CLASS] == ELFCLASS64) {
+        t->is64 = true;
+        ok = parse_tables<Elf64Types>(mem, base, head, t.get(), &new_bias);
+    } else if (head[EI_CLASS] == ELFCLASS32) {
+        t->is64 = false;
+        ok = parse_tables<Elf32Types>(mem, base, head, t.get(), &new_bias);
+    }
+    if (!ok) {
+        return false;
+    }
+    tables = std::move(t);
+    bias = new_bias;
+    return true;
+}
+
+bool RemoteElf::open(uintptr_t base){
+    tables.reset();
+    bias = 0;
+    if (base == 0) {
+        return false;
+    }
+    ProcMapQuery query(mem.get_pid());
+    auto map = query.find(base);
+    ElfFileKey key{};
+    bool cacheable = map != nullptr && mapped_file_key(mem.get_pid(), *map, &key);
+    if (cacheable) {
+        std::lock_guard<std::mutex> guard(cache_lock);
+        for (size_t i = 0; i < cache.size(); i++) {
+            if (cache[i].first == key) {
+                auto hit = cache[i];
+                cache.erase(cache.begin() + i);
+                cache.push_back(hit);
+                tables = hit.second;
+                bias = base - tables->min_vaddr;
+                return true;
+            }
+        }
+    }
+    if (!parse(base)) {
+        return false;
+    }
+    if (cacheable) {
+        std::lock_guard<std::mutex> guard(cache_lock);
+        if (cache.size() >= kCacheSize) {
+            cache.erase(cache.begin());
+        }
+        cache.emplace_back(key, tables);
+    }
+    return true;
+}
+
+uintptr_t RemoteElf::find(std::string_view name){
+    // 批量接口要'\0'结尾的名字
+    std::string copy(name);
+    const char *names[] = {copy.c_str()};
+    uintptr_t addr = 0;
+    find(names, &addr, 1);
+    return addr;
+}
+
+/**
+ * find 里跟位数有关的部分, todo 是 names 里还没查过的下标, 找到的写进 addrs, 个数加到 found 上
+ * 在本地的表上走hash链, 候选符号和它们的 versym 一次readv, 再把名字一次readv读回来比较
+ * 读远程内存失败返回false, 这时的结果不能记下来
+ */
+template<typename E>
+static bool resolve_names(RemoteMemory &mem, const RemoteElfTables &t, uintptr_t bias, const char *const *names,
+                          const std::vector<size_t> &todo, uintptr_t *addrs, size_t *found){
+    ElfGnuHash<E> gnu;
+    ElfSysvHash<E> sysv;
+    if (t.has_gnu) {
+        gnu.nbucket = t.gnu_buckets.size();
+        gnu.symoffset = t.gnu_symoffset;
+        gnu.maskwords = t.gnu_bloom.size() / sizeof(typename E::Addr);
+        gnu.shift2 = t.gnu_shift2;
+        gnu.bloom = reinterpret_cast<const typename E::Addr *>(t.gnu_bloom.data());
+        gnu.buckets = t.gnu_buckets.data();
+        gnu.chains = t.gnu_chains.data();
+        gnu.nchains = t.gnu_chains.size();
+    } else {
+        sysv.nbucket = t.sysv_buckets.size();
+        sysv.nchain = t.sysv_chains.size();
+        sysv.buckets = t.sysv_buckets.data();
+        sysv.chains = t.sysv_chains.data();
+    }
+
+    // 没查过的名字一次算完hash
+    std::vector<const char *> todo_names(todo.size());
+    std::vector<uint32_t> hashes(todo.size());
+    for (size_t k = 0; k < todo.size(); k++) {
+        todo_names[k] = names[todo[k]];
+    }
+    if (t.has_gnu) {
+        gnu_hash_batch(todo_names.data(), hashes.data(), todo.size());
+    } else {
+        elf_hash_batch(todo_names.data(), hashes.data(), todo.size());
+    }
+    // 每个名字在hash链上对得上的符号下标
+    struct Candidate {
+        size_t name;
+        uint32_t index;
+        typename E::Sym sym;
+        uint16_t versym;
+    };
+    std::vector<Candidate> candidates;
+    for (size_t k = 0; k < todo.size(); k++) {
+        auto add = [&](uint32_t index) {
+            candidates.push_back(Candidate{todo[k], index, {}, 0});
+            return false;
+        };
+        if (t.has_gnu) {
+            gnu.for_each_candidate(hashes[k], add);
+        } else {
+            sysv.for_each_candidate(hashes[k], add);
+        }
+    }
+
+    std::vector<RemoteIo> ios;
+    ios.reserve(candidates.size() * 2);
+    for (auto &c: candidates) {
+        ios.push_back(RemoteIo{bias + t.symtab + c.index * sizeof(typename E::Sym), &c.sym, sizeof(c.sym)});
+        if (t.versym != 0) {
+            ios.push_back(RemoteIo{bias + t.versym + c.index * sizeof(uint16_t), &c.versym, sizeof(uint16_t)});
+        }
+    }
+    if (!ios.empty() && !mem.readv(ios.data(), ios.size())) {
+        return false;
+    }
+    ios.clear();
+    std::vector<size_t> name_offsets;
+    std::vector<const Candidate *> matches;
+    size_t name_bytes = 0;
+    for (auto &c: candidates) {
+        size_t len = strlen(names[c.name]);
+        if (!elf_symbol_exported<E>(c.sym) || (c.versym & kElfVersymHidden) != 0 ||
+            c.sym.st_name >= t.strsz || len + 1 > t.strsz - c.sym.st_name) {
+            continue;
+        }
+        matches.push_back(&c);
+        name_offsets.push_back(name_bytes);
+        name_bytes += len + 1;
+    }
+    std::vector<char> name_buf(name_bytes);
+    for (size_t i = 0; i < matches.size(); i++) {
+        ios.push_back(RemoteIo{bias + t.strtab + matches[i]->sym.st_name, &name_buf[name_offsets[i]],
+                               strlen(names[matches[i]->name]) + 1});
+    }
+    if (!ios.empty() && !mem.readv(ios.data(), ios.size())) {
+        return false;
+    }
+    for (size_t i = 0; i < matches.size(); i++) {
+        auto &m = *matches[i];
+        const char *name = names[m.name];
+        if (addrs[m.name] != 0 || memcmp(&name_buf[name_offsets[i]], name, strlen(name) + 1) != 0) {
+            continue;
+        }
+        addrs[m.name] = bias + m.sym.st_value;
+        (*found)++;
+    }
+    return true;
+}
+
+size_t RemoteElf::find(const char *const *names, uintptr_t *addrs, size_t count){
+    memset(addrs, 0, count * sizeof(uintptr_t));
+    if (tables == nullptr) {
+        return 0;
+    }
+    RemoteElfTables &t = *tables;
+    size_t found = 0;
+    std::vector<size_t> todo;
+    {
+        std::lock_guard<std::mutex> guard(t.lock);
+        for (size_t i = 0; i < count; i++) {
+            auto it = t.resolved.find(names[i]);
+            if (it != t.resolved.end()) {
+                addrs[i] = it->second != 0 ? bias + it->second : 0;
+                found += it->second != 0;
+                continue;
+            }
+            todo.push_back(i);
+        }
+    }
+    if (todo.empty()) {
+        return found;
+    }
+    // 表解析完以后不会再变, 走链不用拿锁; 位数在这里选一次
+    bool ok = t.is64 ? resolve_names<Elf64Types>(mem, t, bias, names, todo, addrs, &found)
+                     : resolve_names<Elf32Types>(mem, t, bias, names, todo, addrs, &found);
+    if (!ok) {
+        return found;
+    }
+    std::lock_guard<std::mutex> guard(t.lock);
+    for (auto i: todo) {
+        t.resolved[names[i]] = addrs[i] != 0 ? addrs[i] - bias : 0;
+    }
+    return found;
+}
@@ -0,0 +1,81 @@
+//
+// Created by chic on 2025/7/8.
+//
+
+#pragma once
+#include <sys/types.h>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "remote_memory.h"
+
+// 一个so的动态符号表, 从某个进程里读出来以后按 (dev, inode, mtime, size) 缓存, 其他进程加载的同一个文件直接用
+// 地址都是相对 load bias 的 vaddr, 跟哪个进程无关
+struct RemoteElfTables {
+    bool is64;
+    // 第一个 PT_LOAD 按页对齐的 vaddr, 基址减掉它就是 load bias
+    uint64_t min_vaddr;
+    uint64_t symtab;
+    uint64_t strtab;
+    uint64_t strsz;
+    // DT_VERSYM, 没有的是0
+    uint64_t versym;
+
+    // DT_GNU_HASH, bloom 按目标的字宽原样保存, 查的时候套上 ElfGnuHash
+    bool has_gnu;
+    uint32_t gnu_symoffset;
+    uint32_t gnu_shift2;
+    std::vector<uint8_t> gnu_bloom;
+    std::vector<uint32_t> gnu_buckets;
+    // 下标从 gnu_symoffset 开始
+    std::vector<uint32_t> gnu_chains;
+
+    // DT_HASH, 只有没有 DT_GNU_HASH 时才用
+    std::vector<uint32_t> sysv_buckets;
+    std::vector<uint32_t> sysv_chains;
+
+    // 查过的名字 -> st_value, 没有的是0; 名字在哪个进程里都一样, 查一次以后不用再读远程内存
+    std::mutex lock;
+    std::unordered_map<std::string, uint64_t> resolved;
+};
+
+/**
+ * 直接读目标进程内存解析so的动态符号表, 不需要在 adi 里加载同一个so, 32位和64位的目标都可以
+ * 第一次打开一个文件: ELF头和程序头一次, 动态段一次, hash表的头一次, bloom/bucket/chain 一次readv,
+ * 之后每次查找在本地走hash链, 只把hash值对得上的符号和名字各用一次readv读回来确认
+ * 解析出来的表按 (dev, inode, mtime, size) 缓存, 其他进程里的同一个so只要一次 PROCMAP_QUERY 和一次 stat map_files
+ * 符号只找 GLOBAL/WEAK(glibc 还有 GNU_UNIQUE) 并且有定义的, 跳过 versym 标了 hidden 的旧版本, 跟 linker 的 dlsym 一样
+ * TLS 符号没有固定地址, 不返回; IFUNC 返回的是 resolver 的地址
+ */
+class RemoteElf {
+public:
+    explicit RemoteElf(RemoteMemory &mem) : mem(mem) {
+    }
+
+    // base 是so偏移为0的那个映射的起始地址(find_module_base 的返回值)
+    bool open(uintptr_t base);
+
+    // 符号在目标进程里的地址, 找不到返回0
+    uintptr_t find(std::string_view name);
+    // 一次查多个, addrs[i] 对应 names[i], 所有候选符号合并成一次readv, 返回找到了几个
+    size_t find(const char *const *names, uintptr_t *addrs, size_t count);
+
+    uintptr_t get_bias() const {
+        return bias;
+    }
+
+    // 缓存最多几个文件
+    static constexpr size_t kCacheSize = 16;
+
+private:
+    bool parse(uintptr_t base);
+
+    RemoteMemory &mem;
+    std::shared_ptr<RemoteElfTables> tables;
+    uintptr_t bias = 0;
+};
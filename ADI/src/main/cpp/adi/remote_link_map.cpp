@@ -0,0 +1,190 @@
+//
+// Created by chic on 2025/7/5.
+//
+
+#include "remote_link_map.h"
+#include <sys/auxv.h>
+#include <elf.h>
+#include <link.h>
+#include <cstring>
+#include <climits>
+#include "remote_syscall.h"
+#include "proc_maps.h"
+#include "logging.h"
+
+// link.h 里的 r_debug 和 link_map 前面几个字段, bionic 和 glibc 一样
+struct RemoteRDebug {
+    int32_t r_version;
+    uintptr_t r_map;
+};
+
+struct RemoteLinkMapNode {
+    uintptr_t l_addr;
+    uintptr_t l_name;
+    uintptr_t l_ld;
+    uintptr_t l_next;
+    uintptr_t l_prev;
+};
+
+// 大部分路径一次就能读完, 读不完的再单独读
+static constexpr size_t kNameChunk = 128;
+static constexpr size_t kPageSize = 4096;
+// 动态段一次读这么多项
+static constexpr size_t kDynChunk = 32;
+
+bool RemoteLinkMap::set_r_debug(uintptr_t addr){
+    RemoteRDebug debug{};
+    if (addr == 0 || !mem.read(addr, &debug) || debug.r_version < 1 || debug.r_map == 0) {
+        return false;
+    }
+    r_debug = addr;
+    return true;
+}
+
+bool RemoteLinkMap::locate(){
+    pid_t pid = mem.get_pid();
+    uintptr_t phdr_addr = read_remote_auxv(pid, AT_PHDR);
+    uintptr_t phnum = read_remote_auxv(pid, AT_PHNUM);
+    if (phdr_addr == 0 || phnum == 0 || phnum > 64) {
+        return false;
+    }
+    ElfW(Phdr) phdrs[64];
+    if (!mem.read(phdr_addr, phdrs, phnum * sizeof(ElfW(Phdr)))) {
+        return false;
+    }
+    // PT_PHDR 算出主程序的 load bias
+    uintptr_t bias = 0;
+    uintptr_t dynamic = 0;
+    for (size_t i = 0; i < phnum; i++) {
+        if (phdrs[i].p_type == PT_PHDR) {
+            bias = phdr_addr - phdrs[i].p_vaddr;
+        } else if (phdrs[i].p_type == PT_DYNAMIC) {
+            dynamic = phdrs[i].p_vaddr;
+        }
+    }
+    if (dynamic == 0) {
+        return false;
+    }
+    ElfW(Dyn) dyn[kDynChunk];
+    uintptr_t addr = dynamic + bias;
+    for (size_t n = 0; n < 1024; ) {
+        // 不跨页读, 动态段后面可能就是没有映射的页
+        size_t to_page_end = (kPageSize - (addr & (kPageSize - 1))) / sizeof(ElfW(Dyn));
+        size_t count = to_page_end == 0 ? 1 : (to_page_end < kDynChunk ? to_page_end : kDynChunk);
+        if (!mem.read(addr, dyn, count * sizeof(ElfW(Dyn)))) {
+            return false;
+        }
+        for (size_t i = 0; i < count; i++) {
+            if (dyn[i].d_tag == DT_NULL) {
+                return false;
+            }
+            if (dyn[i].d_tag == DT_DEBUG) {
+                return set_r_debug(dyn[i].d_un.d_ptr);
+            }
+        }
+        addr += count * sizeof(ElfW(Dyn));
+        n += count;
+    }
+    return false;
+}
+
+bool RemoteLinkMap::read_name(uintptr_t addr, std::string *name){
+    char buf[PATH_MAX];
+    if (!mem.read_string(addr, buf, sizeof(buf))) {
+        return false;
+    }
+    name->assign(buf);
+    return true;
+}
+
+bool RemoteLinkMap::read_names(std::vector<RemoteModule> &modules, const std::vector<uintptr_t> &name_addrs){
+    // 每个名字先读一块, 不跨页, 一次 readv
+    std::vector<char> chunks(modules.size() * kNameChunk);
+    std::vector<size_t> lens(modules.size(), 0);
+    std::vector<RemoteIo> ios;
+    ios.reserve(modules.size());
+    for (size_t i = 0; i < modules.size(); i++) {
+        uintptr_t addr = name_addrs[i];
+        if (addr == 0) {
+            continue;
+        }
+        size_t to_page_end = kPageSize - (addr & (kPageSize - 1));
+        lens[i] = to_page_end < kNameChunk ? to_page_end : kNameChunk;
+        ios.push_back(RemoteIo{addr, &chunks[i * kNameChunk], lens[i]});
+    }
+    bool batched = ios.empty() || mem.readv(ios.data(), ios.size());
+    for (size_t i = 0; i < modules.size(); i++) {
+        if (name_addrs[i] == 0) {
+            continue;
+        }
+        const char *chunk = &chunks[i * kNameChunk];
+        size_t len = batched ? strnlen(chunk, lens[i]) : lens[i];
+        if (len < lens[i]) {
+            modules[i].name.assign(chunk, len);
+        } else if (!read_name(name_addrs[i], &modules[i].name)) {
+            // 这一块里没有'\0', 名字比较长或者跨页了
+            return false;
+        }
+    }
+    return true;
+}
+
+bool RemoteLinkMap::snapshot(std::vector<RemoteModule> *modules){
+    modules->clear();
+    RemoteRDebug debug{};
+    if (r_debug == 0 || !mem.read(r_debug, &debug)) {
+        return false;
+    }
+    std::vector<uintptr_t> name_addrs;
+    for (uintptr_t node = debug.r_map; node != 0; ) {
+        if (modules->size() >= kMaxModules) {
+            LOGW("link_map chain longer than %zu, stop", kMaxModules);
+            break;
+        }
+        RemoteLinkMapNode entry{};
+        if (!mem.read(node, &entry)) {
+            return false;
+        }
+        modules->push_back(RemoteModule{node, entry.l_addr, {}});
+        name_addrs.push_back(entry.l_name);
+        node = entry.l_next;
+    }
+    return read_names(*modules, name_addrs);
+}
+
+bool RemoteLinkMap::find(std::string_view suffix, RemoteModule *module){
+    std::vector<RemoteModule> modules;
+    if (!snapshot(&modules)) {
+        return false;
+    }
+    // 跟 ProcMaps::find_module 一样, 文件名完全相同的优先
+    RemoteModule *partial = nullptr;
+    for (auto &m: modules) {
+        if (!ProcMaps::ends_with(m.name, suffix)) {
+            continue;
+        }
+        if (ProcMaps::basename(m.name) == ProcMaps::basename(suffix)) {
+            *module = std::move(m);
+            return true;
+        }
+        if (partial == nullptr) {
+            partial = &m;
+        }
+    }
+    if (partial != nullptr) {
+        *module = std::move(*partial);
+        return true;
+    }
+    return false;
+}
+
+bool RemoteLinkMap::read_node(uintptr_t node, RemoteModule *module){
+    RemoteLinkMapNode entry{};
+    if (node == 0 || !mem.read(node, &entry)) {
+        return false;
+    }
+    module->node = node;
+    module->bias = entry.l_addr;
+    module->name.clear();
+    return entry.l_name == 0 || read_name(entry.l_name, &module->name);
+}
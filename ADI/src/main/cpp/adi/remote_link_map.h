@@ -0,0 +1,60 @@
+//
+// Created by chic on 2025/7/5.
+//
+
+#pragma once
+#include <sys/types.h>
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "remote_memory.h"
+
+// 远程进程 r_debug 链表上的一个so
+struct RemoteModule {
+    // link_map 节点的地址
+    uintptr_t node;
+    // l_addr, load bias
+    uintptr_t bias;
+    // l_name, 完整路径, 主程序是空字符串
+    std::string name;
+};
+
+/**
+ * 遍历远程进程 linker 维护的 r_debug -> link_map 链表, 判断某个so有没有加载以及它的 load bias
+ * 不读 /proc/pid/maps, 名字按需要读完整, 不会截断
+ * r_debug 的地址先从主程序动态段的 DT_DEBUG 找(linker 启动时填进去的), 找不到由调用方用 set_r_debug 给出
+ * 链表节点一个一个读(要先知道 l_next), 名字在最后合并成一次 readv
+ */
+class RemoteLinkMap {
+public:
+    explicit RemoteLinkMap(RemoteMemory &mem) : mem(mem) {
+    }
+
+    // 从auxv和主程序的动态段找 r_debug, 成功返回true
+    bool locate();
+    // 比如 linker 里 __dl__r_debug 的地址, 不是有效的 r_debug 返回false
+    bool set_r_debug(uintptr_t addr);
+    uintptr_t get_r_debug() const {
+        return r_debug;
+    }
+
+    // 当前链表上的所有so, 按链表顺序
+    bool snapshot(std::vector<RemoteModule> *modules);
+    // 路径以 suffix 结尾的so, 文件名完全相同的优先
+    bool find(std::string_view suffix, RemoteModule *module);
+
+    // 读 link_map 节点和它的完整名字, __dl_notify_gdb_of_load 的参数就是节点
+    bool read_node(uintptr_t node, RemoteModule *module);
+
+    // 链表最长多少个节点, 防止读到坏的指针以后一直循环
+    static constexpr size_t kMaxModules = 4096;
+
+private:
+    bool read_names(std::vector<RemoteModule> &modules, const std::vector<uintptr_t> &name_addrs);
+    bool read_name(uintptr_t addr, std::string *name);
+
+    RemoteMemory &mem;
+    uintptr_t r_debug = 0;
+};
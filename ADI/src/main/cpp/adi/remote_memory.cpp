@@ -0,0 +1,331 @@
+//
+// Created by chic on 2025/6/24.
+//
+
+#include "remote_memory.h"
+#include <sys/ptrace.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include "inject_metrics.h"
+#include "logging.h"
+
+// process_vm_readv/writev 一次最多 IOV_MAX 段
+static constexpr size_t kMaxIov = 1024;
+static constexpr uintptr_t kPageSize = 4096;
+
+// 追踪线程每让进程运行一次或者写一次远程内存就加一, 缓存里记录的epoch不一样就整个丢掉
+// ptrace只能由附加的线程操作, 所以每个线程一个计数就够了
+static thread_local uint64_t resume_epoch = 1;
+
+void RemoteMemory::invalidate_all(){
+    resume_epoch++;
+}
+
+void RemoteMemory::on_ptrace(int request){
+    switch (request) {
+        case PTRACE_CONT:
+        case PTRACE_SYSCALL:
+        case PTRACE_SINGLESTEP:
+        case PTRACE_DETACH:
+        case PTRACE_KILL:
+        case PTRACE_LISTEN:
+        case PTRACE_POKETEXT:
+        case PTRACE_POKEDATA:
+            invalidate_all();
+            break;
+        default:
+            break;
+    }
+}
+
+RemoteMemory::~RemoteMemory(){
+    if (mem_fd != -1) {
+        close(mem_fd);
+    }
+}
+
+RemoteMemory::RemoteMemory(RemoteMemory &&other) noexcept
+        : pid(other.pid), mem_fd(other.mem_fd), mem_fd_failed(other.mem_fd_failed),
+          vm_disabled(other.vm_disabled), path(other.path), cache_pages(other.cache_pages),
+          cache_epoch(other.cache_epoch), cache(std::move(other.cache)){
+    other.mem_fd = -1;
+}
+
+RemoteMemory &RemoteMemory::operator=(RemoteMemory &&other) noexcept{
+    if (this != &other) {
+        if (mem_fd != -1) {
+            close(mem_fd);
+        }
+        pid = other.pid;
+        mem_fd = other.mem_fd;
+        mem_fd_failed = other.mem_fd_failed;
+        vm_disabled = other.vm_disabled;
+        path = other.path;
+        cache_pages = other.cache_pages;
+        cache_epoch = other.cache_epoch;
+        cache = std::move(other.cache);
+        other.mem_fd = -1;
+    }
+    return *this;
+}
+
+bool RemoteMemory::readv(const RemoteIo *ios, size_t count){
+    if (cache_pages != 0) {
+        return cached_readv(ios, count);
+    }
+    return transfer(false, ios, count);
+}
+
+bool RemoteMemory::writev(const RemoteIo *ios, size_t count){
+    invalidate_all();
+    return transfer(true, ios, count);
+}
+
+bool RemoteMemory::cacheable(const RemoteIo &io) const{
+    if (io.len == 0) {
+        return false;
+    }
+    uintptr_t first = io.remote & ~(kPageSize - 1);
+    uintptr_t last = (io.remote + io.len - 1) & ~(kPageSize - 1);
+    return (last - first) / kPageSize + 1 <= std::min(kMaxCachedPagesPerRead, cache_pages);
+}
+
+bool RemoteMemory::cached_readv(const RemoteIo *ios, size_t count){
+    if (cache_epoch != resume_epoch) {
+        cache.clear();
+        cache_epoch = resume_epoch;
+    }
+    // 所有段缺的页合并成一次读取
+    std::vector<uintptr_t> missing;
+    for (size_t i = 0; i < count; i++) {
+        if (!cacheable(ios[i])) continue;
+        uintptr_t end = ios[i].remote + ios[i].len;
+        for (uintptr_t page = ios[i].remote & ~(kPageSize - 1); page < end; page += kPageSize) {
+            if (cache.find(page) == cache.end() &&
+                std::find(missing.begin(), missing.end(), page) == missing.end()) {
+                missing.push_back(page);
+            }
+        }
+    }
+    if (!missing.empty()) {
+        fill_pages(missing);
+    }
+    // 从缓存拷贝, 太大或者所在页读不出来的段直接读
+    std::vector<RemoteIo> direct;
+    for (size_t i = 0; i < count; i++) {
+        const RemoteIo &io = ios[i];
+        bool hit = cacheable(io);
+        uintptr_t end = io.remote + io.len;
+        for (uintptr_t page = io.remote & ~(kPageSize - 1); hit && page < end; page += kPageSize) {
+            hit = cache.find(page) != cache.end();
+        }
+        if (!hit) {
+            direct.push_back(io);
+            continue;
+        }
+        uintptr_t addr = io.remote;
+        auto out = static_cast<uint8_t *>(io.local);
+        while (addr < end) {
+            uintptr_t page = addr & ~(kPageSize - 1);
+            size_t n = std::min<size_t>(page + kPageSize, end) - addr;
+            memcpy(out, cache[page].get() + (addr - page), n);
+            out += n;
+            addr += n;
+        }
+    }
+    return direct.empty() || transfer(false, direct.data(), direct.size());
+}
+
+void RemoteMemory::fill_pages(const std::vector<uintptr_t> &pages){
+    if (cache.size() + pages.size() > cache_pages) {
+        cache.clear();
+    }
+    size_t n = std::min(pages.size(), cache_pages);
+    std::vector<std::unique_ptr<uint8_t[]>> bufs(n);
+    std::vector<RemoteIo> ios(n);
+    for (size_t i = 0; i < n; i++) {
+        bufs[i].reset(new uint8_t[kPageSize]);
+        ios[i] = {pages[i], bufs[i].get(), kPageSize};
+    }
+    if (transfer(false, ios.data(), n)) {
+        for (size_t i = 0; i < n; i++) {
+            cache[pages[i]] = std::move(bufs[i]);
+        }
+        return;
+    }
+    // 有页读不出来(比如PROT_NONE的保护页), 逐页重试, 读不出来的页不缓存
+    for (size_t i = 0; i < n; i++) {
+        if (transfer(false, &ios[i], 1)) {
+            cache[pages[i]] = std::move(bufs[i]);
+        }
+    }
+}
+
+bool RemoteMemory::read_string(uintptr_t addr, char *buf, size_t size){
+    if (size == 0) {
+        return false;
+    }
+    size_t done = 0;
+    while (done < size - 1) {
+        // 每次最多读到页尾, 下一页没有映射的时候不影响已经读到的部分
+        size_t chunk = std::min<size_t>(kPageSize - ((addr + done) & (kPageSize - 1)), size - 1 - done);
+        if (!read(addr + done, buf + done, chunk)) {
+            buf[done] = '\0';
+            return false;
+        }
+        auto nul = static_cast<char *>(memchr(buf + done, '\0', chunk));
+        if (nul != nullptr) {
+            return true;
+        }
+        done += chunk;
+    }
+    buf[size - 1] = '\0';
+    return true;
+}
+
+bool RemoteMemory::transfer(bool is_write, const RemoteIo *ios, size_t count){
+    if (path == RemoteMemPath::PROC_MEM || path == RemoteMemPath::PTRACE ||
+        (path == RemoteMemPath::AUTO && vm_disabled)) {
+        for (size_t i = 0; i < count; i++) {
+            if (!single_transfer(is_write, ios[i].remote, static_cast<uint8_t *>(ios[i].local), ios[i].len)) {
+                return false;
+            }
+        }
+        return true;
+    }
+    size_t i = 0;
+    while (i < count) {
+        size_t end = i + std::min(count - i, kMaxIov);
+        ssize_t n = vm_transfer(is_write, ios + i, end - i);
+        if (n < 0) {
+            if (path == RemoteMemPath::VM) {
+                return false;
+            }
+            if (errno == ENOSYS || errno == EPERM) {
+                // 内核没有这个系统调用或者被seccomp拦住了, 剩下的全部单独传输
+                LOGW("process_vm_%s unavailable for %d: %s", is_write ? "writev" : "readv", pid, strerror(errno));
+                vm_disabled = true;
+                return transfer(is_write, ios + i, count - i);
+            }
+            // EFAULT: 第一段就失败了, 跟只传输了0字节一样处理
+            n = 0;
+        }
+        // 跳过已经完整传输的段
+        auto done = static_cast<size_t>(n);
+        while (i < end && done >= ios[i].len) {
+            done -= ios[i].len;
+            i++;
+        }
+        if (i == end) {
+            continue;
+        }
+        if (path == RemoteMemPath::VM) {
+            return false;
+        }
+        // ios[i] 只传输了 done 字节, 剩下的部分单独走 /proc/pid/mem, 后面的段重新合并传输
+        if (!single_transfer(is_write, ios[i].remote + done, static_cast<uint8_t *>(ios[i].local) + done,
+                             ios[i].len - done)) {
+            return false;
+        }
+        i++;
+    }
+    return true;
+}
+
+ssize_t RemoteMemory::vm_transfer(bool is_write, const RemoteIo *ios, size_t count){
+    struct iovec local[kMaxIov];
+    struct iovec remote[kMaxIov];
+    for (size_t i = 0; i < count; i++) {
+        local[i].iov_base = ios[i].local;
+        local[i].iov_len = ios[i].len;
+        remote[i].iov_base = reinterpret_cast<void *>(ios[i].remote);
+        remote[i].iov_len = ios[i].len;
+    }
+    if (is_write) {
+        return process_vm_writev(pid, local, count, remote, count, 0);
+    }
+    return process_vm_readv(pid, local, count, remote, count, 0);
+}
+
+bool RemoteMemory::single_transfer(bool is_write, uintptr_t remote, uint8_t *local, size_t len){
+    if (len == 0) {
+        return true;
+    }
+    if (path != RemoteMemPath::PTRACE && proc_mem_transfer(is_write, remote, local, len)) {
+        return true;
+    }
+    if (path == RemoteMemPath::PROC_MEM) {
+        return false;
+    }
+    return ptrace_transfer(is_write, remote, local, len);
+}
+
+int RemoteMemory::get_mem_fd(){
+    if (mem_fd == -1 && !mem_fd_failed) {
+        char file_name[32];
+        snprintf(file_name, sizeof(file_name), "/proc/%d/mem", pid);
+        mem_fd = open(file_name, O_RDWR | O_CLOEXEC);
+        if (mem_fd == -1) {
+            PLOGE("open %s", file_name);
+            mem_fd_failed = true;
+        }
+    }
+    return mem_fd;
+}
+
+bool RemoteMemory::proc_mem_transfer(bool is_write, uintptr_t remote, uint8_t *local, size_t len){
+    int fd = get_mem_fd();
+    if (fd == -1) {
+        return false;
+    }
+    while (len > 0) {
+        InjectMetrics::count(SyscallKind::PROC_MEM);
+        ssize_t n = is_write ? pwrite64(fd, local, len, static_cast<off64_t>(remote))
+                             : pread64(fd, local, len, static_cast<off64_t>(remote));
+        if (n <= 0) {
+            if (n == -1 && errno == EINTR) continue;
+            LOGV("/proc/%d/mem %s %" PRIxPTR " failed: %s", pid, is_write ? "write" : "read", remote,
+                 n == 0 ? "eof" : strerror(errno));
+            return false;
+        }
+        remote += n;
+        local += n;
+        len -= n;
+    }
+    return true;
+}
+
+bool RemoteMemory::ptrace_transfer(bool is_write, uintptr_t remote, uint8_t *local, size_t len){
+    while (len > 0) {
+        long word = 0;
+        size_t chunk = std::min(len, sizeof(long));
+        if (!is_write || chunk < sizeof(long)) {
+            // 读取,或者写入不满一个long时先取出原来的内容
+            errno = 0;
+            word = ptrace(PTRACE_PEEKDATA, pid, reinterpret_cast<void *>(remote), nullptr);
+            if (word == -1 && errno != 0) {
+                PLOGE("ptrace peek %d %" PRIxPTR, pid, remote);
+                return false;
+            }
+        }
+        if (is_write) {
+            memcpy(&word, local, chunk);
+            if (ptrace(PTRACE_POKEDATA, pid, reinterpret_cast<void *>(remote), reinterpret_cast<void *>(word)) == -1) {
+                PLOGE("ptrace poke %d %" PRIxPTR, pid, remote);
+                return false;
+            }
+        } else {
+            memcpy(local, &word, chunk);
+        }
+        remote += chunk;
+        local += chunk;
+        len -= chunk;
+    }
+    return true;
+}
@@ -0,0 +1,125 @@
+//
+// Created by chic on 2025/6/24.
+//
+
+#pragma once
+#include <sys/types.h>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+// 远程进程内存的一次传输, remote 和 local 都是 len 字节
+struct RemoteIo {
+    uintptr_t remote;
+    void *local;
+    size_t len;
+};
+
+// 访问远程内存的方式, AUTO 按 VM -> PROC_MEM -> PTRACE 的顺序回退
+enum class RemoteMemPath {
+    AUTO,
+    VM,         // process_vm_readv/writev, 一次系统调用传输多段, 不能写只读页
+    PROC_MEM,   // pread/pwrite /proc/pid/mem, 带FOLL_FORCE, 可以往r-x的代码段下断点
+    PTRACE      // PTRACE_PEEKDATA/POKEDATA, 每个long一次系统调用, 最后才用
+};
+
+/**
+ * 远程进程内存读写
+ * readv/writev 把多段传输合并成一次 process_vm_readv/writev, 失败或者只传了一部分的段
+ * (一般是只读页或者没有映射的页) 单独走 /proc/pid/mem, 再失败才用 PEEK/POKE
+ * /proc/pid/mem 第一次需要的时候打开, 对象析构时关闭, 所以同一个进程尽量复用一个对象
+ * 需要在追踪线程里使用, /proc/pid/mem 和 PEEK/POKE 都要求已经ptrace附加
+ *
+ * enable_cache 以后读取按页缓存: 缺的页合并成一次readv整页读进来, 后面的读取直接从本地拷贝
+ * 进程停着的时候内存不会变, 当前线程让任何进程继续运行(CONT/SINGLESTEP/DETACH...)或者写任何远程内存
+ * 都会让这个线程上的所有缓存失效, 所以缓存只在一次停止期间有效
+ */
+class RemoteMemory {
+public:
+    explicit RemoteMemory(pid_t pid) : pid(pid) {}
+    ~RemoteMemory();
+
+    RemoteMemory(RemoteMemory &&other) noexcept;
+    RemoteMemory &operator=(RemoteMemory &&other) noexcept;
+    RemoteMemory(const RemoteMemory &) = delete;
+    RemoteMemory &operator=(const RemoteMemory &) = delete;
+
+    pid_t get_pid() const {
+        return pid;
+    }
+
+    // 最多缓存 max_pages 页, 0表示关闭缓存
+    void enable_cache(size_t max_pages = kDefaultCachePages){
+        cache_pages = max_pages;
+        cache.clear();
+    }
+
+    // 当前线程上所有 RemoteMemory 的缓存失效
+    static void invalidate_all();
+    // ptrace 的 --wrap 包装里调用, 让进程继续运行或者修改内存的请求会让缓存失效
+    static void on_ptrace(int request);
+
+    // 只有benchmark用, 固定使用某一种方式,不回退
+    void set_path(RemoteMemPath p){
+        path = p;
+    }
+
+    // 全部传输成功返回true
+    bool readv(const RemoteIo *ios, size_t count);
+    bool writev(const RemoteIo *ios, size_t count);
+
+    bool read(uintptr_t addr, void *buf, size_t len){
+        RemoteIo io{addr, buf, len};
+        return readv(&io, 1);
+    }
+
+    bool write(uintptr_t addr, const void *buf, size_t len){
+        RemoteIo io{addr, const_cast<void *>(buf), len};
+        return writev(&io, 1);
+    }
+
+    template<typename T>
+    bool read(uintptr_t addr, T *value){
+        return read(addr, value, sizeof(T));
+    }
+
+    template<typename T>
+    bool write(uintptr_t addr, const T &value){
+        return write(addr, &value, sizeof(T));
+    }
+
+    // 读取'\0'结尾的字符串, 最多 size - 1 个字节, buf 总是以'\0'结尾
+    // 按页读取, 不会因为字符串后面是没有映射的页而失败
+    bool read_string(uintptr_t addr, char *buf, size_t size);
+
+    static constexpr size_t kDefaultCachePages = 32;
+
+private:
+    // 超过这么多页的读取不走缓存
+    static constexpr size_t kMaxCachedPagesPerRead = 4;
+
+    pid_t pid;
+    int mem_fd = -1;
+    // /proc/pid/mem 打开失败过, 后面直接用ptrace
+    bool mem_fd_failed = false;
+    // process_vm_* 不可用(ENOSYS/EPERM), 后面不再尝试
+    bool vm_disabled = false;
+    RemoteMemPath path = RemoteMemPath::AUTO;
+    size_t cache_pages = 0;
+    // 缓存填充时的epoch, 跟当前线程的epoch不一样说明进程运行过
+    uint64_t cache_epoch = 0;
+    std::unordered_map<uintptr_t, std::unique_ptr<uint8_t[]>> cache;
+
+    bool cached_readv(const RemoteIo *ios, size_t count);
+    bool cacheable(const RemoteIo &io) const;
+    void fill_pages(const std::vector<uintptr_t> &pages);
+    bool transfer(bool is_write, const RemoteIo *ios, size_t count);
+    // 返回成功传输的字节数, 失败返回-1
+    ssize_t vm_transfer(bool is_write, const RemoteIo *ios, size_t count);
+    bool single_transfer(bool is_write, uintptr_t remote, uint8_t *local, size_t len);
+    bool proc_mem_transfer(bool is_write, uintptr_t remote, uint8_t *local, size_t len);
+    bool ptrace_transfer(bool is_write, uintptr_t remote, uint8_t *local, size_t len);
+    int get_mem_fd();
+};
@@ -0,0 +1,78 @@
+//
+// Created by chic on 2025/6/30.
+//
+
+#include "remote_syscall.h"
+#include <sys/auxv.h>
+#include <elf.h>
+#include <link.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstring>
+#include "logging.h"
+
+#if defined(__aarch64__)
+static const uint8_t kSyscallInsn[] = {0x01, 0x00, 0x00, 0xd4};   // svc #0
+#elif defined(__x86_64__)
+static const uint8_t kSyscallInsn[] = {0x0f, 0x05};               // syscall
+#endif
+
+bool syscall_insn(const uint8_t **code, size_t *size){
+#if defined(__aarch64__) || defined(__x86_64__)
+    *code = kSyscallInsn;
+    *size = sizeof(kSyscallInsn);
+    return true;
+#else
+    *code = nullptr;
+    *size = 0;
+    return false;
+#endif
+}
+
+static uintptr_t find_vdso_syscall(){
+#if defined(__aarch64__) || defined(__x86_64__)
+    auto vdso = reinterpret_cast<const uint8_t *>(getauxval(AT_SYSINFO_EHDR));
+    if (vdso == nullptr) {
+        return 0;
+    }
+    auto ehdr = reinterpret_cast<const ElfW(Ehdr) *>(vdso);
+    auto phdr = reinterpret_cast<const ElfW(Phdr) *>(vdso + ehdr->e_phoff);
+    for (int i = 0; i < ehdr->e_phnum; i++) {
+        if (phdr[i].p_type != PT_LOAD || (phdr[i].p_flags & PF_X) == 0) continue;
+        // vdso 的 p_vaddr 是相对加载地址的, 只搜索可执行段, arm64 的指令4字节对齐
+        size_t step = sizeof(kSyscallInsn) == 4 ? 4 : 1;
+        for (size_t off = phdr[i].p_offset; off + sizeof(kSyscallInsn) <= phdr[i].p_offset + phdr[i].p_filesz; off += step) {
+            if (memcmp(vdso + off, kSyscallInsn, sizeof(kSyscallInsn)) == 0) {
+                return off;
+            }
+        }
+    }
+#endif
+    return 0;
+}
+
+uintptr_t vdso_syscall_offset(){
+    static uintptr_t offset = find_vdso_syscall();
+    return offset;
+}
+
+uintptr_t read_remote_auxv(pid_t pid, unsigned long type){
+    char file_name[32];
+    snprintf(file_name, sizeof(file_name), "/proc/%d/auxv", pid);
+    int fd = open(file_name, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        PLOGE("open %s", file_name);
+        return 0;
+    }
+    ElfW(auxv_t) auxv[64];
+    ssize_t n = read(fd, auxv, sizeof(auxv));
+    close(fd);
+    for (ssize_t i = 0; n > 0 && i < n / (ssize_t) sizeof(auxv[0]); i++) {
+        if (auxv[i].a_type == type) {
+            return (uintptr_t) auxv[i].a_un.a_val;
+        }
+        if (auxv[i].a_type == AT_NULL) break;
+    }
+    return 0;
+}
@@ -0,0 +1,24 @@
+//
+// Created by chic on 2025/6/30.
+//
+
+#pragma once
+#include <sys/types.h>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * 远程系统调用用到的不需要ptrace的部分, 执行在 PtraceUtils.h 的 remote_syscall 里
+ * 只支持 arm64 和 x86_64, 32位的 arm 没有 PTRACE_SINGLESTEP
+ */
+
+// 当前构架的系统调用指令(svc #0 / syscall), 不支持的构架返回false
+bool syscall_insn(const uint8_t **code, size_t *size);
+
+// 注入器自己的vdso里一条系统调用指令相对vdso开头的偏移, 同一个内核上所有进程的vdso内容一样
+// 目标进程的vdso地址加上这个偏移就不需要去目标进程里搜索, 找不到返回0
+uintptr_t vdso_syscall_offset();
+
+// 读 /proc/pid/auxv 里 type 对应的值, 比如 AT_ENTRY, AT_SYSINFO_EHDR, 失败返回0
+// 内核保存的auxv副本, arm_app_process_entry 改的是栈上的那份, 不受影响
+uintptr_t read_remote_auxv(pid_t pid, unsigned long type);
@@ -0,0 +1,177 @@
+//
+// Created by chic on 2025/6/6.
+//
+
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstring>
+#include "rule_table.h"
+#include "contorlProcess.h"
+#include "logging.h"
+
+static bool is_glob(const std::string &s){
+    return s.find_first_of("*?[") != std::string::npos;
+}
+
+// glob转换成ERE, * 和 ? 不匹配 '/'
+static std::string glob_to_regex(const std::string &glob){
+    std::string re;
+    for (size_t i = 0; i < glob.size(); ++i) {
+        char c = glob[i];
+        switch (c) {
+            case '*':
+                re += "[^/]*";
+                break;
+            case '?':
+                re += "[^/]";
+                break;
+            case '[': {
+                size_t end = glob.find(']', i + 1);
+                if (end == std::string::npos) {
+                    re += "\\[";
+                    break;
+                }
+                re += '[';
+                size_t j = i + 1;
+                if (glob[j] == '!') {
+                    re += '^';
+                    ++j;
+                }
+                re.append(glob, j, end - j);
+                re += ']';
+                i = end;
+                break;
+            }
+            case '.': case '+': case '(': case ')': case '|':
+            case '{': case '}': case '^': case '$': case '\\':
+                re += '\\';
+                re += c;
+                break;
+            default:
+                re += c;
+        }
+    }
+    return re;
+}
+
+RuleTable::~RuleTable(){
+    if (has_pattern_) {
+        regfree(&pattern_);
+    }
+}
+
+void RuleTable::add(std::unique_ptr<ContorlProcess> rule){
+    rules_.emplace_back(std::move(rule));
+}
+
+bool RuleTable::compile(){
+    std::string combined;
+    size_t group = 1;
+    for (auto &rule: rules_) {
+        std::string re;
+        if (!rule->execRegex.empty()) {
+            re = rule->execRegex;
+        } else if (is_glob(rule->exec)) {
+            re = glob_to_regex(rule->exec);
+        } else {
+            by_path_.emplace(rule->exec, rule.get());
+            struct stat st;
+            if (stat(rule->exec.c_str(), &st) == 0) {
+                by_inode_.emplace(FileKey{st.st_dev, st.st_ino}, rule.get());
+            } else {
+                LOGD("rule %s not found yet, match by path", rule->exec.c_str());
+            }
+            continue;
+        }
+        // 单独编译一次,检查语法并拿到子分组数量,合并以后才能算出每个规则的分组编号
+        regex_t single;
+        int err = regcomp(&single, re.c_str(), REG_EXTENDED);
+        if (err != 0) {
+            char msg[128];
+            regerror(err, &single, msg, sizeof(msg));
+            LOGE("bad exec pattern %s: %s", re.c_str(), msg);
+            return false;
+        }
+        size_t nsub = single.re_nsub;
+        regfree(&single);
+        if (!combined.empty()) combined += '|';
+        combined += "^(" + re + ")$";
+        pattern_rules_.emplace_back(rule.get());
+        pattern_groups_.emplace_back(group);
+        group += 1 + nsub;
+    }
+    if (!combined.empty()) {
+        if (regcomp(&pattern_, combined.c_str(), REG_EXTENDED) != 0) {
+            LOGE("compile exec patterns failed");
+            return false;
+        }
+        has_pattern_ = true;
+    }
+    LOGD("rule table: %zu inode, %zu path, %zu pattern", by_inode_.size(), by_path_.size(), pattern_rules_.size());
+    return true;
+}
+
+ContorlProcess *RuleTable::match_pattern(const std::string &path){
+    if (!has_pattern_) {
+        return nullptr;
+    }
+    std::vector<regmatch_t> groups(pattern_.re_nsub + 1);
+    if (regexec(&pattern_, path.c_str(), groups.size(), groups.data(), 0) != 0) {
+        return nullptr;
+    }
+    for (size_t i = 0; i < pattern_rules_.size(); ++i) {
+        if (groups[pattern_groups_[i]].rm_so != -1) {
+            return pattern_rules_[i];
+        }
+    }
+    return nullptr;
+}
+
+ContorlProcess *RuleTable::match_file(dev_t dev, ino_t ino, const std::string &path){
+    auto rule = by_inode_.find(FileKey{dev, ino});
+    if (rule != by_inode_.end()) {
+        return rule->second;
+    }
+    if (path.empty()) {
+        return nullptr;
+    }
+    auto exact = by_path_.find(path);
+    if (exact != by_path_.end()) {
+        return exact->second;
+    }
+    return match_pattern(path);
+}
+
+ContorlProcess *RuleTable::match(pid_t pid){
+    char exe[64];
+    snprintf(exe, sizeof(exe), "/proc/%d/exe", pid);
+    struct stat st;
+    if (stat(exe, &st) != 0) {
+        return nullptr;
+    }
+    auto rule = by_inode_.find(FileKey{st.st_dev, st.st_ino});
+    if (rule != by_inode_.end()) {
+        return rule->second;
+    }
+    // inode没有命中也要按路径再查一次: exec文件被替换或者apex/bind重新挂载以后(dev, inode)会变
+    // 只有一个规则都没有按路径或者正则匹配时才能省掉readlink
+    if (by_path_.empty() && !has_pattern_) {
+        return nullptr;
+    }
+    return match_file(st.st_dev, st.st_ino, get_program(pid));
+}
+
+bool RuleTable::take(ContorlProcess *rule){
+    unsigned int count = rule->monitorCount.load(std::memory_order_relaxed);
+    do {
+        if (count == 0) {
+            return false;
+        }
+    } while (!rule->monitorCount.compare_exchange_weak(count, count - 1, std::memory_order_relaxed));
+    return true;
+}
+
+void RuleTable::give_back(ContorlProcess *rule){
+    rule->monitorCount.fetch_add(1, std::memory_order_relaxed);
+}
@@ -0,0 +1,71 @@
+//
+// Created by chic on 2025/6/6.
+//
+
+#pragma once
+#include <sys/types.h>
+#include <regex.h>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class ContorlProcess;
+
+/**
+ * 加载配置以后把 childProcess 编译成索引, 每次exec只需要一次stat和一次hash查找
+ * 1. (dev, inode) -> 规则, stat /proc/pid/exe 不需要readlink
+ * 2. exec路径 -> 规则, inode没有命中时使用: 加载配置时exec文件还不存在(分区没有挂载), 或者之后被替换/重新挂载
+ * 3. exec里带 * ? [ 的glob规则和 execRegex 规则编译成一个正则
+ */
+class RuleTable {
+public:
+    RuleTable() = default;
+    RuleTable(const RuleTable &) = delete;
+    RuleTable &operator=(const RuleTable &) = delete;
+    ~RuleTable();
+
+    void add(std::unique_ptr<ContorlProcess> rule);
+
+    bool compile();
+
+    // 按进程当前的exe匹配规则,没有匹配返回nullptr
+    ContorlProcess *match(pid_t pid);
+
+    // 按exec文件匹配规则(fanotify事件fd)
+    ContorlProcess *match_file(dev_t dev, ino_t ino, const std::string &path);
+
+    // monitorCount 大于0时减一并返回true
+    static bool take(ContorlProcess *rule);
+    // take 以后进程没有走到注入(SEIZE失败, exec没有完成)时把次数还回去
+    static void give_back(ContorlProcess *rule);
+
+    const std::vector<std::unique_ptr<ContorlProcess>> &rules() const {
+        return rules_;
+    }
+
+private:
+    struct FileKey {
+        dev_t dev;
+        ino_t ino;
+        bool operator==(const FileKey &o) const {
+            return dev == o.dev && ino == o.ino;
+        }
+    };
+    struct FileKeyHash {
+        size_t operator()(const FileKey &k) const {
+            return std::hash<uint64_t>()(((uint64_t) k.dev << 32) ^ (uint64_t) k.ino);
+        }
+    };
+
+    ContorlProcess *match_pattern(const std::string &path);
+
+    std::vector<std::unique_ptr<ContorlProcess>> rules_;
+    std::unordered_map<FileKey, ContorlProcess *, FileKeyHash> by_inode_;
+    std::unordered_map<std::string, ContorlProcess *> by_path_;
+    // 合并以后的正则, pattern_groups_[i] 是第i个规则在合并正则里的分组编号
+    regex_t pattern_{};
+    bool has_pattern_ = false;
+    std::vector<ContorlProcess *> pattern_rules_;
+    std::vector<size_t> pattern_groups_;
+};
@@ -0,0 +1,412 @@
+//
+// Created by chic on 2025/7/7.
+//
+
+#include "symbol_cache.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include "elf_engine.h"
+#include "elf_symbol_index.h"
+#include "symbol_hash.h"
+#include "logging.h"
+
+static constexpr char kMagic[8] = {'A', 'D', 'I', 'S', 'Y', 'M', 'C', '\0'};
+static constexpr uint32_t kVersion = 1;
+static constexpr size_t kMaxBuildId = 32;
+// PT_NOTE 段一般只有几十个字节, 再大的不看
+static constexpr size_t kMaxNote = 4096;
+
+struct SymbolCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t file_count;
+    uint32_t entry_count;
+    uint32_t strings_size;
+    // 头后面所有内容的 FNV-1a
+    uint64_t checksum;
+};
+
+struct SymbolCacheFile {
+    uint8_t build_id[kMaxBuildId];
+    uint32_t build_id_len;
+    uint32_t first_entry;
+    uint32_t entry_count;
+    // 最后一次写入时的路径, 只是方便看
+    uint32_t path;
+};
+
+struct SymbolCacheEntry {
+    uint32_t name;
+    uint32_t hash;
+    uint64_t value;
+};
+
+static_assert(sizeof(SymbolCacheHeader) == 32);
+static_assert(sizeof(SymbolCacheFile) == 48);
+static_assert(sizeof(SymbolCacheEntry) == 16);
+
+static uint64_t fnv1a(const uint8_t *p, size_t len){
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ p[i]) * 0x100000001b3ull;
+    }
+    return h;
+}
+
+static bool pread_full(int fd, void *buf, size_t len, off_t offset){
+    auto p = static_cast<char *>(buf);
+    while (len > 0) {
+        ssize_t n = pread(fd, p, len, offset);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        len -= n;
+        offset += n;
+    }
+    return true;
+}
+
+static bool write_full(int fd, const void *buf, size_t len){
+    auto p = static_cast<const char *>(buf);
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+// head 是文件开头读进来的 n 个字节, 已经确认过是 E 这个类别的ELF
+template<typename E>
+static bool read_build_id_notes(int fd, const uint8_t *head, size_t n, std::string *build_id){
+    typename E::Ehdr ehdr;
+    memcpy(&ehdr, head, sizeof(ehdr));
+    if (ehdr.e_phentsize != sizeof(typename E::Phdr) || ehdr.e_phnum == 0 || ehdr.e_phnum > 64) {
+        return false;
+    }
+    typename E::Phdr phdrs[64];
+    size_t phdrs_size = ehdr.e_phnum * sizeof(typename E::Phdr);
+    if (ehdr.e_phoff + phdrs_size <= n) {
+        memcpy(phdrs, head + ehdr.e_phoff, phdrs_size);
+    } else if (!pread_full(fd, phdrs, phdrs_size, ehdr.e_phoff)) {
+        return false;
+    }
+    alignas(4) uint8_t note[kMaxNote];
+    for (size_t i = 0; i < ehdr.e_phnum; i++) {
+        if (phdrs[i].p_type != PT_NOTE || phdrs[i].p_filesz > kMaxNote) {
+            continue;
+        }
+        if (!pread_full(fd, note, phdrs[i].p_filesz, phdrs[i].p_offset)) {
+            continue;
+        }
+        if (parse_build_id_note(note, phdrs[i].p_filesz, build_id) && build_id->size() <= kMaxBuildId) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool SymbolCache::read_build_id(const char *lib_path, std::string *build_id){
+    int fd = open(lib_path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return false;
+    }
+    // ELF头和程序头一般在文件最前面, 一次读进来
+    alignas(8) uint8_t head[1024];
+    ssize_t n = pread(fd, head, sizeof(head), 0);
+    bool found = n >= (ssize_t) sizeof(Elf64_Ehdr) && memcmp(head, ELFMAG, SELFMAG) == 0 &&
+                 elf_dispatch(head[EI_CLASS], [&](auto e) {
+                     return read_build_id_notes<decltype(e)>(fd, head, n, build_id);
+                 });
+    close(fd);
+    return found;
+}
+
+SymbolCache::SymbolCache(const char *path) : path(path) {
+}
+
+SymbolCache::~SymbolCache(){
+    unload();
+}
+
+void SymbolCache::setPath(const char *new_path){
+    std::lock_guard<std::mutex> guard(lock);
+    unload();
+    pending.clear();
+    path = new_path;
+}
+
+void SymbolCache::unload(){
+    if (data != nullptr) {
+        munmap(data, length);
+    }
+    data = nullptr;
+    length = 0;
+    loaded = false;
+}
+
+void SymbolCache::load(){
+    loaded = true;
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1 || (size_t) st.st_size < sizeof(SymbolCacheHeader)) {
+        close(fd);
+        return;
+    }
+    void *map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        PLOGE("mmap %s", path.c_str());
+        return;
+    }
+    auto base = static_cast<const uint8_t *>(map);
+    auto header = static_cast<const SymbolCacheHeader *>(map);
+    size_t size = st.st_size;
+    uint64_t expected = sizeof(SymbolCacheHeader) + (uint64_t) header->file_count * sizeof(SymbolCacheFile) +
+                        (uint64_t) header->entry_count * sizeof(SymbolCacheEntry) + header->strings_size;
+    bool valid = memcmp(header->magic, kMagic, sizeof(kMagic)) == 0 && header->version == kVersion &&
+                 expected == size && header->strings_size > 0 &&
+                 fnv1a(base + sizeof(SymbolCacheHeader), size - sizeof(SymbolCacheHeader)) == header->checksum;
+    if (valid) {
+        // 字符串区最后一定是'\0', 每个文件的符号范围不能越界
+        auto files = reinterpret_cast<const SymbolCacheFile *>(base + sizeof(SymbolCacheHeader));
+        auto entries = reinterpret_cast<const SymbolCacheEntry *>(files + header->file_count);
+        auto strings = reinterpret_cast<const char *>(entries + header->entry_count);
+        valid = strings[header->strings_size - 1] == '\0';
+        for (uint32_t i = 0; valid && i < header->file_count; i++) {
+            valid = files[i].build_id_len <= kMaxBuildId && files[i].first_entry <= header->entry_count &&
+                    files[i].entry_count <= header->entry_count - files[i].first_entry &&
+                    files[i].path < header->strings_size;
+        }
+        for (uint32_t i = 0; valid && i < header->entry_count; i++) {
+            valid = entries[i].name < header->strings_size;
+        }
+    }
+    if (!valid) {
+        LOGW("symbol cache %s is invalid, rebuild it", path.c_str());
+        munmap(map, size);
+        return;
+    }
+    data = map;
+    length = size;
+}
+
+bool SymbolCache::find_mapped(const std::string &build_id, const char *name, uint64_t *value) const {
+    if (data == nullptr) {
+        return false;
+    }
+    auto header = static_cast<const SymbolCacheHeader *>(data);
+    auto files = reinterpret_cast<const SymbolCacheFile *>(header + 1);
+    auto entries = reinterpret_cast<const SymbolCacheEntry *>(files + header->file_count);
+    auto strings = reinterpret_cast<const char *>(entries + header->entry_count);
+    for (uint32_t i = 0; i < header->file_count; i++) {
+        auto &file = files[i];
+        if (file.build_id_len != build_id.size() || memcmp(file.build_id, build_id.data(), build_id.size()) != 0) {
+            continue;
+        }
+        uint32_t hash = gnu_hash(name);
+        auto begin = entries + file.first_entry;
+        auto end = begin + file.entry_count;
+        auto it = std::lower_bound(begin, end, hash,
+                                   [](const SymbolCacheEntry &e, uint32_t h) { return e.hash < h; });
+        for (; it != end && it->hash == hash; ++it) {
+            if (strcmp(strings + it->name, name) == 0) {
+                *value = it->value;
+                return true;
+            }
+        }
+        return false;
+    }
+    return false;
+}
+
+bool SymbolCache::find_pending(const std::string &build_id, const char *name, uint64_t *value) const {
+    for (auto &file: pending) {
+        if (file.build_id != build_id) {
+            continue;
+        }
+        for (auto &sym: file.symbols) {
+            if (sym.name == name) {
+                *value = sym.value;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+size_t SymbolCache::lookup(const char *lib_path, const char *const *names, uintptr_t *offs, size_t count){
+    std::string build_id;
+    if (!read_build_id(lib_path, &build_id)) {
+        auto index = ElfSymbolIndex::get(lib_path);
+        if (index == nullptr) {
+            memset(offs, 0, count * sizeof(uintptr_t));
+            return 0;
+        }
+        return index->find(names, offs, count);
+    }
+    std::lock_guard<std::mutex> guard(lock);
+    if (!loaded) {
+        load();
+    }
+    size_t found = 0;
+    std::vector<size_t> missing;
+    for (size_t i = 0; i < count; i++) {
+        uint64_t value;
+        if (find_mapped(build_id, names[i], &value) || find_pending(build_id, names[i], &value)) {
+            offs[i] = value;
+            found += value != 0;
+        } else {
+            missing.push_back(i);
+        }
+    }
+    if (missing.empty()) {
+        return found;
+    }
+    auto index = ElfSymbolIndex::get(lib_path);
+    if (index == nullptr) {
+        for (auto i: missing) {
+            offs[i] = 0;
+        }
+        return found;
+    }
+    auto file = std::find_if(pending.begin(), pending.end(),
+                             [&](const PendingFile &f) { return f.build_id == build_id; });
+    if (file == pending.end()) {
+        pending.push_back(PendingFile{build_id, lib_path, {}});
+        file = pending.end() - 1;
+    }
+    for (auto i: missing) {
+        offs[i] = index->find(names[i]);
+        found += offs[i] != 0;
+        // 没找到也记下来, 同一个 build-id 以后也不会有
+        file->symbols.push_back(PendingSymbol{names[i], offs[i]});
+    }
+    if (store()) {
+        pending.clear();
+        unload();
+        load();
+    }
+    return found;
+}
+
+bool SymbolCache::store(){
+    // build-id -> (路径, 符号名 -> 值), 缓存文件里原来的在前, 这次新查的覆盖
+    struct FileModel {
+        std::string path;
+        std::map<std::string, uint64_t> symbols;
+    };
+    std::map<std::string, FileModel> model;
+    if (data != nullptr) {
+        auto header = static_cast<const SymbolCacheHeader *>(data);
+        auto files = reinterpret_cast<const SymbolCacheFile *>(header + 1);
+        auto entries = reinterpret_cast<const SymbolCacheEntry *>(files + header->file_count);
+        auto strings = reinterpret_cast<const char *>(entries + header->entry_count);
+        for (uint32_t i = 0; i < header->file_count; i++) {
+            auto &m = model[std::string(reinterpret_cast<const char *>(files[i].build_id), files[i].build_id_len)];
+            m.path = strings + files[i].path;
+            for (uint32_t j = 0; j < files[i].entry_count; j++) {
+                auto &e = entries[files[i].first_entry + j];
+                m.symbols[strings + e.name] = e.value;
+            }
+        }
+    }
+    for (auto &file: pending) {
+        auto &m = model[file.build_id];
+        m.path = file.path;
+        for (auto &sym: file.symbols) {
+            m.symbols[sym.name] = sym.value;
+        }
+    }
+
+    std::vector<SymbolCacheFile> files;
+    std::vector<SymbolCacheEntry> entries;
+    std::string strings(1, '\0');
+    auto add_string = [&strings](const std::string &s) {
+        uint32_t off = strings.size();
+        strings.append(s.c_str(), s.size() + 1);
+        return off;
+    };
+    for (auto &[build_id, m]: model) {
+        SymbolCacheFile file{};
+        memcpy(file.build_id, build_id.data(), build_id.size());
+        file.build_id_len = build_id.size();
+        file.first_entry = entries.size();
+        file.entry_count = m.symbols.size();
+        file.path = add_string(m.path);
+        for (auto &[name, value]: m.symbols) {
+            entries.push_back(SymbolCacheEntry{add_string(name), gnu_hash(name.c_str()), value});
+        }
+        std::sort(entries.begin() + file.first_entry, entries.end(),
+                  [&strings](const SymbolCacheEntry &a, const SymbolCacheEntry &b) {
+                      if (a.hash != b.hash) return a.hash < b.hash;
+                      return strcmp(strings.c_str() + a.name, strings.c_str() + b.name) < 0;
+                  });
+        files.push_back(file);
+    }
+    std::string body;
+    body.append(reinterpret_cast<const char *>(files.data()), files.size() * sizeof(SymbolCacheFile));
+    body.append(reinterpret_cast<const char *>(entries.data()), entries.size() * sizeof(SymbolCacheEntry));
+    body.append(strings);
+    SymbolCacheHeader header{};
+    memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.file_count = files.size();
+    header.entry_count = entries.size();
+    header.strings_size = strings.size();
+    header.checksum = fnv1a(reinterpret_cast<const uint8_t *>(body.data()), body.size());
+
+    // 先写临时文件再 rename, 别的 adi 进程要么看到旧的要么看到新的
+    size_t slash = path.rfind('/');
+    if (slash != std::string::npos && slash > 0) {
+        mkdir(path.substr(0, slash).c_str(), 0700);
+    }
+    std::string tmp = path + ".tmp." + std::to_string(getpid());
+    int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd == -1) {
+        PLOGE("open %s", tmp.c_str());
+        return false;
+    }
+    bool ok = write_full(fd, &header, sizeof(header)) && write_full(fd, body.data(), body.size());
+    close(fd);
+    if (!ok || rename(tmp.c_str(), path.c_str()) == -1) {
+        PLOGE("write %s", path.c_str());
+        unlink(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+size_t SymbolCache::file_count(){
+    std::lock_guard<std::mutex> guard(lock);
+    if (!loaded) {
+        load();
+    }
+    return data != nullptr ? static_cast<const SymbolCacheHeader *>(data)->file_count : 0;
+}
+
+size_t SymbolCache::entry_count(){
+    std::lock_guard<std::mutex> guard(lock);
+    if (!loaded) {
+        load();
+    }
+    return data != nullptr ? static_cast<const SymbolCacheHeader *>(data)->entry_count : 0;
+}
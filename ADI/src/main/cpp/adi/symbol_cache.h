@@ -0,0 +1,83 @@
+//
+// Created by chic on 2025/7/7.
+//
+
+#pragma once
+#include <sys/types.h>
+#include <cstdint>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifdef __ANDROID__
+#define ADI_SYMBOL_CACHE_PATH "/data/adb/adi/symbols.cache"
+#else
+#define ADI_SYMBOL_CACHE_PATH "/tmp/adi/symbols.cache"
+#endif
+
+/**
+ * 磁盘上的符号偏移缓存, 按 GNU build-id 区分文件
+ * linker64/libc/libart 这些只有OTA才会变, 查过一次的 (build-id, 符号名) -> st_value 写到缓存文件里,
+ * 以后的查找只读目标文件的 build-id(一次open, 两次pread), 不再解析符号表
+ * 没有的符号(包括没找到的, 记成0)才用 ElfSymbolIndex 解析, 解析完马上写一个新的缓存文件再 rename 过去
+ *
+ * 文件格式, 整个文件 mmap 进来直接查:
+ *   SymbolCacheHeader
+ *   SymbolCacheFile[file_count]     每个 build-id 一项
+ *   SymbolCacheEntry[entry_count]   每个文件的符号连续存放, 按 (hash, 名字) 排好序, 二分查找
+ *   字符串                           符号名和路径, '\0'结尾
+ * 头里有整个文件的校验和, 打开时检查, 不对(或者版本不对)就当没有缓存, 下一次没命中时重写
+ */
+class SymbolCache {
+public:
+    explicit SymbolCache(const char *path = ADI_SYMBOL_CACHE_PATH);
+    ~SymbolCache();
+    SymbolCache(const SymbolCache &) = delete;
+    SymbolCache &operator=(const SymbolCache &) = delete;
+
+    static SymbolCache &getInstance(){
+        static SymbolCache instance;
+        return instance;
+    }
+
+    // 换一个缓存文件, 之前读进来的缓存作废
+    void setPath(const char *path);
+
+    // 跟 get_libFile_Symbol_offs 一样, offs[i] 是 names[i] 在 lib_path 里的偏移, 找不到是0, 返回找到了几个
+    // 没有 build-id 的文件不缓存, 每次都解析
+    size_t lookup(const char *lib_path, const char *const *names, uintptr_t *offs, size_t count);
+
+    // lib_path 的 GNU build-id, 没有返回false
+    static bool read_build_id(const char *lib_path, std::string *build_id);
+
+    // 缓存文件里有几个文件, 几个符号
+    size_t file_count();
+    size_t entry_count();
+
+private:
+    struct PendingSymbol {
+        std::string name;
+        uint64_t value;
+    };
+    struct PendingFile {
+        std::string build_id;
+        std::string path;
+        std::vector<PendingSymbol> symbols;
+    };
+
+    void load();
+    void unload();
+    bool store();
+    // 在缓存文件里找, 找到返回true
+    bool find_mapped(const std::string &build_id, const char *name, uint64_t *value) const;
+    bool find_pending(const std::string &build_id, const char *name, uint64_t *value) const;
+
+    std::mutex lock;
+    std::string path;
+    bool loaded = false;
+    void *data = nullptr;
+    size_t length = 0;
+    // 写不进缓存文件的时候也留在内存里, 这个进程里不会再解析
+    std::vector<PendingFile> pending;
+};
@@ -0,0 +1,475 @@
+//
+// Created by chic on 2025/7/10.
+//
+
+#include "xz_decoder.h"
+#include <cstring>
+#include <memory>
+#include "logging.h"
+
+static constexpr uint8_t kXzMagic[6] = {0xfd, '7', 'z', 'X', 'Z', 0x00};
+static constexpr size_t kStreamHeaderSize = 12;
+static constexpr uint64_t kLzma2FilterId = 0x21;
+// 各种校验类型的长度, 下标是 stream flags 里的 check type
+static constexpr uint8_t kCheckSizes[16] = {0, 4, 4, 4, 8, 8, 8, 16, 16, 16, 32, 32, 32, 64, 64, 64};
+static constexpr uint8_t kCheckCrc32 = 1;
+static constexpr uint8_t kCheckCrc64 = 4;
+
+struct CrcTables {
+    uint32_t crc32[256];
+    uint64_t crc64[256];
+};
+
+static constexpr CrcTables make_crc_tables(){
+    CrcTables t{};
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c32 = i;
+        uint64_t c64 = i;
+        for (int k = 0; k < 8; k++) {
+            c32 = (c32 >> 1) ^ (0xedb88320u & (0u - (c32 & 1)));
+            c64 = (c64 >> 1) ^ (0xc96c5795d7870f42ull & (0ull - (c64 & 1)));
+        }
+        t.crc32[i] = c32;
+        t.crc64[i] = c64;
+    }
+    return t;
+}
+
+static constexpr CrcTables kCrcTables = make_crc_tables();
+
+static uint32_t crc32(const uint8_t *p, size_t len){
+    uint32_t crc = ~0u;
+    for (size_t i = 0; i < len; i++) {
+        crc = kCrcTables.crc32[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+static uint64_t crc64(const uint8_t *p, size_t len){
+    uint64_t crc = ~0ull;
+    for (size_t i = 0; i < len; i++) {
+        crc = kCrcTables.crc64[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+static uint64_t read_le(const uint8_t *p, size_t n){
+    uint64_t v = 0;
+    for (size_t i = 0; i < n; i++) {
+        v |= (uint64_t) p[i] << (8 * i);
+    }
+    return v;
+}
+
+// xz 的变长整数, 每字节7位, 最多9字节
+static bool read_varint(const uint8_t *p, const uint8_t *end, const uint8_t **next, uint64_t *value){
+    uint64_t v = 0;
+    for (size_t i = 0; i < 9 && p + i < end; i++) {
+        v |= (uint64_t) (p[i] & 0x7f) << (7 * i);
+        if ((p[i] & 0x80) == 0) {
+            if (i > 0 && p[i] == 0) {
+                return false;
+            }
+            *next = p + i + 1;
+            *value = v;
+            return true;
+        }
+    }
+    return false;
+}
+
+// LZMA 的 range decoder, 每个 LZMA2 chunk 重新初始化
+struct RangeDecoder {
+    const uint8_t *in;
+    const uint8_t *end;
+    uint32_t range;
+    uint32_t code;
+    bool overrun;
+
+    bool init(const uint8_t *p, const uint8_t *e){
+        if (e - p < 5 || p[0] != 0) {
+            return false;
+        }
+        range = 0xffffffff;
+        code = (uint32_t) p[1] << 24 | (uint32_t) p[2] << 16 | (uint32_t) p[3] << 8 | p[4];
+        in = p + 5;
+        end = e;
+        overrun = false;
+        return true;
+    }
+
+    void normalize(){
+        if (range < (1u << 24)) {
+            range <<= 8;
+            if (in < end) {
+                code = (code << 8) | *in++;
+            } else {
+                code <<= 8;
+                overrun = true;
+            }
+        }
+    }
+
+    uint32_t bit(uint16_t *prob){
+        normalize();
+        uint32_t bound = (range >> 11) * *prob;
+        if (code < bound) {
+            range = bound;
+            *prob += (2048 - *prob) >> 5;
+            return 0;
+        }
+        range -= bound;
+        code -= bound;
+        *prob -= *prob >> 5;
+        return 1;
+    }
+
+    // 高位在前的 bits 位, probs 从下标1开始用
+    uint32_t tree(uint16_t *probs, int bits){
+        uint32_t m = 1;
+        for (int i = 0; i < bits; i++) {
+            m = (m << 1) | bit(&probs[m]);
+        }
+        return m - (1u << bits);
+    }
+
+    // 低位在前
+    uint32_t reverse(uint16_t *probs, int bits){
+        uint32_t m = 1, result = 0;
+        for (int i = 0; i < bits; i++) {
+            uint32_t b = bit(&probs[m]);
+            m = (m << 1) | b;
+            result |= b << i;
+        }
+        return result;
+    }
+
+    // 概率固定为1/2的位
+    uint32_t direct(int bits){
+        uint32_t result = 0;
+        for (int i = 0; i < bits; i++) {
+            normalize();
+            range >>= 1;
+            code -= range;
+            uint32_t mask = 0u - (code >> 31);
+            code += range & mask;
+            result = (result << 1) + (mask + 1);
+        }
+        return result;
+    }
+};
+
+struct LenProbs {
+    uint16_t choice;
+    uint16_t choice2;
+    uint16_t low[16][8];
+    uint16_t mid[16][8];
+    uint16_t high[256];
+};
+
+static constexpr int kStates = 12;
+static constexpr uint32_t kMatchMinLen = 2;
+
+// 一个 LZMA2 block 的解码状态, 输出直接写在 out 里, out 本身就是字典
+struct LzmaDecoder {
+    uint16_t is_match[kStates][16];
+    uint16_t is_rep[kStates];
+    uint16_t is_rep0[kStates];
+    uint16_t is_rep1[kStates];
+    uint16_t is_rep2[kStates];
+    uint16_t is_rep0_long[kStates][16];
+    uint16_t dist_slot[4][64];
+    uint16_t dist_special[114];
+    uint16_t dist_align[16];
+    LenProbs match_len;
+    LenProbs rep_len;
+    // LZMA2 限制 lc + lp <= 4
+    uint16_t literal[0x300 << 4];
+
+    uint32_t lc, lp, lp_mask, pb_mask;
+    uint32_t state;
+    uint32_t rep0, rep1, rep2, rep3;
+    RangeDecoder rc;
+
+    void reset_state(){
+        uint16_t *begin = &is_match[0][0];
+        uint16_t *end = literal + (0x300u << (lc + lp));
+        for (uint16_t *p = begin; p < end; p++) {
+            *p = 1024;
+        }
+        state = 0;
+        rep0 = rep1 = rep2 = rep3 = 0;
+    }
+
+    bool set_props(uint8_t props){
+        if (props >= 9 * 5 * 5) {
+            return false;
+        }
+        lc = props % 9;
+        props /= 9;
+        lp = props % 5;
+        uint32_t pb = props / 5;
+        if (lc + lp > 4) {
+            return false;
+        }
+        lp_mask = (1u << lp) - 1;
+        pb_mask = (1u << pb) - 1;
+        return true;
+    }
+
+    uint32_t decode_len(LenProbs &l, uint32_t pos_state){
+        if (!rc.bit(&l.choice)) {
+            return kMatchMinLen + rc.tree(l.low[pos_state], 3);
+        }
+        if (!rc.bit(&l.choice2)) {
+            return kMatchMinLen + 8 + rc.tree(l.mid[pos_state], 3);
+        }
+        return kMatchMinLen + 16 + rc.tree(l.high, 8);
+    }
+
+    uint32_t decode_dist(uint32_t len){
+        uint32_t len_state = len - kMatchMinLen < 3 ? len - kMatchMinLen : 3;
+        uint32_t slot = rc.tree(dist_slot[len_state], 6);
+        if (slot < 4) {
+            return slot;
+        }
+        int bits = (slot >> 1) - 1;
+        uint32_t dist = (2 | (slot & 1)) << bits;
+        if (slot < 14) {
+            return dist + rc.reverse(dist_special + dist - slot - 1, bits);
+        }
+        dist += rc.direct(bits - 4) << 4;
+        return dist + rc.reverse(dist_align, 4);
+    }
+
+    // 解出 out[pos, chunk_end), dict_start 是最近一次字典重置的位置
+    bool decode(uint8_t *out, size_t dict_start, size_t pos, size_t chunk_end){
+        while (pos < chunk_end) {
+            size_t dict_pos = pos - dict_start;
+            uint32_t pos_state = dict_pos & pb_mask;
+            if (!rc.bit(&is_match[state][pos_state])) {
+                uint32_t prev = dict_pos > 0 ? out[pos - 1] : 0;
+                uint16_t *probs = literal + 0x300 * (((dict_pos & lp_mask) << lc) + (prev >> (8 - lc)));
+                uint32_t symbol = 1;
+                if (state < 7) {
+                    symbol = rc.tree(probs, 8) | 0x100;
+                } else {
+                    if (rep0 >= dict_pos) {
+                        return false;
+                    }
+                    uint32_t match_byte = (uint32_t) out[pos - rep0 - 1] << 1;
+                    uint32_t offset = 0x100;
+                    do {
+                        uint32_t match_bit = match_byte & offset;
+                        match_byte <<= 1;
+                        if (rc.bit(&probs[offset + match_bit + symbol])) {
+                            symbol = (symbol << 1) | 1;
+                            offset = match_bit;
+                        } else {
+                            symbol <<= 1;
+                            offset &= ~match_bit;
+                        }
+                    } while (symbol < 0x100);
+                }
+                out[pos++] = (uint8_t) symbol;
+                state = state < 4 ? 0 : (state < 10 ? state - 3 : state - 6);
+                continue;
+            }
+            uint32_t len;
+            if (rc.bit(&is_rep[state])) {
+                if (dict_pos == 0) {
+                    return false;
+                }
+                if (!rc.bit(&is_rep0[state])) {
+                    if (!rc.bit(&is_rep0_long[state][pos_state])) {
+                        // short rep: 只重复一个字节
+                        if (rep0 >= dict_pos) {
+                            return false;
+                        }
+                        state = state < 7 ? 9 : 11;
+                        out[pos] = out[pos - rep0 - 1];
+                        pos++;
+                        continue;
+                    }
+                } else {
+                    uint32_t dist;
+                    if (!rc.bit(&is_rep1[state])) {
+                        dist = rep1;
+                    } else {
+                        if (!rc.bit(&is_rep2[state])) {
+                            dist = rep2;
+                        } else {
+                            dist = rep3;
+                            rep3 = rep2;
+                        }
+                        rep2 = rep1;
+                    }
+                    rep1 = rep0;
+                    rep0 = dist;
+                }
+                state = state < 7 ? 8 : 11;
+                len = decode_len(rep_len, pos_state);
+            } else {
+                rep3 = rep2;
+                rep2 = rep1;
+                rep1 = rep0;
+                len = decode_len(match_len, pos_state);
+                state = state < 7 ? 7 : 10;
+                rep0 = decode_dist(len);
+                // LZMA2 里不会有结束标记(距离全1), 出现了也当作坏数据
+            }
+            if (rep0 >= dict_pos || len > chunk_end - pos) {
+                return false;
+            }
+            const uint8_t *src = out + pos - rep0 - 1;
+            for (uint32_t i = 0; i < len; i++) {
+                out[pos + i] = src[i];
+            }
+            pos += len;
+        }
+        return !rc.overrun;
+    }
+};
+
+// 解一个 block 的 LZMA2 数据, 输出追加到 out, consumed 是用掉的输入长度
+static bool lzma2_decode(const uint8_t *in, size_t in_size, std::vector<uint8_t> *out, size_t max_size,
+                         size_t *consumed){
+    auto lzma = std::make_unique<LzmaDecoder>();
+    const uint8_t *p = in;
+    const uint8_t *end = in + in_size;
+    size_t dict_start = out->size();
+    bool need_dict_reset = true;
+    bool need_props = true;
+    bool need_state_reset = true;
+    while (true) {
+        if (p >= end) {
+            return false;
+        }
+        uint8_t control = *p++;
+        if (control == 0x00) {
+            break;
+        }
+        if (control >= 0x03 && control < 0x80) {
+            return false;
+        }
+        if (control == 0x01 || control >= 0xe0) {
+            dict_start = out->size();
+            need_dict_reset = false;
+        } else if (need_dict_reset) {
+            return false;
+        }
+        if (control < 0x80) {
+            // 不压缩的 chunk, 之后的 LZMA chunk 至少要重置状态
+            if (end - p < 2) {
+                return false;
+            }
+            size_t size = ((size_t) p[0] << 8 | p[1]) + 1;
+            p += 2;
+            if ((size_t) (end - p) < size || out->size() + size > max_size) {
+                return false;
+            }
+            out->insert(out->end(), p, p + size);
+            p += size;
+            need_state_reset = true;
+            continue;
+        }
+        if (end - p < 4) {
+            return false;
+        }
+        size_t unpacked = ((size_t) (control & 0x1f) << 16 | (size_t) p[0] << 8 | p[1]) + 1;
+        size_t packed = ((size_t) p[2] << 8 | p[3]) + 1;
+        p += 4;
+        uint32_t reset = (control >> 5) & 3;
+        if (reset >= 2) {
+            if (p >= end || !lzma->set_props(*p++)) {
+                return false;
+            }
+            need_props = false;
+        } else if (need_props) {
+            return false;
+        }
+        if (reset >= 1) {
+            lzma->reset_state();
+            need_state_reset = false;
+        } else if (need_state_reset) {
+            return false;
+        }
+        if ((size_t) (end - p) < packed || out->size() + unpacked > max_size || !lzma->rc.init(p, p + packed)) {
+            return false;
+        }
+        size_t pos = out->size();
+        out->resize(pos + unpacked);
+        if (!lzma->decode(out->data(), dict_start, pos, pos + unpacked)) {
+            return false;
+        }
+        p += packed;
+    }
+    *consumed = p - in;
+    return true;
+}
+
+bool xz_decompress(const uint8_t *data, size_t size, std::vector<uint8_t> *out, size_t max_size){
+    out->clear();
+    if (size < kStreamHeaderSize || memcmp(data, kXzMagic, sizeof(kXzMagic)) != 0 || data[6] != 0 ||
+        (data[7] & 0xf0) != 0 || crc32(data + 6, 2) != read_le(data + 8, 4)) {
+        LOGE("invalid xz stream header");
+        return false;
+    }
+    uint8_t check = data[7];
+    size_t pos = kStreamHeaderSize;
+    // block 一个接一个, 遇到 index(第一个字节是0)就结束
+    while (pos < size && data[pos] != 0) {
+        size_t header_size = ((size_t) data[pos] + 1) * 4;
+        if (size - pos < header_size || crc32(data + pos, header_size - 4) != read_le(data + pos + header_size - 4, 4)) {
+            LOGE("invalid xz block header at %zu", pos);
+            return false;
+        }
+        const uint8_t *h = data + pos + 2;
+        const uint8_t *h_end = data + pos + header_size - 4;
+        uint8_t flags = data[pos + 1];
+        uint64_t compressed = 0, uncompressed = 0, filter_id = 0, props_size = 0;
+        if ((flags & 0x3c) != 0 || (flags & 3) != 0 ||
+            ((flags & 0x40) && !read_varint(h, h_end, &h, &compressed)) ||
+            ((flags & 0x80) && !read_varint(h, h_end, &h, &uncompressed)) ||
+            !read_varint(h, h_end, &h, &filter_id) || !read_varint(h, h_end, &h, &props_size)) {
+            LOGE("unsupported xz block flags %x", flags);
+            return false;
+        }
+        if (filter_id != kLzma2FilterId || props_size != 1 || h >= h_end || *h > 40) {
+            LOGE("unsupported xz filter %llx", (unsigned long long) filter_id);
+            return false;
+        }
+        size_t block_start = out->size();
+        size_t consumed;
+        pos += header_size;
+        if (!lzma2_decode(data + pos, size - pos, out, max_size, &consumed)) {
+            LOGE("corrupt lzma2 data in xz block at %zu", pos);
+            return false;
+        }
+        size_t produced = out->size() - block_start;
+        if (((flags & 0x40) && compressed != consumed) || ((flags & 0x80) && uncompressed != produced)) {
+            LOGE("xz block size mismatch");
+            return false;
+        }
+        pos += consumed;
+        // block 补齐到4字节, 然后是校验值
+        while ((pos & 3) != 0) {
+            if (pos >= size || data[pos] != 0) {
+                return false;
+            }
+            pos++;
+        }
+        size_t check_size = kCheckSizes[check];
+        if (size - pos < check_size) {
+            return false;
+        }
+        const uint8_t *block_out = out->data() + block_start;
+        if ((check == kCheckCrc32 && crc32(block_out, produced) != read_le(data + pos, 4)) ||
+            (check == kCheckCrc64 && crc64(block_out, produced) != read_le(data + pos, 8))) {
+            LOGE("xz block check mismatch");
+            return false;
+        }
+        pos += check_size;
+    }
+    return pos < size;
+}
@@ -0,0 +1,15 @@
+//
+// Created by chic on 2025/7/10.
+//
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * 把一个 .xz 流整个解压到 out 里, 用来读 .gnu_debugdata(MiniDebugInfo), 不依赖 liblzma
+ * 只支持 MiniDebugInfo 实际用到的格式: 每个 block 只有一个 LZMA2 过滤器, 多个 block 依次接在后面
+ * stream/block 头的 CRC32 和 block 的 CRC32/CRC64 都会校验, 解压后超过 max_size 当作失败
+ */
+bool xz_decompress(const uint8_t *data, size_t size, std::vector<uint8_t> *out, size_t max_size);
@@ -4,6 +4,7 @@
 
 #include <android/log.h>
 #include "lsplt.hpp"
+#include "proc_maps.h"
 #include <cinttypes>
 #include <sys/sysmacros.h>
 #include <asm-generic/mman.h>
@@ -15,73 +16,6 @@
 #define LOGE(...) __android_log_print(ANDROID_LOG_ERROR,LOG_TAG,__VA_ARGS__)
 
 
-struct MapInfo {
-    /// \brief The start address of the memory region.
-    uintptr_t start;
-    /// \brief The end address of the memory region.
-    uintptr_t end;
-    /// \brief The permissions of the memory region. This is a bit mask of the following values:
-    /// - PROT_READ
-    /// - PROT_WRITE
-    /// - PROT_EXEC
-    uint8_t perms;
-    /// \brief Whether the memory region is private.
-    bool is_private;
-    /// \brief The offset of the memory region.
-    uintptr_t offset;
-    /// \brief The device number of the memory region.
-    /// Major can be obtained by #major()
-    /// Minor can be obtained by #minor()
-    dev_t dev;
-    /// \brief The inode number of the memory region.
-    ino_t inode;
-    /// \brief The path of the memory region.
-    std::string path;
-
-
-};
-
-
-std::vector<MapInfo> Scan(pid_t pid) {
-    constexpr static auto kPermLength = 5;
-    constexpr static auto kMapEntry = 7;
-    std::vector<MapInfo> info;
-    auto path = "/proc/" + std::to_string(pid) + "/maps";
-    auto maps = std::unique_ptr<FILE, decltype(&fclose)>{fopen(path.c_str(), "r"), &fclose};
-    if (maps) {
-        char *line = nullptr;
-        size_t len = 0;
-        ssize_t read;
-        while ((read = getline(&line, &len, maps.get())) > 0) {
-            line[read - 1] = '\0';
-            uintptr_t start = 0;
-            uintptr_t end = 0;
-            uintptr_t off = 0;
-            ino_t inode = 0;
-            unsigned int dev_major = 0;
-            unsigned int dev_minor = 0;
-            std::array<char, kPermLength> perm{'\0'};
-            int path_off;
-            if (sscanf(line, "%" PRIxPTR "-%" PRIxPTR " %4s %" PRIxPTR " %x:%x %lu %n%*s", &start,
-                    &end, perm.data(), &off, &dev_major, &dev_minor, &inode,
-                    &path_off) != kMapEntry) {
-                continue;
-            }
-            while (path_off < read && isspace(line[path_off])) path_off++;
-            auto ref = MapInfo{start, end, 0, perm[3] == 'p', off,
-                               static_cast<dev_t>(makedev(dev_major, dev_minor)),
-                               inode, line + path_off};
-            if (perm[0] == 'r') ref.perms |= PROT_READ;
-            if (perm[1] == 'w') ref.perms |= PROT_WRITE;
-            if (perm[2] == 'x') ref.perms |= PROT_EXEC;
-            info.emplace_back(ref);
-        }
-        free(line);
-    }
-    return info;
-}
-
-
 char * replace_drm;
 int length = -1;
 void * (* old_getDeviceUniqueId)(void * arg1,intptr_t * drmid);
@@ -118,7 +52,9 @@ void DrmIdHook(void* handle, const char* AUTHORITY) {
     memcpy(replace_drm,memory.data(),length);
     ino_t art_inode = 0;
     dev_t art_dev = 0;
-    for (auto &map : Scan(getpid())) {
+    ProcMaps maps;
+    maps.scan(-1);
+    for (auto &map : maps) {
         if (map.path.find("libwvhidl.so") != std::string_view::npos) {
             LOGE("found libwvhidl\n");
 
@@ -12,6 +12,7 @@
 
 #include "elf_util.hpp"
 #include "logging.hpp"
+#include "proc_maps.h"
 #include "syscall.hpp"
 
 namespace {
@@ -204,38 +205,14 @@ HookInfos hook_info;
 namespace lsplt {
 inline namespace v2 {
 [[maybe_unused]] std::vector<MapInfo> MapInfo::Scan() {
-    constexpr static auto kPermLength = 5;
-    constexpr static auto kMapEntry = 7;
     std::vector<MapInfo> info;
-    auto maps = std::unique_ptr<FILE, decltype(&fclose)>{fopen("/proc/self/maps", "r"), &fclose};
-    if (maps) {
-        char *line = nullptr;
-        size_t len = 0;
-        ssize_t read;
-        while ((read = getline(&line, &len, maps.get())) > 0) {
-            line[read - 1] = '\0';
-            uintptr_t start = 0;
-            uintptr_t end = 0;
-            uintptr_t off = 0;
-            ino_t inode = 0;
-            unsigned int dev_major = 0;
-            unsigned int dev_minor = 0;
-            std::array<char, kPermLength> perm{'\0'};
-            int path_off;
-            if (sscanf(line, "%" PRIxPTR "-%" PRIxPTR " %4s %" PRIxPTR " %x:%x %lu %n%*s", &start,
-                       &end, perm.data(), &off, &dev_major, &dev_minor, &inode,
-                       &path_off) != kMapEntry) {
-                continue;
-            }
-            while (path_off < read && isspace(line[path_off])) path_off++;
-            auto &ref = info.emplace_back(MapInfo{start, end, 0, perm[3] == 'p', off,
-                                                  static_cast<dev_t>(makedev(dev_major, dev_minor)),
-                                                  inode, line + path_off});
-            if (perm[0] == 'r') ref.perms |= PROT_READ;
-            if (perm[1] == 'w') ref.perms |= PROT_WRITE;
-            if (perm[2] == 'x') ref.perms |= PROT_EXEC;
+    ProcMaps maps;
+    if (maps.scan(-1)) {
+        info.reserve(maps.size());
+        for (const auto &map : maps) {
+            info.emplace_back(MapInfo{map.start, map.end, map.perms, map.is_private, map.offset,
+                                      map.dev, map.inode, std::string{map.path}});
         }
-        free(line);
     }
     return info;
 }
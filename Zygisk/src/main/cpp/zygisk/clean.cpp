@@ -46,8 +46,6 @@ namespace SoList {
 
 bool initialize() {
     SandHook::ElfImg linker("/linker");
-    if (!ProtectedDataGuard::setup(linker)) return false;
-    LOGD("found symbol ProtectedDataGuard");
 
     std::string_view solist_sym_name = linker.findSymbolNameByPrefix("__dl__ZL6solist");
     if (solist_sym_name.empty()) return false;
@@ -75,39 +73,61 @@ bool initialize() {
     char vdso_sym_name[sizeof("__dl__ZL4vdso") + sizeof(llvm_sufix)];
     snprintf(vdso_sym_name, sizeof(vdso_sym_name), "__dl__ZL4vdso%s", llvm_sufix);
 
-    somain = getStaticPointer<SoInfo>(linker, somain_sym_name);
+    // Resolve everything in one go, symtab is scanned once for all of them.
+    // The names found by prefix point into the mapped strtab, so they are NUL-terminated too
+    enum {
+        kGuardCtor, kGuardDtor, kSomain, kSonext, kVdso, kGetRealpath, kSoinfoFree,
+        kLoadCounter, kUnloadCounter, kSolist, kSymbolCount
+    };
+    const char *const names[kSymbolCount] = {
+        "__dl__ZN18ProtectedDataGuardC2Ev",
+        "__dl__ZN18ProtectedDataGuardD2Ev",
+        somain_sym_name,
+        sonext_sym_name,
+        vdso_sym_name,
+        "__dl__ZNK6soinfo12get_realpathEv",
+        soinfo_free_name.data(),
+        "__dl__ZL21g_module_load_counter",
+        "__dl__ZL23g_module_unload_counter",
+        solist_sym_name.data(),
+    };
+    ElfW(Addr) addresses[kSymbolCount];
+    linker.resolve(names, addresses);
+
+    if (!ProtectedDataGuard::setup(addresses[kGuardCtor], addresses[kGuardDtor])) return false;
+    LOGD("found symbol ProtectedDataGuard");
+
+    somain = getStaticPointer<SoInfo>(addresses[kSomain]);
     if (somain == nullptr) return false;
     LOGD("found symbol somain");
 
-    sonext = linker.getSymbAddress<SoInfo **>(sonext_sym_name);
+    sonext = reinterpret_cast<SoInfo **>(addresses[kSonext]);
     if (sonext == nullptr) return false;
     LOGD("found symbol sonext");
 
-    auto *vdso = getStaticPointer<SoInfo>(linker, vdso_sym_name);
+    auto *vdso = getStaticPointer<SoInfo>(addresses[kVdso]);
     if (vdso != nullptr) LOGD("found symbol vdso");
 
-    SoInfo::get_realpath_sym = reinterpret_cast<decltype(SoInfo::get_realpath_sym)>(
-        linker.getSymbAddress("__dl__ZNK6soinfo12get_realpathEv"));
+    SoInfo::get_realpath_sym =
+        reinterpret_cast<decltype(SoInfo::get_realpath_sym)>(addresses[kGetRealpath]);
     if (SoInfo::get_realpath_sym != nullptr) LOGD("found symbol get_realpath_sym");
 
 //    SoInfo::get_soname = reinterpret_cast<decltype(SoInfo::get_soname)>(
 //            linker.getSymbAddress("__dl__ZNK6soinfo10get_sonameEv"));
 //    if (SoInfo::get_soname != nullptr) LOGD("found symbol get_soname");
 
-    SoInfo::soinfo_free =
-        reinterpret_cast<decltype(SoInfo::soinfo_free)>(linker.getSymbAddress(soinfo_free_name));
+    SoInfo::soinfo_free = reinterpret_cast<decltype(SoInfo::soinfo_free)>(addresses[kSoinfoFree]);
     if (SoInfo::soinfo_free == nullptr) return false;
     LOGD("found symbol soinfo_free");
 
-    g_module_load_counter = reinterpret_cast<decltype(g_module_load_counter)>(
-        linker.getSymbAddress("__dl__ZL21g_module_load_counter"));
+    g_module_load_counter = reinterpret_cast<decltype(g_module_load_counter)>(addresses[kLoadCounter]);
     if (g_module_load_counter != nullptr) LOGD("found symbol g_module_load_counter");
 
-    g_module_unload_counter = reinterpret_cast<decltype(g_module_unload_counter)>(
-        linker.getSymbAddress("__dl__ZL23g_module_unload_counter"));
+    g_module_unload_counter =
+        reinterpret_cast<decltype(g_module_unload_counter)>(addresses[kUnloadCounter]);
     if (g_module_unload_counter != nullptr) LOGD("found symbol g_module_unload_counter");
 
-    solist = getStaticPointer<SoInfo>(linker, solist_sym_name.data());
+    solist = getStaticPointer<SoInfo>(addresses[kSolist]);
     if (solist == nullptr) return false;
     LOGD("found symbol solist");
 
@@ -20,7 +20,6 @@
 #include "elf_util.hpp"
 
 #include <fcntl.h>
-#include <malloc.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <unistd.h>
@@ -30,11 +29,13 @@
 
 using namespace SandHook;
 
-template <typename T>
-inline constexpr auto offsetOf(ElfW(Ehdr) * head, ElfW(Off) off) {
-    return reinterpret_cast<std::conditional_t<std::is_pointer_v<T>, T, T *>>(
-        reinterpret_cast<uintptr_t>(head) + off);
+namespace {
+// name is exactly the NUL terminated string at offset off of a string table of strings_size bytes
+inline bool NameIs(const char *strings, ElfW(Off) strings_size, ElfW(Word) off, std::string_view name) {
+    return off < strings_size && name.size() < strings_size - off &&
+           memcmp(strings + off, name.data(), name.size()) == 0 && strings[off + name.size()] == '\0';
 }
+}  // namespace
 
 ElfImg::ElfImg(std::string_view base_name) : elf(base_name) {
     if (!findModuleBase()) {
@@ -52,127 +53,123 @@ ElfImg::ElfImg(std::string_view base_name) : elf(base_name) {
     size = lseek(fd, 0, SEEK_END);
     if (size <= 0) {
         // LOGE("lseek() failed for %s", elf.data());
+        close(fd);
+        return;
     }
 
-    header = reinterpret_cast<decltype(header)>(mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0));
-
+    void *map = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
     close(fd);
+    if (map == MAP_FAILED) {
+        return;
+    }
+    header = static_cast<uint8_t *>(map);
+    if (!image.open(header, size)) {
+        return;
+    }
 
-    section_header = offsetOf<decltype(section_header)>(header, header->e_shoff);
-
-    auto shoff = reinterpret_cast<uintptr_t>(section_header);
-    char *section_str = offsetOf<char *>(header, section_header[header->e_shstrndx].sh_offset);
-
-    for (int i = 0; i < header->e_shnum; i++, shoff += header->e_shentsize) {
-        auto *section_h = (ElfW(Shdr) *) shoff;
-        char *sname = section_h->sh_name + section_str;
-        auto entsize = section_h->sh_entsize;
-        switch (section_h->sh_type) {
+    // Bounds of every section and string table are checked by ElfFileImage before use
+    bool seen_strtab = false;
+    for (size_t i = 0; i < image.section_count(); i++) {
+        const auto &section = image.section(i);
+        switch (section.sh_type) {
         case SHT_DYNSYM: {
-            if (bias == -4396) {
-                dynsym = section_h;
-                dynsym_offset = section_h->sh_offset;
-                dynsym_start = offsetOf<decltype(dynsym_start)>(header, dynsym_offset);
+            if (bias != -4396 || section.sh_link >= image.section_count()) break;
+            const auto &str = image.section(section.sh_link);
+            if (!image.contains(section.sh_offset, section.sh_size) ||
+                !image.contains(str.sh_offset, str.sh_size)) {
+                break;
             }
+            dynsym_start = reinterpret_cast<const ElfW(Sym) *>(image.at(section.sh_offset));
+            dynsym_count = section.sh_size / sizeof(ElfW(Sym));
+            dynstr = reinterpret_cast<const char *>(image.at(str.sh_offset));
+            dynstr_size = str.sh_size;
             break;
         }
-        case SHT_SYMTAB: {
-            if (strcmp(sname, ".symtab") == 0) {
-                symtab = section_h;
-                symtab_offset = section_h->sh_offset;
-                symtab_size = section_h->sh_size;
-                symtab_count = symtab_size / entsize;
-                symtab_start = offsetOf<decltype(symtab_start)>(header, symtab_offset);
-            }
+        case SHT_STRTAB:
+            seen_strtab = true;
             break;
-        }
-        case SHT_STRTAB: {
-            if (bias == -4396) {
-                strtab = section_h;
-                symstr_offset = section_h->sh_offset;
-                strtab_start = offsetOf<decltype(strtab_start)>(header, symstr_offset);
-            }
-            if (strcmp(sname, ".strtab") == 0) {
-                symstr_offset_for_symtab = section_h->sh_offset;
-            }
-            break;
-        }
         case SHT_PROGBITS: {
-            if (strtab == nullptr || dynsym == nullptr) break;
+            // load bias of the file, taken from the first PROGBITS after the dynamic symbols
+            if (!seen_strtab || dynsym_start == nullptr) break;
             if (bias == -4396) {
-                bias = (off_t) section_h->sh_addr - (off_t) section_h->sh_offset;
+                bias = (off_t) section.sh_addr - (off_t) section.sh_offset;
             }
             break;
         }
         case SHT_HASH: {
-            auto *d_un = offsetOf<ElfW(Word)>(header, section_h->sh_offset);
-            nbucket_ = d_un[0];
-            bucket_ = d_un + 2;
-            chain_ = bucket_ + nbucket_;
+            if (!has_sysv && image.contains(section.sh_offset, section.sh_size)) {
+                has_sysv = sysv.init(image.at(section.sh_offset));
+            }
             break;
         }
         case SHT_GNU_HASH: {
-            auto *d_buf = reinterpret_cast<ElfW(Word) *>(((size_t) header) + section_h->sh_offset);
-            gnu_nbucket_ = d_buf[0];
-            gnu_symndx_ = d_buf[1];
-            gnu_bloom_size_ = d_buf[2];
-            gnu_shift2_ = d_buf[3];
-            gnu_bloom_filter_ = reinterpret_cast<decltype(gnu_bloom_filter_)>(d_buf + 4);
-            gnu_bucket_ =
-                reinterpret_cast<decltype(gnu_bucket_)>(gnu_bloom_filter_ + gnu_bloom_size_);
-            gnu_chain_ = gnu_bucket_ + gnu_nbucket_ - gnu_symndx_;
+            if (!has_gnu && image.contains(section.sh_offset, section.sh_size)) {
+                has_gnu = gnu.init(image.at(section.sh_offset));
+            }
             break;
         }
         }
     }
+    if (has_gnu && dynsym_count > gnu.symoffset) {
+        gnu.nchains = dynsym_count - gnu.symoffset;
+    }
+
+    if (const auto *section = image.find_section(".symtab", SHT_SYMTAB);
+        section != nullptr && section->sh_link < image.section_count()) {
+        const auto &str = image.section(section->sh_link);
+        if (image.contains(str.sh_offset, str.sh_size)) {
+            symtab_start = reinterpret_cast<const ElfW(Sym) *>(image.at(section->sh_offset));
+            symtab_count = section->sh_size / sizeof(ElfW(Sym));
+            strtab = reinterpret_cast<const char *>(image.at(str.sh_offset));
+            strtab_size = str.sh_size;
+        }
+    }
 }
 
 ElfW(Addr) ElfImg::ElfLookup(std::string_view name, uint32_t hash) const {
-    if (nbucket_ == 0) return 0;
-
-    char *strings = (char *) strtab_start;
+    if (!has_sysv || dynsym_start == nullptr) return 0;
 
-    for (auto n = bucket_[hash % nbucket_]; n != 0; n = chain_[n]) {
-        auto *sym = dynsym_start + n;
-        if (name == strings + sym->st_name) {
-            return sym->st_value;
+    ElfW(Addr) result = 0;
+    sysv.for_each_candidate(hash, [&](uint32_t n) {
+        if (n < dynsym_count && NameIs(dynstr, dynstr_size, dynsym_start[n].st_name, name)) {
+            result = dynsym_start[n].st_value;
+            return true;
         }
-    }
-    return 0;
+        return false;
+    });
+    return result;
 }
 
 ElfW(Addr) ElfImg::GnuLookup(std::string_view name, uint32_t hash) const {
-    static constexpr auto bloom_mask_bits = sizeof(ElfW(Addr)) * 8;
-
-    if (gnu_nbucket_ == 0 || gnu_bloom_size_ == 0) return 0;
+    if (!has_gnu || dynsym_start == nullptr) return 0;
 
-    auto bloom_word = gnu_bloom_filter_[(hash / bloom_mask_bits) % gnu_bloom_size_];
-    uintptr_t mask = 0 | (uintptr_t) 1 << (hash % bloom_mask_bits) |
-                     (uintptr_t) 1 << ((hash >> gnu_shift2_) % bloom_mask_bits);
-    if ((mask & bloom_word) == mask) {
-        auto sym_index = gnu_bucket_[hash % gnu_nbucket_];
-        if (sym_index >= gnu_symndx_) {
-            char *strings = (char *) strtab_start;
-            do {
-                auto *sym = dynsym_start + sym_index;
-                if (((gnu_chain_[sym_index] ^ hash) >> 1) == 0 && name == strings + sym->st_name) {
-                    return sym->st_value;
-                }
-            } while ((gnu_chain_[sym_index++] & 1) == 0);
+    ElfW(Addr) result = 0;
+    gnu.for_each_candidate(hash, [&](uint32_t n) {
+        if (n < dynsym_count && NameIs(dynstr, dynstr_size, dynsym_start[n].st_name, name)) {
+            result = dynsym_start[n].st_value;
+            return true;
         }
+        return false;
+    });
+    return result;
+}
+
+const char *ElfImg::SymtabName(ElfW(Off) index) const {
+    const auto &sym = symtab_start[index];
+    unsigned int st_type = ELF_ST_TYPE(sym.st_info);
+    if ((st_type == STT_FUNC || st_type == STT_OBJECT) && sym.st_size && sym.st_name < strtab_size &&
+        memchr(strtab + sym.st_name, '\0', strtab_size - sym.st_name) != nullptr) {
+        return strtab + sym.st_name;
     }
-    return 0;
+    return nullptr;
 }
 
 ElfW(Addr) ElfImg::LinearLookup(std::string_view name) const {
     if (symtabs_.empty()) {
         symtabs_.reserve(symtab_count);
-        if (symtab_start != nullptr && symstr_offset_for_symtab != 0) {
+        if (symtab_start != nullptr) {
             for (ElfW(Off) i = 0; i < symtab_count; i++) {
-                unsigned int st_type = ELF_ST_TYPE(symtab_start[i].st_info);
-                const char *st_name = offsetOf<const char *>(
-                    header, symstr_offset_for_symtab + symtab_start[i].st_name);
-                if ((st_type == STT_FUNC || st_type == STT_OBJECT) && symtab_start[i].st_size) {
+                if (const char *st_name = SymtabName(i); st_name != nullptr) {
                     symtabs_.emplace(st_name, &symtab_start[i]);
                 }
             }
@@ -187,39 +184,65 @@ ElfW(Addr) ElfImg::LinearLookup(std::string_view name) const {
 }
 
 std::string_view ElfImg::LinearLookupByPrefix(std::string_view name) const {
-    if (symtabs_.empty()) {
-        symtabs_.reserve(symtab_count);
-        if (symtab_start != nullptr && symstr_offset_for_symtab != 0) {
-            for (ElfW(Off) i = 0; i < symtab_count; i++) {
-                unsigned int st_type = ELF_ST_TYPE(symtab_start[i].st_info);
-                const char *st_name = offsetOf<const char *>(
-                    header, symstr_offset_for_symtab + symtab_start[i].st_name);
-                if ((st_type == STT_FUNC || st_type == STT_OBJECT) && symtab_start[i].st_size) {
-                    symtabs_.emplace(st_name, &symtab_start[i]);
-                }
-            }
+    // Scan symtab in place: hashing every name into symtabs_ costs far more than
+    // the few prefix queries made against a library
+    if (symtab_start == nullptr) return "";
+
+    for (ElfW(Off) i = 0; i < symtab_count; i++) {
+        const char *st_name = SymtabName(i);
+        if (st_name != nullptr && strncmp(st_name, name.data(), name.size()) == 0) {
+            return st_name;
         }
     }
 
-    auto size = name.size();
-    for (auto symtab : symtabs_) {
-        if (symtab.first.size() < size) continue;
+    return "";
+}
+
+size_t ElfImg::resolve(std::span<const char *const> names, ElfW(Addr) *addresses) const {
+    // All GNU hashes in one go with the hash implementation picked for this CPU
+    std::vector<uint32_t> hashes(has_gnu ? names.size() : 0);
+    if (has_gnu) gnu_hash_batch(names.data(), hashes.data(), names.size());
 
-        if (symtab.first.substr(0, size) == name) {
-            return symtab.first;
+    std::vector<size_t> pending;
+    for (size_t i = 0; i < names.size(); i++) {
+        ElfW(Addr) offset = has_gnu ? GnuLookup(names[i], hashes[i]) : 0;
+        if (offset == 0 && has_sysv) offset = ElfLookup(names[i], elf_hash(names[i]));
+        if (offset == 0 && !symtabs_.empty()) offset = LinearLookup(names[i]);
+        addresses[i] = offset;
+        if (offset == 0) pending.push_back(i);
+    }
+
+    // Names only in symtab are all matched in a single scan instead of building symtabs_,
+    // the first definition of a name wins as in LinearLookup
+    if (!pending.empty() && symtab_start != nullptr) {
+        for (ElfW(Off) i = 0; i < symtab_count && !pending.empty(); i++) {
+            const char *st_name = SymtabName(i);
+            if (st_name == nullptr) continue;
+            for (size_t p = 0; p < pending.size();) {
+                if (strcmp(names[pending[p]], st_name) == 0) {
+                    addresses[pending[p]] = symtab_start[i].st_value;
+                    pending[p] = pending.back();
+                    pending.pop_back();
+                } else {
+                    p++;
+                }
+            }
         }
     }
 
-    return "";
+    size_t found = 0;
+    for (size_t i = 0; i < names.size(); i++) {
+        if (addresses[i] > 0 && base != nullptr) {
+            addresses[i] = static_cast<ElfW(Addr)>((uintptr_t) base + addresses[i] - bias);
+            found++;
+        } else {
+            addresses[i] = 0;
+        }
+    }
+    return found;
 }
 
 ElfImg::~ElfImg() {
-    // open elf file local
-    if (buffer) {
-        free(buffer);
-        buffer = nullptr;
-    }
-    // use mmap
     if (header) {
         munmap(header, size);
     }
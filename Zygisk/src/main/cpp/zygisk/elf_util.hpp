@@ -21,12 +21,15 @@
 #define SANDHOOK_ELF_UTIL_H
 
 #include <link.h>
-#include <linux/elf.h>
 #include <sys/types.h>
 
+#include <span>
 #include <string>
 #include <string_view>
 #include <unordered_map>
+#include <vector>
+
+#include "elf_engine.h"
 
 #define SHT_GNU_HASH 0x6ffffff6
 
@@ -35,11 +38,11 @@ class ElfImg {
 public:
     ElfImg(std::string_view elf);
 
-    constexpr ElfW(Addr) getSymbOffset(std::string_view name) const {
-        return getSymbOffset(name, GnuHash(name), ElfHash(name));
+    ElfW(Addr) getSymbOffset(const char *name) const {
+        return getSymbOffset(name, gnu_hash(name), elf_hash(name));
     }
 
-    constexpr ElfW(Addr) getSymbAddress(std::string_view name) const {
+    ElfW(Addr) getSymbAddress(const char *name) const {
         ElfW(Addr) offset = getSymbOffset(name);
         if (offset > 0 && base != nullptr) {
             return static_cast<ElfW(Addr)>((uintptr_t) base + offset - bias);
@@ -48,12 +51,18 @@ public:
         }
     }
 
+    // First symtab name, in symtab order, that starts with prefix
     std::string_view findSymbolNameByPrefix(std::string_view prefix) const {
         return LinearLookupByPrefix(prefix);
     }
 
+    // Resolve all names at once: exported names through the hash tables, the rest in one
+    // scan over symtab. addresses[i] is 0 when names[i] is not found.
+    // Returns the number of names found.
+    size_t resolve(std::span<const char *const> names, ElfW(Addr) *addresses) const;
+
     template <typename T>
-    constexpr T getSymbAddress(std::string_view name) const {
+    T getSymbAddress(const char *name) const {
         return reinterpret_cast<T>(getSymbAddress(name));
     }
 
@@ -74,65 +83,36 @@ private:
 
     std::string_view LinearLookupByPrefix(std::string_view name) const;
 
-    constexpr static uint32_t ElfHash(std::string_view name);
-
-    constexpr static uint32_t GnuHash(std::string_view name);
+    // Name of symtab entry index if it is a sized function or object, nullptr otherwise
+    const char *SymtabName(ElfW(Off) index) const;
 
     bool findModuleBase();
 
     std::string elf;
     void *base = nullptr;
-    char *buffer = nullptr;
     off_t size = 0;
     off_t bias = -4396;
-    ElfW(Ehdr) *header = nullptr;
-    ElfW(Shdr) *section_header = nullptr;
-    ElfW(Shdr) *symtab = nullptr;
-    ElfW(Shdr) *strtab = nullptr;
-    ElfW(Shdr) *dynsym = nullptr;
-    ElfW(Sym) *symtab_start = nullptr;
-    ElfW(Sym) *dynsym_start = nullptr;
-    ElfW(Sym) *strtab_start = nullptr;
+    // The whole file, mapped read-only; sections are parsed through the shared ELF engine
+    uint8_t *header = nullptr;
+    ElfFileImage<ElfNativeTypes> image;
+
+    const ElfW(Sym) *dynsym_start = nullptr;
+    ElfW(Off) dynsym_count = 0;
+    const char *dynstr = nullptr;
+    ElfW(Off) dynstr_size = 0;
+
+    const ElfW(Sym) *symtab_start = nullptr;
     ElfW(Off) symtab_count = 0;
-    ElfW(Off) symstr_offset = 0;
-    ElfW(Off) symstr_offset_for_symtab = 0;
-    ElfW(Off) symtab_offset = 0;
-    ElfW(Off) dynsym_offset = 0;
-    ElfW(Off) symtab_size = 0;
-
-    uint32_t nbucket_{};
-    uint32_t *bucket_ = nullptr;
-    uint32_t *chain_ = nullptr;
-
-    uint32_t gnu_nbucket_{};
-    uint32_t gnu_symndx_{};
-    uint32_t gnu_bloom_size_;
-    uint32_t gnu_shift2_;
-    uintptr_t *gnu_bloom_filter_;
-    uint32_t *gnu_bucket_;
-    uint32_t *gnu_chain_;
-
-    mutable std::unordered_map<std::string_view, ElfW(Sym) *> symtabs_;
-};
+    const char *strtab = nullptr;
+    ElfW(Off) strtab_size = 0;
 
-constexpr uint32_t ElfImg::ElfHash(std::string_view name) {
-    uint32_t h = 0, g = 0;
-    for (unsigned char p : name) {
-        h = (h << 4) + p;
-        g = h & 0xf0000000;
-        h ^= g;
-        h ^= g >> 24;
-    }
-    return h;
-}
+    bool has_sysv = false;
+    ElfSysvHash<ElfNativeTypes> sysv;
+    bool has_gnu = false;
+    ElfGnuHash<ElfNativeTypes> gnu;
 
-constexpr uint32_t ElfImg::GnuHash(std::string_view name) {
-    uint32_t h = 5381;
-    for (unsigned char p : name) {
-        h += (h << 5) + p;
-    }
-    return h;
-}
+    mutable std::unordered_map<std::string_view, const ElfW(Sym) *> symtabs_;
+};
 }  // namespace SandHook
 
 #endif  // SANDHOOK_ELF_UTIL_H
@@ -65,15 +65,10 @@ namespace SoList {
             if (dtor != nullptr) (this->*dtor)();
         }
 
-        static bool setup(const SandHook::ElfImg &linker) {
-            ctor = MemFunc{.data = {.p = reinterpret_cast<void *>(
-                    linker.getSymbAddress("__dl__ZN18ProtectedDataGuardC2Ev")),
-                    .adj = 0}}
-                    .f;
-            dtor = MemFunc{.data = {.p = reinterpret_cast<void *>(
-                    linker.getSymbAddress("__dl__ZN18ProtectedDataGuardD2Ev")),
-                    .adj = 0}}
-                    .f;
+        // Addresses of __dl__ZN18ProtectedDataGuardC2Ev and __dl__ZN18ProtectedDataGuardD2Ev
+        static bool setup(ElfW(Addr) ctor_addr, ElfW(Addr) dtor_addr) {
+            ctor = MemFunc{.data = {.p = reinterpret_cast<void *>(ctor_addr), .adj = 0}}.f;
+            dtor = MemFunc{.data = {.p = reinterpret_cast<void *>(dtor_addr), .adj = 0}}.f;
             return ctor != nullptr && dtor != nullptr;
         }
 
@@ -109,8 +104,8 @@ namespace SoList {
     const size_t size_minimal = 0x100;
     const size_t llvm_suffix_length = 25;
     template <typename T>
-    inline T *getStaticPointer(const SandHook::ElfImg &linker, const char *name) {
-        auto *addr = reinterpret_cast<T **>(linker.getSymbAddress(name));
+    inline T *getStaticPointer(ElfW(Addr) address) {
+        auto *addr = reinterpret_cast<T **>(address);
 
         return addr == nullptr ? nullptr : *addr;
     }
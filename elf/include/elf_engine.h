@@ -0,0 +1,701 @@
+//
+// Created by chic on 2025/7/11.
+//
+
+#pragma once
+#include <elf.h>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include "symbol_hash.h"
+
+/**
+ * ELF32 和 ELF64 共用的一套解析代码, 只有头文件
+ * 所有东西都以 Elf32Types/Elf64Types 为模板参数, 位数在编译期定好, 查找和遍历的循环里不用再判断
+ * 64位的 adi 也能用 Elf32Types 解析32位目标的so; 位数只在最外面用 elf_dispatch 按 e_ident 选一次
+ * 这里只解析调用方给的内存: 本进程加载的so用 ElfLoadedImage, 文件内容用 ElfFileImage,
+ * 别的进程里的表由 RemoteElf 读回来以后套上 ElfGnuHash/ElfSysvHash 查
+ * adi, zygisk 的 SandHook::ElfImg 和 common/elf_symbol_resolver, 以及两份 lsplt 都用这一份
+ */
+
+#ifndef STB_GNU_UNIQUE
+#define STB_GNU_UNIQUE 10
+#endif
+#ifndef DT_ANDROID_REL
+#define DT_ANDROID_REL 0x6000000f
+#define DT_ANDROID_RELSZ 0x60000010
+#define DT_ANDROID_RELA 0x60000011
+#define DT_ANDROID_RELASZ 0x60000012
+#endif
+
+struct Elf32Types {
+    using Ehdr = Elf32_Ehdr;
+    using Phdr = Elf32_Phdr;
+    using Shdr = Elf32_Shdr;
+    using Dyn = Elf32_Dyn;
+    using Sym = Elf32_Sym;
+    using Rel = Elf32_Rel;
+    using Rela = Elf32_Rela;
+    // 也是 GNU hash bloom 一个字的宽度
+    using Addr = Elf32_Addr;
+    static constexpr unsigned char kClass = ELFCLASS32;
+
+    static constexpr uint32_t r_sym(Addr info){
+        return info >> 8;
+    }
+    static constexpr uint32_t r_type(Addr info){
+        return info & 0xff;
+    }
+};
+
+struct Elf64Types {
+    using Ehdr = Elf64_Ehdr;
+    using Phdr = Elf64_Phdr;
+    using Shdr = Elf64_Shdr;
+    using Dyn = Elf64_Dyn;
+    using Sym = Elf64_Sym;
+    using Rel = Elf64_Rel;
+    using Rela = Elf64_Rela;
+    using Addr = Elf64_Addr;
+    static constexpr unsigned char kClass = ELFCLASS64;
+
+    static constexpr uint32_t r_sym(Addr info){
+        return info >> 32;
+    }
+    static constexpr uint32_t r_type(Addr info){
+        return info & 0xffffffff;
+    }
+};
+
+#if defined(__LP64__)
+using ElfNativeTypes = Elf64Types;
+#else
+using ElfNativeTypes = Elf32Types;
+#endif
+
+// 按 e_ident[EI_CLASS] 选一种实例化, fn 是 [&](auto e) {...} 这样的lambda, 里面用 decltype(e) 拿类型
+// 不是32位也不是64位的返回false
+template<typename F>
+inline bool elf_dispatch(unsigned char elf_class, F &&fn){
+    if (elf_class == ELFCLASS64) {
+        return fn(Elf64Types{});
+    }
+    if (elf_class == ELFCLASS32) {
+        return fn(Elf32Types{});
+    }
+    return false;
+}
+
+// versym 的这一位表示不是默认版本, 不指定版本查找时跳过
+static constexpr uint16_t kElfVersymHidden = 0x8000;
+
+// 不指定版本的 dlsym 能找到的符号: 有定义, GLOBAL/WEAK(glibc 还有 GNU_UNIQUE), 不是 TLS
+template<typename E>
+inline bool elf_symbol_exported(const typename E::Sym &sym){
+    int bind = sym.st_info >> 4;
+    int type = sym.st_info & 0xf;
+    return sym.st_shndx != SHN_UNDEF && (bind == STB_GLOBAL || bind == STB_WEAK || bind == STB_GNU_UNIQUE) &&
+           type != STT_TLS;
+}
+
+// 程序头里跟加载有关的部分, 都是文件里的 vaddr
+struct ElfLoadInfo {
+    // 第一个 PT_LOAD 按页对齐的 vaddr, 映射的起始地址减掉它就是 load bias
+    uint64_t min_vaddr = UINT64_MAX;
+    uint64_t max_end = 0;
+    uint64_t dyn_vaddr = 0;
+    uint64_t dyn_size = 0;
+
+    bool has_dynamic() const {
+        return min_vaddr != UINT64_MAX && dyn_size != 0;
+    }
+
+    // bionic 不改动态段, glibc 会把 d_ptr 改成加上 load bias 以后的地址, 两种都换成 vaddr, 不在映射范围内的是0
+    uint64_t to_vaddr(uint64_t ptr, uint64_t bias) const {
+        if (ptr >= min_vaddr && ptr < max_end) {
+            return ptr;
+        }
+        if (ptr >= bias && ptr - bias < max_end) {
+            return ptr - bias;
+        }
+        return 0;
+    }
+};
+
+template<typename E>
+inline ElfLoadInfo elf_load_info(const typename E::Phdr *phdrs, size_t phnum, uint64_t page_size = 4096){
+    ElfLoadInfo info;
+    for (size_t i = 0; i < phnum; i++) {
+        if (phdrs[i].p_type == PT_LOAD) {
+            info.min_vaddr = std::min<uint64_t>(info.min_vaddr, phdrs[i].p_vaddr);
+            info.max_end = std::max<uint64_t>(info.max_end, phdrs[i].p_vaddr + phdrs[i].p_memsz);
+        } else if (phdrs[i].p_type == PT_DYNAMIC) {
+            info.dyn_vaddr = phdrs[i].p_vaddr;
+            info.dyn_size = phdrs[i].p_memsz;
+        }
+    }
+    if (info.min_vaddr != UINT64_MAX) {
+        info.min_vaddr &= ~(page_size - 1);
+    }
+    return info;
+}
+
+// 动态段里用到的项, 地址都换成了 vaddr, 没有的是0
+struct ElfDynamicInfo {
+    uint64_t symtab = 0;
+    uint64_t strtab = 0;
+    uint64_t strsz = 0;
+    uint64_t syment = 0;
+    uint64_t versym = 0;
+    uint64_t gnu_hash = 0;
+    uint64_t sysv_hash = 0;
+    // PLT 重定位, pltrel 是 DT_REL 或 DT_RELA
+    uint64_t jmprel = 0;
+    uint64_t pltrelsz = 0;
+    uint64_t pltrel = 0;
+    uint64_t rel = 0;
+    uint64_t relsz = 0;
+    uint64_t rela = 0;
+    uint64_t relasz = 0;
+    // DT_ANDROID_REL(A), APS2 格式压缩的重定位
+    uint64_t android_rel = 0;
+    uint64_t android_relsz = 0;
+    bool android_rela = false;
+};
+
+// to_vaddr 把 d_ptr 换成 vaddr, 一般是 ElfLoadInfo::to_vaddr
+template<typename E, typename ToVaddr>
+inline ElfDynamicInfo elf_parse_dynamic(const typename E::Dyn *dyn, size_t count, ToVaddr &&to_vaddr){
+    ElfDynamicInfo info;
+    for (size_t i = 0; i < count && dyn[i].d_tag != DT_NULL; i++) {
+        uint64_t val = dyn[i].d_un.d_val;
+        switch (dyn[i].d_tag) {
+            case DT_SYMTAB:
+                info.symtab = to_vaddr(val);
+                break;
+            case DT_STRTAB:
+                info.strtab = to_vaddr(val);
+                break;
+            case DT_STRSZ:
+                info.strsz = val;
+                break;
+            case DT_SYMENT:
+                info.syment = val;
+                break;
+            case DT_VERSYM:
+                info.versym = to_vaddr(val);
+                break;
+            case DT_GNU_HASH:
+                info.gnu_hash = to_vaddr(val);
+                break;
+            case DT_HASH:
+                info.sysv_hash = to_vaddr(val);
+                break;
+            case DT_JMPREL:
+                info.jmprel = to_vaddr(val);
+                break;
+            case DT_PLTRELSZ:
+                info.pltrelsz = val;
+                break;
+            case DT_PLTREL:
+                info.pltrel = val;
+                break;
+            case DT_REL:
+                info.rel = to_vaddr(val);
+                break;
+            case DT_RELSZ:
+                info.relsz = val;
+                break;
+            case DT_RELA:
+                info.rela = to_vaddr(val);
+                break;
+            case DT_RELASZ:
+                info.relasz = val;
+                break;
+            case DT_ANDROID_REL:
+            case DT_ANDROID_RELA:
+                info.android_rel = to_vaddr(val);
+                info.android_rela = dyn[i].d_tag == DT_ANDROID_RELA;
+                break;
+            case DT_ANDROID_RELSZ:
+            case DT_ANDROID_RELASZ:
+                info.android_relsz = val;
+                break;
+        }
+    }
+    return info;
+}
+
+/**
+ * DT_GNU_HASH 表的视图, 表可以是映射着的原表, 也可以是从别的进程读回来的几段
+ * chains[0] 是符号 symoffset 的链, nchains 不知道的时候(本进程加载的so)是 SIZE_MAX, 靠链尾的标记结束
+ */
+template<typename E>
+struct ElfGnuHash {
+    using BloomWord = typename E::Addr;
+    static constexpr uint32_t kBloomBits = sizeof(BloomWord) * 8;
+
+    uint32_t nbucket = 0;
+    uint32_t symoffset = 0;
+    uint32_t maskwords = 0;
+    uint32_t shift2 = 0;
+    const BloomWord *bloom = nullptr;
+    const uint32_t *buckets = nullptr;
+    const uint32_t *chains = nullptr;
+    size_t nchains = SIZE_MAX;
+
+    // table 是 DT_GNU_HASH 指向的整张表
+    bool init(const void *table){
+        auto words = static_cast<const uint32_t *>(table);
+        nbucket = words[0];
+        symoffset = words[1];
+        maskwords = words[2];
+        shift2 = words[3];
+        if (nbucket == 0 || maskwords == 0 || (maskwords & (maskwords - 1)) != 0) {
+            return false;
+        }
+        bloom = reinterpret_cast<const BloomWord *>(words + 4);
+        buckets = reinterpret_cast<const uint32_t *>(bloom + maskwords);
+        chains = buckets + nbucket;
+        nchains = SIZE_MAX;
+        return true;
+    }
+
+    // 对 hash 对得上的每个符号下标调用 fn(index), fn 返回true就停下
+    template<typename F>
+    void for_each_candidate(uint32_t hash, F &&fn) const {
+        BloomWord word = bloom[(hash / kBloomBits) & (maskwords - 1)];
+        if (((word >> (hash % kBloomBits)) & (word >> ((hash >> shift2) % kBloomBits)) & 1) == 0) {
+            return;
+        }
+        uint32_t n = buckets[hash % nbucket];
+        if (n < symoffset) {
+            return;
+        }
+        for (; n - symoffset < nchains; n++) {
+            uint32_t c = chains[n - symoffset];
+            if (((c ^ hash) >> 1) == 0 && fn(n)) {
+                return;
+            }
+            if (c & 1) {
+                return;
+            }
+        }
+    }
+};
+
+// DT_HASH 表的视图, 两种位数的表都是32位的字
+template<typename E>
+struct ElfSysvHash {
+    uint32_t nbucket = 0;
+    uint32_t nchain = 0;
+    const uint32_t *buckets = nullptr;
+    const uint32_t *chains = nullptr;
+
+    bool init(const void *table){
+        auto words = static_cast<const uint32_t *>(table);
+        nbucket = words[0];
+        nchain = words[1];
+        if (nbucket == 0) {
+            return false;
+        }
+        buckets = words + 2;
+        chains = buckets + nbucket;
+        return true;
+    }
+
+    // 同 ElfGnuHash::for_each_candidate, 链上每个符号都是候选; 链最长 nchain, 成环的表不会死循环
+    template<typename F>
+    void for_each_candidate(uint32_t hash, F &&fn) const {
+        size_t steps = 0;
+        for (uint32_t n = buckets[hash % nbucket]; n != 0 && n < nchain && steps < nchain; n = chains[n], steps++) {
+            if (fn(n)) {
+                return;
+            }
+        }
+    }
+};
+
+// 一条重定位, 不是 RELA 的 addend 是0; offset 是 vaddr
+struct ElfReloc {
+    uint64_t offset;
+    uint32_t type;
+    uint32_t sym;
+    int64_t addend;
+};
+
+// 普通的 REL/RELA 表, size 是字节数
+template<typename E, typename F>
+inline void elf_for_each_reloc(const void *table, size_t size, bool rela, F &&fn){
+    if (rela) {
+        auto r = static_cast<const typename E::Rela *>(table);
+        for (size_t i = 0; i < size / sizeof(*r); i++) {
+            fn(ElfReloc{r[i].r_offset, E::r_type(r[i].r_info), E::r_sym(r[i].r_info), (int64_t) r[i].r_addend});
+        }
+    } else {
+        auto r = static_cast<const typename E::Rel *>(table);
+        for (size_t i = 0; i < size / sizeof(*r); i++) {
+            fn(ElfReloc{r[i].r_offset, E::r_type(r[i].r_info), E::r_sym(r[i].r_info), 0});
+        }
+    }
+}
+
+/**
+ * DT_ANDROID_REL(A) 指向的 APS2 格式, 跟 bionic 的 packed_reloc_iterator 一样解码
+ * 内容是 "APS2" 后面一串 sleb128: 总数, 起始 offset, 然后一组一组的 (组大小, 标志, 组内共用的字段, 每条自己的字段)
+ * 数据不完整或者格式不对返回false, 已经解出来的照样回调过了
+ */
+template<typename E, typename F>
+inline bool elf_for_each_packed_reloc(const uint8_t *data, size_t size, bool rela, F &&fn){
+    enum : uint64_t {
+        kGroupedByInfo = 1,
+        kGroupedByOffsetDelta = 2,
+        kGroupedByAddend = 4,
+        kGroupHasAddend = 8,
+    };
+    size_t pos = 4;
+    bool ok = true;
+    // 值按目标的位宽截断, 跟 bionic 用 ElfW(Addr) 解码一样
+    auto next = [&]() -> typename E::Addr {
+        uint64_t value = 0;
+        unsigned shift = 0;
+        uint8_t byte;
+        do {
+            if (pos >= size || shift >= 64) {
+                ok = false;
+                return 0;
+            }
+            byte = data[pos++];
+            value |= (uint64_t) (byte & 0x7f) << shift;
+            shift += 7;
+        } while (byte & 0x80);
+        if (shift < 64 && (byte & 0x40)) {
+            value |= ~(uint64_t) 0 << shift;
+        }
+        return (typename E::Addr) value;
+    };
+    if (size < 4 || memcmp(data, "APS2", 4) != 0) {
+        return false;
+    }
+    typename E::Addr count = next();
+    ElfReloc reloc{next(), 0, 0, 0};
+    typename E::Addr offset = reloc.offset;
+    typename E::Addr info = 0;
+    typename E::Addr addend = 0;
+    for (typename E::Addr done = 0; ok && done < count;) {
+        typename E::Addr group_size = next();
+        typename E::Addr flags = next();
+        typename E::Addr group_offset_delta = 0;
+        if (flags & kGroupedByOffsetDelta) {
+            group_offset_delta = next();
+        }
+        if (flags & kGroupedByInfo) {
+            info = next();
+        }
+        if (flags & kGroupHasAddend) {
+            if (!rela) {
+                return false;
+            }
+            if (flags & kGroupedByAddend) {
+                addend += next();
+            }
+        } else {
+            addend = 0;
+        }
+        if (!ok || group_size == 0 || group_size > count - done) {
+            return false;
+        }
+        for (typename E::Addr i = 0; i < group_size; i++) {
+            offset += (flags & kGroupedByOffsetDelta) ? group_offset_delta : next();
+            if (!(flags & kGroupedByInfo)) {
+                info = next();
+            }
+            if ((flags & kGroupHasAddend) && !(flags & kGroupedByAddend)) {
+                addend += next();
+            }
+            if (!ok) {
+                return false;
+            }
+            reloc.offset = offset;
+            reloc.type = E::r_type(info);
+            reloc.sym = E::r_sym(info);
+            reloc.addend = (int64_t) (std::make_signed_t<typename E::Addr>) addend;
+            fn(reloc);
+        }
+        done += group_size;
+    }
+    return ok;
+}
+
+// 在一段 PT_NOTE 的内容里找 GNU build-id, 找到返回true; 两种位数的 note 头一样
+inline bool parse_build_id_note(const uint8_t *note, size_t size, std::string *build_id){
+    size_t off = 0;
+    while (off + sizeof(Elf32_Nhdr) <= size) {
+        Elf32_Nhdr nhdr;
+        memcpy(&nhdr, note + off, sizeof(nhdr));
+        size_t name_off = off + sizeof(Elf32_Nhdr);
+        size_t desc_off = name_off + ((nhdr.n_namesz + 3) & ~3u);
+        size_t next = desc_off + ((nhdr.n_descsz + 3) & ~3u);
+        if (next > size) {
+            break;
+        }
+        if (nhdr.n_type == NT_GNU_BUILD_ID && nhdr.n_namesz == 4 && memcmp(note + name_off, "GNU", 4) == 0 &&
+            nhdr.n_descsz > 0) {
+            build_id->assign(reinterpret_cast<const char *>(note + desc_off), nhdr.n_descsz);
+            return true;
+        }
+        off = next;
+    }
+    return false;
+}
+
+/**
+ * 本进程里已经加载的一个so, 数据直接从映射里读
+ * 符号只找 elf_symbol_exported 的, 跳过 versym 标了 hidden 的旧版本, 跟 linker 的 dlsym 一样
+ */
+template<typename E>
+class ElfLoadedImage {
+public:
+    // base 是ELF头所在的地址, 也就是so偏移为0的映射的起始地址
+    bool open(uintptr_t base){
+        auto ehdr = reinterpret_cast<const typename E::Ehdr *>(base);
+        if (memcmp(ehdr->e_ident, ELFMAG, SELFMAG) != 0 || ehdr->e_ident[EI_CLASS] != E::kClass ||
+            ehdr->e_phentsize != sizeof(typename E::Phdr)) {
+            return false;
+        }
+        auto load = elf_load_info<E>(reinterpret_cast<const typename E::Phdr *>(base + ehdr->e_phoff), ehdr->e_phnum);
+        if (!load.has_dynamic()) {
+            return false;
+        }
+        bias = base - load.min_vaddr;
+        auto dyn = reinterpret_cast<const typename E::Dyn *>(bias + load.dyn_vaddr);
+        dynamic = elf_parse_dynamic<E>(dyn, load.dyn_size / sizeof(typename E::Dyn),
+                                       [&](uint64_t ptr) { return load.to_vaddr(ptr, bias); });
+        if (dynamic.symtab == 0 || dynamic.strtab == 0) {
+            return false;
+        }
+        symtab = reinterpret_cast<const typename E::Sym *>(bias + dynamic.symtab);
+        strtab = reinterpret_cast<const char *>(bias + dynamic.strtab);
+        versym = dynamic.versym != 0 ? reinterpret_cast<const uint16_t *>(bias + dynamic.versym) : nullptr;
+        has_gnu = dynamic.gnu_hash != 0 && gnu.init(reinterpret_cast<const void *>(bias + dynamic.gnu_hash));
+        has_sysv = !has_gnu && dynamic.sysv_hash != 0 && sysv.init(reinterpret_cast<const void *>(bias + dynamic.sysv_hash));
+        return has_gnu || has_sysv;
+    }
+
+    uintptr_t get_bias() const {
+        return bias;
+    }
+
+    const ElfDynamicInfo &get_dynamic() const {
+        return dynamic;
+    }
+
+    // 导出的符号, 找不到返回nullptr; 地址是 get_bias() + st_value
+    const typename E::Sym *find(const char *name) const {
+        const typename E::Sym *result = nullptr;
+        auto match = [&](uint32_t index) {
+            const typename E::Sym &sym = symtab[index];
+            if (sym.st_name < dynamic.strsz && strcmp(strtab + sym.st_name, name) == 0 &&
+                elf_symbol_exported<E>(sym) && (versym == nullptr || (versym[index] & kElfVersymHidden) == 0)) {
+                result = &sym;
+                return true;
+            }
+            return false;
+        };
+        if (has_gnu) {
+            gnu.for_each_candidate(gnu_hash(name), match);
+        } else {
+            sysv.for_each_candidate(elf_hash(name), match);
+        }
+        return result;
+    }
+
+    /**
+     * 名字完全相同的动态符号的下标, 不管有没有定义, 找不到返回0; 找引用了这个符号的重定位时用
+     * GNU hash 表里没有 symoffset 之前的符号(一般是引用的外部符号), 这一段逐个比较
+     */
+    uint32_t find_index(const char *name) const {
+        uint32_t result = 0;
+        size_t len = strlen(name);
+        auto match = [&](uint32_t index) {
+            uint32_t off = symtab[index].st_name;
+            if (off < dynamic.strsz && len < dynamic.strsz - off && memcmp(strtab + off, name, len + 1) == 0) {
+                result = index;
+                return true;
+            }
+            return false;
+        };
+        if (has_gnu) {
+            gnu.for_each_candidate(gnu_hash(name), match);
+            for (uint32_t i = 1; result == 0 && i < gnu.symoffset; i++) {
+                match(i);
+            }
+        } else {
+            sysv.for_each_candidate(elf_hash(name), match);
+        }
+        return result;
+    }
+
+    // 动态符号表第 index 个符号的名字, 重定位里的 sym 用它换成名字
+    const char *symbol_name(uint32_t index) const {
+        uint32_t name = symtab[index].st_name;
+        return name < dynamic.strsz ? strtab + name : nullptr;
+    }
+
+    // PLT 重定位(DT_JMPREL), 每条调用 fn(const ElfReloc &)
+    template<typename F>
+    void for_each_plt_reloc(F &&fn) const {
+        if (dynamic.jmprel != 0) {
+            elf_for_each_reloc<E>(reinterpret_cast<const void *>(bias + dynamic.jmprel), dynamic.pltrelsz,
+                                  dynamic.pltrel == DT_RELA, fn);
+        }
+    }
+
+    // 除了 PLT 以外的重定位: DT_REL, DT_RELA 和 APS2 压缩的 DT_ANDROID_REL(A); 压缩的格式不对返回false
+    template<typename F>
+    bool for_each_dyn_reloc(F &&fn) const {
+        if (dynamic.rel != 0) {
+            elf_for_each_reloc<E>(reinterpret_cast<const void *>(bias + dynamic.rel), dynamic.relsz, false, fn);
+        }
+        if (dynamic.rela != 0) {
+            elf_for_each_reloc<E>(reinterpret_cast<const void *>(bias + dynamic.rela), dynamic.relasz, true, fn);
+        }
+        if (dynamic.android_rel != 0) {
+            return elf_for_each_packed_reloc<E>(reinterpret_cast<const uint8_t *>(bias + dynamic.android_rel),
+                                                dynamic.android_relsz, dynamic.android_rela, fn);
+        }
+        return true;
+    }
+
+private:
+    uintptr_t bias = 0;
+    ElfDynamicInfo dynamic;
+    const typename E::Sym *symtab = nullptr;
+    const char *strtab = nullptr;
+    const uint16_t *versym = nullptr;
+    bool has_gnu = false;
+    bool has_sysv = false;
+    ElfGnuHash<E> gnu;
+    ElfSysvHash<E> sysv;
+};
+
+/**
+ * 一个ELF文件的全部内容(mmap 或者解压出来的), 按 section 和 program header 解析, 所有偏移都检查过不越界
+ */
+template<typename E>
+class ElfFileImage {
+public:
+    // 类别不对或者没有 section header 表返回false
+    bool open(const uint8_t *file, size_t file_size){
+        data = file;
+        size = file_size;
+        if (size < sizeof(typename E::Ehdr) || memcmp(data, ELFMAG, SELFMAG) != 0 || data[EI_CLASS] != E::kClass) {
+            return false;
+        }
+        ehdr = reinterpret_cast<const typename E::Ehdr *>(data);
+        if (ehdr->e_shentsize != sizeof(typename E::Shdr) ||
+            !contains(ehdr->e_shoff, (uint64_t) ehdr->e_shnum * sizeof(typename E::Shdr))) {
+            return false;
+        }
+        sections = reinterpret_cast<const typename E::Shdr *>(data + ehdr->e_shoff);
+        return true;
+    }
+
+    // [offset, offset + length) 是不是都在文件里
+    bool contains(uint64_t offset, uint64_t length) const {
+        return offset <= size && length <= size - offset;
+    }
+
+    const typename E::Ehdr &header() const {
+        return *ehdr;
+    }
+
+    size_t section_count() const {
+        return ehdr->e_shnum;
+    }
+
+    const typename E::Shdr &section(size_t i) const {
+        return sections[i];
+    }
+
+    const uint8_t *at(uint64_t offset) const {
+        return data + offset;
+    }
+
+    // 名字和类型都对得上并且内容在文件里的第一个 section, 没有返回nullptr
+    const typename E::Shdr *find_section(std::string_view name, uint32_t type) const {
+        if (ehdr->e_shstrndx >= ehdr->e_shnum) {
+            return nullptr;
+        }
+        const typename E::Shdr &names = sections[ehdr->e_shstrndx];
+        if (!contains(names.sh_offset, names.sh_size)) {
+            return nullptr;
+        }
+        for (size_t i = 0; i < ehdr->e_shnum; i++) {
+            const typename E::Shdr &s = sections[i];
+            if (s.sh_type == type && s.sh_name + name.size() < names.sh_size &&
+                memcmp(data + names.sh_offset + s.sh_name, name.data(), name.size()) == 0 &&
+                data[names.sh_offset + s.sh_name + name.size()] == '\0' && contains(s.sh_offset, s.sh_size)) {
+                return &s;
+            }
+        }
+        return nullptr;
+    }
+
+    /**
+     * symtab_sh 是 SHT_SYMTAB 或 SHT_DYNSYM, 跳过第0个, 对每个有名字的符号调用 fn(std::string_view name, const Sym &)
+     * 表或者对应的字符串表越界的话什么都不做
+     */
+    template<typename F>
+    void for_each_symbol(const typename E::Shdr &symtab_sh, F &&fn) const {
+        if (symtab_sh.sh_link >= ehdr->e_shnum || symtab_sh.sh_entsize != sizeof(typename E::Sym) ||
+            !contains(symtab_sh.sh_offset, symtab_sh.sh_size)) {
+            return;
+        }
+        const typename E::Shdr &strtab_sh = sections[symtab_sh.sh_link];
+        if (strtab_sh.sh_type != SHT_STRTAB || !contains(strtab_sh.sh_offset, strtab_sh.sh_size)) {
+            return;
+        }
+        auto syms = reinterpret_cast<const typename E::Sym *>(data + symtab_sh.sh_offset);
+        size_t count = symtab_sh.sh_size / sizeof(typename E::Sym);
+        auto strtab = reinterpret_cast<const char *>(data + strtab_sh.sh_offset);
+        size_t strtab_size = strtab_sh.sh_size;
+        for (size_t i = 1; i < count; i++) {
+            if (syms[i].st_name >= strtab_size) {
+                continue;
+            }
+            const char *name = strtab + syms[i].st_name;
+            size_t len = strnlen(name, strtab_size - syms[i].st_name);
+            if (len == 0 || len == strtab_size - syms[i].st_name) {
+                continue;
+            }
+            fn(std::string_view(name, len), syms[i]);
+        }
+    }
+
+    // PT_NOTE 里的 GNU build-id, 没有返回false
+    bool build_id(std::string *out) const {
+        if (ehdr->e_phentsize != sizeof(typename E::Phdr) ||
+            !contains(ehdr->e_phoff, (uint64_t) ehdr->e_phnum * sizeof(typename E::Phdr))) {
+            return false;
+        }
+        auto phdrs = reinterpret_cast<const typename E::Phdr *>(data + ehdr->e_phoff);
+        for (size_t i = 0; i < ehdr->e_phnum; i++) {
+            if (phdrs[i].p_type == PT_NOTE && contains(phdrs[i].p_offset, phdrs[i].p_filesz) &&
+                parse_build_id_note(data + phdrs[i].p_offset, phdrs[i].p_filesz, out)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    const uint8_t *data = nullptr;
+    size_t size = 0;
+    const typename E::Ehdr *ehdr = nullptr;
+    const typename E::Shdr *sections = nullptr;
+};
@@ -0,0 +1,153 @@
+//
+// Created by chic on 2025/7/4.
+//
+
+#pragma once
+#include <sys/types.h>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+struct MapInfo {
+    /// \brief The start address of the memory region.
+    uintptr_t start;
+    /// \brief The end address of the memory region.
+    uintptr_t end;
+    /// \brief The permissions of the memory region. This is a bit mask of the following values:
+    /// - PROT_READ
+    /// - PROT_WRITE
+    /// - PROT_EXEC
+    uint8_t perms;
+    /// \brief Whether the memory region is private.
+    bool is_private;
+    /// \brief The offset of the memory region.
+    uintptr_t offset;
+    /// \brief The device number of the memory region.
+    /// Major can be obtained by #major()
+    /// Minor can be obtained by #minor()
+    dev_t dev;
+    /// \brief The inode number of the memory region.
+    ino_t inode;
+    /// \brief The path of the memory region.
+    /// 指向 ProcMaps 里读到的maps内容, 以'\0'结尾, ProcMaps 释放以后不能再用
+    std::string_view path;
+};
+
+/**
+ * 一次读进来的 /proc/pid/maps
+ * 整个文件用大块 read 读到一块缓冲区里, 手动解析十六进制, 路径直接指向缓冲区, 每行不再分配 std::string
+ * 内核按地址从小到大输出映射, 地址查找用二分; 模块查找先按文件名(最后一个'/'后面的部分)查哈希表
+ * 移动以后路径还指向原来的缓冲区, 不能拷贝
+ */
+class ProcMaps {
+public:
+    ProcMaps() = default;
+    ProcMaps(ProcMaps &&) = default;
+    ProcMaps &operator=(ProcMaps &&) = default;
+    ProcMaps(const ProcMaps &) = delete;
+    ProcMaps &operator=(const ProcMaps &) = delete;
+
+    // pid 为 -1 时读自己的maps, 失败返回false, 之前的内容会被清空
+    // adi, zygisk 和 lsplt 共用, 这里不打日志, 打开失败时 errno 是 open 的错误
+    bool scan(pid_t pid);
+
+    // 包含 addr 的映射, 没有返回nullptr
+    const MapInfo *find(uintptr_t addr) const;
+
+    // 按地址顺序第一个路径以 suffix 结尾并且满足 pred 的映射
+    // 文件名跟 suffix 的文件名完全相同的映射优先, 都不满足时再逐个比较后缀(比如 suffix 只是文件名的一部分)
+    template<typename Pred>
+    const MapInfo *find_module(std::string_view suffix, Pred pred) const {
+        auto it = name_head.find(basename(suffix));
+        if (it != name_head.end()) {
+            for (uint32_t i = it->second; i != kNone; i = name_next[i]) {
+                if (ends_with(maps[i].path, suffix) && pred(maps[i])) {
+                    return &maps[i];
+                }
+            }
+        }
+        for (auto &map: maps) {
+            if (ends_with(map.path, suffix) && pred(map)) {
+                return &map;
+            }
+        }
+        return nullptr;
+    }
+
+    const std::vector<MapInfo> &entries() const {
+        return maps;
+    }
+    std::vector<MapInfo>::const_iterator begin() const {
+        return maps.begin();
+    }
+    std::vector<MapInfo>::const_iterator end() const {
+        return maps.end();
+    }
+    size_t size() const {
+        return maps.size();
+    }
+    bool empty() const {
+        return maps.empty();
+    }
+
+    static std::string_view basename(std::string_view path){
+        size_t slash = path.rfind('/');
+        return slash == std::string_view::npos ? path : path.substr(slash + 1);
+    }
+
+    static bool ends_with(std::string_view str, std::string_view suffix){
+        return str.size() >= suffix.size() && str.substr(str.size() - suffix.size()) == suffix;
+    }
+
+private:
+    static constexpr uint32_t kNone = UINT32_MAX;
+
+    // 解析一行, 行尾的'\n'已经换成'\0'
+    static bool parse_line(char *line, char *line_end, MapInfo *info);
+    void build_index();
+
+    std::unique_ptr<char[]> buffer;
+    std::vector<MapInfo> maps;
+    // 文件名 -> 这个文件名第一个映射的下标, 同名的映射按地址顺序用 name_next 串起来
+    std::unordered_map<std::string_view, uint32_t> name_head;
+    std::vector<uint32_t> name_next;
+};
+
+/**
+ * 只需要一个答案的查找(某个地址所在的映射, 某个模块的基址)不用读整个maps
+ * linux 6.11 以后用 /proc/pid/maps 的 PROCMAP_QUERY ioctl 让内核查找, 按地址查找是一次ioctl;
+ * 按模块名内核没有对应的查询, 要从头一个文件映射一次ioctl地往后走, 还是O(映射数), 只是不用让内核生成整个文本
+ * 内核不支持的时候自动改用 ProcMaps 读一次文本, 之后的查找都在这份文本上做, 按名字找走文本的名字索引
+ * 返回的 MapInfo 和里面的 path 在下一次查找以前有效
+ */
+class ProcMapQuery {
+public:
+    explicit ProcMapQuery(pid_t pid);
+    ~ProcMapQuery();
+    ProcMapQuery(const ProcMapQuery &) = delete;
+    ProcMapQuery &operator=(const ProcMapQuery &) = delete;
+
+    // 包含 addr 的映射, 没有返回nullptr
+    const MapInfo *find(uintptr_t addr);
+    // 跟 ProcMaps::find_module 一样, 文件名完全相同的优先; 用ioctl走的时候 pred 调用时 path 还是空的, 只能看其他字段
+    const MapInfo *find_module(std::string_view suffix, bool (*pred)(const MapInfo &));
+
+    // 当前内核能不能用 PROCMAP_QUERY
+    static bool ioctl_supported();
+
+private:
+    bool open_maps();
+    // addr 所在(或者 next 时之后第一个)的映射放到 result 里, 没有映射或者出错返回false
+    bool query(uintptr_t addr, uint64_t flags, bool with_name);
+    ProcMaps &text();
+
+    pid_t pid;
+    int fd = -1;
+    bool text_loaded = false;
+    ProcMaps text_maps;
+    MapInfo result{};
+    std::unique_ptr<char[]> name;
+};
@@ -0,0 +1,27 @@
+//
+// Created by chic on 2025/7/9.
+//
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// DT_GNU_HASH 用的hash(h = h * 33 + c, 初值5381), name 以'\0'结尾, len 不为空时顺便返回名字长度
+// 实现在启动时按CPU选一次: arm 上用 NEON, x86_64 上有 AVX2 用 AVX2, 否则 SSE4.2, 都没有就逐字节算
+uint32_t gnu_hash(const char *name, uint32_t *len = nullptr);
+// 一次算多个, hashes[i] 对应 names[i]; 建符号索引或者一次查一批符号时用
+// 只是按顺序对每个名字调用一次选好的实现, 几个名字没有交错着算, 省掉的只是每次查选了哪个实现
+void gnu_hash_batch(const char *const *names, uint32_t *hashes, size_t count);
+
+// DT_HASH 用的hash, 每个字节都要折叠高4位, 没法并行, 只有逐字节的实现
+uint32_t elf_hash(const char *name);
+void elf_hash_batch(const char *const *names, uint32_t *hashes, size_t count);
+
+// 一种实现, benchmark 用来逐个比较
+struct GnuHashBackend {
+    const char *name;
+    uint32_t (*hash)(const char *name, uint32_t *len);
+};
+
+// 当前CPU能用的所有实现, 第一个是逐字节的, 最后一个是 gnu_hash 实际用的
+size_t gnu_hash_backends(const GnuHashBackend **backends);
@@ -0,0 +1,363 @@
+//
+// Created by chic on 2025/7/9.
+//
+
+#include "symbol_hash.h"
+
+#if defined(__arm__) || defined(__aarch64__)
+#define USE_GNU_HASH_NEON 1
+#include <arm_neon.h>
+#else
+#define USE_GNU_HASH_NEON 0
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#define USE_GNU_HASH_X86 1
+#include <immintrin.h>
+#else
+#define USE_GNU_HASH_X86 0
+#endif
+
+static uint32_t gnu_hash_scalar(const char *name, uint32_t *len){
+    uint32_t h = 5381;
+    const uint8_t *name_bytes = reinterpret_cast<const uint8_t *>(name);
+#if defined(__clang__)
+#pragma unroll 8
+#elif defined(__GNUC__)
+#pragma GCC unroll 8
+#endif
+    while (*name_bytes != 0) {
+        h += (h << 5) + *name_bytes++; // h*33 + c = h + h * 32 + c = h + h << 5 + c
+    }
+    if (len != nullptr) {
+        *len = reinterpret_cast<const char *>(name_bytes) - name;
+    }
+    return h;
+}
+
+#if USE_GNU_HASH_NEON
+struct __attribute__((aligned(8))) GnuHashInitEntry {
+    uint64_t ignore_mask;
+    uint32_t accum;
+};
+
+constexpr uint32_t kStep0 = 1;
+constexpr uint32_t kStep1 = kStep0 * 33;
+constexpr uint32_t kStep2 = kStep1 * 33;
+constexpr uint32_t kStep3 = kStep2 * 33;
+constexpr uint32_t kStep4 = kStep3 * 33;
+constexpr uint32_t kStep5 = kStep4 * 33;
+constexpr uint32_t kStep6 = kStep5 * 33;
+constexpr uint32_t kStep7 = kStep6 * 33;
+constexpr uint32_t kStep8 = kStep7 * 33;
+constexpr uint32_t kStep9 = kStep8 * 33;
+constexpr uint32_t kStep10 = kStep9 * 33;
+constexpr uint32_t kStep11 = kStep10 * 33;
+
+// Step by -1 through -7:  33 * 0x3e0f83e1 == 1 (mod 2**32)
+constexpr uint32_t kStepN1 = kStep0 * 0x3e0f83e1;
+constexpr uint32_t kStepN2 = kStepN1 * 0x3e0f83e1;
+constexpr uint32_t kStepN3 = kStepN2 * 0x3e0f83e1;
+constexpr uint32_t kStepN4 = kStepN3 * 0x3e0f83e1;
+constexpr uint32_t kStepN5 = kStepN4 * 0x3e0f83e1;
+constexpr uint32_t kStepN6 = kStepN5 * 0x3e0f83e1;
+constexpr uint32_t kStepN7 = kStepN6 * 0x3e0f83e1;
+
+// Calculate the GNU hash and string length of the symbol name.
+//
+// The hash calculation is an optimized version of gnu_hash_scalar().
+static uint32_t gnu_hash_neon(const char* name, uint32_t *len) {
+
+    // The input string may be misaligned by 0-7 bytes (K). This function loads the first aligned
+    // 8-byte chunk, then counteracts the misalignment:
+    //  - The initial K bytes are set to 0xff in the working chunk vector.
+    //  - The accumulator is initialized to 5381 * modinv(33)**K.
+    //  - The accumulator also cancels out each initial 0xff byte.
+    // If we could set bytes to NUL instead, then the accumulator wouldn't need to cancel out the
+    // 0xff values, but this would break the NUL check.
+
+    static const struct GnuHashInitEntry kInitTable[] = {
+            { // (addr&7) == 0
+                    0ull,
+                    5381u*kStep0,
+            }, { // (addr&7) == 1
+                    0xffull,
+                    5381u*kStepN1 - 0xffu*kStepN1,
+            }, { // (addr&7) == 2
+                    0xffffull,
+                    5381u*kStepN2 - 0xffu*kStepN1 - 0xffu*kStepN2,
+            }, { // (addr&7) == 3
+                    0xffffffull,
+                    5381u*kStepN3 - 0xffu*kStepN1 - 0xffu*kStepN2 - 0xffu*kStepN3,
+            }, { // (addr&7) == 4
+                    0xffffffffull,
+                    5381u*kStepN4 - 0xffu*kStepN1 - 0xffu*kStepN2 - 0xffu*kStepN3 - 0xffu*kStepN4,
+            }, { // (addr&7) == 5
+                    0xffffffffffull,
+                    5381u*kStepN5 - 0xffu*kStepN1 - 0xffu*kStepN2 - 0xffu*kStepN3 - 0xffu*kStepN4 - 0xffu*kStepN5,
+            }, { // (addr&7) == 6
+                    0xffffffffffffull,
+                    5381u*kStepN6 - 0xffu*kStepN1 - 0xffu*kStepN2 - 0xffu*kStepN3 - 0xffu*kStepN4 - 0xffu*kStepN5 - 0xffu*kStepN6,
+            }, { // (addr&7) == 7
+                    0xffffffffffffffull,
+                    5381u*kStepN7 - 0xffu*kStepN1 - 0xffu*kStepN2 - 0xffu*kStepN3 - 0xffu*kStepN4 - 0xffu*kStepN5 - 0xffu*kStepN6 - 0xffu*kStepN7,
+            },
+    };
+
+    uint8_t offset = reinterpret_cast<uintptr_t>(name) & 7;
+    const uint64_t* chunk_ptr = reinterpret_cast<const uint64_t*>(reinterpret_cast<uintptr_t>(name) & ~7);
+    const struct GnuHashInitEntry* entry = &kInitTable[offset];
+
+    uint8x8_t chunk = vld1_u8(reinterpret_cast<const uint8_t*>(chunk_ptr));
+    chunk |= vld1_u8(reinterpret_cast<const uint8_t*>(&entry->ignore_mask));
+
+    uint32x4_t accum_lo = { 0 };
+    uint32x4_t accum_hi = { entry->accum, 0, 0, 0 };
+    const uint16x4_t kInclineVec = { kStep3, kStep2, kStep1, kStep0 };
+    const uint32x4_t kStep8Vec = vdupq_n_u32(kStep8);
+    uint8x8_t is_nul;
+    uint16x8_t expand;
+
+    while (1) {
+        // Exit the loop if any of the 8 bytes is NUL.
+        is_nul = vceq_u8(chunk, (uint8x8_t){ 0 });
+        expand = vmovl_u8(chunk);
+        uint64x1_t is_nul_64 = vreinterpret_u64_u8(is_nul);
+        if (vget_lane_u64(is_nul_64, 0)) break;
+
+        // Multiply both accumulators by 33**8.
+        accum_lo = vmulq_u32(accum_lo, kStep8Vec);
+        accum_hi = vmulq_u32(accum_hi, kStep8Vec);
+
+        // Multiply each 4-piece subchunk by (33**3, 33**2, 33*1, 1), then accumulate the result. The lo
+        // accumulator will be behind by 33**4 until the very end of the computation.
+        accum_lo = vmlal_u16(accum_lo, vget_low_u16(expand), kInclineVec);
+        accum_hi = vmlal_u16(accum_hi, vget_high_u16(expand), kInclineVec);
+
+        // Load the next chunk.
+        chunk = vld1_u8(reinterpret_cast<const uint8_t*>(++chunk_ptr));
+    }
+
+    // Reverse the is-NUL vector so we can use clz to count the number of remaining bytes.
+    is_nul = vrev64_u8(is_nul);
+    const uint64_t is_nul_u64 = vget_lane_u64(vreinterpret_u64_u8(is_nul), 0);
+    const uint32_t num_valid_bits = __builtin_clzll(is_nul_u64);
+
+    const uint32_t name_len = reinterpret_cast<const char*>(chunk_ptr) - name + (num_valid_bits >> 3);
+
+    static const uint32_t kFinalStepTable[] = {
+            kStep4, kStep0,   // 0 remaining bytes
+            kStep5, kStep1,   // 1 remaining byte
+            kStep6, kStep2,   // 2 remaining bytes
+            kStep7, kStep3,   // 3 remaining bytes
+            kStep8, kStep4,   // 4 remaining bytes
+            kStep9, kStep5,   // 5 remaining bytes
+            kStep10, kStep6,  // 6 remaining bytes
+            kStep11, kStep7,  // 7 remaining bytes
+    };
+
+    // Advance the lo/hi accumulators appropriately for the number of remaining bytes. Multiply 33**4
+    // into the lo accumulator to catch it up with the hi accumulator.
+    const uint32_t* final_step = &kFinalStepTable[num_valid_bits >> 2];
+    accum_lo = vmulq_u32(accum_lo, vdupq_n_u32(final_step[0]));
+    accum_lo = vmlaq_u32(accum_lo, accum_hi, vdupq_n_u32(final_step[1]));
+
+    static const uint32_t kFinalInclineTable[] = {
+            0,      kStep6, kStep5, kStep4, kStep3, kStep2, kStep1, kStep0,
+            0,      0,      0,      0,      0,      0,      0,      0,
+    };
+
+    // Prepare a vector to multiply powers of 33 into each of the remaining bytes.
+    const uint32_t* const incline = &kFinalInclineTable[8 - (num_valid_bits >> 3)];
+    const uint32x4_t incline_lo = vld1q_u32(incline);
+    const uint32x4_t incline_hi = vld1q_u32(incline + 4);
+
+    // Multiply 33 into each of the remaining 4-piece vectors, then accumulate everything into
+    // accum_lo. Combine everything into a single 32-bit result.
+    accum_lo = vmlaq_u32(accum_lo, vmovl_u16(vget_low_u16(expand)), incline_lo);
+    accum_lo = vmlaq_u32(accum_lo, vmovl_u16(vget_high_u16(expand)), incline_hi);
+
+    uint32x2_t sum = vadd_u32(vget_low_u32(accum_lo), vget_high_u32(accum_lo));
+    const uint32_t hash = sum[0] + sum[1];
+
+    if (len != nullptr) {
+        *len = name_len;
+    }
+    return hash;
+}
+#endif
+
+#if USE_GNU_HASH_X86
+// x86 上按对齐的16/32字节一块: 对齐读不会跨页, 块里名字前面的字节清零, 找到'\0'的块只算到'\0'为止
+// 一块的结果是 h * 33^块里的字节数 + Σ c[i] * 33^(end-1-i), 后面一项用 pmulld 乘一张33的幂表再横向加
+struct GnuHashTables {
+    // weights[k] = 33^(31-k), 后32个是0; 块在 end 结束时块内第i个字节的权重是 weights[i + 32 - end]
+    uint32_t weights[64];
+    // steps[k] = 33^k
+    uint32_t steps[33];
+    // 前32个字节0, 后32个0xff, 从 keep + 32 - skip 开始读就是把块开头的 skip 个字节清零
+    uint8_t keep[64];
+};
+
+static constexpr GnuHashTables make_gnu_hash_tables(){
+    GnuHashTables t{};
+    uint32_t p = 1;
+    for (int k = 31; k >= 0; k--) {
+        t.weights[k] = p;
+        p *= 33;
+    }
+    p = 1;
+    for (int k = 0; k <= 32; k++) {
+        t.steps[k] = p;
+        p *= 33;
+    }
+    for (int k = 32; k < 64; k++) {
+        t.keep[k] = 0xff;
+    }
+    return t;
+}
+
+alignas(32) static constexpr GnuHashTables kGnuHashTables = make_gnu_hash_tables();
+
+__attribute__((target("sse4.2")))
+static inline uint32_t hsum_epi32(__m128i s){
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4e));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xb1));
+    return _mm_cvtsi128_si32(s);
+}
+
+__attribute__((target("sse4.2")))
+static uint32_t gnu_hash_sse42(const char *name, uint32_t *len){
+    const GnuHashTables &t = kGnuHashTables;
+    uintptr_t skip = reinterpret_cast<uintptr_t>(name) & 15;
+    const uint8_t *block = reinterpret_cast<const uint8_t *>(name) - skip;
+    uint32_t h = 5381;
+    while (true) {
+        __m128i v = _mm_load_si128(reinterpret_cast<const __m128i *>(block));
+        uint32_t nul = (uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128())) >> skip << skip;
+        uint32_t end = nul != 0 ? __builtin_ctz(nul) : 16;
+        v = _mm_and_si128(v, _mm_loadu_si128(reinterpret_cast<const __m128i *>(t.keep + 32 - skip)));
+        const uint32_t *w = t.weights + 32 - end;
+        __m128i s = _mm_mullo_epi32(_mm_cvtepu8_epi32(v), _mm_loadu_si128(reinterpret_cast<const __m128i *>(w)));
+        s = _mm_add_epi32(s, _mm_mullo_epi32(_mm_cvtepu8_epi32(_mm_srli_si128(v, 4)),
+                                             _mm_loadu_si128(reinterpret_cast<const __m128i *>(w + 4))));
+        s = _mm_add_epi32(s, _mm_mullo_epi32(_mm_cvtepu8_epi32(_mm_srli_si128(v, 8)),
+                                             _mm_loadu_si128(reinterpret_cast<const __m128i *>(w + 8))));
+        s = _mm_add_epi32(s, _mm_mullo_epi32(_mm_cvtepu8_epi32(_mm_srli_si128(v, 12)),
+                                             _mm_loadu_si128(reinterpret_cast<const __m128i *>(w + 12))));
+        h = h * t.steps[end - skip] + hsum_epi32(s);
+        if (nul != 0) {
+            if (len != nullptr) {
+                *len = reinterpret_cast<const char *>(block + end) - name;
+            }
+            return h;
+        }
+        block += 16;
+        skip = 0;
+    }
+}
+
+__attribute__((target("avx2")))
+static uint32_t gnu_hash_avx2(const char *name, uint32_t *len){
+    const GnuHashTables &t = kGnuHashTables;
+    uintptr_t skip = reinterpret_cast<uintptr_t>(name) & 31;
+    const uint8_t *block = reinterpret_cast<const uint8_t *>(name) - skip;
+    uint32_t h = 5381;
+    while (true) {
+        __m256i v = _mm256_load_si256(reinterpret_cast<const __m256i *>(block));
+        uint32_t nul = (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_setzero_si256())) >> skip << skip;
+        uint32_t end = nul != 0 ? __builtin_ctz(nul) : 32;
+        v = _mm256_and_si256(v, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(t.keep + 32 - skip)));
+        const uint32_t *w = t.weights + 32 - end;
+        __m128i lo = _mm256_castsi256_si128(v);
+        __m128i hi = _mm256_extracti128_si256(v, 1);
+        __m256i s = _mm256_mullo_epi32(_mm256_cvtepu8_epi32(lo),
+                                       _mm256_loadu_si256(reinterpret_cast<const __m256i *>(w)));
+        s = _mm256_add_epi32(s, _mm256_mullo_epi32(_mm256_cvtepu8_epi32(_mm_srli_si128(lo, 8)),
+                                                   _mm256_loadu_si256(reinterpret_cast<const __m256i *>(w + 8))));
+        s = _mm256_add_epi32(s, _mm256_mullo_epi32(_mm256_cvtepu8_epi32(hi),
+                                                   _mm256_loadu_si256(reinterpret_cast<const __m256i *>(w + 16))));
+        s = _mm256_add_epi32(s, _mm256_mullo_epi32(_mm256_cvtepu8_epi32(_mm_srli_si128(hi, 8)),
+                                                   _mm256_loadu_si256(reinterpret_cast<const __m256i *>(w + 24))));
+        h = h * t.steps[end - skip] + hsum_epi32(_mm_add_epi32(_mm256_castsi256_si128(s), _mm256_extracti128_si256(s, 1)));
+        if (nul != 0) {
+            if (len != nullptr) {
+                *len = reinterpret_cast<const char *>(block + end) - name;
+            }
+            return h;
+        }
+        block += 32;
+        skip = 0;
+    }
+}
+#endif
+
+// 按从慢到快排, 能用的是前面一段
+static const GnuHashBackend kBackends[] = {
+        {"scalar", gnu_hash_scalar},
+#if USE_GNU_HASH_NEON
+        {"neon", gnu_hash_neon},
+#endif
+#if USE_GNU_HASH_X86
+        {"sse4.2", gnu_hash_sse42},
+        {"avx2", gnu_hash_avx2},
+#endif
+};
+
+static size_t supported_backends(){
+#if USE_GNU_HASH_X86
+    __builtin_cpu_init();
+    if (!__builtin_cpu_supports("sse4.2")) {
+        return 1;
+    }
+    return __builtin_cpu_supports("avx2") ? 3 : 2;
+#else
+    return sizeof(kBackends) / sizeof(kBackends[0]);
+#endif
+}
+
+size_t gnu_hash_backends(const GnuHashBackend **backends){
+    static const size_t count = supported_backends();
+    *backends = kBackends;
+    return count;
+}
+
+static const GnuHashBackend &active_backend(){
+    static const GnuHashBackend *backend = []() {
+        const GnuHashBackend *all;
+        size_t count = gnu_hash_backends(&all);
+        return &all[count - 1];
+    }();
+    return *backend;
+}
+
+uint32_t gnu_hash(const char *name, uint32_t *len){
+    return active_backend().hash(name, len);
+}
+
+void gnu_hash_batch(const char *const *names, uint32_t *hashes, size_t count){
+    auto hash = active_backend().hash;
+    for (size_t i = 0; i < count; i++) {
+        hashes[i] = hash(names[i], nullptr);
+    }
+}
+
+uint32_t elf_hash(const char *name){
+    const uint8_t *name_bytes = reinterpret_cast<const uint8_t *>(name);
+    uint32_t h = 0, g;
+
+    while (*name_bytes) {
+        h = (h << 4) + *name_bytes++;
+        g = h & 0xf0000000;
+        h ^= g;
+        h ^= g >> 24;
+    }
+
+    return h;
+}
+
+void elf_hash_batch(const char *const *names, uint32_t *hashes, size_t count){
+    for (size_t i = 0; i < count; i++) {
+        hashes[i] = elf_hash(names[i]);
+    }
+}